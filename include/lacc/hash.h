@@ -9,7 +9,9 @@
 struct hash_table {
     int capacity;
     int count;
+    int deleted;
     struct hash_entry *entries;
+    unsigned char *meta;
 };
 
 /* Reset table, clearing all values. Does not deallocate memory. */
@@ -42,4 +44,45 @@ INTERNAL void hash_remove(
     String key,
     void (*del)(void *));
 
+/*
+ * Index of elements stored elsewhere, for example in an array, and
+ * identified by small non-negative numbers. Keys are hashed and
+ * compared by the caller, finding candidates with the same hash value
+ * through the index. Elements are expected to be added in increasing
+ * order, and those with equal hash are visited with the most recent
+ * first.
+ *
+ *     for (i = hash_index_first(&idx, h); i != -1;
+ *         i = hash_index_next(&idx, i))
+ *     {
+ *         if (is_same(&array_get(&list, i), key))
+ *             return i;
+ *     }
+ */
+struct hash_index {
+    int capacity;
+    int count;
+    int *buckets;
+    int size;
+    struct hash_link *links;
+};
+
+/* Add element with the given hash, which must not already be present. */
+INTERNAL void hash_index_add(struct hash_index *idx, int i, unsigned long h);
+
+/* First element with hash equal to h, or -1 if there is none. */
+INTERNAL int hash_index_first(const struct hash_index *idx, unsigned long h);
+
+/* Next element with the same hash as i, or -1 if there are no more. */
+INTERNAL int hash_index_next(const struct hash_index *idx, int i);
+
+/* Remove element from index. */
+INTERNAL void hash_index_remove(struct hash_index *idx, int i);
+
+/* Remove all elements. Does not deallocate memory. */
+INTERNAL void hash_index_clear(struct hash_index *idx);
+
+/* Free resources owned by index. */
+INTERNAL void hash_index_destroy(struct hash_index *idx);
+
 #endif
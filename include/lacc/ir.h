@@ -15,6 +15,9 @@
  * offset, or immediate constant value. Used in intermediate
  * representation of expressions, forming operands of three-address
  * code.
+ *
+ * Symbols are referenced by id, and share space with the immediate
+ * value, to keep operands at 16 bytes. Statements embed three of them.
  */
 struct var {
     int kind : 8;
@@ -35,15 +38,20 @@ struct var {
 
     Type type;
 
-    /*
-     * Offset from symbol, which can only be positive. It is possible to
-     * construct expressions that would result in negative offset, like
-     * "Hello" - 3, but this is undefined behavior.
-     */
-    size_t offset;
-
     union {
-        const struct symbol *symbol;
+        struct {
+            /* Symbol id, use var_symbol to read. */
+            int id;
+
+            /*
+             * Offset from symbol, which can only be positive. It is
+             * possible to construct expressions that would result in
+             * negative offset, like "Hello" - 3, but this is undefined
+             * behavior. Intermediate results can still be negative,
+             * as in "Hello" - 3 + 4.
+             */
+            int offset;
+        } sym;
         union value imm;
     } value;
 };
@@ -69,8 +77,8 @@ enum kind {
     /*
      * l-value or r-value reference to *(symbol + offset). Symbol
      * must have pointer type. If not is_symbol, the dereferenced
-     * pointer is an immediate value. Offset in bytes, not pointer
-     * arithmetic.
+     * pointer is an immediate value, which includes any offset.
+     * Offset in bytes, not pointer arithmetic.
      *
      * Not valid if symbol is string literal.
      */
@@ -83,6 +91,12 @@ enum kind {
 
 #define is_field(v) ((v).field_width != 0)
 
+/* Symbol referenced by var, which must be set. */
+#define var_symbol(v) ((const struct symbol *) sym_get((v).value.sym.id))
+
+/* Offset from symbol, which must be set. Can be assigned to. */
+#define var_offset(v) ((v).value.sym.offset)
+
 /*
  * Represent an intermediate expression with up to two operands.
  *
@@ -146,7 +160,6 @@ enum sttype {
 struct statement {
     char st;
     short asm_index;
-    unsigned long out;
     struct var t;
     struct expression expr;
 };
@@ -203,9 +216,15 @@ struct block {
      */
     unsigned int has_init_value : 1;
 
-    /* Liveness at the start and end of the block. */
-    unsigned long in;
-    unsigned long out;
+    /* Position in list of blocks ordered during optimization. */
+    int order;
+
+    /*
+     * Liveness at the start and end of the block, as bitsets owned by
+     * the optimizer.
+     */
+    unsigned long *in;
+    unsigned long *out;
 };
 
 /*
@@ -295,6 +314,13 @@ struct definition {
      */
     array_of(struct statement) statements;
 
+    /*
+     * Liveness after each statement, as bitsets of equal size stored in
+     * parallel with the list of statements. Only computed when
+     * optimizing.
+     */
+    array_of(unsigned long) liveness;
+
     /* Inline assembly stored more or less as-is from parsing. */
     array_of(struct asm_statement) asm_statements;
 };
@@ -320,4 +346,10 @@ INTERNAL struct var var_numeric(Type type, union value val);
  */
 INTERNAL struct symbol *create_label(struct definition *def);
 
+/*
+ * Give back block no longer part of the given definition, after it has
+ * been removed from the list of nodes. The block label is discarded.
+ */
+INTERNAL void release_block(struct definition *def, struct block *block);
+
 #endif
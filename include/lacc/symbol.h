@@ -40,14 +40,14 @@ struct symbol {
     String name;
     Type type;
 
-    unsigned int symtype : 8;
-    unsigned int linkage : 8;
+    unsigned int symtype : 4;
+    unsigned int linkage : 2;
     unsigned int referenced : 1; /* Mark symbol as used. */
     unsigned int memory : 1;     /* Disable register allocation. */
     unsigned int inlined : 1;    /* Inline function. */
-    unsigned int : 1;
+    unsigned int readonly : 1;   /* Constant object with known value. */
     unsigned int slot : 4;       /* Register allocation slot. */
-    unsigned int index : 8;      /* Enumeration used in optimization. */
+    unsigned int index : 18;     /* Enumeration used in optimization. */
 
     /*
      * Tag to disambiguate temporaries, strings, constants, labels, and
@@ -69,11 +69,20 @@ struct symbol {
      */
     int stack_offset;
 
+    /*
+     * Position in table of all symbols, used to refer to the symbol by
+     * a 32 bit index from IR operands. Always positive.
+     */
+    int id;
+
     union {
         /*
          * Hold a constant integral or floating point value. Used for
          * enumeration members and numbers which must be loaded from
          * memory in assembly code. Denoted by symtype SYM_CONSTANT.
+         *
+         * Also hold the initial value of const qualified scalar objects
+         * with static storage, denoted by readonly.
          */
         union value constant;
 
@@ -108,6 +117,9 @@ struct symbol {
 /* Holds the declaration for memcpy, which is needed for codegen. */
 EXTERNAL const struct symbol *decl_memcpy;
 
+/* Get symbol with the given id. */
+INTERNAL struct symbol *sym_get(int id);
+
 /* Get the full name, including numeric value to disambiguate. */
 INTERNAL const char *sym_name(const struct symbol *sym);
 
@@ -123,4 +135,17 @@ INTERNAL int is_temporary(const struct symbol *sym);
  */
 INTERNAL struct symbol *sym_create_constant(Type type, union value val);
 
+/*
+ * Create a symbol with the provided type and add it to current scope in
+ * identifier namespace. Used to hold temporary values in expression
+ * evaluation.
+ */
+INTERNAL struct symbol *sym_create_temporary(Type type);
+
+/*
+ * Release memory used for a temporary symbol, allowing it to be reused
+ * in a different function.
+ */
+INTERNAL void sym_discard(struct symbol *sym);
+
 #endif
@@ -0,0 +1,75 @@
+#ifndef TIMER_H
+#define TIMER_H
+#if !defined(INTERNAL) || !defined(EXTERNAL)
+# error Missing amalgamation macros
+#endif
+
+#include <stdio.h>
+
+/*
+ * Compilation phases measured with -ftime-report. Time is attributed
+ * to the innermost active phase only, so that nested phases are not
+ * counted twice. Preprocessing is done lazily while parsing, and is
+ * subtracted from parse time.
+ */
+enum timer_phase {
+    TIMER_PREPROCESS,
+    TIMER_PARSE,
+    TIMER_INLINE,
+    TIMER_OPTIMIZE,
+    TIMER_SSA,
+    TIMER_CONSTANT_PROPAGATION,
+    TIMER_VALUE_NUMBERING,
+    TIMER_LIVENESS,
+    TIMER_DEAD_STORE,
+    TIMER_MERGE_ASSIGNMENT,
+    TIMER_SELECT,
+    TIMER_ENCODE,
+    TIMER_FLUSH,
+    TIMER_PHASES
+};
+
+/* Collect time spent in each phase, printed by timer_report. */
+INTERNAL void timer_enable_report(void);
+
+/*
+ * Write trace events in Chrome trace format to file, closed on
+ * timer_finalize.
+ */
+INTERNAL int timer_enable_trace(const char *path);
+
+/* Whether trace output is enabled. */
+INTERNAL int timer_is_tracing(void);
+
+/*
+ * Write trace events of a worker process to stream instead, shown as a
+ * separate thread with the given id. Called in the worker after fork.
+ */
+INTERNAL void timer_trace_worker(FILE *stream, int id);
+
+/* Add trace events written by a worker process to the trace output. */
+INTERNAL void timer_merge_trace(FILE *stream);
+
+/* Enter and leave phase. No-op unless -ftime-report is enabled. */
+INTERNAL void timer_push(enum timer_phase phase);
+INTERNAL void timer_pop(void);
+
+/*
+ * Wall clock time in microseconds, used as start of trace events. Zero
+ * if tracing is not enabled.
+ */
+INTERNAL long timer_clock(void);
+
+/*
+ * Write trace event spanning from start until now. Detail is optional,
+ * and added as argument to the event.
+ */
+INTERNAL void timer_trace(const char *name, const char *detail, long start);
+
+/* Print time spent in each phase to stream, and reset counters. */
+INTERNAL void timer_report(FILE *stream, const char *file);
+
+/* Finish writing trace output. */
+INTERNAL void timer_finalize(void);
+
+#endif
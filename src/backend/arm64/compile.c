@@ -25,6 +25,12 @@ INTERNAL void flush(void)
 {
 }
 
+INTERNAL size_t take_object_file(char **data)
+{
+    *data = NULL;
+    return 0;
+}
+
 INTERNAL void finalize(void)
 {
 }
@@ -7,7 +7,8 @@
 
 /*
  * Initialize compile target format and output stream. Must be called
- * before any other compile function.
+ * before any other compile function. Object files are kept in memory
+ * if stream is NULL.
  */
 INTERNAL void set_compile_target(FILE *stream, const char *file);
 
@@ -24,6 +25,12 @@ INTERNAL int declare(const struct symbol *sym);
 /* Flush any buffered output, no more input will follow. */
 INTERNAL void flush(void);
 
+/*
+ * Take object file kept in memory after flush. Return size of the data,
+ * which must be freed by caller.
+ */
+INTERNAL size_t take_object_file(char **data);
+
 /* Free resources after all input objects have been processed. */
 INTERNAL void finalize(void);
 
@@ -62,17 +62,17 @@ static const char *escape(const struct symbol *sym)
 static char *vartostr(const struct var var)
 {
     int n = 0;
-    const char *name = var.is_symbol ? sym_name(var.value.symbol) : NULL;
+    const char *name = var.is_symbol ? sym_name(var_symbol(var)) : NULL;
     char *buffer = get_buffer();
 
-    if (var.is_symbol && var.value.symbol->symtype == SYM_LITERAL) {
+    if (var.is_symbol && var_symbol(var)->symtype == SYM_LITERAL) {
         if (var.kind == DIRECT) {
             n = sprintf(buffer, "\\\"%s\\\"",
-                str_raw(var.value.symbol->value.string));
+                str_raw(var_symbol(var)->value.string));
         } else {
             assert(var.kind == ADDRESS);
-            if (var.offset) {
-                n = sprintf(buffer, "$%s+%lu", name, var.offset);
+            if (var_offset(var)) {
+                n = sprintf(buffer, "$%s+%d", name, var_offset(var));
             } else {
                 n = sprintf(buffer, "$%s", name);
             }
@@ -107,22 +107,22 @@ static char *vartostr(const struct var var)
         }
         break;
     case DIRECT:
-        if (var.offset) {
-            n = sprintf(buffer, "*(&%s + %lu)", name, var.offset);
+        if (var_offset(var)) {
+            n = sprintf(buffer, "*(&%s + %d)", name, var_offset(var));
         } else {
             n = sprintf(buffer, "%s", name);
         }
         break;
     case ADDRESS:
-        if (var.offset) {
-            n = sprintf(buffer, "(&%s + %lu)", name, var.offset);
+        if (var_offset(var)) {
+            n = sprintf(buffer, "(&%s + %d)", name, var_offset(var));
         } else {
             n = sprintf(buffer, "&%s", name);
         }
         break;
     case DEREF:
-        if (var.offset) {
-            n = sprintf(buffer, "*(%s + %lu)", name, var.offset);
+        if (var_offset(var)) {
+            n = sprintf(buffer, "*(%s + %d)", name, var_offset(var));
         } else {
             n = sprintf(buffer, "*%s", name);
         }
@@ -244,7 +244,7 @@ static void dot_print_node(FILE *stream, struct definition *def, struct block *n
         case IR_VLA_ALLOC:
             fprintf(stream, " | vla_alloc %s:%s (",
                 vartostr(s.t),
-                vartostr(var_direct(s.t.value.symbol->value.vla_address)));
+                vartostr(var_direct(var_symbol(s.t)->value.vla_address)));
             dot_print_expr(stream, s.expr);
             fputs(")", stream);
             break;
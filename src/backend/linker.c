@@ -3,11 +3,17 @@
 # define EXTERNAL extern
 #endif
 #include "linker.h"
+#if x86_64
+# include "x86_64/link.h"
+#endif
 #include <lacc/array.h>
 #include <lacc/context.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
@@ -16,7 +22,23 @@
 typedef array_of(char *) ArgArray;
 
 static ArgArray ld_args, ld_user_args;
-static int is_shared, is_static;
+static int is_shared, is_static, is_builtin;
+
+/*
+ * Object files compiled in memory when using the built-in linker,
+ * replacing the linker input with the same handle.
+ */
+struct linker_object {
+    int handle;
+    char *data;
+    size_t size;
+};
+
+static array_of(struct linker_object) linker_objects;
+
+#define DEFAULT_LINKER "/usr/bin/ld"
+
+static const char *linker = DEFAULT_LINKER;
 
 static void add_option(ArgArray *args, const char *opt)
 {
@@ -42,11 +64,18 @@ INTERNAL void clear_linker_args(void)
     }
 
     array_clear(&ld_args);
+    for (i = 0; i < array_len(&linker_objects); ++i) {
+        free(array_get(&linker_objects, i).data);
+    }
+
+    array_clear(&linker_objects);
+    linker = DEFAULT_LINKER;
+    is_builtin = 0;
 }
 
 static void init_linker(void)
 {
-    add_option(&ld_args, "/usr/bin/ld");
+    add_option(&ld_args, linker);
 #if OpenBSD
     if (!is_shared) {
         add_option(&ld_args, "-e");
@@ -107,6 +136,73 @@ INTERNAL int add_linker_arg(const char *opt)
     return 0;
 }
 
+INTERNAL int add_linker_input(const char *file)
+{
+    add_option(&ld_user_args, file);
+    return array_len(&ld_user_args) - 1;
+}
+
+INTERNAL void set_linker_input(int handle, const char *file)
+{
+    char *ptr;
+
+    assert(handle >= 0 && handle < array_len(&ld_user_args));
+    ptr = array_get(&ld_user_args, handle);
+    free(ptr);
+    ptr = malloc(strlen(file) + 1);
+    strcpy(ptr, file);
+    array_get(&ld_user_args, handle) = ptr;
+}
+
+INTERNAL void set_linker_object(int handle, char *data, size_t size)
+{
+    struct linker_object obj;
+
+    assert(is_builtin);
+    assert(handle >= 0 && handle < array_len(&ld_user_args));
+    obj.handle = handle;
+    obj.data = data;
+    obj.size = size;
+    array_push_back(&linker_objects, obj);
+}
+
+INTERNAL int is_builtin_linker(void)
+{
+    return is_builtin;
+}
+
+/*
+ * Select linker by flavor name like with GCC, or a path to the linker
+ * executable. The built-in linker is selected by name lacc.
+ */
+INTERNAL int set_linker(const char *name)
+{
+    is_builtin = 0;
+    if (!strcmp("lacc", name)) {
+#if x86_64 && (GLIBC || MUSL)
+        is_builtin = 1;
+#else
+        fprintf(stderr, "Built-in linker is not supported on %s.\n", TARGET);
+        return 1;
+#endif
+    } else if (!strcmp("bfd", name)) {
+        linker = "ld.bfd";
+    } else if (!strcmp("gold", name)) {
+        linker = "ld.gold";
+    } else if (!strcmp("lld", name)) {
+        linker = "ld.lld";
+    } else if (!strcmp("mold", name)) {
+        linker = "ld.mold";
+    } else if (strchr(name, '/')) {
+        linker = name;
+    } else {
+        fprintf(stderr, "Unsupported linker '%s'.\n", name);
+        return 1;
+    }
+
+    return 0;
+}
+
 #ifndef NDEBUG
 static void print_invocation(void)
 {
@@ -122,12 +218,185 @@ static void print_invocation(void)
 }
 #endif
 
+#if x86_64 && (GLIBC || MUSL)
+#if GLIBC
+# define CRT_PATH "/usr/lib/x86_64-linux-gnu/"
+#else
+# define CRT_PATH "/usr/lib/"
+#endif
+
+static const char *builtin_paths[] = {
+#if GLIBC
+    "/usr/lib/x86_64-linux-gnu",
+#endif
+#ifdef LIBGCC_PATH
+    LIBGCC_PATH,
+#endif
+    "/usr/local/lib",
+    "/usr/lib"
+};
+
+/*
+ * Find static library lib<name>.a in directories from -L, followed by
+ * the system directories.
+ */
+static char *find_library(ArgArray *paths, const char *name)
+{
+    int i, n;
+    char *path;
+    const char *dir;
+    struct stat st;
+
+    n = array_len(paths) + sizeof(builtin_paths) / sizeof(builtin_paths[0]);
+    for (i = 0; i < n; ++i) {
+        dir = i < array_len(paths)
+            ? array_get(paths, i)
+            : builtin_paths[i - array_len(paths)];
+        path = malloc(strlen(dir) + strlen(name) + 7);
+        sprintf(path, "%s/lib%s.a", dir, name);
+        if (!stat(path, &st) && S_ISREG(st.st_mode))
+            return path;
+        free(path);
+    }
+
+    fprintf(stderr, "Could not find static library '%s'.\n", name);
+    return NULL;
+}
+
+static int link_library(ArgArray *paths, const char *name)
+{
+    int ret;
+    char *path;
+
+    path = find_library(paths, name);
+    if (!path)
+        return 1;
+
+    ret = link_add_file(path);
+    free(path);
+    return ret;
+}
+
+static const char *linker_object_of(int handle, char **data, size_t *size)
+{
+    int i;
+    struct linker_object *obj;
+
+    for (i = 0; i < array_len(&linker_objects); ++i) {
+        obj = &array_get(&linker_objects, i);
+        if (obj->handle == handle) {
+            *data = obj->data;
+            *size = obj->size;
+            obj->data = NULL;
+            return array_get(&ld_user_args, handle);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Link statically with the built-in linker, taking object files,
+ * -l libraries, and -L paths from the command line, as well as the
+ * startup files and static C library.
+ */
+static int invoke_builtin_linker(void)
+{
+    int i, ret;
+    char *arg, *data;
+    size_t size;
+    const char *output, *name;
+    ArgArray paths = {0};
+
+    output = "a.out";
+    for (i = 0, ret = 0; i < array_len(&ld_user_args); ++i) {
+        arg = array_get(&ld_user_args, i);
+        if (!strcmp("-o", arg) || !strcmp("-L", arg) || !strcmp("-l", arg)) {
+            if (++i == array_len(&ld_user_args)) {
+                fprintf(stderr, "Missing argument to linker option %s.\n",
+                    arg);
+                ret = 1;
+            } else if (arg[1] == 'o') {
+                output = array_get(&ld_user_args, i);
+            } else if (arg[1] == 'L') {
+                array_push_back(&paths, array_get(&ld_user_args, i));
+            }
+        } else if (!strncmp("-L", arg, 2)) {
+            array_push_back(&paths, arg + 2);
+        } else if (!strcmp("-shared", arg)
+            || !strcmp("-pie", arg)
+            || !strcmp("-export-dynamic", arg))
+        {
+            fprintf(stderr, "Option %s is not supported by built-in linker.\n",
+                arg);
+            ret = 1;
+        }
+    }
+
+    if (ret) {
+        array_clear(&paths);
+        return ret;
+    }
+
+    ret = link_add_file(CRT_PATH "crt1.o") || link_add_file(CRT_PATH "crti.o");
+    for (i = 0; i < array_len(&ld_user_args) && !ret; ++i) {
+        arg = array_get(&ld_user_args, i);
+        if (!strcmp("-o", arg) || !strcmp("-L", arg)) {
+            i++;
+        } else if (!strcmp("-l", arg)) {
+            ret = link_library(&paths, array_get(&ld_user_args, ++i));
+        } else if (!strncmp("-l", arg, 2)) {
+            ret = link_library(&paths, arg + 2);
+        } else if (*arg == '-') {
+            if (strncmp("-L", arg, 2)
+                && strcmp("-static", arg)
+                && strcmp("-no-pie", arg)
+                && strcmp("-nopie", arg)
+                && strcmp("-fPIE", arg)
+                && strcmp("-fno-PIE", arg))
+            {
+                fprintf(stderr, "Ignoring linker option %s.\n", arg);
+            }
+        } else if ((name = linker_object_of(i, &data, &size)) != NULL) {
+            ret = link_add_object(name, data, size);
+        } else {
+            ret = link_add_file(arg);
+        }
+    }
+
+    if (!ret) {
+        ret = link_library(&paths, "c");
+    }
+
+#ifdef LIBGCC_PATH
+    if (!ret) {
+        ret = link_add_file(LIBGCC_PATH "/libgcc.a")
+            || link_add_file(LIBGCC_PATH "/libgcc_eh.a");
+    }
+#endif
+
+    if (!ret) {
+        ret = link_add_file(CRT_PATH "crtn.o") || link_executable(output);
+    }
+
+    link_finalize();
+    array_clear(&paths);
+    return ret;
+}
+#endif
+
 INTERNAL int invoke_linker(void)
 {
     char **argv;
     int status, ret;
     pid_t pid;
 
+#if x86_64 && (GLIBC || MUSL)
+    if (is_builtin) {
+        return invoke_builtin_linker();
+    }
+#endif
+
     init_linker();
     array_concat(&ld_args, &ld_user_args);
 
@@ -149,7 +418,8 @@ INTERNAL int invoke_linker(void)
     switch ((pid = fork())) {
     case 0:
         execvp(argv[0], argv);
-        _exit(0);
+        fprintf(stderr, "Failed to execute linker '%s'.\n", argv[0]);
+        _exit(1);
     case -1:
         fprintf(stderr, "%s\n", "Failed to start linker process.");
         ret = 1;
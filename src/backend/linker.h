@@ -6,6 +6,28 @@
 /* Add command line argument to be passed to the linker. */
 INTERNAL int add_linker_arg(const char *opt);
 
+/*
+ * Add input file to be passed to the linker, returning a handle which
+ * can be used to change the file name later, keeping the position.
+ */
+INTERNAL int add_linker_input(const char *file);
+
+/* Replace file name of linker input previously added. */
+INTERNAL void set_linker_input(int handle, const char *file);
+
+/*
+ * Set object file compiled in memory as linker input, replacing the
+ * file name. Only used with the built-in linker, which takes ownership
+ * of the data.
+ */
+INTERNAL void set_linker_object(int handle, char *data, size_t size);
+
+/* Use a different linker, by name or path, from -fuse-ld= option. */
+INTERNAL int set_linker(const char *name);
+
+/* Check if the built-in linker is selected, with -fuse-ld=lacc. */
+INTERNAL int is_builtin_linker(void);
+
 /* Invoke the system linker. */
 INTERNAL int invoke_linker(void);
 
@@ -276,19 +276,22 @@ static int is_global_offset(const struct symbol *sym)
 static int is_register_allocated(struct var v)
 {
     return v.kind == DIRECT
-        && is_temporary(v.value.symbol)
-        && v.value.symbol->slot != 0;
+        && is_temporary(var_symbol(v))
+        && var_symbol(v)->slot != 0;
 }
 
 static enum reg allocated_register(struct var v)
 {
+    const struct symbol *sym;
+
     if (is_register_allocated(v)) {
-        if (is_integer(v.value.symbol->type) || is_pointer(v.value.symbol->type)) {
-            return temp_int_reg[v.value.symbol->slot - 1];
+        sym = var_symbol(v);
+        if (is_integer(sym->type) || is_pointer(sym->type)) {
+            return temp_int_reg[sym->slot - 1];
         }
 
-        assert(is_float(v.value.symbol->type) || is_double(v.value.symbol->type));
-        return temp_sse_reg[v.value.symbol->slot - 1];
+        assert(is_float(sym->type) || is_double(sym->type));
+        return temp_sse_reg[sym->slot - 1];
     }
 
     return 0;
@@ -299,7 +302,6 @@ static struct immediate value_of(struct var var, int w)
     struct immediate imm = {0};
 
     assert(var.kind == IMMEDIATE);
-    assert(!var.offset);
     assert(is_scalar(var.type));
     assert(w == 1 || w == 2 || w == 4 || w == 8);
 
@@ -323,20 +325,20 @@ static struct address address_of(struct var var)
     assert(var.kind == DIRECT || var.kind == ADDRESS);
 
     addr.type = ADDR_NORMAL;
-    addr.displacement = displacement_from_offset(var.offset);
-    switch (var.value.symbol->linkage) {
+    addr.displacement = displacement_from_offset(var_offset(var));
+    switch (var_symbol(var)->linkage) {
     case LINK_EXTERN:
     case LINK_INTERN:
         addr.base = IP;
-        addr.sym = var.value.symbol;
+        addr.sym = var_symbol(var);
         break;
     case LINK_NONE:
-        addr.displacement += var.value.symbol->stack_offset;
+        addr.displacement += var_symbol(var)->stack_offset;
         addr.base = BP;
         break;
     }
 
-    ((struct symbol *) var.value.symbol)->referenced = 1;
+    ((struct symbol *) var_symbol(var))->referenced = 1;
     return addr;
 }
 
@@ -437,10 +439,11 @@ INTERNAL enum instr_optype allocation(struct var var, union operand *op)
         op->mem.addr = address_of(var);
         break;
     case DEREF:
-        tmp = var_direct(var.value.symbol);
+        tmp = var_direct(var_symbol(var));
         assert(is_register_allocated(tmp));
         ax = allocated_register(tmp);
-        op->mem.addr = address(displacement_from_offset(var.offset), ax, 0, 0);
+        op->mem.addr = address(
+            displacement_from_offset(var_offset(var)), ax, 0, 0);
         break;
     }
 
@@ -542,6 +545,7 @@ static void emit_load(
     struct registr dest)
 {
     struct var ptr;
+    const struct symbol *sym;
     enum reg ax;
     int w;
 
@@ -560,7 +564,9 @@ static void emit_load(
          */
         if (is_real(source.type)) {
             if (!source.is_symbol) {
-                source.value.symbol = sym_create_constant(source.type, source.value.imm);
+                sym = sym_create_constant(source.type, source.value.imm);
+                source.value.sym.id = sym->id;
+                var_offset(source) = 0;
                 source.is_symbol = 1;
             }
             source.kind = DIRECT;
@@ -577,25 +583,26 @@ static void emit_load(
         if (is_register_allocated(source)) {
             ax = allocated_register(source);
             emit_rr(opcode, reg(ax, w), dest);
-        } else if (is_global_offset(source.value.symbol)) {
+        } else if (is_global_offset(var_symbol(source))) {
             ax = dest.r < XMM0 ? dest.r : R11;
             emit_mr(INSTR_MOV,
-                location(got(source.value.symbol), 8), reg(ax, 8));
+                location(got(var_symbol(source)), 8), reg(ax, 8));
             emit_mr(opcode, location(address(
-                displacement_from_offset(source.offset), ax, 0, 0), w), dest);
+                displacement_from_offset(var_offset(source)), ax, 0, 0), w),
+                dest);
         } else {
             emit_mr(opcode, location_of(source, w), dest);
         }
         break;
     case DEREF:
-        ptr = var_direct(source.value.symbol);
+        ptr = var_direct(var_symbol(source));
         assert(is_pointer(ptr.type));
         if (is_register_allocated(ptr)) {
             ax = allocated_register(ptr);
-        } else if (is_global_offset(source.value.symbol)) {
+        } else if (is_global_offset(var_symbol(source))) {
             ax = dest.r < XMM0 ? dest.r : R11;
             emit_mr(INSTR_MOV,
-                location(got(source.value.symbol), 8), reg(ax, 8));
+                location(got(var_symbol(source)), 8), reg(ax, 8));
             emit_mr(INSTR_MOV,
                 location(address(0, ax, 0, 0), 8),
                 reg(ax, 8));
@@ -606,19 +613,19 @@ static void emit_load(
         emit_mr(opcode,
             location(
                 address(
-                    displacement_from_offset(source.offset), ax, 0, 0), w),
+                    displacement_from_offset(var_offset(source)), ax, 0, 0), w),
             dest);
         break;
     case ADDRESS:
         assert(opcode == INSTR_LEA);
         assert(dest.width == 8);
-        if (is_global_offset(source.value.symbol)) {
+        if (is_global_offset(var_symbol(source))) {
             ax = dest.r;
-            emit_mr(INSTR_MOV, location(got(source.value.symbol), 8), dest);
-            if (source.offset) {
+            emit_mr(INSTR_MOV, location(got(var_symbol(source)), 8), dest);
+            if (var_offset(source)) {
                 emit_mr(INSTR_LEA,
-                    location(address(
-                        displacement_from_offset(source.offset), ax, 0, 0), 8),
+                    location(address(displacement_from_offset(
+                        var_offset(source)), ax, 0, 0), 8),
                     dest);
             }
         } else {
@@ -752,12 +759,12 @@ static enum reg load(struct var v, enum reg r)
 static void load_address(struct var v, enum reg r)
 {
     if (v.kind == DIRECT) {
-        if (is_global_offset(v.value.symbol)) {
-            emit_mr(INSTR_MOV, location(got(v.value.symbol), 8), reg(r, 8));
-            if (v.offset) {
+        if (is_global_offset(var_symbol(v))) {
+            emit_mr(INSTR_MOV, location(got(var_symbol(v)), 8), reg(r, 8));
+            if (var_offset(v)) {
                 emit_mr(INSTR_LEA,
                     location(address(
-                        displacement_from_offset(v.offset), r, 0, 0), 8),
+                        displacement_from_offset(var_offset(v)), r, 0, 0), 8),
                     reg(r, 8));
             }
         } else {
@@ -765,9 +772,9 @@ static void load_address(struct var v, enum reg r)
         }
     } else {
         assert(v.kind == DEREF);
-        load(var_direct(v.value.symbol), r);
-        if (v.offset) {
-            emit_ir(INSTR_ADD, constant(v.offset, 8), reg(r, 8));
+        load(var_direct(var_symbol(v)), r);
+        if (var_offset(v)) {
+            emit_ir(INSTR_ADD, constant(var_offset(v), 8), reg(r, 8));
         }
     }
 }
@@ -848,14 +855,15 @@ static void push(struct var v)
     if (is_long_double(v.type)) {
         if (v.kind == IMMEDIATE) {
             assert(!v.is_symbol);
-            v.value.symbol = sym_create_constant(v.type, v.value.imm);
+            v.value.sym.id = sym_create_constant(v.type, v.value.imm)->id;
+            var_offset(v) = 0;
             v.is_symbol = 1;
             v.kind = DIRECT;
         }
         if (v.kind == DIRECT) {
-            v.offset += 8;
+            var_offset(v) += 8;
             emit_m_(INSTR_PUSH, location_of(v, 8));
-            v.offset -= 8;
+            var_offset(v) -= 8;
             emit_m_(INSTR_PUSH, location_of(v, 8));
         } else {
             load_address(v, SI);
@@ -865,6 +873,12 @@ static void push(struct var v)
     } else if (is_scalar(v.type)) {
         if (v.kind == IMMEDIATE && is_int_constant(v)) {
             emit_i_(INSTR_PUSH, value_of(v, 8));
+        } else if (is_real(v.type) && is_register_allocated(v)) {
+            eb = size_of(v.type);
+            emit_ir(INSTR_SUB, constant(8, 8), reg(SP, 8));
+            emit_rm(INSTR_MOVS,
+                reg(allocated_register(v), eb),
+                location(address(0, SP, 0, 0), eb));
         } else {
             /*
              * Not possible to push SSE registers, so load as if normal
@@ -901,7 +915,8 @@ static enum reg load_x87(struct var v)
     st = get_x87_reg();
     if (v.kind == IMMEDIATE) {
         assert(!v.is_symbol);
-        v.value.symbol = sym_create_constant(v.type, v.value.imm);
+        v.value.sym.id = sym_create_constant(v.type, v.value.imm)->id;
+        var_offset(v) = 0;
         v.is_symbol = 1;
         v.kind = DIRECT;
     }
@@ -910,7 +925,7 @@ static enum reg load_x87(struct var v)
     if (is_real(v.type)) {
         if (v.kind == DIRECT
             && !is_register_allocated(v)
-            && !is_global_offset(v.value.symbol))
+            && !is_global_offset(var_symbol(v)))
         {
             emit_m_(INSTR_FLD, location_of(v, w));
         } else {
@@ -939,12 +954,15 @@ static enum reg load_x87(struct var v)
     } else {
         assert(is_signed(v.type));
         assert(w != 1);
-        if (v.kind == DIRECT && !is_global_offset(v.value.symbol)) {
+        if (v.kind == DIRECT
+            && !is_register_allocated(v)
+            && !is_global_offset(var_symbol(v)))
+        {
             emit_m_(INSTR_FILD, location_of(v, w));
         } else {
             push(v);
             emit_m_(INSTR_FILD, location(address(0, SP, 0, 0), w));
-            emit_ir(INSTR_ADD, constant(w, 8), reg(SP, 8));
+            emit_ir(INSTR_ADD, constant(8, 8), reg(SP, 8));
         }
     }
 
@@ -1229,6 +1247,7 @@ static void store_op(
     struct var target)
 {
     size_t w;
+    int disp;
     long mask;
     enum reg ax;
     enum opcode opc;
@@ -1281,11 +1300,11 @@ static void store_op(
             if ((ax = allocated_register(target)) != 0) {
                 emit_ir(opc, op.imm, reg(ax, w));
             } else {
-                if (is_global_offset(target.value.symbol)) {
+                if (is_global_offset(var_symbol(target))) {
                     emit_mr(INSTR_MOV,
-                        location(got(target.value.symbol), 8), reg(R11, 8));
-                    mem = location(address(
-                        displacement_from_offset(target.offset), R11, 0, 0), w);
+                        location(got(var_symbol(target)), 8), reg(R11, 8));
+                    disp = displacement_from_offset(var_offset(target));
+                    mem = location(address(disp, R11, 0, 0), w);
                 } else {
                     mem = location_of(target, w);
                 }
@@ -1295,12 +1314,11 @@ static void store_op(
         } else {
             if ((ax = allocated_register(target)) != 0) {
                 emit_rr(opc, op.reg, reg(ax, w));
-            } else if (is_global_offset(target.value.symbol)) {
+            } else if (is_global_offset(var_symbol(target))) {
                 emit_mr(INSTR_MOV,
-                    location(got(target.value.symbol), 8), reg(R11, 8));
-                emit_rm(opc, op.reg,
-                    location(address(
-                        displacement_from_offset(target.offset), R11, 0, 0), w));
+                    location(got(var_symbol(target)), 8), reg(R11, 8));
+                disp = displacement_from_offset(var_offset(target));
+                emit_rm(opc, op.reg, location(address(disp, R11, 0, 0), w));
             } else {
                 emit_rm(opc, op.reg, location_of(target, w));
             }
@@ -1311,12 +1329,13 @@ static void store_op(
         if (!target.is_symbol) {
             target.kind = IMMEDIATE;
             load_int(target, R11, 8);
+            mem = location(address(0, R11, 0, 0), w);
         } else {
-            assert(is_pointer(target.value.symbol->type));
-            load_int(var_direct(target.value.symbol), R11, 8);
+            assert(is_pointer(var_symbol(target)->type));
+            load_int(var_direct(var_symbol(target)), R11, 8);
+            disp = displacement_from_offset(var_offset(target));
+            mem = location(address(disp, R11, 0, 0), w);
         }
-        mem = location(address(
-            displacement_from_offset(target.offset), R11, 0, 0), w);
         if (optype == OPT_IMM) {
             emit_im(opc, op.imm, mem);
         } else {
@@ -1393,7 +1412,7 @@ static void move_to_from_registers(
             } else {
                 store(r, var);
             }
-            var.offset += 8;
+            var_offset(var) += 8;
         }
     }   
 }
@@ -1617,7 +1636,7 @@ static void allocate_asmblock_registers(
     for (i = 0; i < array_len(&st->operands); ++i) {
         op = &array_get(&st->operands, i);
         assert(op->variable.kind == DIRECT || op->variable.kind == DEREF);
-        sym = (struct symbol *) op->variable.value.symbol;
+        sym = (struct symbol *) var_symbol(op->variable);
         str = op->constraint;
         if (sym->slot || sym->memory || explicit_reg_constraint(str, &r)) {
             continue;
@@ -1759,7 +1778,7 @@ static void enter(struct definition *def)
         next_integer_reg = 1;
         return_address_offset = -8 - reg_offset;
         if (is_vararg(type)) {
-            return_address_offset = -176 - reg_offset;
+            return_address_offset = -176 - reg_offset - reg_offset % 16;
         }
     }
 
@@ -1769,10 +1788,11 @@ static void enter(struct definition *def)
      * there are 8 bytes for each of the 6 integer registers, and 16
      * bytes for each of the 8 SSE registers, for a total of 176 bytes.
      * If return type is MEMORY, the return address is automatically
-     * included in register spill area.
+     * included in register spill area. The area is placed below saved
+     * callee-saved registers, aligned to 16 bytes for SSE stores.
      */
     if (is_vararg(type)) {
-        stack_offset = -176;
+        stack_offset = -176 - reg_offset % 16;
     }
 
     /*
@@ -1839,7 +1859,7 @@ static void enter(struct definition *def)
         vararg.gp_offset = 8*next_integer_reg;
         vararg.fp_offset = 8*MAX_INTEGER_ARGS + 16*next_sse_reg;
         vararg.overflow_arg_area_offset = mem_offset;
-        vararg.reg_save_area_offset = 0;
+        vararg.reg_save_area_offset = -reg_offset - reg_offset % 16;
         emit_rr(INSTR_TEST, reg(AX, 1), reg(AX, 1));
         emit_jcc(CC_E, addr(sym));
         for (i = 0; i < MAX_SSE_ARGS; ++i) {
@@ -1900,9 +1920,9 @@ static void deconstruct_va_arg(
     overflow_arg_area->type = basic_type__unsigned_long;
     reg_save_area->type = basic_type__unsigned_long;
 
-    fp_offset->offset += 4;
-    overflow_arg_area->offset += 8;
-    reg_save_area->offset += 16;
+    var_offset(*fp_offset) += 4;
+    var_offset(*overflow_arg_area) += 8;
+    var_offset(*reg_save_area) += 16;
 }
 
 /*
@@ -1975,7 +1995,7 @@ static void compile__builtin_va_arg(struct var res, struct var args)
      * reference element directly.
      */
     assert(is_pointer(args.type));
-    assert(!args.offset);
+    assert(!var_offset(args));
     if (args.kind == ADDRESS) {
         args.kind = DIRECT;
     } else {
@@ -2060,7 +2080,7 @@ static void compile__builtin_va_arg(struct var res, struct var args)
             default: assert(0);
             }
 
-            slice.offset += size_of(slice.type);
+            var_offset(slice) += size_of(slice.type);
         }
 
         /*
@@ -2180,8 +2200,8 @@ static enum reg compile_call(struct var target, struct var ptr)
     }
 
     if (ptr.kind == ADDRESS) {
-        assert(!ptr.offset);
-        emit_i_(INSTR_CALL, addr(ptr.value.symbol));
+        assert(!var_offset(ptr));
+        emit_i_(INSTR_CALL, addr(var_symbol(ptr)));
     } else {
         load(ptr, R11);
         emit_r_(INSTR_CALL, reg(R11, 8));
@@ -2265,7 +2285,7 @@ static enum tttn compile_compare(
         assert(w == size_of(r.type));
         if (l.kind == IMMEDIATE && w < 8) {
             if (r.kind == DIRECT
-                && !is_global_offset(r.value.symbol)
+                && !is_global_offset(var_symbol(r))
                 && !is_field(r))
             {
                 if ((ax = allocated_register(r)) != 0) {
@@ -2294,7 +2314,7 @@ static enum tttn compile_compare(
             }
         } else if (r.kind == IMMEDIATE && w < 8) {
             if (l.kind == DIRECT
-                && !is_global_offset(l.value.symbol)
+                && !is_global_offset(var_symbol(l))
                 && !is_field(l))
             {
                 if ((ax = allocated_register(l)) != 0) {
@@ -2309,7 +2329,7 @@ static enum tttn compile_compare(
             }
         } else {
             if (l.kind == DIRECT
-                && !is_global_offset(l.value.symbol)
+                && !is_global_offset(var_symbol(l))
                 && !is_field(l))
             {
                 if ((ax = allocated_register(l)) != 0) {
@@ -2321,7 +2341,7 @@ static enum tttn compile_compare(
                     emit_rm(INSTR_CMP, reg(ax, w), location_of(l, w));
                 }
             } else if (r.kind == DIRECT
-                && !is_global_offset(r.value.symbol)
+                && !is_global_offset(var_symbol(r))
                 && !is_field(r))
             {
                 if ((ax = allocated_register(r)) != 0) {
@@ -2353,11 +2373,11 @@ static int operand_equal(struct var a, struct var b)
 {
     return a.is_symbol
         && b.is_symbol
-        && a.value.symbol == b.value.symbol
+        && var_symbol(a) == var_symbol(b)
         && a.kind == b.kind
         && a.field_width == b.field_width
         && a.field_offset == b.field_offset
-        && a.offset == b.offset;
+        && var_offset(a) == var_offset(b);
 }
 
 static enum reg compile_add(
@@ -2383,14 +2403,14 @@ static enum reg compile_add(
     } else {
         if (!is_void(target.type)
             && target.kind == DIRECT
-            && !is_global_offset(target.value.symbol)
+            && !is_global_offset(var_symbol(target))
             && !is_field(target))
         {
             ax = AX;
             if (operand_equal(target, r)) {
                 if (is_int_constant(l)) {
                     if ((cx = allocated_register(r)) != 0) {
-                        emit_rr(INSTR_ADD, reg(ax, w), reg(cx, w));
+                        emit_ir(INSTR_ADD, value_of(l, w), reg(cx, w));
                         ax = cx;
                     } else {
                         emit_im(INSTR_ADD,
@@ -2409,7 +2429,7 @@ static enum reg compile_add(
             } else if (operand_equal(target, l)) {
                 if (is_int_constant(r)) {
                     if ((cx = allocated_register(l)) != 0) {
-                        emit_rr(INSTR_ADD, reg(ax, w), reg(cx, w));
+                        emit_ir(INSTR_ADD, value_of(r, w), reg(cx, w));
                         ax = cx;
                     } else {
                         emit_im(INSTR_ADD,
@@ -2434,7 +2454,7 @@ static enum reg compile_add(
             ax = load_cast(l, type);
             emit_ir(INSTR_ADD, value_of(r, w), reg(ax, w));
         } else if (l.kind == DIRECT
-            && !is_global_offset(l.value.symbol)
+            && !is_global_offset(var_symbol(l))
             && !is_field(l))
         {
             ax = load_cast(r, type);
@@ -2444,7 +2464,7 @@ static enum reg compile_add(
                 emit_mr(INSTR_ADD, location_of(l, w), reg(ax, w));
             }
         } else if (r.kind == DIRECT
-            && !is_global_offset(r.value.symbol)
+            && !is_global_offset(var_symbol(r))
             && !is_field(r))
         {
             ax = load_cast(l, type);
@@ -2582,7 +2602,7 @@ static enum reg compile_mul(
         assert(ax == AX);
         if (l.kind == DIRECT
             && !is_register_allocated(l)
-            && !is_global_offset(l.value.symbol))
+            && !is_global_offset(var_symbol(l)))
         {
             emit_m_(INSTR_MUL, location_of(l, w));
         } else {
@@ -2636,7 +2656,7 @@ static enum reg compile_div(
         }
         opc = is_signed(type) ? INSTR_IDIV : INSTR_DIV;
         if (r.kind == DIRECT
-            && !is_global_offset(r.value.symbol)
+            && !is_global_offset(var_symbol(r))
             && !is_register_allocated(r)
             && !is_field(r))
         {
@@ -2678,7 +2698,7 @@ static enum reg compile_mod(
     opc = is_signed(type) ? INSTR_IDIV : INSTR_DIV;
     if (r.kind == DIRECT
         && !is_register_allocated(r)
-        && !is_global_offset(r.value.symbol)
+        && !is_global_offset(var_symbol(r))
         && !is_field(r))
     {
         emit_m_(opc, location_of(r, size_of(r.type)));
@@ -2810,7 +2830,7 @@ static void store_copy_object(struct var var, struct var target)
     if (is_array(var.type)) {
         assert(target.kind == DIRECT);
         assert(var.is_symbol);
-        assert(var.value.symbol->symtype == SYM_LITERAL);
+        assert(var_symbol(var)->symtype == SYM_LITERAL);
         assert(type_equal(target.type, var.type));
         emit_mr(INSTR_LEA, location_of(var, 8), reg(SI, 8));
     } else {
@@ -3033,29 +3053,34 @@ static void compile__asm(struct asm_statement st)
     }
 }
 
-static void compile_statement(struct statement stmt)
+static void compile_statement(const struct statement *stmt)
 {
-    switch (stmt.st) {
+    struct var target;
+
+    switch (stmt->st) {
     case IR_PARAM:
-        assert(is_identity(stmt.expr));
-        array_push_back(&func_args, stmt.expr.l);
+        assert(is_identity(stmt->expr));
+        array_push_back(&func_args, stmt->expr.l);
         break;
     case IR_VA_START:
-        assert(is_identity(stmt.expr));
-        compile__builtin_va_start(stmt.expr.l);
+        assert(is_identity(stmt->expr));
+        compile__builtin_va_start(stmt->expr.l);
         break;
     case IR_EXPR:
-        stmt.t.type = basic_type__void;
+        target = stmt->t;
+        target.type = basic_type__void;
+        compile_assign(target, stmt->expr);
+        break;
     case IR_ASSIGN:
-        compile_assign(stmt.t, stmt.expr);
+        compile_assign(stmt->t, stmt->expr);
         break;
     case IR_VLA_ALLOC:
-        assert(stmt.t.kind == DIRECT);
-        assert(stmt.t.is_symbol);
-        compile_vla_alloc(stmt.t.value.symbol, stmt.expr);
+        assert(stmt->t.kind == DIRECT);
+        assert(stmt->t.is_symbol);
+        compile_vla_alloc(var_symbol(stmt->t), stmt->expr);
         break;
     case IR_ASM:
-        compile__asm(array_get(&definition->asm_statements, stmt.asm_index));
+        compile__asm(array_get(&definition->asm_statements, stmt->asm_index));
         break;
     }
 
@@ -3155,7 +3180,6 @@ static void compile_block(
     enum reg ax;
     enum reg xmm0, xmm1;
     enum tttn cc;
-    struct statement st;
     struct immediate br0, br1;
 
     assert(is_function(type));
@@ -3165,8 +3189,7 @@ static void compile_block(
     block->color = BLACK;
     enter_context(block->label);
     for (i = block->head; i < block->head + block->count; ++i) {
-        st = array_get(&def->statements, i);
-        compile_statement(st);
+        compile_statement(&array_get(&def->statements, i));
     }
 
     if (!block->jump[0] && !block->jump[1]) {
@@ -3304,7 +3327,7 @@ static void compile_data_assign(struct var target, struct var val)
         case IMMEDIATE:
             assert(!is_array(target.type));
             assert(type_equal(target.type, val.type));
-            assert(!val.is_symbol || val.value.symbol->symtype == SYM_CONSTANT);
+            assert(!val.is_symbol || var_symbol(val)->symtype == SYM_CONSTANT);
             imm.type = IMM_INT;
             if (is_long_double(val.type)) {
                 union {
@@ -3321,13 +3344,13 @@ static void compile_data_assign(struct var target, struct var val)
             }
             break;
         case DIRECT:
-            assert(val.value.symbol->symtype == SYM_LITERAL);
+            assert(var_symbol(val)->symtype == SYM_LITERAL);
             imm.type = IMM_STRING;
-            imm.d.string = val.value.symbol->value.string;
+            imm.d.string = var_symbol(val)->value.string;
             break;
         default:
             assert(val.kind == ADDRESS);
-            assert(val.value.symbol->linkage != LINK_NONE);
+            assert(var_symbol(val)->linkage != LINK_NONE);
             imm.type = IMM_ADDR;
             imm.d.addr = address_of(val);
             break;
@@ -3340,16 +3363,16 @@ static void compile_data_assign(struct var target, struct var val)
 static void compile_data(struct definition *def)
 {
     int i;
-    struct statement st;
+    const struct statement *st;
 
     enter_context(def->symbol);
     for (i = def->body->head; i < def->body->head + def->body->count; ++i) {
-        st = array_get(&def->statements, i);
-        assert(st.st == IR_ASSIGN);
-        assert(st.t.kind == DIRECT);
-        assert(st.t.value.symbol == def->symbol);
-        assert(is_identity(st.expr));
-        compile_data_assign(st.t, st.expr.l);
+        st = &array_get(&def->statements, i);
+        assert(st->st == IR_ASSIGN);
+        assert(st->t.kind == DIRECT);
+        assert(var_symbol(st->t) == def->symbol);
+        assert(is_identity(st->expr));
+        compile_data_assign(st->t, st->expr.l);
     }
 }
 
@@ -3439,6 +3462,12 @@ INTERNAL void flush(void)
     x87_unsigned_adjust_constant = NULL;
 }
 
+INTERNAL size_t take_object_file(char **data)
+{
+    assert(context.target == TARGET_EXE);
+    return elf_take_image(data);
+}
+
 INTERNAL void finalize(void)
 {
     array_clear(&func_args);
@@ -7,11 +7,15 @@
 #include "dwarf.h"
 #include <lacc/array.h>
 #include <lacc/context.h>
+#include <lacc/timer.h>
 
 #include <assert.h>
 
 static FILE *object_file_output;
 
+/* Object file kept in memory, when there is no output stream. */
+static array_of(char) object_image;
+
 static Elf64_Ehdr header = {
     {
         '\x7f', 'E', 'L', 'F',  /* El_MAG */
@@ -513,6 +517,8 @@ INTERNAL int elf_text_displacement(const struct symbol *label, int instr_offset)
 
 /*
  * Initialize object file output. Called once for every input file.
+ * Without an output stream, the object file is written to memory, and
+ * taken by elf_take_image after flush.
  *
  * Write initial values to .symtab, starting with {0}, followed by a
  * special symbol representing the name of the source file, and section
@@ -527,6 +533,7 @@ INTERNAL void elf_init(FILE *output, const char *file)
     memset(&section_symbol, 0, sizeof(section_symbol));
     memset(&current_function, 0, sizeof(current_function));
     object_file_output = output;
+    array_empty(&object_image);
 
     section.shstrtab = elf_section_init(
         ".shstrtab", SHT_STRTAB, 0, SHN_UNDEF, 0, 1, 0);
@@ -649,7 +656,11 @@ INTERNAL int elf_symbol(const struct symbol *sym)
 
 INTERNAL int elf_text(struct instruction instr)
 {
-    struct code c = encode(instr);
+    struct code c;
+
+    timer_push(TIMER_ENCODE);
+    c = encode(instr);
+    timer_pop();
 
     if (c.val[0] != 0x90) {
         elf_section_write(section.text, &c.val, c.len);
@@ -694,12 +705,27 @@ static void write_data(const void *ptr, size_t size)
 {
     char padding[16] = {0};
     size_t b;
+    int n;
 
     if (!ptr) {
         assert(size <= sizeof(padding));
         ptr = padding;
     }
 
+    if (!object_file_output) {
+        n = array_len(&object_image) + size;
+        if (n > object_image.capacity) {
+            b = object_image.capacity ? object_image.capacity : 4096;
+            while (b < n) {
+                b *= 2;
+            }
+            array_realloc(&object_image, b);
+        }
+        memcpy(object_image.data + array_len(&object_image), ptr, size);
+        object_image.length = n;
+        return;
+    }
+
     b = fwrite(ptr, 1, size, object_file_output);
     if (b != size) {
         fprintf(stderr, "Write failed with %lu out of %lu bytes.\n", b, size);
@@ -748,17 +774,28 @@ INTERNAL int elf_flush(void)
     elf_chain_offsets();
 
     /* Write headers and section data to file. */
-    assert(object_file_output);
     write_data(&header, sizeof(header));
     write_data(shdr, shnum * sizeof(*shdr));
     write_sections();
     return 0;
 }
 
+INTERNAL size_t elf_take_image(char **data)
+{
+    size_t size;
+
+    assert(!object_file_output);
+    *data = object_image.data;
+    size = array_len(&object_image);
+    memset(&object_image, 0, sizeof(object_image));
+    return size;
+}
+
 INTERNAL int elf_finalize(void)
 {
     int i;
 
+    array_clear(&object_image);
     array_clear(&globals);
     array_clear(&pending_displacement_list);
     for (i = 1; i < SHNUM_MAX; ++i) {
@@ -38,6 +38,8 @@ typedef struct {
 #define EV_CURRENT 1                /* Current ELF version. */
 #define ELFOSABI_SYSV 0             /* System V ABI. */
 #define ET_REL 1                    /* Relocatable file. */
+#define ET_EXEC 2                   /* Executable file. */
+#define EM_X86_64 0x3E              /* Machine type x86_64. */
 
 typedef struct {
     Elf64_Word      sh_name;        /* Section name. */
@@ -53,6 +55,7 @@ typedef struct {
 } Elf64_Shdr;
 
 #define SHN_UNDEF 0
+#define SHN_LORESERVE 0xFF00        /* Start of reserved indices. */
 #define SHN_ABS 0xFFF1              /* Absolute value reference. */
 #define SHN_COMMON 0xFFF2           /* Tentative definitions. */
 
@@ -67,11 +70,20 @@ typedef struct {
 #define SHT_NOTE 7
 #define SHT_NOBITS 8                /* Uninitialized space. */
 #define SHT_DYNSYM 11
+#define SHT_INIT_ARRAY 14
+#define SHT_FINI_ARRAY 15
+#define SHT_PREINIT_ARRAY 16
+#define SHT_GROUP 17                /* Section group. */
 
 /* Section attributes, sh_flags. */
 #define SHF_WRITE 0x1
 #define SHF_ALLOC 0x2
 #define SHF_EXECINSTR 0x4
+#define SHF_TLS 0x400               /* Thread local storage. */
+#define SHF_EXCLUDE 0x80000000ul    /* Not included in executable. */
+
+/* Flag in first word of SHT_GROUP section. */
+#define GRP_COMDAT 0x1
 
 typedef struct {
     Elf64_Word      st_name;        /* Symbol name. */
@@ -84,12 +96,18 @@ typedef struct {
 
 #define STB_LOCAL 0
 #define STB_GLOBAL 1
+#define STB_WEAK 2
 
 #define STT_NOTYPE 0
 #define STT_OBJECT 1
 #define STT_FUNC 2
 #define STT_SECTION 3
 #define STT_FILE 4
+#define STT_TLS 6
+#define STT_GNU_IFUNC 10            /* Function resolved at load time. */
+
+#define ELF64_ST_BIND(i) ((i) >> 4)
+#define ELF64_ST_TYPE(i) ((i) & 0xF)
 
 typedef struct {
     Elf64_Addr      r_offset;       /* Address of reference. */
@@ -115,10 +133,44 @@ enum rel_type {
     R_X86_64_64 = 1,                /* word64   S + A. */
     R_X86_64_PC32 = 2,              /* word32   S + A - P */
     R_X86_64_PLT32 = 4,             /* word32   L + A - P */
-    R_X86_64_GOTPCREL = 9           /* word32   G + GOT + A - P */
+    R_X86_64_GOTPCREL = 9,          /* word32   G + GOT + A - P */
+    R_X86_64_32 = 10,               /* word32   S + A, zero extended */
+    R_X86_64_32S = 11,              /* word32   S + A, sign extended */
+    R_X86_64_DTPOFF64 = 17,         /* word64   Offset in TLS block */
+    R_X86_64_TPOFF64 = 18,          /* word64   Offset from thread pointer */
+    R_X86_64_DTPOFF32 = 21,         /* word32   Offset in TLS block */
+    R_X86_64_GOTTPOFF = 22,         /* word32   GOT entry of TPOFF64 - P */
+    R_X86_64_TPOFF32 = 23,          /* word32   Offset from thread pointer */
+    R_X86_64_PC64 = 24,             /* word64   S + A - P */
+    R_X86_64_IRELATIVE = 37,        /* word64   Call resolver at A */
+    R_X86_64_GOTPCRELX = 41,        /* word32   Relaxable GOTPCREL */
+    R_X86_64_REX_GOTPCRELX = 42     /* word32   Relaxable GOTPCREL */
 };
 
 #define ELF64_R_INFO(s, t) ((((long) s) << 32) + (((long) t) & 0xFFFFFFFFL))
+#define ELF64_R_SYM(i) ((i) >> 32)
+#define ELF64_R_TYPE(i) ((i) & 0xFFFFFFFFL)
+
+typedef struct {
+    Elf64_Word      p_type;         /* Type of segment. */
+    Elf64_Word      p_flags;        /* Segment attributes. */
+    Elf64_Off       p_offset;       /* Offset in file. */
+    Elf64_Addr      p_vaddr;        /* Virtual address in memory. */
+    Elf64_Addr      p_paddr;        /* Reserved. */
+    Elf64_Xword     p_filesz;       /* Size of segment in file. */
+    Elf64_Xword     p_memsz;        /* Size of segment in memory. */
+    Elf64_Xword     p_align;        /* Alignment of segment. */
+} Elf64_Phdr;
+
+/* Segment types, p_type. */
+#define PT_LOAD 1
+#define PT_TLS 7
+#define PT_GNU_STACK 0x6474E551
+
+/* Segment attributes, p_flags. */
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
 
 EXTERNAL struct elf_sections {
     int shstrtab;
@@ -148,6 +200,12 @@ INTERNAL void elf_flush_text_displacements(void);
 
 INTERNAL int elf_flush(void);
 
+/*
+ * Take object file written by elf_flush, when initialized without an
+ * output stream. Return size of data, which must be freed by caller.
+ */
+INTERNAL size_t elf_take_image(char **data);
+
 /* Free memory after all objects have been compiled. */
 INTERNAL int elf_finalize(void);
 
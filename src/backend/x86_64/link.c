@@ -0,0 +1,1799 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "link.h"
+#include "elf.h"
+#include <lacc/array.h>
+#include <lacc/context.h>
+#include <lacc/hash.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Executables are loaded at a fixed address, with ELF header and
+ * program headers mapped at the start of the first segment.
+ */
+#define LINK_BASE_ADDRESS 0x400000ul
+#define LINK_PAGE_SIZE 0x1000ul
+
+/* Each PLT entry is an indirect jump through a GOT entry. */
+#define PLT_ENTRY_SIZE 16
+
+/* Size of archive member header. */
+#define AR_HEADER_SIZE 60
+
+struct link_object {
+    char *name;
+    char *data;
+    size_t size;
+    const Elf64_Shdr *shdr;
+    const Elf64_Sym *symtab;
+    const char *strtab;
+    int shnum;
+    int symnum;
+    int first_section;
+    int first_symbol;
+};
+
+/*
+ * Section of input object, placed at offset in output section. Sections
+ * not included in the executable have output -1.
+ */
+struct input_section {
+    int output;
+    unsigned long offset;
+};
+
+/* GOT and PLT entries allocated for a symbol, or -1. */
+struct slots {
+    int got;
+    int tls_got;
+    int plt;
+};
+
+/*
+ * Symbol table entry of input object. Non-local symbols refer to the
+ * global symbol they resolve to, which holds the slots instead.
+ */
+struct symbol_ref {
+    int global;
+    struct slots slots;
+};
+
+/*
+ * Global symbol, defined by symbol at index in object, or undefined
+ * with object -1. Common symbols are allocated in .bss unless another
+ * definition is found.
+ */
+struct link_symbol {
+    const char *name;
+    int object;
+    int index;
+    int referenced_by;
+    unsigned long common_size;
+    unsigned long common_align;
+    unsigned long address;
+    struct slots slots;
+};
+
+struct output_section {
+    const char *name;
+    int type;
+    unsigned long flags;
+    unsigned long align;
+    unsigned long size;
+    unsigned long address;
+    unsigned long offset;
+};
+
+struct archive_symbol {
+    const char *name;
+    size_t member;
+};
+
+struct archive {
+    char *name;
+    char *data;
+    size_t size;
+    const char *long_names;
+    size_t long_names_size;
+    array_of(struct archive_symbol) symbols;
+    array_of(size_t) loaded;
+};
+
+/* IFUNC resolver called to fill GOT entry of PLT stub. */
+struct plt_entry {
+    int object;
+    int index;
+};
+
+/* Segments of executable; code, read-only data, and writable data. */
+struct segment {
+    unsigned long offset;
+    unsigned long address;
+    unsigned long filesz;
+    unsigned long memsz;
+};
+
+static array_of(struct link_object) link_objects;
+static array_of(struct input_section) input_sections;
+static array_of(struct symbol_ref) symbol_refs;
+static array_of(struct link_symbol) link_symbols;
+static array_of(struct output_section) output_sections;
+static array_of(struct archive) archives;
+static array_of(struct plt_entry) plt_entries;
+static array_of(const char *) comdat_groups;
+static array_of(int) output_order;
+static array_of(char) discarded;
+static struct hash_index link_symbol_index, comdat_index;
+
+static struct segment segments[3];
+static unsigned long tls_address, tls_filesz, tls_memsz, tls_align;
+static int plt_output, got_output, iplt_output, bss_output;
+static int got_count, link_errors;
+
+static int link_error(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    link_errors++;
+    return 1;
+}
+
+static unsigned long hash_name(const char *name)
+{
+    unsigned long hash = 5381;
+
+    while (*name) {
+        hash = hash * 33 + (unsigned char) *name++;
+    }
+
+    return hash;
+}
+
+static unsigned long align_to(unsigned long n, unsigned long align)
+{
+    return align > 1 ? (n + align - 1) & ~(align - 1) : n;
+}
+
+static int find_global(const char *name)
+{
+    int i;
+
+    for (i = hash_index_first(&link_symbol_index, hash_name(name)); i != -1;
+        i = hash_index_next(&link_symbol_index, i))
+    {
+        if (!strcmp(array_get(&link_symbols, i).name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+static int add_global(const char *name)
+{
+    int i;
+    struct link_symbol sym = {0};
+
+    i = find_global(name);
+    if (i == -1) {
+        sym.name = name;
+        sym.object = -1;
+        sym.referenced_by = -1;
+        sym.slots.got = sym.slots.tls_got = sym.slots.plt = -1;
+        i = array_len(&link_symbols);
+        array_push_back(&link_symbols, sym);
+        hash_index_add(&link_symbol_index, i, hash_name(name));
+    }
+
+    return i;
+}
+
+/*
+ * Only the first COMDAT group with a given signature is kept. Return
+ * non-zero if the group is new.
+ */
+static int add_comdat_group(const char *signature)
+{
+    int i;
+    unsigned long h;
+
+    h = hash_name(signature);
+    for (i = hash_index_first(&comdat_index, h); i != -1;
+        i = hash_index_next(&comdat_index, i))
+    {
+        if (!strcmp(array_get(&comdat_groups, i), signature))
+            return 0;
+    }
+
+    i = array_len(&comdat_groups);
+    array_push_back(&comdat_groups, signature);
+    hash_index_add(&comdat_index, i, h);
+    return 1;
+}
+
+static int is_section_prefix(const char *name, const char *prefix)
+{
+    size_t len;
+
+    len = strlen(prefix);
+    return !strncmp(name, prefix, len)
+        && (name[len] == '\0' || name[len] == '.');
+}
+
+/*
+ * Name of output section where input section is placed, or NULL if it
+ * is not part of the executable. Sections with other names than these
+ * keep their own name, which can be referenced by __start_ and __stop_
+ * symbols.
+ */
+static const char *output_section_name(
+    const char *name,
+    const Elf64_Shdr *shdr)
+{
+    if (!(shdr->sh_flags & SHF_ALLOC)
+        || (shdr->sh_flags & SHF_EXCLUDE)
+        || shdr->sh_type == SHT_NOTE
+        || shdr->sh_type == SHT_GROUP)
+    {
+        return NULL;
+    }
+
+    if (shdr->sh_flags & SHF_TLS)
+        return shdr->sh_type == SHT_NOBITS ? ".tbss" : ".tdata";
+
+    switch (shdr->sh_type) {
+    case SHT_INIT_ARRAY: return ".init_array";
+    case SHT_FINI_ARRAY: return ".fini_array";
+    case SHT_PREINIT_ARRAY: return ".preinit_array";
+    }
+
+    if (is_section_prefix(name, ".text"))
+        return ".text";
+    if (is_section_prefix(name, ".rodata"))
+        return ".rodata";
+    if (is_section_prefix(name, ".data.rel.ro"))
+        return ".data.rel.ro";
+    if (is_section_prefix(name, ".data"))
+        return ".data";
+    if (is_section_prefix(name, ".bss"))
+        return ".bss";
+
+    return name;
+}
+
+static int find_output(const char *name)
+{
+    int i;
+
+    for (i = 0; i < array_len(&output_sections); ++i) {
+        if (!strcmp(array_get(&output_sections, i).name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+static int add_output(
+    const char *name,
+    int type,
+    unsigned long flags,
+    unsigned long align)
+{
+    int i;
+    struct output_section *out, sec = {0};
+
+    flags &= SHF_WRITE | SHF_ALLOC | SHF_EXECINSTR | SHF_TLS;
+    i = find_output(name);
+    if (i == -1) {
+        sec.name = name;
+        sec.type = type;
+        sec.align = 1;
+        i = array_len(&output_sections);
+        array_push_back(&output_sections, sec);
+    }
+
+    out = &array_get(&output_sections, i);
+    if (out->type == SHT_NOBITS) {
+        out->type = type;
+    }
+
+    out->flags |= flags;
+    if (align > out->align) {
+        out->align = align;
+    }
+
+    return i;
+}
+
+static int check_object(const char *name, const char *data, size_t size)
+{
+    int i;
+    const Elf64_Ehdr *hdr;
+    const Elf64_Shdr *shdr;
+
+    hdr = (const Elf64_Ehdr *) data;
+    if (size < sizeof(*hdr) || memcmp(hdr->e_ident, "\x7f" "ELF", 4)) {
+        return link_error("%s: Not an object file.", name);
+    }
+
+    if (hdr->e_ident[4] != ELFCLASS64
+        || hdr->e_ident[5] != ELFDATA2LSB
+        || hdr->e_type != ET_REL
+        || hdr->e_machine != EM_X86_64)
+    {
+        return link_error("%s: Not a relocatable x86_64 object.", name);
+    }
+
+    if (hdr->e_shentsize != sizeof(*shdr)
+        || hdr->e_shnum == 0
+        || hdr->e_shstrndx >= hdr->e_shnum
+        || hdr->e_shoff > size
+        || hdr->e_shnum > (size - hdr->e_shoff) / sizeof(*shdr))
+    {
+        return link_error("%s: Invalid section headers.", name);
+    }
+
+    shdr = (const Elf64_Shdr *) (data + hdr->e_shoff);
+    for (i = 0; i < hdr->e_shnum; ++i) {
+        if (shdr[i].sh_type != SHT_NOBITS
+            && (shdr[i].sh_offset > size
+                || shdr[i].sh_size > size - shdr[i].sh_offset))
+        {
+            return link_error("%s: Invalid section %d.", name, i);
+        }
+
+        if (shdr[i].sh_link >= hdr->e_shnum) {
+            return link_error("%s: Invalid section link %d.", name, i);
+        }
+    }
+
+    return 0;
+}
+
+static int is_weak(const struct link_symbol *sym)
+{
+    const struct link_object *obj;
+
+    assert(sym->object != -1);
+    obj = &array_get(&link_objects, sym->object);
+    return ELF64_ST_BIND(obj->symtab[sym->index].st_info) == STB_WEAK;
+}
+
+static int is_defined(int o, const Elf64_Sym *sym)
+{
+    const struct link_object *obj;
+
+    if (sym->st_shndx == SHN_UNDEF)
+        return 0;
+
+    if (sym->st_shndx >= SHN_LORESERVE)
+        return 1;
+
+    obj = &array_get(&link_objects, o);
+    return array_get(&input_sections, obj->first_section + sym->st_shndx)
+        .output != -1;
+}
+
+/*
+ * Resolve non-local symbol against global symbol table. Definitions
+ * replace common and weak symbols, and only strong references can
+ * extract archive members.
+ */
+static int resolve_symbol(int o, int i)
+{
+    int s, bind;
+    const char *name;
+    const Elf64_Sym *sym;
+    struct link_symbol *global;
+    const struct link_object *obj;
+
+    obj = &array_get(&link_objects, o);
+    sym = &obj->symtab[i];
+    name = obj->strtab + sym->st_name;
+    bind = ELF64_ST_BIND(sym->st_info);
+    s = add_global(name);
+    global = &array_get(&link_symbols, s);
+    if (!is_defined(o, sym)) {
+        if (bind != STB_WEAK && global->referenced_by == -1) {
+            global->referenced_by = o;
+        }
+    } else if (sym->st_shndx == SHN_COMMON) {
+        if (global->object == -1) {
+            if (sym->st_size > global->common_size) {
+                global->common_size = sym->st_size;
+            }
+            if (sym->st_value > global->common_align) {
+                global->common_align = sym->st_value;
+            }
+        }
+    } else if (global->object == -1
+        || (is_weak(global) && bind != STB_WEAK))
+    {
+        global->object = o;
+        global->index = i;
+        global->common_size = 0;
+    } else if (!is_weak(global) && bind != STB_WEAK) {
+        link_error("Multiple definitions of '%s', in %s and %s.", name,
+            array_get(&link_objects, global->object).name, obj->name);
+    }
+
+    return s;
+}
+
+/* Mark sections of COMDAT groups already seen as discarded. */
+static void select_groups(const struct link_object *obj)
+{
+    int i, j, n;
+    const char *signature;
+    const Elf64_Word *words;
+    const Elf64_Shdr *shdr;
+
+    array_empty(&discarded);
+    for (i = 0; i < obj->shnum; ++i) {
+        array_push_back(&discarded, 0);
+    }
+
+    for (i = 0; i < obj->shnum; ++i) {
+        shdr = &obj->shdr[i];
+        if (shdr->sh_type != SHT_GROUP
+            || shdr->sh_size < sizeof(*words)
+            || shdr->sh_info >= obj->symnum)
+        {
+            continue;
+        }
+
+        words = (const Elf64_Word *) (obj->data + shdr->sh_offset);
+        n = shdr->sh_size / sizeof(*words);
+        signature = obj->strtab + obj->symtab[shdr->sh_info].st_name;
+        if ((words[0] & GRP_COMDAT) && !add_comdat_group(signature)) {
+            for (j = 1; j < n; ++j) {
+                if (words[j] < obj->shnum) {
+                    array_get(&discarded, words[j]) = 1;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Add relocatable object, taking ownership of name and data. Sections
+ * are assigned to output sections, and symbols are resolved.
+ */
+static int add_object(char *name, char *data, size_t size)
+{
+    int i, o;
+    const char *secname;
+    const Elf64_Ehdr *hdr;
+    const Elf64_Shdr *shdr;
+    const Elf64_Sym *sym;
+    struct input_section sec;
+    struct symbol_ref ref;
+    struct link_object obj = {0}, *ptr;
+
+    if (check_object(name, data, size)) {
+        free(name);
+        free(data);
+        return 1;
+    }
+
+    hdr = (const Elf64_Ehdr *) data;
+    obj.name = name;
+    obj.data = data;
+    obj.size = size;
+    obj.shdr = (const Elf64_Shdr *) (data + hdr->e_shoff);
+    obj.shnum = hdr->e_shnum;
+    obj.strtab = "";
+    obj.first_section = array_len(&input_sections);
+    obj.first_symbol = array_len(&symbol_refs);
+    for (i = 0; i < obj.shnum; ++i) {
+        shdr = &obj.shdr[i];
+        if (shdr->sh_type == SHT_SYMTAB) {
+            obj.symtab = (const Elf64_Sym *) (data + shdr->sh_offset);
+            obj.symnum = shdr->sh_size / sizeof(Elf64_Sym);
+            obj.strtab = data + obj.shdr[shdr->sh_link].sh_offset;
+        }
+    }
+
+    o = array_len(&link_objects);
+    array_push_back(&link_objects, obj);
+    ptr = &array_get(&link_objects, o);
+    select_groups(ptr);
+    for (i = 0; i < ptr->shnum; ++i) {
+        shdr = &ptr->shdr[i];
+        sec.output = -1;
+        sec.offset = 0;
+        if (i > 0 && !array_get(&discarded, i)) {
+            secname = data + ptr->shdr[hdr->e_shstrndx].sh_offset
+                + shdr->sh_name;
+            secname = output_section_name(secname, shdr);
+            if (secname) {
+                sec.output = add_output(secname, shdr->sh_type,
+                    shdr->sh_flags, shdr->sh_addralign);
+            }
+        }
+
+        array_push_back(&input_sections, sec);
+    }
+
+    for (i = 0; i < ptr->symnum; ++i) {
+        sym = &ptr->symtab[i];
+        ref.global = -1;
+        ref.slots.got = ref.slots.tls_got = ref.slots.plt = -1;
+        if (sym->st_shndx == 0xFFFF) {
+            return link_error("%s: Extended section indices are not "
+                "supported.", name);
+        }
+
+        if (i > 0 && ELF64_ST_BIND(sym->st_info) != STB_LOCAL) {
+            ref.global = resolve_symbol(o, i);
+        }
+
+        array_push_back(&symbol_refs, ref);
+    }
+
+    return 0;
+}
+
+static unsigned long read_number(const char *str, int len, int base)
+{
+    char buf[16];
+
+    assert(len < sizeof(buf));
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+    return strtoul(buf, NULL, base);
+}
+
+static unsigned long read_big_endian(const char *data, int width)
+{
+    int i;
+    unsigned long n;
+
+    for (i = 0, n = 0; i < width; ++i) {
+        n = (n << 8) | (unsigned char) data[i];
+    }
+
+    return n;
+}
+
+/*
+ * Read archive symbol index, a count followed by offsets of members
+ * defining each symbol, and then the symbol names.
+ */
+static int read_archive_index(
+    struct archive *ar,
+    const char *data,
+    size_t size,
+    int width)
+{
+    size_t i, n;
+    const char *name, *end;
+    struct archive_symbol sym;
+
+    n = size < width ? 0 : read_big_endian(data, width);
+    if (size < width || n > size / width - 1) {
+        return link_error("%s: Invalid archive index.", ar->name);
+    }
+
+    name = data + (n + 1) * width;
+    end = data + size;
+    for (i = 0; i < n; ++i) {
+        sym.name = name;
+        sym.member = read_big_endian(data + (i + 1) * width, width);
+        name = memchr(name, '\0', end - name);
+        if (!name) {
+            return link_error("%s: Invalid archive index.", ar->name);
+        }
+
+        name++;
+        array_push_back(&ar->symbols, sym);
+    }
+
+    return 0;
+}
+
+static size_t member_size(const char *header)
+{
+    return read_number(header + 48, 10, 10);
+}
+
+/* Format name of archive member as archive(member). */
+static char *member_name(const struct archive *ar, const char *header)
+{
+    size_t off, len;
+    const char *name;
+    char *str;
+
+    name = header;
+    len = 0;
+    if (name[0] == '/' && name[1] >= '0' && name[1] <= '9') {
+        off = read_number(header + 1, 15, 10);
+        if (off < ar->long_names_size) {
+            name = ar->long_names + off;
+            while (off + len < ar->long_names_size && name[len] != '/'
+                && name[len] != '\n')
+            {
+                len++;
+            }
+        }
+    } else {
+        while (len < 16 && name[len] != '/' && name[len] != ' ') {
+            len++;
+        }
+    }
+
+    str = malloc(strlen(ar->name) + len + 3);
+    sprintf(str, "%s(%.*s)", ar->name, (int) len, name);
+    return str;
+}
+
+static int add_archive(char *name, char *data, size_t size)
+{
+    size_t pos, len;
+    const char *header;
+    struct archive ar = {0};
+
+    ar.name = name;
+    ar.data = data;
+    ar.size = size;
+    for (pos = 8; pos + AR_HEADER_SIZE <= size;
+        pos += AR_HEADER_SIZE + len + (len & 1))
+    {
+        header = data + pos;
+        len = member_size(header);
+        if (memcmp(header + 58, "`\n", 2)
+            || len > size - pos - AR_HEADER_SIZE)
+        {
+            link_error("%s: Invalid archive member header.", name);
+            break;
+        }
+
+        if (!memcmp(header, "/ ", 2)) {
+            read_archive_index(&ar, header + AR_HEADER_SIZE, len, 4);
+        } else if (!memcmp(header, "/SYM64/ ", 8)) {
+            read_archive_index(&ar, header + AR_HEADER_SIZE, len, 8);
+        } else if (!memcmp(header, "// ", 3)) {
+            ar.long_names = header + AR_HEADER_SIZE;
+            ar.long_names_size = len;
+        }
+    }
+
+    if (!array_len(&ar.symbols) && pos > 8) {
+        link_error("%s: Archive has no symbol index.", name);
+    }
+
+    array_push_back(&archives, ar);
+    return link_errors;
+}
+
+static int load_member(struct archive *ar, size_t member)
+{
+    size_t len;
+    char *data;
+    const char *header;
+
+    array_push_back(&ar->loaded, member);
+    if (member + AR_HEADER_SIZE > ar->size) {
+        return link_error("%s: Invalid archive index.", ar->name);
+    }
+
+    header = ar->data + member;
+    len = member_size(header);
+    if (len > ar->size - member - AR_HEADER_SIZE) {
+        return link_error("%s: Invalid archive member header.", ar->name);
+    }
+
+    data = malloc(len ? len : 1);
+    memcpy(data, header + AR_HEADER_SIZE, len);
+    return add_object(member_name(ar, header), data, len);
+}
+
+static int is_loaded(const struct archive *ar, size_t member)
+{
+    int i;
+
+    for (i = 0; i < array_len(&ar->loaded); ++i) {
+        if (array_get(&ar->loaded, i) == member)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Extract archive members defining symbols which are still undefined,
+ * searching all archives repeatedly until no more are added.
+ */
+static void extract_members(void)
+{
+    int i, j, s, changed;
+    struct archive *ar;
+    const struct archive_symbol *sym;
+    const struct link_symbol *global;
+
+    do {
+        changed = 0;
+        for (i = 0; i < array_len(&archives); ++i) {
+            ar = &array_get(&archives, i);
+            for (j = 0; j < array_len(&ar->symbols); ++j) {
+                sym = &array_get(&ar->symbols, j);
+                s = find_global(sym->name);
+                if (s == -1)
+                    continue;
+
+                global = &array_get(&link_symbols, s);
+                if (global->object != -1
+                    || global->common_size
+                    || global->referenced_by == -1
+                    || is_loaded(ar, sym->member))
+                {
+                    continue;
+                }
+
+                load_member(ar, sym->member);
+                changed = 1;
+            }
+        }
+    } while (changed);
+}
+
+static const struct output_section *output_of(const char *name)
+{
+    int i;
+
+    i = find_output(name);
+    return i == -1 ? NULL : &array_get(&output_sections, i);
+}
+
+/*
+ * Symbols defined by the linker, marking boundaries of sections and
+ * segments. Return non-zero if name is one of them, and set address if
+ * layout is done.
+ */
+static int synthetic_symbol(const char *name, unsigned long *address)
+{
+    int is_end;
+    const char *secname;
+    const struct output_section *out;
+
+    secname = NULL;
+    is_end = 0;
+    if (!strcmp(name, "__ehdr_start")
+        || !strcmp(name, "__executable_start"))
+    {
+        *address = LINK_BASE_ADDRESS;
+    } else if (!strcmp(name, "_GLOBAL_OFFSET_TABLE_")) {
+        secname = ".got";
+    } else if (!strcmp(name, "__rela_iplt_start")
+        || (is_end = !strcmp(name, "__rela_iplt_end")))
+    {
+        secname = ".rela.iplt";
+    } else if (!strcmp(name, "__init_array_start")
+        || (is_end = !strcmp(name, "__init_array_end")))
+    {
+        secname = ".init_array";
+    } else if (!strcmp(name, "__fini_array_start")
+        || (is_end = !strcmp(name, "__fini_array_end")))
+    {
+        secname = ".fini_array";
+    } else if (!strcmp(name, "__preinit_array_start")
+        || (is_end = !strcmp(name, "__preinit_array_end")))
+    {
+        secname = ".preinit_array";
+    } else if (!strcmp(name, "_etext")
+        || !strcmp(name, "etext")
+        || !strcmp(name, "__etext"))
+    {
+        *address = segments[0].address + segments[0].memsz;
+    } else if (!strcmp(name, "_edata")
+        || !strcmp(name, "edata")
+        || !strcmp(name, "__bss_start"))
+    {
+        *address = segments[2].address + segments[2].filesz;
+    } else if (!strcmp(name, "_end") || !strcmp(name, "end")) {
+        *address = segments[2].address + segments[2].memsz;
+    } else if (!strncmp(name, "__start_", 8) && output_of(name + 8)) {
+        secname = name + 8;
+    } else if (!strncmp(name, "__stop_", 7) && output_of(name + 7)) {
+        secname = name + 7;
+        is_end = 1;
+    } else {
+        return 0;
+    }
+
+    if (secname) {
+        out = output_of(secname);
+        *address = !out ? 0 : is_end ? out->address + out->size
+            : out->address;
+    }
+
+    return 1;
+}
+
+static struct symbol_ref *symbol_ref(int o, int i)
+{
+    const struct link_object *obj;
+
+    obj = &array_get(&link_objects, o);
+    return &array_get(&symbol_refs, obj->first_symbol + i);
+}
+
+static struct slots *slots_of(int o, int i)
+{
+    struct symbol_ref *ref;
+
+    ref = symbol_ref(o, i);
+    return ref->global == -1
+        ? &ref->slots
+        : &array_get(&link_symbols, ref->global).slots;
+}
+
+/*
+ * Find symbol table entry defining symbol at index i in object o. Set
+ * object to where the definition is found, or return NULL if the
+ * symbol is undefined.
+ */
+static const Elf64_Sym *definition_of(int o, int i, int *object)
+{
+    const struct symbol_ref *ref;
+    const struct link_symbol *global;
+
+    ref = symbol_ref(o, i);
+    if (ref->global != -1) {
+        global = &array_get(&link_symbols, ref->global);
+        if (global->object == -1)
+            return NULL;
+
+        o = global->object;
+        i = global->index;
+    }
+
+    *object = o;
+    return &array_get(&link_objects, o).symtab[i];
+}
+
+/*
+ * Allocate GOT entries, and PLT entries for references to IFUNC
+ * symbols. The GOT entry of each PLT stub is filled by the resolver
+ * function at startup, from IRELATIVE relocations in .rela.iplt.
+ */
+static void allocate_slot(int o, int i, int type)
+{
+    int object;
+    struct slots *slots;
+    const Elf64_Sym *sym;
+    struct plt_entry plt;
+
+    slots = slots_of(o, i);
+    if (type == R_X86_64_GOTTPOFF) {
+        if (slots->tls_got == -1) {
+            slots->tls_got = got_count++;
+        }
+        return;
+    }
+
+    if (type == R_X86_64_GOTPCREL
+        || type == R_X86_64_GOTPCRELX
+        || type == R_X86_64_REX_GOTPCRELX)
+    {
+        if (slots->got == -1) {
+            slots->got = got_count++;
+        }
+    }
+
+    sym = definition_of(o, i, &object);
+    if (slots->plt == -1
+        && sym
+        && ELF64_ST_TYPE(sym->st_info) == STT_GNU_IFUNC)
+    {
+        plt.object = object;
+        plt.index = sym - array_get(&link_objects, object).symtab;
+        slots->plt = array_len(&plt_entries);
+        array_push_back(&plt_entries, plt);
+    }
+}
+
+static int is_relocated(const struct link_object *obj, const Elf64_Shdr *shdr)
+{
+    return shdr->sh_type == SHT_RELA
+        && shdr->sh_info < obj->shnum
+        && obj->shdr[shdr->sh_info].sh_type != SHT_NOBITS
+        && array_get(&input_sections, obj->first_section + shdr->sh_info)
+            .output != -1;
+}
+
+static void scan_relocations(void)
+{
+    int o, i, j, n, type, sym;
+    const Elf64_Shdr *shdr;
+    const Elf64_Rela *rela;
+    const struct link_object *obj;
+
+    for (o = 0; o < array_len(&link_objects); ++o) {
+        obj = &array_get(&link_objects, o);
+        for (i = 0; i < obj->shnum; ++i) {
+            shdr = &obj->shdr[i];
+            if (!is_relocated(obj, shdr))
+                continue;
+
+            rela = (const Elf64_Rela *) (obj->data + shdr->sh_offset);
+            n = shdr->sh_size / sizeof(*rela);
+            for (j = 0; j < n; ++j) {
+                type = ELF64_R_TYPE(rela[j].r_info);
+                sym = ELF64_R_SYM(rela[j].r_info);
+                if (sym >= obj->symnum) {
+                    link_error("%s: Invalid relocation symbol %d.",
+                        obj->name, sym);
+                    continue;
+                }
+
+                switch (type) {
+                case R_X86_64_64:
+                case R_X86_64_PC32:
+                case R_X86_64_PLT32:
+                case R_X86_64_GOTPCREL:
+                case R_X86_64_32:
+                case R_X86_64_32S:
+                case R_X86_64_GOTTPOFF:
+                case R_X86_64_PC64:
+                case R_X86_64_GOTPCRELX:
+                case R_X86_64_REX_GOTPCRELX:
+                    allocate_slot(o, sym, type);
+                    /* Fallthrough. */
+                case R_X86_64_NONE:
+                case R_X86_64_DTPOFF64:
+                case R_X86_64_TPOFF64:
+                case R_X86_64_DTPOFF32:
+                case R_X86_64_TPOFF32:
+                    break;
+                default:
+                    link_error("%s: Unsupported relocation type %d.",
+                        obj->name, type);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Segment of output section, where TLS and uninitialized data must be
+ * ordered last among the writable sections. Code starts with .init and
+ * ends with .fini.
+ */
+static int output_rank(const struct output_section *out)
+{
+    int rank;
+
+    if (out->flags & SHF_EXECINSTR) {
+        rank = !strcmp(out->name, ".init") ? 0
+            : !strcmp(out->name, ".fini") ? 2 : 1;
+    } else if (out->type == SHT_NOBITS && !(out->flags & SHF_TLS)) {
+        rank = 7;
+    } else if (!(out->flags & SHF_WRITE)) {
+        rank = 3;
+    } else if (out->flags & SHF_TLS) {
+        rank = out->type == SHT_NOBITS ? 5 : 4;
+    } else {
+        rank = 6;
+    }
+
+    return rank;
+}
+
+static int segment_of(const struct output_section *out)
+{
+    int rank;
+
+    rank = output_rank(out);
+    return rank < 3 ? 0 : rank == 3 ? 1 : 2;
+}
+
+static void sort_outputs(void)
+{
+    int i, j, k, rank;
+
+    array_empty(&output_order);
+    for (i = 0; i < array_len(&output_sections); ++i) {
+        k = i;
+        rank = output_rank(&array_get(&output_sections, i));
+        array_push_back(&output_order, i);
+        for (j = i; j > 0; --j) {
+            k = array_get(&output_order, j - 1);
+            if (output_rank(&array_get(&output_sections, k)) <= rank)
+                break;
+            array_get(&output_order, j) = k;
+        }
+
+        array_get(&output_order, j) = i;
+    }
+}
+
+static int has_tls(void)
+{
+    int i;
+
+    for (i = 0; i < array_len(&output_sections); ++i) {
+        if (array_get(&output_sections, i).flags & SHF_TLS)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int program_header_count(void)
+{
+    return 4 + has_tls();
+}
+
+/*
+ * Place input sections and common symbols in output sections, and
+ * assign addresses. Each segment starts on a new page, at an address
+ * equal to the file offset plus base address.
+ */
+static void layout(void)
+{
+    int o, i, seg;
+    unsigned long offset, address, align;
+    const Elf64_Shdr *shdr;
+    struct input_section *sec;
+    struct output_section *out;
+    struct link_symbol *sym;
+    const struct link_object *obj;
+
+    for (o = 0; o < array_len(&link_objects); ++o) {
+        obj = &array_get(&link_objects, o);
+        for (i = 0; i < obj->shnum; ++i) {
+            sec = &array_get(&input_sections, obj->first_section + i);
+            if (sec->output == -1)
+                continue;
+
+            shdr = &obj->shdr[i];
+            out = &array_get(&output_sections, sec->output);
+            out->size = align_to(out->size, shdr->sh_addralign);
+            sec->offset = out->size;
+            out->size += shdr->sh_size;
+        }
+    }
+
+    out = &array_get(&output_sections, bss_output);
+    for (i = 0; i < array_len(&link_symbols); ++i) {
+        sym = &array_get(&link_symbols, i);
+        if (sym->object == -1 && sym->common_size) {
+            align = sym->common_align;
+            out->size = align_to(out->size, align);
+            if (align > out->align) {
+                out->align = align;
+            }
+            sym->address = out->size;
+            out->size += sym->common_size;
+        }
+    }
+
+    array_get(&output_sections, plt_output).size =
+        PLT_ENTRY_SIZE * array_len(&plt_entries);
+    array_get(&output_sections, got_output).size =
+        8 * (got_count + array_len(&plt_entries));
+    array_get(&output_sections, iplt_output).size =
+        sizeof(Elf64_Rela) * array_len(&plt_entries);
+
+    sort_outputs();
+    offset = sizeof(Elf64_Ehdr) + program_header_count() * sizeof(Elf64_Phdr);
+    address = LINK_BASE_ADDRESS + offset;
+    segments[0].offset = 0;
+    segments[0].address = LINK_BASE_ADDRESS;
+    tls_address = tls_filesz = tls_memsz = 0;
+    tls_align = 1;
+    for (seg = 0, i = 0; i <= array_len(&output_order); ++i) {
+        out = NULL;
+        if (i < array_len(&output_order)) {
+            out = &array_get(&output_sections, array_get(&output_order, i));
+        }
+
+        while (seg < (out ? segment_of(out) : 3)) {
+            segments[seg].filesz = offset - segments[seg].offset;
+            segments[seg].memsz = address - segments[seg].address;
+            if (++seg == 3)
+                break;
+            offset = align_to(offset, LINK_PAGE_SIZE);
+            address = LINK_BASE_ADDRESS + offset;
+            segments[seg].offset = offset;
+            segments[seg].address = address;
+        }
+
+        if (!out)
+            break;
+
+        if (out->type == SHT_NOBITS) {
+            out->address = align_to(address, out->align);
+            out->offset = offset;
+            if (!(out->flags & SHF_TLS)) {
+                address = out->address + out->size;
+            }
+        } else {
+            offset = align_to(offset, out->align);
+            address = LINK_BASE_ADDRESS + offset;
+            out->address = address;
+            out->offset = offset;
+            offset += out->size;
+            address += out->size;
+        }
+
+        if (out->flags & SHF_TLS) {
+            if (!tls_memsz && !tls_address) {
+                tls_address = out->address;
+            }
+            if (out->type != SHT_NOBITS) {
+                tls_filesz = out->address + out->size - tls_address;
+            }
+            tls_memsz = out->address + out->size - tls_address;
+            if (out->align > tls_align) {
+                tls_align = out->align;
+            }
+        }
+    }
+}
+
+static unsigned long section_address(int o, int shndx)
+{
+    const struct link_object *obj;
+    const struct input_section *sec;
+
+    obj = &array_get(&link_objects, o);
+    sec = &array_get(&input_sections, obj->first_section + shndx);
+    if (sec->output == -1)
+        return 0;
+
+    return array_get(&output_sections, sec->output).address + sec->offset;
+}
+
+static unsigned long symbol_address(int o, const Elf64_Sym *sym)
+{
+    if (sym->st_shndx == SHN_ABS)
+        return sym->st_value;
+
+    if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+        return 0;
+
+    return section_address(o, sym->st_shndx) + sym->st_value;
+}
+
+static void assign_addresses(void)
+{
+    int i;
+    struct link_symbol *sym;
+    const struct link_object *obj;
+
+    for (i = 0; i < array_len(&link_symbols); ++i) {
+        sym = &array_get(&link_symbols, i);
+        if (sym->object != -1) {
+            obj = &array_get(&link_objects, sym->object);
+            sym->address =
+                symbol_address(sym->object, &obj->symtab[sym->index]);
+        } else if (sym->common_size) {
+            sym->address +=
+                array_get(&output_sections, bss_output).address;
+        } else if (!synthetic_symbol(sym->name, &sym->address)) {
+            sym->address = 0;
+        }
+    }
+}
+
+/*
+ * Address of symbol used in relocation. References to IFUNC symbols
+ * go through the PLT stub.
+ */
+static unsigned long target_address(int o, int i)
+{
+    const struct slots *slots;
+    const struct symbol_ref *ref;
+
+    slots = slots_of(o, i);
+    if (slots->plt != -1) {
+        return array_get(&output_sections, plt_output).address
+            + PLT_ENTRY_SIZE * slots->plt;
+    }
+
+    ref = symbol_ref(o, i);
+    if (ref->global != -1)
+        return array_get(&link_symbols, ref->global).address;
+
+    return symbol_address(o, &array_get(&link_objects, o).symtab[i]);
+}
+
+/* Offset from thread pointer, which points to the end of TLS block. */
+static unsigned long tls_offset(unsigned long address)
+{
+    return address - tls_address - align_to(tls_memsz, tls_align);
+}
+
+static void write_word(char *ptr, unsigned long value, int size)
+{
+    int i;
+
+    for (i = 0; i < size; ++i) {
+        ptr[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static void write_signed(
+    const struct link_object *obj,
+    char *ptr,
+    unsigned long value,
+    int type)
+{
+    long n;
+
+    n = (long) value;
+    if (n < -2147483647L - 1 || n > 2147483647L) {
+        link_error("%s: Relocation type %d out of range.", obj->name, type);
+    }
+
+    write_word(ptr, value, 4);
+}
+
+static unsigned long got_entry(
+    char *image,
+    int slot,
+    unsigned long value)
+{
+    const struct output_section *got;
+
+    got = &array_get(&output_sections, got_output);
+    write_word(image + got->offset + 8 * slot, value, 8);
+    return got->address + 8 * slot;
+}
+
+static void apply_relocations(
+    char *image,
+    int o,
+    const Elf64_Shdr *shdr)
+{
+    int j, n, type, sym, size;
+    unsigned long offset, address, S, A, P, G;
+    char *ptr;
+    const Elf64_Rela *rela;
+    const Elf64_Shdr *target;
+    const struct slots *slots;
+    const struct link_object *obj;
+    const struct input_section *sec;
+    const struct output_section *out;
+
+    obj = &array_get(&link_objects, o);
+    target = &obj->shdr[shdr->sh_info];
+    sec = &array_get(&input_sections, obj->first_section + shdr->sh_info);
+    out = &array_get(&output_sections, sec->output);
+    offset = out->offset + sec->offset;
+    address = out->address + sec->offset;
+    rela = (const Elf64_Rela *) (obj->data + shdr->sh_offset);
+    n = shdr->sh_size / sizeof(*rela);
+    for (j = 0; j < n; ++j) {
+        type = ELF64_R_TYPE(rela[j].r_info);
+        sym = ELF64_R_SYM(rela[j].r_info);
+        switch (type) {
+        case R_X86_64_NONE:
+            continue;
+        case R_X86_64_64:
+        case R_X86_64_PC64:
+        case R_X86_64_TPOFF64:
+        case R_X86_64_DTPOFF64:
+            size = 8;
+            break;
+        default:
+            size = 4;
+            break;
+        }
+
+        if (rela[j].r_offset > target->sh_size
+            || size > target->sh_size - rela[j].r_offset)
+        {
+            link_error("%s: Relocation offset out of range.", obj->name);
+            continue;
+        }
+
+        ptr = image + offset + rela[j].r_offset;
+        P = address + rela[j].r_offset;
+        A = rela[j].r_addend;
+        S = target_address(o, sym);
+        slots = slots_of(o, sym);
+        switch (type) {
+        case R_X86_64_64:
+            write_word(ptr, S + A, 8);
+            break;
+        case R_X86_64_PC64:
+            write_word(ptr, S + A - P, 8);
+            break;
+        case R_X86_64_PC32:
+        case R_X86_64_PLT32:
+            write_signed(obj, ptr, S + A - P, type);
+            break;
+        case R_X86_64_32:
+            if (S + A > 0xFFFFFFFFul) {
+                link_error("%s: Relocation type %d out of range.",
+                    obj->name, type);
+            }
+            write_word(ptr, S + A, 4);
+            break;
+        case R_X86_64_32S:
+            write_signed(obj, ptr, S + A, type);
+            break;
+        case R_X86_64_GOTPCREL:
+        case R_X86_64_GOTPCRELX:
+        case R_X86_64_REX_GOTPCRELX:
+            G = got_entry(image, slots->got, S);
+            write_signed(obj, ptr, G + A - P, type);
+            break;
+        case R_X86_64_GOTTPOFF:
+            G = got_entry(image, slots->tls_got, tls_offset(S));
+            write_signed(obj, ptr, G + A - P, type);
+            break;
+        case R_X86_64_TPOFF32:
+            write_signed(obj, ptr, tls_offset(S + A), type);
+            break;
+        case R_X86_64_TPOFF64:
+            write_word(ptr, tls_offset(S + A), 8);
+            break;
+        case R_X86_64_DTPOFF32:
+            write_signed(obj, ptr, S + A - tls_address, type);
+            break;
+        case R_X86_64_DTPOFF64:
+            write_word(ptr, S + A - tls_address, 8);
+            break;
+        }
+    }
+}
+
+/*
+ * Write PLT stubs jumping through GOT entries following the regular
+ * ones, and IRELATIVE relocations for initializing them.
+ */
+static void write_plt(char *image)
+{
+    int i;
+    char *stub;
+    unsigned long slot, address, resolver;
+    Elf64_Rela rela;
+    const struct plt_entry *plt;
+    const struct output_section *out, *iplt;
+
+    out = &array_get(&output_sections, plt_output);
+    iplt = &array_get(&output_sections, iplt_output);
+    for (i = 0; i < array_len(&plt_entries); ++i) {
+        plt = &array_get(&plt_entries, i);
+        resolver = symbol_address(plt->object,
+            &array_get(&link_objects, plt->object).symtab[plt->index]);
+        slot = got_entry(image, got_count + i, resolver);
+        address = out->address + PLT_ENTRY_SIZE * i;
+        stub = image + out->offset + PLT_ENTRY_SIZE * i;
+        memset(stub, 0xCC, PLT_ENTRY_SIZE);
+        stub[0] = (char) 0xFF;
+        stub[1] = 0x25;
+        write_word(stub + 2, slot - (address + 6), 4);
+        rela.r_offset = slot;
+        rela.r_info = ELF64_R_INFO(0, R_X86_64_IRELATIVE);
+        rela.r_addend = resolver;
+        memcpy(image + iplt->offset + i * sizeof(rela), &rela, sizeof(rela));
+    }
+}
+
+static void write_headers(char *image, unsigned long entry)
+{
+    int i;
+    Elf64_Ehdr *hdr;
+    Elf64_Phdr *phdr;
+    const struct output_section *out;
+
+    hdr = (Elf64_Ehdr *) image;
+    memcpy(hdr->e_ident, "\x7f" "ELF", 4);
+    hdr->e_ident[4] = ELFCLASS64;
+    hdr->e_ident[5] = ELFDATA2LSB;
+    hdr->e_ident[6] = EV_CURRENT;
+    hdr->e_ident[7] = ELFOSABI_SYSV;
+    hdr->e_type = ET_EXEC;
+    hdr->e_machine = EM_X86_64;
+    hdr->e_version = 1;
+    hdr->e_entry = entry;
+    hdr->e_phoff = sizeof(*hdr);
+    hdr->e_ehsize = sizeof(*hdr);
+    hdr->e_phentsize = sizeof(*phdr);
+    hdr->e_phnum = program_header_count();
+    hdr->e_shentsize = sizeof(Elf64_Shdr);
+
+    phdr = (Elf64_Phdr *) (image + hdr->e_phoff);
+    for (i = 0; i < 3; ++i) {
+        phdr[i].p_type = PT_LOAD;
+        phdr[i].p_flags = PF_R | (i == 0 ? PF_X : i == 2 ? PF_W : 0);
+        phdr[i].p_offset = segments[i].offset;
+        phdr[i].p_vaddr = segments[i].address;
+        phdr[i].p_paddr = segments[i].address;
+        phdr[i].p_filesz = segments[i].filesz;
+        phdr[i].p_memsz = segments[i].memsz;
+        phdr[i].p_align = LINK_PAGE_SIZE;
+    }
+
+    if (has_tls()) {
+        for (i = 0; i < array_len(&output_order); ++i) {
+            out = &array_get(&output_sections, array_get(&output_order, i));
+            if (out->flags & SHF_TLS)
+                break;
+        }
+
+        phdr[3].p_type = PT_TLS;
+        phdr[3].p_flags = PF_R;
+        phdr[3].p_offset = out->offset;
+        phdr[3].p_vaddr = tls_address;
+        phdr[3].p_paddr = tls_address;
+        phdr[3].p_filesz = tls_filesz;
+        phdr[3].p_memsz = tls_memsz;
+        phdr[3].p_align = tls_align;
+        phdr++;
+    }
+
+    phdr[3].p_type = PT_GNU_STACK;
+    phdr[3].p_flags = PF_R | PF_W;
+    phdr[3].p_align = 16;
+}
+
+/*
+ * Append section headers after segment data, with names in .shstrtab.
+ * Return total size of file.
+ */
+static size_t write_section_headers(char **image, size_t size)
+{
+    int i, n;
+    size_t names;
+    Elf64_Ehdr *hdr;
+    Elf64_Shdr *shdr;
+    const struct output_section *out;
+
+    names = 1 + strlen(".shstrtab") + 1;
+    for (i = 0, n = 2; i < array_len(&output_order); ++i) {
+        out = &array_get(&output_sections, array_get(&output_order, i));
+        if (out->size) {
+            names += strlen(out->name) + 1;
+            n++;
+        }
+    }
+
+    *image = realloc(*image, align_to(size + names, 8) + n * sizeof(*shdr));
+    memset(*image + size, 0, align_to(size + names, 8) - size);
+    hdr = (Elf64_Ehdr *) *image;
+    hdr->e_shoff = align_to(size + names, 8);
+    hdr->e_shnum = n;
+    hdr->e_shstrndx = n - 1;
+    shdr = (Elf64_Shdr *) (*image + hdr->e_shoff);
+    memset(shdr, 0, n * sizeof(*shdr));
+    names = 1;
+    for (i = 0, n = 1; i < array_len(&output_order); ++i) {
+        out = &array_get(&output_sections, array_get(&output_order, i));
+        if (!out->size)
+            continue;
+
+        shdr[n].sh_name = names;
+        shdr[n].sh_type = out->type;
+        shdr[n].sh_flags = out->flags;
+        shdr[n].sh_addr = out->address;
+        shdr[n].sh_offset = out->offset;
+        shdr[n].sh_size = out->size;
+        shdr[n].sh_addralign = out->align;
+        if (out->type == SHT_RELA) {
+            shdr[n].sh_entsize = sizeof(Elf64_Rela);
+        }
+
+        strcpy(*image + size + names, out->name);
+        names += strlen(out->name) + 1;
+        n++;
+    }
+
+    shdr[n].sh_name = names;
+    shdr[n].sh_type = SHT_STRTAB;
+    shdr[n].sh_offset = size;
+    shdr[n].sh_size = names + strlen(".shstrtab") + 1;
+    shdr[n].sh_addralign = 1;
+    strcpy(*image + size + names, ".shstrtab");
+    return hdr->e_shoff + (n + 1) * sizeof(*shdr);
+}
+
+static int write_executable(const char *path, const char *image, size_t size)
+{
+    int fd;
+    ssize_t n;
+    struct stat st;
+
+    if (!stat(path, &st) && S_ISREG(st.st_mode)) {
+        unlink(path);
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (fd == -1) {
+        return link_error("Could not open output file '%s'.", path);
+    }
+
+    while (size) {
+        n = write(fd, image, size);
+        if (n <= 0) {
+            close(fd);
+            return link_error("Failed writing output file '%s'.", path);
+        }
+
+        image += n;
+        size -= n;
+    }
+
+    close(fd);
+    return 0;
+}
+
+/*
+ * Check that all strongly referenced symbols are defined. The address
+ * of __dso_handle identifies the executable for atexit handlers, and
+ * is normally defined by crtbegin.o.
+ */
+static void check_undefined(void)
+{
+    int i;
+    unsigned long address;
+    struct link_symbol *sym;
+
+    i = find_global("__dso_handle");
+    if (i != -1) {
+        sym = &array_get(&link_symbols, i);
+        if (sym->object == -1 && !sym->common_size) {
+            sym->common_size = 8;
+            sym->common_align = 8;
+        }
+    }
+
+    for (i = 0; i < array_len(&link_symbols); ++i) {
+        sym = &array_get(&link_symbols, i);
+        if (sym->object == -1
+            && !sym->common_size
+            && sym->referenced_by != -1
+            && !synthetic_symbol(sym->name, &address))
+        {
+            link_error("Undefined symbol '%s', referenced in %s.", sym->name,
+                array_get(&link_objects, sym->referenced_by).name);
+        }
+    }
+}
+
+static char *read_input(const char *path, size_t *size)
+{
+    FILE *f;
+    long n;
+    char *data;
+
+    f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+
+    data = NULL;
+    if (!fseek(f, 0, SEEK_END) && (n = ftell(f)) >= 0) {
+        rewind(f);
+        data = malloc(n + 1);
+        *size = fread(data, 1, n, f);
+        if (*size != n) {
+            free(data);
+            data = NULL;
+        } else {
+            data[n] = '\0';
+        }
+    }
+
+    fclose(f);
+    return data;
+}
+
+/*
+ * Libraries can be linker scripts referring to other files, like libm.a
+ * in glibc. Only file names listed in GROUP and INPUT commands are
+ * considered, and other commands are ignored.
+ */
+static int add_script(const char *name, char *text)
+{
+    int depth, is_input;
+    char *end;
+
+    depth = 0;
+    is_input = 0;
+    while (*text && !link_errors) {
+        if (isspace((unsigned char) *text) || *text == ',') {
+            text++;
+        } else if (text[0] == '/' && text[1] == '*') {
+            end = strstr(text + 2, "*/");
+            text = end ? end + 2 : text + strlen(text);
+        } else if (*text == '(') {
+            depth++;
+            text++;
+        } else if (*text == ')') {
+            if (--depth == 0) {
+                is_input = 0;
+            }
+            text++;
+        } else {
+            end = text;
+            while (*end && !isspace((unsigned char) *end)
+                && *end != '(' && *end != ')' && *end != ',')
+            {
+                end++;
+            }
+
+            if (*end) {
+                *end++ = '\0';
+            }
+
+            if (depth == 0) {
+                is_input = !strcmp(text, "GROUP") || !strcmp(text, "INPUT");
+            } else if (is_input && strcmp(text, "AS_NEEDED")) {
+                if (*text == '-') {
+                    link_error("%s: Unsupported linker script input %s.",
+                        name, text);
+                } else {
+                    link_add_file(text);
+                }
+            }
+
+            text = end;
+        }
+    }
+
+    return link_errors;
+}
+
+INTERNAL int link_add_object(const char *name, char *data, size_t size)
+{
+    char *str;
+
+    str = malloc(strlen(name) + 1);
+    strcpy(str, name);
+    return add_object(str, data, size);
+}
+
+INTERNAL int link_add_file(const char *path)
+{
+    int ret;
+    size_t size;
+    char *name, *data;
+
+    data = read_input(path, &size);
+    if (!data) {
+        return link_error("Could not read linker input '%s'.", path);
+    }
+
+    name = malloc(strlen(path) + 1);
+    strcpy(name, path);
+    if (size >= 8 && !memcmp(data, "!<arch>\n", 8)) {
+        if (add_archive(name, data, size))
+            return 1;
+        extract_members();
+        return link_errors;
+    }
+
+    if (size >= 4 && memcmp(data, "\x7f" "ELF", 4)
+        && !memchr(data, '\0', size))
+    {
+        ret = add_script(name, data);
+        free(name);
+        free(data);
+        return ret;
+    }
+
+    return add_object(name, data, size);
+}
+
+INTERNAL int link_executable(const char *path)
+{
+    int i, j, entry;
+    char *image;
+    size_t size;
+    const Elf64_Shdr *shdr;
+    const struct link_object *obj;
+
+    extract_members();
+    plt_output = add_output(".plt", SHT_PROGBITS,
+        SHF_ALLOC | SHF_EXECINSTR, 16);
+    got_output = add_output(".got", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8);
+    iplt_output = add_output(".rela.iplt", SHT_RELA, SHF_ALLOC, 8);
+    bss_output = add_output(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 1);
+    check_undefined();
+    entry = find_global("_start");
+    if (entry == -1 || array_get(&link_symbols, entry).object == -1) {
+        link_error("Undefined entry point '_start'.");
+    }
+
+    if (!link_errors) {
+        scan_relocations();
+    }
+
+    if (link_errors)
+        return 1;
+
+    layout();
+    assign_addresses();
+    size = segments[2].offset + segments[2].filesz;
+    image = calloc(1, size);
+    for (i = 0; i < array_len(&link_objects); ++i) {
+        obj = &array_get(&link_objects, i);
+        for (j = 0; j < obj->shnum; ++j) {
+            shdr = &obj->shdr[j];
+            if (shdr->sh_type != SHT_NOBITS
+                && array_get(&input_sections, obj->first_section + j)
+                    .output != -1)
+            {
+                memcpy(image + section_address(i, j) - LINK_BASE_ADDRESS,
+                    obj->data + shdr->sh_offset, shdr->sh_size);
+            }
+        }
+    }
+
+    for (i = 0; i < array_len(&link_objects); ++i) {
+        obj = &array_get(&link_objects, i);
+        for (j = 0; j < obj->shnum; ++j) {
+            shdr = &obj->shdr[j];
+            if (is_relocated(obj, shdr)) {
+                apply_relocations(image, i, shdr);
+            }
+        }
+    }
+
+    write_plt(image);
+    write_headers(image, array_get(&link_symbols, entry).address);
+    size = write_section_headers(&image, size);
+    if (!link_errors) {
+        write_executable(path, image, size);
+        verbose("Linked %d objects, %lu bytes written to %s.",
+            array_len(&link_objects), size, path);
+    }
+
+    free(image);
+    return link_errors != 0;
+}
+
+INTERNAL void link_finalize(void)
+{
+    int i;
+    struct archive *ar;
+
+    for (i = 0; i < array_len(&link_objects); ++i) {
+        free(array_get(&link_objects, i).name);
+        free(array_get(&link_objects, i).data);
+    }
+
+    for (i = 0; i < array_len(&archives); ++i) {
+        ar = &array_get(&archives, i);
+        free(ar->name);
+        free(ar->data);
+        array_clear(&ar->symbols);
+        array_clear(&ar->loaded);
+    }
+
+    array_clear(&link_objects);
+    array_clear(&input_sections);
+    array_clear(&symbol_refs);
+    array_clear(&link_symbols);
+    array_clear(&output_sections);
+    array_clear(&archives);
+    array_clear(&plt_entries);
+    array_clear(&comdat_groups);
+    array_clear(&output_order);
+    array_clear(&discarded);
+    hash_index_destroy(&link_symbol_index);
+    hash_index_destroy(&comdat_index);
+    got_count = 0;
+    link_errors = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stddef.h>
+
+/*
+ * Add relocatable object kept in memory, taking ownership of the data.
+ * Name is used in diagnostics. Return non-zero on error.
+ */
+INTERNAL int link_add_object(const char *name, char *data, size_t size);
+
+/*
+ * Add relocatable object or static library read from path. Members of
+ * libraries are extracted when they define a symbol which is still
+ * undefined, searching all libraries added so far as a group.
+ */
+INTERNAL int link_add_file(const char *path);
+
+/* Write statically linked executable to path. */
+INTERNAL int link_executable(const char *path);
+
+/* Free memory used for linking. */
+INTERNAL void link_finalize(void);
+
+#endif
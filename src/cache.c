@@ -0,0 +1,252 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "cache.h"
+#include <lacc/context.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Changing the compiler output format, or anything else that makes old
+ * results invalid, requires bumping the version.
+ */
+#define CACHE_VERSION "lacc-cache-1"
+
+static char *cache_directory, *cache_path_buffer;
+static int cache_hits, cache_misses;
+
+/*
+ * Counts reported by worker processes, kept apart so that workers
+ * started later do not inherit and report them again.
+ */
+static int worker_hits, worker_misses;
+
+INTERNAL int cache_set_directory(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) && mkdir(path, 0755)) {
+        fprintf(stderr, "Could not create cache directory '%s'.\n", path);
+        return 1;
+    }
+
+    free(cache_directory);
+    cache_directory = malloc(strlen(path) + 1);
+    strcpy(cache_directory, path);
+    cache_path_buffer = realloc(cache_path_buffer, strlen(path) + 64);
+    return 0;
+}
+
+INTERNAL int cache_is_enabled(void)
+{
+    return cache_directory != NULL;
+}
+
+/*
+ * Combine two independent 64 bit hashes, FNV-1a and sdbm, into a 128
+ * bit key.
+ */
+INTERNAL void cache_key_update(void *ptr, const char *str, size_t len)
+{
+    size_t i;
+    unsigned long a, b, c;
+    struct cache_key *key;
+
+    key = (struct cache_key *) ptr;
+    a = key->a;
+    b = key->b;
+    for (i = 0; i < len; ++i) {
+        c = (unsigned char) str[i];
+        a = (a ^ c) * 0x100000001b3ul;
+        b = c + (b << 6) + (b << 16) - b;
+    }
+
+    key->a = a;
+    key->b = b;
+}
+
+INTERNAL void cache_key_init(
+    struct cache_key *key,
+    const char *file,
+    int optimization_level)
+{
+    char buf[128];
+
+    key->a = 0xcbf29ce484222325ul;
+    key->b = 0;
+    sprintf(buf, "%s %d %d %d %d %d %d %d",
+        CACHE_VERSION,
+        context.target == TARGET_ASM,
+        optimization_level,
+        context.pic,
+        context.debug,
+        context.no_common,
+        context.no_sse,
+        context.standard);
+
+    cache_key_update(key, buf, strlen(buf) + 1);
+    if (file) {
+        cache_key_update(key, file, strlen(file) + 1);
+    }
+}
+
+static const char *cache_path(const struct cache_key *key, const char *ext)
+{
+    assert(cache_directory);
+    sprintf(cache_path_buffer, "%s/%016lx%016lx%s",
+        cache_directory, key->a, key->b, ext);
+    return cache_path_buffer;
+}
+
+static int copy_file(const char *source, const char *target)
+{
+    size_t n;
+    char buf[4096];
+    FILE *in, *out;
+
+    in = fopen(source, "rb");
+    if (!in) {
+        return 1;
+    }
+
+    out = fopen(target, "wb");
+    if (!out) {
+        fclose(in);
+        return 1;
+    }
+
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        fwrite(buf, 1, n, out);
+    }
+
+    fclose(in);
+    return fclose(out) != 0;
+}
+
+INTERNAL int cache_fetch(const struct cache_key *key, const char *output)
+{
+    const char *path;
+
+    path = cache_path(key, context.target == TARGET_ASM ? ".s" : ".o");
+    if (!copy_file(path, output)) {
+        verbose("Cache hit for %s.", output);
+        cache_hits++;
+        return 1;
+    }
+
+    verbose("Cache miss for %s.", output);
+    cache_misses++;
+    return 0;
+}
+
+/*
+ * Write to temporary file first, and rename when complete. Concurrent
+ * compilations of the same source will then never see partial results.
+ */
+INTERNAL void cache_store(const struct cache_key *key, const char *output)
+{
+    char *tmp;
+    const char *path;
+
+    path = cache_path(key, ".tmp");
+    tmp = malloc(strlen(path) + 32);
+    sprintf(tmp, "%s.%ld", path, (long) getpid());
+    if (!copy_file(output, tmp)) {
+        path = cache_path(key, context.target == TARGET_ASM ? ".s" : ".o");
+        if (rename(tmp, path)) {
+            unlink(tmp);
+        }
+    } else {
+        unlink(tmp);
+    }
+
+    free(tmp);
+}
+
+INTERNAL void cache_write_counts(int fd)
+{
+    int counts[2];
+
+    counts[0] = cache_hits;
+    counts[1] = cache_misses;
+    if (write(fd, counts, sizeof(counts)) != sizeof(counts)) {
+        verbose("Failed to report cache statistics.");
+    }
+}
+
+INTERNAL void cache_read_counts(int fd)
+{
+    int counts[2];
+
+    if (lseek(fd, 0, SEEK_SET) == 0
+        && read(fd, counts, sizeof(counts)) == sizeof(counts))
+    {
+        worker_hits += counts[0];
+        worker_misses += counts[1];
+    }
+}
+
+/*
+ * Only the parent process updates the statistics file. Worker processes
+ * started with -j report their counts through cache_write_counts, as
+ * concurrent updates would overwrite each other.
+ */
+INTERNAL void cache_finalize(FILE *stream)
+{
+    FILE *f;
+    char *tmp;
+    long total_hits, total_misses;
+
+    if (!cache_directory) {
+        return;
+    }
+
+    total_hits = 0;
+    total_misses = 0;
+    sprintf(cache_path_buffer, "%s/stats", cache_directory);
+    if ((f = fopen(cache_path_buffer, "r")) != NULL) {
+        if (fscanf(f, "hits %ld misses %ld", &total_hits, &total_misses) != 2) {
+            total_hits = 0;
+            total_misses = 0;
+        }
+        fclose(f);
+    }
+
+    cache_hits += worker_hits;
+    cache_misses += worker_misses;
+    total_hits += cache_hits;
+    total_misses += cache_misses;
+    if (cache_hits || cache_misses) {
+        tmp = malloc(strlen(cache_path_buffer) + 32);
+        sprintf(tmp, "%s.%ld", cache_path_buffer, (long) getpid());
+        if ((f = fopen(tmp, "w")) != NULL) {
+            fprintf(f, "hits %ld\nmisses %ld\n", total_hits, total_misses);
+            if (fclose(f) || rename(tmp, cache_path_buffer)) {
+                unlink(tmp);
+            }
+        }
+        free(tmp);
+    }
+
+    if (stream) {
+        fprintf(stream, "cache directory: %s\n", cache_directory);
+        fprintf(stream, "hits: %ld\n", total_hits);
+        fprintf(stream, "misses: %ld\n", total_misses);
+    }
+
+    free(cache_directory);
+    free(cache_path_buffer);
+    cache_directory = NULL;
+    cache_path_buffer = NULL;
+    cache_hits = 0;
+    cache_misses = 0;
+    worker_hits = 0;
+    worker_misses = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Key identifying a compilation result, computed from preprocessed
+ * source text and options affecting code generation.
+ */
+struct cache_key {
+    unsigned long a, b;
+};
+
+/* Set directory to store compilation results, created if missing. */
+INTERNAL int cache_set_directory(const char *path);
+
+/* Whether result caching is enabled. */
+INTERNAL int cache_is_enabled(void);
+
+/*
+ * Initialize key with current compilation options. The input file
+ * name is included, as it is also part of the object file.
+ */
+INTERNAL void cache_key_init(
+    struct cache_key *key,
+    const char *file,
+    int optimization_level);
+
+/* Add data to key, compatible with preprocess_text. */
+INTERNAL void cache_key_update(void *key, const char *str, size_t len);
+
+/*
+ * Copy cached result to output file. Return non-zero on cache hit, or
+ * 0 if not found.
+ */
+INTERNAL int cache_fetch(const struct cache_key *key, const char *output);
+
+/* Store compilation result written to output file. */
+INTERNAL void cache_store(const struct cache_key *key, const char *output);
+
+/*
+ * Write hits and misses counted in a worker process to file descriptor,
+ * to be added to the totals of the parent with cache_read_counts.
+ */
+INTERNAL void cache_write_counts(int fd);
+
+/* Add hits and misses written by a worker process. */
+INTERNAL void cache_read_counts(int fd);
+
+/*
+ * Add hits and misses from this invocation to the statistics kept in
+ * the cache directory. If stream is not NULL, print the totals.
+ */
+INTERNAL void cache_finalize(FILE *stream);
+
+#endif
@@ -4,11 +4,13 @@
 # include "context.c"
 # include "util/argparse.c"
 # include "util/hash.c"
+# include "util/timer.c"
 # include "util/string.c"
 # ifdef x86_64
 #  include "backend/x86_64/encoding.c"
 #  include "backend/x86_64/dwarf.c"
 #  include "backend/x86_64/elf.c"
+#  include "backend/x86_64/link.c"
 #  include "backend/x86_64/abi.c"
 #  include "backend/x86_64/assemble.c"
 #  include "backend/x86_64/assembler.c"
@@ -21,6 +23,9 @@
 # include "backend/linker.c"
 # include "optimizer/transform.c"
 # include "optimizer/liveness.c"
+# include "optimizer/ssa.c"
+# include "optimizer/sccp.c"
+# include "optimizer/numbering.c"
 # include "optimizer/optimize.c"
 # include "preprocessor/tokenize.c"
 # include "preprocessor/strtab.c"
@@ -28,15 +33,19 @@
 # include "preprocessor/directive.c"
 # include "preprocessor/preprocess.c"
 # include "preprocessor/macro.c"
+# include "preprocessor/pch.c"
 # include "parser/typetree.c"
 # include "parser/symtab.c"
 # include "parser/parse.c"
+# include "parser/inline.c"
 # include "parser/statement.c"
 # include "parser/initializer.c"
 # include "parser/expression.c"
 # include "parser/declaration.c"
 # include "parser/eval.c"
 # include "parser/builtin.c"
+# include "cache.c"
+# include "server.c"
 #else
 # define INTERNAL
 # define EXTERNAL extern
@@ -45,20 +54,29 @@
 # include "backend/linker.h"
 # include "optimizer/optimize.h"
 # include "parser/builtin.h"
+# include "parser/inline.h"
 # include "parser/parse.h"
 # include "parser/symtab.h"
 # include "parser/typetree.h"
 # include "preprocessor/preprocess.h"
 # include "preprocessor/input.h"
 # include "preprocessor/macro.h"
+# include "preprocessor/pch.h"
 # include "util/argparse.h"
+# include "cache.h"
+# include "server.h"
 # include <lacc/context.h>
 # include <lacc/ir.h>
+# include <lacc/timer.h>
 #endif
 
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #if !defined(LIB_PATH) || !defined(INCLUDE_PATHS)
@@ -68,6 +86,7 @@
 static enum lang {
     LANG_UNKNOWN,
     LANG_C,
+    LANG_HEADER,
     LANG_ASM
 } source_language;
 
@@ -75,17 +94,46 @@ struct input_file {
     const char *name;
     const char *output_name;
     int is_default_name;
+    int is_temporary;
+    int is_in_memory;
+    int linker_input;
     enum lang language;
 };
 
+/*
+ * Worker process compiling a single input file when running with -j.
+ * Output written to stdout and stderr is captured in temporary files,
+ * and replayed in input order once the job is done.
+ */
+struct job {
+    pid_t pid;
+    int out, err, stats;
+    FILE *trace;
+    int status;
+    int is_done;
+};
+
 static const char *program, *output_name;
-static int optimization_level;
-static int dump_symbols, dump_types;
+
+/*
+ * Write dependencies of each input file in make format, with -MD, or
+ * -MMD to exclude system headers. Add phony targets with -MP.
+ */
+static const char *dependency_file, *dependency_target;
+static int write_dependencies, user_dependencies, phony_dependencies;
+static int optimization_level, jobs, linker_inputs;
+static int dump_symbols, dump_types, cache_stats;
 
 static array_of(struct input_file) input_files;
 static array_of(char *) predefined_macros;
 static array_of(const char *) system_include_paths;
 
+/*
+ * Options affecting preprocessing, which must be the same when using a
+ * precompiled header as when it was created.
+ */
+static array_of(char) signature;
+
 static int help(const char *arg)
 {
     fprintf(
@@ -155,6 +203,8 @@ static int option(const char *arg)
             /* Always slow... */
         } else if (!strcmp("strict-aliasing", arg)) {
             /* We don't consider aliasing. */
+        } else if (!strcmp("time-report", arg)) {
+            timer_enable_report();
         } else assert(0);
     } else if (arg[1] == 'm') {
         arg = arg + 2;
@@ -184,11 +234,10 @@ static int language(const char *arg)
     enum lang lang;
 
     assert(arg);
-    if (!strcmp("c", arg)
-        || !strcmp("c-header", arg)
-        || !strcmp("c-cpp-output", arg))
-    {
+    if (!strcmp("c", arg) || !strcmp("c-cpp-output", arg)) {
         lang = LANG_C;
+    } else if (!strcmp("c-header", arg)) {
+        lang = LANG_HEADER;
     } else if (!strcmp("assembler", arg)) {
         lang = LANG_ASM;
     } else if (!strcmp("none", arg)) {
@@ -202,6 +251,11 @@ static int language(const char *arg)
     return 0;
 }
 
+static int set_time_trace(const char *path)
+{
+    return timer_enable_trace(path);
+}
+
 /* Support -fvisibility, with no effect. */
 static int set_visibility(const char *arg)
 {
@@ -228,8 +282,28 @@ static int set_output_name(const char *file)
     return 0;
 }
 
+static void add_signature(const char *option, const char *value)
+{
+    while (*option) {
+        array_push_back(&signature, *option++);
+    }
+
+    while (*value) {
+        array_push_back(&signature, *value++);
+    }
+
+    array_push_back(&signature, '\n');
+}
+
+static int add_user_include_path(const char *path)
+{
+    add_signature("-I", path);
+    return add_include_search_path(path);
+}
+
 static int add_system_include_path(const char *path)
 {
+    add_signature("-isystem", path);
     array_push_back(&system_include_paths, path);
     return 0;
 }
@@ -283,6 +357,21 @@ static char *change_file_suffix(const char *file, enum target target)
     return name;
 }
 
+/*
+ * Precompiled header is written next to the header, with the suffix
+ * '.pch' appended. This is where it is looked for when the header is
+ * passed with -include.
+ */
+static char *precompiled_header_name(const char *file)
+{
+    char *name;
+
+    name = calloc(strlen(file) + 5, sizeof(*name));
+    strcpy(name, file);
+    strcat(name, ".pch");
+    return name;
+}
+
 static int add_input_file(const char *name)
 {
     char *ptr;
@@ -292,24 +381,112 @@ static int add_input_file(const char *name)
         ptr = strrchr(name, '.');
         if (ptr && (ptr[1] == 'c' || ptr[1] == 'i') && ptr[2] == '\0') {
             file.language = LANG_C;
+        } else if (ptr && ptr[1] == 'h' && ptr[2] == '\0') {
+            file.language = LANG_HEADER;
         }
     }
 
     file.name = name;
-    array_push_back(&input_files, file);
 
     /*
      * Linker argument might not be needed, but make sure order is
-     * preserved.
+     * preserved. Headers are precompiled, and not linked.
      */
-    if (file.language != LANG_UNKNOWN) {
+    if (file.language == LANG_HEADER) {
+        file.linker_input = -1;
+    } else if (file.language != LANG_UNKNOWN) {
         ptr = change_file_suffix(name, TARGET_OBJ);
-        add_linker_arg(ptr);
+        file.linker_input = add_linker_input(ptr);
         free(ptr);
     } else {
-        add_linker_arg(name);
+        file.linker_input = add_linker_input(name);
     }
 
+    array_push_back(&input_files, file);
+    return 0;
+}
+
+/*
+ * Create a new file in TMPDIR, or /tmp if not set, with name ending in
+ * the given suffix. Return open file descriptor, or -1 on failure. Name
+ * of the created file is written to path, which must be freed.
+ */
+static int create_temporary_file(const char *suffix, char **path)
+{
+    static int count;
+    int fd, attempts;
+    const char *dir;
+
+    dir = getenv("TMPDIR");
+    if (!dir || !*dir) {
+        dir = "/tmp";
+    }
+
+    fd = -1;
+    *path = calloc(strlen(dir) + strlen(suffix) + 64, sizeof(**path));
+    for (attempts = 0; attempts < 100; ++attempts) {
+        sprintf(*path, "%s/lacc-%ld-%d%s",
+            dir, (long) getpid(), count++, suffix);
+        fd = open(*path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd != -1) {
+            break;
+        }
+    }
+
+    return fd;
+}
+
+static pid_t temporary_files_owner;
+
+/*
+ * Remove temporary object files. Also called on exit, which happens on
+ * fatal errors before any cleanup is done. Worker processes see the
+ * same files, but leave them for the parent process to remove.
+ */
+static void remove_temporary_files(void)
+{
+    int i;
+    struct input_file *file;
+
+    if (getpid() != temporary_files_owner) {
+        return;
+    }
+
+    for (i = 0; i < array_len(&input_files); ++i) {
+        file = &array_get(&input_files, i);
+        if (file->is_temporary) {
+            unlink(file->output_name);
+            file->is_temporary = 0;
+        }
+    }
+}
+
+/*
+ * Object files compiled only to be linked are written to temporary
+ * files, which are removed after linking.
+ */
+static int set_temporary_output(struct input_file *file)
+{
+    int fd;
+    char *path;
+
+    if (!temporary_files_owner) {
+        temporary_files_owner = getpid();
+        atexit(remove_temporary_files);
+    }
+
+    fd = create_temporary_file(".o", &path);
+    if (fd == -1) {
+        fprintf(stderr, "Could not create temporary file for %s.\n",
+            file->name);
+        free(path);
+        return 1;
+    }
+
+    close(fd);
+    file->output_name = path;
+    file->is_temporary = 1;
+    set_linker_input(file->linker_input, path);
     return 0;
 }
 
@@ -318,6 +495,7 @@ static void clear_input_files(void)
     int i;
     struct input_file *file;
 
+    remove_temporary_files();
     for (i = 0; i < array_len(&input_files); ++i) {
         file = &array_get(&input_files, i);
         if (file->is_default_name) {
@@ -328,6 +506,33 @@ static void clear_input_files(void)
     array_clear(&input_files);
 }
 
+static int set_dependency_option(const char *arg)
+{
+    if (!strcmp("-MD", arg)) {
+        write_dependencies = 1;
+    } else if (!strcmp("-MMD", arg)) {
+        write_dependencies = 1;
+        user_dependencies = 1;
+    } else {
+        assert(!strcmp("-MP", arg));
+        phony_dependencies = 1;
+    }
+
+    return 0;
+}
+
+static int set_dependency_file(const char *path)
+{
+    dependency_file = path;
+    return 0;
+}
+
+static int set_dependency_target(const char *target)
+{
+    dependency_target = target;
+    return 0;
+}
+
 static int set_c_std(const char *std)
 {
     if (!strcmp("c89", std) || !strcmp("gnu89", std)) {
@@ -344,6 +549,21 @@ static int set_c_std(const char *std)
     return 0;
 }
 
+static int set_jobs(const char *arg)
+{
+    char *end;
+    long n;
+
+    n = strtol(arg, &end, 10);
+    if (*end != '\0' || n < 1 || n > 1024) {
+        fprintf(stderr, "Invalid number of jobs '%s'.\n", arg);
+        return 1;
+    }
+
+    jobs = (int) n;
+    return 0;
+}
+
 static int set_optimization_level(const char *level)
 {
     assert(isdigit(level[2]));
@@ -357,6 +577,8 @@ static int long_option(const char *arg)
         dump_symbols = 1;
     } else if (!strcmp("--dump-types", arg)) {
         dump_types = 1;
+    } else if (!strcmp("--cache-stats", arg)) {
+        cache_stats = 1;
     }
 
     return 0;
@@ -470,7 +692,7 @@ static int print_file_name(const char *name)
 
 static int parse_program_arguments(int argc, char *argv[])
 {
-    int i, n, k;
+    int i, n, k, h;
     struct input_file *file;
     struct option optv[] = {
         {"-S", &flag},
@@ -487,6 +709,8 @@ static int parse_program_arguments(int argc, char *argv[])
         {"-f[no-]strict-aliasing", &option},
         {"-f[no-]common", &option},
         {"-fvisibility=", &set_visibility},
+        {"-ftime-report", &option},
+        {"-ftime-trace=", &set_time_trace},
         {"-m[no-]sse", &option},
         {"-m[no-]sse2", &option},
         {"-m[no-]3dnow", &option},
@@ -496,20 +720,26 @@ static int parse_program_arguments(int argc, char *argv[])
         {"--version", &version},
         {"-march=", &set_cpu},
         {"-o:", &set_output_name},
-        {"-I:", &add_include_search_path},
+        {"-I:", &add_user_include_path},
         {"-O{0|1|2|3}", &set_optimization_level},
+        {"-j:", &set_jobs},
         {"-std=", &set_c_std},
         {"-D:", &define_macro},
         {"--dump-symbols", &long_option},
         {"--dump-types", &long_option},
+        {"--cache-dir=", &cache_set_directory},
+        {"--cache-stats", &long_option},
         {"-nostdinc", &option},
         {"-isystem:", &add_system_include_path},
         {"-include:", &add_include_file},
         {"-print-file-name=", &print_file_name},
         {"-pipe", &option},
         {"-pedantic", &option},
-        {"-MD", &option},
-        {"-MP", &option},
+        {"-MD", &set_dependency_option},
+        {"-MMD", &set_dependency_option},
+        {"-MP", &set_dependency_option},
+        {"-MF:", &set_dependency_file},
+        {"-MT:", &set_dependency_target},
         {"-Wl,", &add_linker_flag},
         {"-rdynamic", &add_linker_flag},
         {"-shared", &add_linker_arg},
@@ -518,6 +748,7 @@ static int parse_program_arguments(int argc, char *argv[])
         {"-f[no-]PIE", &add_linker_arg},
         {"-l:", &add_linker_library},
         {"-L:", &add_linker_path},
+        {"-fuse-ld=", &set_linker},
         {NULL, &add_input_file}
     };
 
@@ -530,9 +761,15 @@ static int parse_program_arguments(int argc, char *argv[])
         return i;
     }
 
-    for (i = 0, k = 0; i < array_len(&input_files); ++i) {
+    for (i = 0, k = 0, h = 0; i < array_len(&input_files); ++i) {
         file = &array_get(&input_files, i);
-        if (file->language == LANG_UNKNOWN) {
+        if (file->language == LANG_HEADER) {
+            if (context.target == TARGET_PREPROCESS) {
+                file->language = LANG_C;
+            } else {
+                h++;
+            }
+        } else if (file->language == LANG_UNKNOWN) {
             switch (context.target) {
             case TARGET_PREPROCESS:
                 file->language = LANG_C;
@@ -550,12 +787,22 @@ static int parse_program_arguments(int argc, char *argv[])
     }
 
     n = array_len(&input_files);
+    if (n == 0 && k == 0 && cache_stats) {
+        return -1;
+    }
+
     if (n == 0 && (k == 0 || context.target != TARGET_EXE)) {
         fprintf(stderr, "%s\n", "No input files.");
         return 1;
     }
 
-    if (output_name && context.target != TARGET_EXE) {
+    linker_inputs = n - h + k;
+    if (dependency_file && n > 1 && write_dependencies) {
+        fprintf(stderr, "%s\n", "Cannot set -MF with multiple inputs.");
+        return 1;
+    }
+
+    if (output_name && (context.target != TARGET_EXE || !linker_inputs)) {
         if (n > 1) {
             fprintf(stderr, "%s\n", "Cannot set -o with multiple inputs.");
             return 1;
@@ -566,13 +813,45 @@ static int parse_program_arguments(int argc, char *argv[])
         file->output_name = output_name;
     } else for (i = 0; i < n; ++i) {
         file = &array_get(&input_files, i);
-        file->output_name = change_file_suffix(file->name, context.target);
         file->is_default_name = 1;
+        if (file->language == LANG_HEADER) {
+            file->output_name = precompiled_header_name(file->name);
+        } else if (context.target == TARGET_EXE) {
+            if (is_builtin_linker()
+                && !cache_is_enabled()
+                && (jobs < 2 || n == 1))
+            {
+                file->is_in_memory = 1;
+            } else if (set_temporary_output(file)) {
+                return 1;
+            }
+        } else {
+            file->output_name =
+                change_file_suffix(file->name, context.target);
+        }
     }
 
     return 0;
 }
 
+static void build_signature(void)
+{
+    int i;
+    char buf[16];
+
+    sprintf(buf, "%d", (int) context.standard);
+    add_signature("-std=", buf);
+    if (context.nostdinc) {
+        add_signature("-nostdinc", "");
+    }
+
+    for (i = 0; i < array_len(&predefined_macros); ++i) {
+        add_signature("", array_get(&predefined_macros, i));
+    }
+
+    array_push_back(&signature, '\0');
+}
+
 static void register_argument_definitions(void)
 {
     int i;
@@ -597,28 +876,159 @@ static void add_include_search_paths(void)
 
     if (!context.nostdinc) {
         for (i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
-            add_include_search_path(paths[i]);
+            add_system_search_path(paths[i]);
         }
     }
 
     for (i = 0; i < array_len(&system_include_paths); ++i) {
         path = array_get(&system_include_paths, i);
-        add_include_search_path(path);
+        add_system_search_path(path);
     }
 
     array_clear(&system_include_paths);
 }
 
-static int process_file(struct input_file file)
+/*
+ * Optimize and generate code for a definition. Parsing started at the
+ * given time, recorded in trace output together with the other phases.
+ */
+static void compile_definition(FILE *output, struct definition *def, long start)
 {
-    FILE *output;
-    struct definition *def;
-    const struct symbol *sym;
+    long time;
+    const char *name;
+
+    name = sym_name(def->symbol);
+    timer_trace("parse", name, start);
+    time = timer_clock();
+    timer_push(TIMER_OPTIMIZE);
+    optimize(def);
+    timer_pop();
+    timer_trace("optimize", name, time);
+    time = timer_clock();
+    timer_push(TIMER_SELECT);
+    compile(def);
+    timer_pop();
+    timer_trace("compile", name, time);
+    if (context.target == TARGET_IR_DOT) {
+        dotgen(output, def);
+    }
+
+    timer_trace(name, NULL, start);
+}
 
+static void begin_input_file(struct input_file file)
+{
     preprocess_reset();
     set_input_file(file.name);
     register_builtin_definitions(context.standard);
     register_argument_definitions();
+}
+
+/*
+ * Use precompiled header in place of the first -include file, if one
+ * exists and is up to date. This skips preprocessing of the header,
+ * but its tokens are still parsed.
+ */
+static void load_precompiled_header(void)
+{
+    char *path;
+    const char *header;
+
+    header = prefix_header();
+    if (header) {
+        path = precompiled_header_name(header);
+        if (!pch_load(path, signature.data)) {
+            verbose("Using precompiled header %s.", path);
+            skip_prefix_header();
+        }
+
+        free(path);
+    }
+}
+
+/*
+ * Preprocess header, recording all macro definitions and tokens, and
+ * write the result to output file.
+ */
+static int precompile_file(struct input_file file)
+{
+    FILE *output;
+
+    timer_push(TIMER_PREPROCESS);
+    begin_input_file(file);
+    pch_begin();
+    while (peek() != END) {
+        next();
+    }
+
+    timer_pop();
+    if (!context.errors) {
+        output = fopen(file.output_name, "wb");
+        if (!output) {
+            fprintf(stderr, "Could not open output file '%s'.\n",
+                file.output_name);
+            return 1;
+        }
+
+        if (pch_write(output, signature.data)) {
+            context.errors++;
+        }
+
+        if (fclose(output) || context.errors) {
+            remove(file.output_name);
+            return 1;
+        }
+    }
+
+    return context.errors;
+}
+
+/*
+ * Look up result of compiling input file in cache directory, using
+ * hash of the preprocessed source as key. Return non-zero and copy the
+ * result to output on cache hit.
+ */
+static int fetch_cached_result(struct input_file file, struct cache_key *key)
+{
+    timer_push(TIMER_PREPROCESS);
+    begin_input_file(file);
+    cache_key_init(key, file.name, optimization_level);
+    preprocess_text(&cache_key_update, key);
+    timer_pop();
+    return !context.errors && cache_fetch(key, file.output_name);
+}
+
+static int compile_file(struct input_file file)
+{
+    int is_cached;
+    long start, time;
+    char *data;
+    size_t size;
+    FILE *output;
+    struct definition *def;
+    const struct symbol *sym;
+    struct cache_key key;
+
+    start = timer_clock();
+    is_cached = cache_is_enabled()
+        && file.output_name
+        && context.target != TARGET_PREPROCESS
+        && context.target != TARGET_IR_DOT;
+
+    if (is_cached) {
+        if (fetch_cached_result(file, &key)) {
+            timer_trace(file.name, "cached", start);
+            return 0;
+        } else if (context.errors) {
+            return context.errors;
+        }
+    }
+
+    begin_input_file(file);
+    if (context.target != TARGET_PREPROCESS) {
+        load_precompiled_header();
+    }
+
     if (file.output_name) {
         output = fopen(file.output_name, "w");
         if (!output) {
@@ -626,54 +1036,395 @@ static int process_file(struct input_file file)
                 file.output_name);
             return 1;
         }
+    } else if (file.is_in_memory) {
+        output = NULL;
     } else {
         output = stdout;
     }
 
     if (context.target == TARGET_PREPROCESS) {
+        timer_push(TIMER_PREPROCESS);
         preprocess(output);
+        timer_pop();
     } else {
         set_compile_target(output, file.name);
         register_builtins();
         push_optimization(optimization_level);
+        push_inlining(
+            context.target == TARGET_IR_DOT ? 0 : optimization_level);
+
+        while (1) {
+            time = timer_clock();
+            timer_push(TIMER_PARSE);
+            def = parse();
+            timer_pop();
+            if (!def) {
+                break;
+            }
 
-        while ((def = parse()) != NULL) {
             if (context.errors) {
                 error("Aborting because of previous %s.",
                     (context.errors > 1) ? "errors" : "error");
                 break;
             }
 
-            optimize(def);
-            compile(def);
-            if (context.target == TARGET_IR_DOT) {
-                dotgen(output, def);
-            }
+            compile_definition(output, def, time);
         }
 
+        timer_push(TIMER_SELECT);
         while ((sym = yield_declaration(&ns_ident)) != NULL) {
             declare(sym);
         }
 
+        timer_pop();
         if (dump_symbols) {
             output_symbols(stdout, &ns_ident);
             output_symbols(stdout, &ns_tag);
         }
 
+        time = timer_clock();
+        timer_push(TIMER_FLUSH);
         flush();
+        timer_pop();
+        timer_trace("flush", NULL, time);
         pop_optimization();
+        pop_inlining();
         clear_types(dump_types ? stdout : NULL);
         symtab_clear();
     }
 
-    if (output != stdout) {
+    if (output && output != stdout) {
         fclose(output);
     }
 
+    if (file.is_in_memory && !context.errors) {
+        size = take_object_file(&data);
+        set_linker_object(file.linker_input, data, size);
+    }
+
+    if (is_cached && !context.errors) {
+        cache_store(&key, file.output_name);
+    }
+
+    timer_trace(file.name ? file.name : "<stdin>", NULL, start);
+    timer_report(stderr, file.name);
     return context.errors;
 }
 
-int main(int argc, char *argv[])
+/*
+ * Copy path with suffix replaced, or added if there is none. Directory
+ * is kept, unlike change_file_suffix.
+ */
+static char *replace_file_suffix(const char *path, const char *suffix)
+{
+    char *name;
+    const char *slash, *dot;
+    size_t len;
+
+    slash = strrchr(path, '/');
+    dot = strrchr(path, '.');
+    if (!dot || (slash && dot < slash)) {
+        dot = path + strlen(path);
+    }
+
+    len = dot - path;
+    name = calloc(len + strlen(suffix) + 1, sizeof(*name));
+    strncpy(name, path, len);
+    strcpy(name + len, suffix);
+    return name;
+}
+
+/* Escape characters that are special to make in target and file names. */
+static void write_make_path(FILE *stream, const char *path)
+{
+    for (; *path; ++path) {
+        if (*path == ' ' || *path == '#') {
+            fputc('\\', stream);
+        } else if (*path == '$') {
+            fputc('$', stream);
+        }
+        fputc(*path, stream);
+    }
+}
+
+/*
+ * Write make rule with the object file as target, depending on every
+ * file read when compiling it. The file is named from -MF, or from the
+ * output file when given with -o, or else from the input file.
+ */
+static int write_dependency_file(struct input_file file)
+{
+    int i, k, n, is_system;
+    FILE *stream;
+    char *name, *target;
+    const char *path, *input;
+
+    input = file.name ? file.name : "-";
+    if (dependency_target) {
+        target = NULL;
+    } else if (file.output_name
+        && !file.is_temporary
+        && context.target != TARGET_PREPROCESS)
+    {
+        target = NULL;
+    } else {
+        target = change_file_suffix(input, TARGET_OBJ);
+    }
+
+    if (dependency_file) {
+        name = NULL;
+    } else if (file.output_name
+        && !file.is_default_name
+        && context.target != TARGET_PREPROCESS)
+    {
+        name = replace_file_suffix(file.output_name, ".d");
+    } else {
+        path = strrchr(input, '/');
+        name = replace_file_suffix(path ? path + 1 : input, ".d");
+    }
+
+    stream = fopen(name ? name : dependency_file, "w");
+    if (!stream) {
+        fprintf(stderr, "Could not open dependency file '%s'.\n",
+            name ? name : dependency_file);
+        free(name);
+        free(target);
+        return 1;
+    }
+
+    if (dependency_target) {
+        fputs(dependency_target, stream);
+    } else {
+        write_make_path(stream, target ? target : file.output_name);
+    }
+
+    fputc(':', stream);
+    n = input_dependency_count();
+    for (i = 0, k = 0; i < n; ++i) {
+        path = input_dependency(i, &is_system);
+        if (!is_system || !user_dependencies) {
+            fputs(k++ ? " \\\n  " : " ", stream);
+            write_make_path(stream, path);
+        }
+    }
+
+    fputc('\n', stream);
+    if (phony_dependencies) {
+        for (i = 0; i < n; ++i) {
+            path = input_dependency(i, &is_system);
+            if ((!is_system || !user_dependencies)
+                && (!file.name || strcmp(path, file.name)))
+            {
+                fputc('\n', stream);
+                write_make_path(stream, path);
+                fputs(":\n", stream);
+            }
+        }
+    }
+
+    free(name);
+    free(target);
+    return fclose(stream) != 0;
+}
+
+static int process_file(struct input_file file)
+{
+    int ret;
+
+    if (file.language == LANG_HEADER) {
+        ret = precompile_file(file);
+    } else {
+        ret = compile_file(file);
+    }
+
+    if (!ret && write_dependencies) {
+        ret = write_dependency_file(file);
+    }
+
+    return ret;
+}
+
+/*
+ * Create an anonymous temporary file for capturing output of a worker
+ * process. The file is unlinked immediately, leaving only the open file
+ * descriptor.
+ */
+static int create_capture_file(void)
+{
+    int fd;
+    char *path;
+
+    fd = create_temporary_file("", &path);
+    if (fd != -1) {
+        unlink(path);
+    }
+
+    free(path);
+    return fd;
+}
+
+/*
+ * Copy captured output to stream, and close the file descriptor.
+ */
+static void replay_capture_file(int fd, FILE *stream)
+{
+    char buf[4096];
+    ssize_t n;
+
+    if (lseek(fd, 0, SEEK_SET) == 0) {
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            fwrite(buf, sizeof(char), n, stream);
+        }
+    }
+
+    fflush(stream);
+    close(fd);
+}
+
+/*
+ * Start worker process compiling a file, with output captured to be
+ * replayed later. Trace events are written to a separate file, and
+ * shown as a thread with the given id when merged.
+ */
+static int start_job(struct job *job, struct input_file file, int id)
+{
+    int ret;
+
+    job->out = create_capture_file();
+    job->err = create_capture_file();
+    job->stats = cache_is_enabled() ? create_capture_file() : -1;
+    job->trace = timer_is_tracing() ? tmpfile() : NULL;
+    if (job->out == -1
+        || job->err == -1
+        || (cache_is_enabled() && job->stats == -1)
+        || (timer_is_tracing() && !job->trace))
+    {
+        fprintf(stderr, "%s\n", "Failed to create temporary file.");
+        goto fail;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    switch ((job->pid = fork())) {
+    case 0:
+        dup2(job->out, STDOUT_FILENO);
+        dup2(job->err, STDERR_FILENO);
+        if (job->trace) {
+            timer_trace_worker(job->trace, id);
+        }
+
+        ret = process_file(file);
+        if (job->stats != -1) {
+            cache_write_counts(job->stats);
+        }
+
+        timer_finalize();
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ret != 0);
+    case -1:
+        fprintf(stderr, "%s\n", "Failed to start worker process.");
+        goto fail;
+    default:
+        return 0;
+    }
+
+fail:
+    if (job->out != -1) {
+        close(job->out);
+    }
+
+    if (job->err != -1) {
+        close(job->err);
+    }
+
+    if (job->stats != -1) {
+        close(job->stats);
+    }
+
+    if (job->trace) {
+        fclose(job->trace);
+    }
+
+    return 1;
+}
+
+/*
+ * Compile input files in parallel, running at most the given number of
+ * worker processes at a time. Each translation unit is independent, so
+ * the only shared resource is the terminal. Output is replayed in the
+ * same order as the files were given, matching sequential compilation.
+ *
+ * No new jobs are started after one fails.
+ */
+static int process_files_parallel(int limit)
+{
+    int i, n, ret, status, next, running, reported;
+    pid_t pid;
+    struct job *job, *list;
+    struct input_file file;
+
+    n = array_len(&input_files);
+    list = calloc(n, sizeof(*list));
+    ret = 0;
+    next = 0;
+    running = 0;
+    reported = 0;
+
+    while (reported < next || (next < n && !ret)) {
+        while (!ret && next < n && running < limit) {
+            file = array_get(&input_files, next);
+            if (start_job(&list[next], file, next + 2)) {
+                ret = 1;
+                break;
+            }
+
+            next++;
+            running++;
+        }
+
+        if (running) {
+            pid = wait(&status);
+            if (pid == -1) {
+                break;
+            }
+
+            for (i = 0; i < next; ++i) {
+                job = &list[i];
+                if (job->pid == pid) {
+                    job->is_done = 1;
+                    job->status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+                    running--;
+                    break;
+                }
+            }
+        }
+
+        while (reported < next && list[reported].is_done) {
+            job = &list[reported++];
+            replay_capture_file(job->out, stdout);
+            replay_capture_file(job->err, stderr);
+            if (job->stats != -1) {
+                cache_read_counts(job->stats);
+                close(job->stats);
+            }
+
+            if (job->trace) {
+                timer_merge_trace(job->trace);
+                fclose(job->trace);
+            }
+
+            if (job->status && !ret) {
+                ret = job->status;
+            }
+        }
+    }
+
+    free(list);
+    return ret;
+}
+
+static int run(int argc, char *argv[])
 {
     int i, ret;
     struct input_file file;
@@ -682,24 +1433,60 @@ int main(int argc, char *argv[])
         goto end;
     }
 
+    build_signature();
     add_include_search_paths();
-    for (i = 0, ret = 0; i < array_len(&input_files); ++i) {
+    if (jobs > 1 && array_len(&input_files) > 1) {
+        if ((ret = process_files_parallel(jobs)) != 0) {
+            goto end;
+        }
+    } else for (i = 0, ret = 0; i < array_len(&input_files); ++i) {
         file = array_get(&input_files, i);
         if ((ret = process_file(file)) != 0) {
             goto end;
         }
     }
 
-    if (context.target == TARGET_EXE) {
+    if (context.target == TARGET_EXE && linker_inputs) {
         ret = invoke_linker();
     }
 
 end:
+    cache_finalize(cache_stats ? stdout : NULL);
+    timer_finalize();
     finalize();
     parse_finalize();
     preprocess_finalize();
     clear_predefined_macros();
     clear_input_files();
+    pch_finalize();
+    array_clear(&signature);
     clear_linker_args();
     return ret < 0 ? 0 : ret;
 }
+
+/*
+ * Start compile server with --server <socket>, or forward compilation
+ * to a running server with --client <socket>. These must be the first
+ * arguments. Compile locally if the server is not available.
+ */
+int main(int argc, char *argv[])
+{
+    int ret;
+    const char *path;
+
+    if (argc > 2 && !strcmp("--server", argv[1])) {
+        return serve(argv[2], &run);
+    }
+
+    if (argc > 2 && !strcmp("--client", argv[1])) {
+        path = argv[2];
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+        if ((ret = connect_server(path, argc, argv)) != -1) {
+            return ret;
+        }
+    }
+
+    return run(argc, argv);
+}
@@ -6,10 +6,62 @@
 #include "optimize.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
 
 /*
- * Set bit for symbol definitely written through operation. Unless used
- * in right hand side expression, this can be removed from in-liveness.
+ * Liveness is represented as bitsets with one bit per symbol, where
+ * symbol index n maps to bit n - 1. All sets have the same number of
+ * words, depending on how many symbols are used in the function.
+ */
+static int words;
+
+/* Storage for in and out sets of each block, and a working set. */
+static unsigned long *block_sets, *live;
+static size_t block_sets_capacity;
+
+static void set_bit(unsigned long *set, int index)
+{
+    assert(index > 0);
+    index -= 1;
+    set[index / WORD_BITS] |= 1ul << (index % WORD_BITS);
+}
+
+static void clear_bit(unsigned long *set, int index)
+{
+    assert(index > 0);
+    index -= 1;
+    set[index / WORD_BITS] &= ~(1ul << (index % WORD_BITS));
+}
+
+static int test_bit(const unsigned long *set, int index)
+{
+    assert(index > 0);
+    index -= 1;
+    return (set[index / WORD_BITS] & (1ul << (index % WORD_BITS))) != 0;
+}
+
+static void set_all(unsigned long *set)
+{
+    memset(set, 0xFF, words * sizeof(*set));
+}
+
+static void set_union(unsigned long *set, const unsigned long *other)
+{
+    int i;
+
+    for (i = 0; i < words; ++i) {
+        set[i] |= other[i];
+    }
+}
+
+/*
+ * Get index of symbol definitely written through operation. Unless
+ * used in right hand side expression, this can be removed from
+ * in-liveness.
  *
  * Only safe to say object is written when the whole object is actually
  * overwritten. Consider only basic integral types.
@@ -17,12 +69,12 @@
  * Pointers can point to anything, so we cannot say for sure what is
  * written.
  */
-static unsigned long set_def_bit(struct var var)
+static int def_index(struct var var)
 {
     switch (var.kind) {
     case DIRECT:
-        if (is_scalar(var.value.symbol->type) && var.value.symbol->index) {
-            return 1ul << (var.value.symbol->index - 1);
+        if (is_scalar(var_symbol(var)->type)) {
+            return var_symbol(var)->index;
         }
     default:
         return 0;
@@ -35,48 +87,41 @@ static unsigned long set_def_bit(struct var var)
  *
  * Pointers can point to anything, so assume everything is touched.
  */
-static unsigned long set_use_bit(struct var var)
+static void set_use_bit(unsigned long *set, struct var var)
 {
     switch (var.kind) {
     case DEREF:
-        return 0xFFFFFFFFFFFFFFFFul;
+        set_all(set);
+        break;
     case DIRECT:
     case ADDRESS:
-        if (is_object(var.value.symbol->type)) {
-            assert(var.value.symbol->index);
-            return 1ul << (var.value.symbol->index - 1);
+        if (is_object(var_symbol(var)->type)) {
+            set_bit(set, var_symbol(var)->index);
         }
         break;
     case IMMEDIATE:
         if (var.is_symbol) {
-            assert(var.value.symbol->symtype == SYM_LITERAL
-                || var.value.symbol->symtype == SYM_CONSTANT);
-            assert(var.value.symbol->index);
-            return 1ul << (var.value.symbol->index - 1);
+            assert(var_symbol(var)->symtype == SYM_LITERAL
+                || var_symbol(var)->symtype == SYM_CONSTANT);
+            set_bit(set, var_symbol(var)->index);
         }
         break;
     }
-
-    return 0;
 }
 
-static unsigned long use(const struct expression *expr)
+static void use(unsigned long *set, const struct expression *expr)
 {
-    unsigned long r = 0ul;
-
     switch (expr->op) {
     default:
-        r |= set_use_bit(expr->r);
+        set_use_bit(set, expr->r);
     case IR_OP_CAST:
     case IR_OP_NOT:
     case IR_OP_NEG:
     case IR_OP_CALL:
     case IR_OP_VA_ARG:
-        r |= set_use_bit(expr->l);
+        set_use_bit(set, expr->l);
         break;
     }
-
-    return r;
 }
 
 static int is_or_has_pointer(Type type)
@@ -104,87 +149,148 @@ static int is_or_has_pointer(Type type)
  * Consider special case of sending a pointer into a function. Assume
  * then that anything can be used.
  */
-static unsigned long uses(const struct statement *s)
+static void uses(unsigned long *set, const struct statement *s)
 {
     struct var t;
-    unsigned long r;
 
     assert(s->st != IR_ASM);
-    r = use(&s->expr);
+    use(set, &s->expr);
     switch (s->st) {
     case IR_ASSIGN:
         if (s->t.kind == DEREF && s->t.is_symbol) {
             t = s->t;
             t.kind = DIRECT;
-            r |= set_use_bit(t);
+            set_use_bit(set, t);
         }
         break;
     case IR_PARAM:
         if (is_or_has_pointer(s->expr.type)) {
-            r |= 0xFFFFFFFFFFFFFFFFul;
+            set_all(set);
         }
     default:
         break;
     }
-
-    return r;
 }
 
-static unsigned long defs(const struct statement *s)
+static int defs(const struct statement *s)
 {
     switch (s->st) {
     case IR_ASSIGN:
-        return set_def_bit(s->t);
+        return def_index(s->t);
     case IR_ASM:
         assert(0);
     default:
-        return 0ul;
+        return 0;
     }
 }
 
-INTERNAL int live_variable_analysis(
+INTERNAL void initialize_liveness(
     struct definition *def,
-    struct block *block)
+    struct block **blocks,
+    int count,
+    int symbols)
 {
     int i;
-    unsigned long top;
-    struct statement *prev, *next, *st;
+    size_t size;
+
+    words = (symbols + WORD_BITS - 1) / WORD_BITS;
+    if (!words) {
+        words = 1;
+    }
+
+    size = (2 * count + 1) * words;
+    if (size > block_sets_capacity) {
+        free(block_sets);
+        block_sets = malloc(size * sizeof(*block_sets));
+        block_sets_capacity = size;
+    }
+
+    memset(block_sets, 0, size * sizeof(*block_sets));
+    for (i = 0; i < count; ++i) {
+        blocks[i]->in = block_sets + (2 * i) * words;
+        blocks[i]->out = block_sets + (2 * i + 1) * words;
+    }
+
+    live = block_sets + 2 * count * words;
+    size = array_len(&def->statements) * words;
+    array_realloc(&def->liveness, size);
+    array_len(&def->liveness) = size;
+    array_zero(&def->liveness);
+}
 
-    top = block->in;
+INTERNAL int live_variable_analysis(
+    struct definition *def,
+    struct block *block)
+{
+    int i, d, changed;
+    const struct statement *st;
 
     /* Transfer liveness from children. */
+    memset(block->out, 0, words * sizeof(*block->out));
     if (block->jump[0]) {
-        block->out = block->jump[0]->in;
+        set_union(block->out, block->jump[0]->in);
         if (block->jump[1]) {
-            block->out |= block->jump[1]->in;
+            set_union(block->out, block->jump[1]->in);
         }
-    } else {
-        block->out = 0l;
     }
 
     /* Go through all statements. Extra edge for branch and return. */
-    if (block->count) {
-        i = block->head + block->count - 1;
-        prev = &array_get(&def->statements, i);
-        prev->out = block->out;
-        if (block->jump[1] || block->has_return_value) {
-            prev->out |= use(&block->expr);
-        }
+    memcpy(live, block->out, words * sizeof(*live));
+    if (block->jump[1] || block->has_return_value) {
+        use(live, &block->expr);
+    }
 
-        while (--i >= block->head) {
-            st = &array_get(&def->statements, i);
-            next = prev;
-            prev = st;
-            prev->out = (next->out & ~defs(next)) | uses(next);
+    for (i = block->head + block->count - 1; i >= block->head; --i) {
+        st = &array_get(&def->statements, i);
+        memcpy(&array_get(&def->liveness, i * words), live,
+            words * sizeof(*live));
+        d = defs(st);
+        if (d) {
+            clear_bit(live, d);
         }
+        uses(live, st);
+    }
 
-        block->in = (prev->out & ~defs(prev)) | uses(prev);
-    } else {
-        block->in = block->out;
-        if (block->jump[1] || block->has_return_value) {
-            block->in |= use(&block->expr);
-        }
+    changed = memcmp(block->in, live, words * sizeof(*live)) != 0;
+    if (changed) {
+        memcpy(block->in, live, words * sizeof(*live));
     }
 
-    return top != block->in;
+    return changed;
+}
+
+INTERNAL const unsigned long *live_after(
+    const struct definition *def,
+    int index)
+{
+    assert(index * words < array_len(&def->liveness));
+    return &array_get(&def->liveness, index * words);
+}
+
+INTERNAL int is_live_in(const unsigned long *set, int sym)
+{
+    return test_bit(set, sym);
+}
+
+INTERNAL void erase_liveness(struct definition *def, int index)
+{
+    int len;
+    unsigned long *data;
+
+    len = array_len(&def->liveness);
+    if (index * words < len) {
+        data = &array_get(&def->liveness, 0);
+        memmove(data + index * words, data + (index + 1) * words,
+            (len - (index + 1) * words) * sizeof(*data));
+        array_len(&def->liveness) = len - words;
+    }
+}
+
+INTERNAL void liveness_finalize(void)
+{
+    free(block_sets);
+    block_sets = NULL;
+    block_sets_capacity = 0;
+    live = NULL;
+    words = 0;
 }
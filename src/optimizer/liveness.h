@@ -3,20 +3,48 @@
 
 #include <lacc/ir.h>
 
+/*
+ * Allocate liveness sets for each block in the list, and for each
+ * statement in the definition, large enough to hold the given number
+ * of symbols. Symbols must be numbered from 1 to n.
+ */
+INTERNAL void initialize_liveness(
+    struct definition *def,
+    struct block **blocks,
+    int count,
+    int symbols);
+
 /*
  * Compute liveness of each variable on every edge, before and after
- * every ir operation.
+ * every ir operation. Return non-zero if liveness at the start of the
+ * block changed.
  */
 INTERNAL int live_variable_analysis(
     struct definition *def,
     struct block *block);
 
+/* Get set of symbols live after statement at given index. */
+INTERNAL const unsigned long *live_after(
+    const struct definition *def,
+    int index);
+
+/* Check if symbol with given index is part of liveness set. */
+INTERNAL int is_live_in(const unsigned long *set, int sym);
+
+/* Remove liveness of statement at given index, after erasing it. */
+INTERNAL void erase_liveness(struct definition *def, int index);
+
 /*
- * Determine whether a variable may be read after a given statement.
- * Return zero iff it is definitely not accessed after this point.
+ * Determine whether a variable may be read after statement at given
+ * index. Return zero iff it is definitely not accessed after this
+ * point.
  */
 INTERNAL int is_live_after(
-	const struct symbol *sym,
-	const struct statement *st);
+    const struct definition *def,
+    const struct symbol *sym,
+    int index);
+
+/* Free memory used for liveness sets. */
+INTERNAL void liveness_finalize(void);
 
 #endif
@@ -0,0 +1,509 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "numbering.h"
+#include "ssa.h"
+
+#include <lacc/array.h>
+#include <lacc/context.h>
+#include <lacc/hash.h>
+#include <lacc/symbol.h>
+#include <lacc/type.h>
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Operand reads memory which can be changed by storing through a
+ * pointer, or by calling a function.
+ */
+#define READS_MEMORY 1
+
+/* Operand can change in other blocks, and is only reused locally. */
+#define IS_LOCAL 2
+
+#define is_binary(e) ((e).op >= IR_OP_ADD)
+
+/* Expression computed earlier, with the variable holding the result. */
+struct computed {
+    struct expression expr;
+    const struct symbol *holder;
+    const struct block *block;
+
+    /*
+     * Number of assignments to symbols of each operand, and to holder,
+     * when the value was computed. Memory state is compared by epoch.
+     */
+    int l, r, count;
+    unsigned long epoch;
+    unsigned int flags;
+};
+
+/* Values in scope, in the order they were computed. */
+static array_of(struct computed) values;
+
+/* Index of values by expression hash, finding the most recent first. */
+static struct hash_index available;
+
+/*
+ * Number of assignments to each symbol seen so far, and whether the
+ * symbol has its address taken. Indexed by symbol number.
+ */
+static array_of(int) assignments;
+static array_of(char) aliased;
+
+/* Incremented on each store through pointer, or function call. */
+static unsigned long memory_epoch;
+
+static int is_ssa_form;
+
+static int expressions_replaced;
+
+static void scan_operand(struct var var)
+{
+    int i;
+
+    if (!var.is_symbol)
+        return;
+
+    i = var_symbol(var)->index;
+    if (i >= array_len(&aliased)) {
+        array_realloc(&aliased, (i + 1));
+        memset(
+            &array_get(&aliased, 0) + array_len(&aliased),
+            0,
+            i + 1 - array_len(&aliased));
+        array_len(&aliased) = i + 1;
+    }
+
+    if (var.kind == ADDRESS) {
+        array_get(&aliased, i) = 1;
+    }
+}
+
+static void scan_expression(const struct expression *expr)
+{
+    switch (expr->op) {
+    default:
+        scan_operand(expr->r);
+    case IR_OP_CAST:
+    case IR_OP_NOT:
+    case IR_OP_NEG:
+    case IR_OP_CALL:
+    case IR_OP_VA_ARG:
+        scan_operand(expr->l);
+        break;
+    }
+}
+
+/*
+ * Find symbols which have their address taken, and reset state for a
+ * new function.
+ */
+static void initialize(
+    struct definition *def,
+    struct block **blocks,
+    int count)
+{
+    int i, j;
+    struct block *block;
+    const struct statement *st;
+
+    array_empty(&aliased);
+    for (i = 0; i < count; ++i) {
+        block = blocks[i];
+        for (j = block->head; j < block->head + block->count; ++j) {
+            st = &array_get(&def->statements, j);
+            scan_expression(&st->expr);
+            if (st->st == IR_ASSIGN || st->st == IR_VLA_ALLOC) {
+                scan_operand(st->t);
+            }
+        }
+
+        if (block->has_return_value || block->jump[1]) {
+            scan_expression(&block->expr);
+        }
+    }
+
+    i = array_len(&aliased);
+    array_empty(&assignments);
+    array_realloc(&assignments, i);
+    array_len(&assignments) = i;
+    array_zero(&assignments);
+    hash_index_clear(&available);
+    array_empty(&values);
+}
+
+/*
+ * Local variables which never have their address taken can only be
+ * changed by assigning to them directly.
+ */
+static int is_register(const struct symbol *sym)
+{
+    return sym->index
+        && !array_get(&aliased, sym->index)
+        && sym->symtype == SYM_DEFINITION
+        && sym->linkage == LINK_NONE
+        && !is_volatile(sym->type)
+        && !is_vla(sym->type);
+}
+
+/*
+ * Classify operand, and get number of assignments seen to the symbol
+ * it depends on.
+ */
+static int operand_state(struct var var, int *count)
+{
+    const struct symbol *sym;
+
+    *count = 0;
+    if (!var.is_symbol) {
+        return var.kind == DEREF ? READS_MEMORY | IS_LOCAL : 0;
+    }
+
+    sym = var_symbol(var);
+    switch (var.kind) {
+    case IMMEDIATE:
+        return 0;
+    case ADDRESS:
+        return is_vla(sym->type) ? READS_MEMORY | IS_LOCAL : 0;
+    case DIRECT:
+        if (!is_register(sym))
+            return READS_MEMORY | IS_LOCAL;
+        *count = array_get(&assignments, sym->index);
+        return is_ssa_form && ssa_is_version(sym) ? 0 : IS_LOCAL;
+    default:
+        assert(var.kind == DEREF);
+        if (is_register(sym)) {
+            *count = array_get(&assignments, sym->index);
+        }
+        return READS_MEMORY | IS_LOCAL;
+    }
+}
+
+static int is_commutative(enum optype op)
+{
+    switch (op) {
+    case IR_OP_ADD:
+    case IR_OP_MUL:
+    case IR_OP_AND:
+    case IR_OP_OR:
+    case IR_OP_XOR:
+    case IR_OP_EQ:
+    case IR_OP_NE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int same_operand(struct var a, struct var b)
+{
+    if (a.kind != b.kind
+        || a.is_symbol != b.is_symbol
+        || a.field_width != b.field_width
+        || a.field_offset != b.field_offset
+        || !type_equal(a.type, b.type))
+    {
+        return 0;
+    }
+
+    if (a.is_symbol) {
+        return var_symbol(a) == var_symbol(b)
+            && var_offset(a) == var_offset(b);
+    }
+
+    if (a.kind != IMMEDIATE) {
+        return a.value.imm.u == b.value.imm.u;
+    }
+
+    switch (type_of(a.type)) {
+    case T_FLOAT:
+        return !memcmp(&a.value.imm.f, &b.value.imm.f, sizeof(float));
+    case T_LDOUBLE:
+        return a.value.imm.ld == b.value.imm.ld;
+    default:
+        return a.value.imm.u == b.value.imm.u;
+    }
+}
+
+static int same_expression(
+    const struct expression *a,
+    const struct expression *b)
+{
+    if (a->op != b->op || !type_equal(a->type, b->type))
+        return 0;
+
+    if (!is_binary(*a))
+        return same_operand(a->l, b->l);
+
+    return (same_operand(a->l, b->l) && same_operand(a->r, b->r))
+        || (is_commutative(a->op)
+            && same_operand(a->l, b->r)
+            && same_operand(a->r, b->l));
+}
+
+static unsigned long hash_operand(struct var var)
+{
+    unsigned long h;
+
+    h = var.kind * 31;
+    if (var.is_symbol) {
+        h += var_offset(var) + var_symbol(var)->index;
+    } else if (is_integer(var.type) || is_pointer(var.type)) {
+        h += var.value.imm.u;
+    }
+
+    return h * 2654435761ul;
+}
+
+/* Hash is symmetric in operands, to find commutative expressions. */
+static unsigned long hash_expression(const struct expression *expr)
+{
+    unsigned long h;
+
+    h = expr->op * 17 + type_of(expr->type) + hash_operand(expr->l);
+    if (is_binary(*expr)) {
+        h += hash_operand(expr->r);
+    }
+
+    return h ^ (h >> 16);
+}
+
+/*
+ * Expressions without side effects, computing a scalar value of the
+ * same type as the target. Copies of immediates or register variables
+ * are not worth replacing.
+ */
+static int is_redundant_candidate(const struct statement *st)
+{
+    const struct expression *expr;
+
+    expr = &st->expr;
+    if (st->st != IR_ASSIGN
+        || has_side_effects(*expr)
+        || !is_scalar(expr->type)
+        || !type_equal(st->t.type, expr->type)
+        || is_volatile(expr->l.type)
+        || (is_binary(*expr) && is_volatile(expr->r.type)))
+    {
+        return 0;
+    }
+
+    if (is_identity(*expr)) {
+        switch (expr->l.kind) {
+        case DEREF:
+            return 1;
+        case DIRECT:
+            return !is_register(var_symbol(expr->l));
+        default:
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int is_holder(struct var t)
+{
+    return t.kind == DIRECT
+        && !var_offset(t)
+        && !is_field(t)
+        && is_register(var_symbol(t))
+        && type_equal(t.type, var_symbol(t)->type);
+}
+
+/*
+ * Check that operands and holder are not assigned since the value was
+ * computed, and that memory read is unchanged.
+ */
+static int is_available(const struct computed *value, const struct block *block)
+{
+    int count;
+
+    if ((value->flags & IS_LOCAL) && value->block != block)
+        return 0;
+
+    if ((value->flags & READS_MEMORY) && value->epoch != memory_epoch)
+        return 0;
+
+    operand_state(value->expr.l, &count);
+    if (count != value->l)
+        return 0;
+
+    if (is_binary(value->expr)) {
+        operand_state(value->expr.r, &count);
+        if (count != value->r)
+            return 0;
+    }
+
+    return array_get(&assignments, value->holder->index) == value->count;
+}
+
+static const struct symbol *lookup(
+    const struct expression *expr,
+    const struct block *block)
+{
+    int i;
+    const struct computed *value;
+
+    for (i = hash_index_first(&available, hash_expression(expr));
+        i != -1;
+        i = hash_index_next(&available, i))
+    {
+        value = &array_get(&values, i);
+        if (same_expression(&value->expr, expr)
+            && is_available(value, block))
+        {
+            return value->holder;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Update state after statement is executed. Assignments to variables
+ * which can be aliased count as stores to memory.
+ */
+static void update_state(const struct statement *st)
+{
+    const struct symbol *sym;
+
+    switch (st->st) {
+    case IR_ASSIGN:
+        if (st->t.kind == DEREF) {
+            memory_epoch++;
+        } else {
+            sym = var_symbol(st->t);
+            if (sym->index) {
+                array_get(&assignments, sym->index) += 1;
+            }
+            if (!is_register(sym)) {
+                memory_epoch++;
+            }
+        }
+    case IR_EXPR:
+        if (has_side_effects(st->expr)) {
+            memory_epoch++;
+        }
+        break;
+    case IR_VLA_ALLOC:
+        sym = var_symbol(st->t);
+        if (sym->index) {
+            array_get(&assignments, sym->index) += 1;
+        }
+    case IR_VA_START:
+        memory_epoch++;
+        break;
+    default:
+        break;
+    }
+}
+
+static int number_block(struct definition *def, struct block *block)
+{
+    int i, n, flags;
+    const struct symbol *holder;
+    struct statement *st;
+    struct computed value;
+
+    for (i = block->head, n = 0; i < block->head + block->count; ++i) {
+        st = &array_get(&def->statements, i);
+        if (!is_redundant_candidate(st)) {
+            update_state(st);
+            continue;
+        }
+
+        holder = lookup(&st->expr, block);
+        if (holder) {
+            st->expr = as_expr(var_direct(holder));
+            update_state(st);
+            n++;
+            continue;
+        }
+
+        memset(&value, 0, sizeof(value));
+        value.expr = st->expr;
+        value.block = block;
+        value.epoch = memory_epoch;
+        flags = operand_state(st->expr.l, &value.l);
+        if (is_binary(st->expr)) {
+            flags |= operand_state(st->expr.r, &value.r);
+        }
+
+        update_state(st);
+        if (!is_holder(st->t))
+            continue;
+
+        value.holder = var_symbol(st->t);
+        value.count = array_get(&assignments, value.holder->index);
+        value.flags = flags;
+        if (!is_ssa_form || !ssa_is_unique_version(value.holder)) {
+            value.flags |= IS_LOCAL;
+        }
+
+        if (is_available(&value, block)) {
+            hash_index_add(
+                &available,
+                array_len(&values),
+                hash_expression(&value.expr));
+            array_push_back(&values, value);
+        }
+    }
+
+    expressions_replaced += n;
+    return n;
+}
+
+/* Forget values computed in block, when leaving its scope. */
+static void leave_block(struct definition *def, struct block *block)
+{
+    while (array_len(&values)
+        && array_get(&values, array_len(&values) - 1).block == block)
+    {
+        (void) array_pop_back(&values);
+        hash_index_remove(&available, array_len(&values));
+    }
+}
+
+INTERNAL int local_value_numbering(
+    struct definition *def,
+    struct block **blocks,
+    int count)
+{
+    int i, n;
+
+    is_ssa_form = 0;
+    initialize(def, blocks, count);
+    for (i = 0, n = 0; i < count; ++i) {
+        n += number_block(def, blocks[i]);
+        leave_block(def, blocks[i]);
+    }
+
+    return n;
+}
+
+INTERNAL int global_value_numbering(
+    struct definition *def,
+    struct block **blocks,
+    int count)
+{
+    is_ssa_form = 1;
+    initialize(def, blocks, count);
+    return ssa_visit_dominator_tree(&number_block, &leave_block);
+}
+
+INTERNAL void value_numbering_finalize(void)
+{
+    if (expressions_replaced) {
+        verbose("Value numbering eliminated %d redundant expressions.",
+            expressions_replaced);
+    }
+
+    expressions_replaced = 0;
+    array_clear(&values);
+    hash_index_destroy(&available);
+    array_clear(&assignments);
+    array_clear(&aliased);
+}
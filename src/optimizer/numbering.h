@@ -0,0 +1,41 @@
+#ifndef NUMBERING_H
+#define NUMBERING_H
+
+#include <lacc/ir.h>
+
+/*
+ * Optimization pass replacing expressions already computed by a copy
+ * of the variable holding the earlier result.
+ *
+ *   .t1 = a * b
+ *   .t2 = a * b
+ *
+ * If neither a, b or .t1 are assigned in between, the second statement
+ * is replaced by the following:
+ *
+ *   .t2 = .t1
+ *
+ * Loads through pointers, and reads of variables that can be aliased,
+ * are only reused until the next store through a pointer or function
+ * call. Blocks are given in postorder, and are numbered one by one.
+ * Return number of statements replaced.
+ */
+INTERNAL int local_value_numbering(
+    struct definition *def,
+    struct block **blocks,
+    int count);
+
+/*
+ * Same as local_value_numbering, but over the dominator tree of a
+ * function in SSA form. Expressions over versions are also reused in
+ * blocks dominated by the one computing it.
+ */
+INTERNAL int global_value_numbering(
+    struct definition *def,
+    struct block **blocks,
+    int count);
+
+/* Print statistics, and free memory. */
+INTERNAL void value_numbering_finalize(void);
+
+#endif
@@ -4,19 +4,41 @@
 #endif
 #include "optimize.h"
 #include "liveness.h"
+#include "numbering.h"
+#include "sccp.h"
+#include "ssa.h"
 #include "transform.h"
 
 #include <lacc/array.h>
 #include <lacc/context.h>
+#include <lacc/timer.h>
 #include <assert.h>
+#include <string.h>
 
 static int optimization_level;
 
+/* Number of functions optimized, and skipped. */
+static int functions_optimized, functions_skipped;
+
+/* Number of branches folded, and blocks removed. */
+static int branches_folded, blocks_removed;
+
 /*
  * Serialized control flow graph. Topologically sorted if non-cyclical.
  */
 static array_of(struct block *) blocklist;
 
+/*
+ * Reachable blocks in postorder, and list of predecessors for each of
+ * them. Predecessors of block number i are stored in pred_list, from
+ * pred_index[i] up to pred_index[i + 1].
+ */
+static array_of(struct block *) postorder;
+static array_of(int) pred_index, pred_list;
+
+/* Blocks waiting to be visited by the dataflow solver. */
+static array_of(char) pending;
+
 /*
  * List of symbols used in the control flow graph.
  */
@@ -44,23 +66,70 @@ static int serialize_basic_blocks(struct block *block)
     return 1;
 }
 
-/* Initialize liveness information in each block. */
+static void order_basic_blocks(struct block *block)
+{
+    if (block->color == WHITE)
+        return;
+
+    block->color = WHITE;
+    if (block->jump[0]) {
+        order_basic_blocks(block->jump[0]);
+        if (block->jump[1]) {
+            order_basic_blocks(block->jump[1]);
+        }
+    }
+
+    block->order = array_len(&postorder);
+    array_push_back(&postorder, block);
+}
+
+/*
+ * Number reachable blocks in postorder, after jumps through empty
+ * blocks are removed, and build list of predecessors for each of them.
+ * Blocks are marked as visited by resetting color to white.
+ */
 static void initialize_dataflow(struct definition *def)
 {
-    int i;
-    struct block *block;
-    struct statement *st;
+    int i, j, n;
+    struct block *block, *next;
+
+    array_empty(&postorder);
+    order_basic_blocks(def->body);
+
+    n = array_len(&postorder);
+    array_empty(&pred_index);
+    array_realloc(&pred_index, (n + 1));
+    array_len(&pred_index) = n + 1;
+    array_zero(&pred_index);
+    for (i = 0; i < n; ++i) {
+        block = array_get(&postorder, i);
+        for (j = 0; j < 2 && block->jump[j]; ++j) {
+            array_get(&pred_index, block->jump[j]->order + 1) += 1;
+        }
+    }
 
-    for (i = 0; i < array_len(&blocklist); ++i) {
-        block = array_get(&blocklist, i);
-        block->in = 0;
-        block->out = 0;
+    for (i = 0; i < n; ++i) {
+        array_get(&pred_index, i + 1) += array_get(&pred_index, i);
+    }
+
+    array_empty(&pred_list);
+    array_realloc(&pred_list, array_get(&pred_index, n));
+    array_len(&pred_list) = array_get(&pred_index, n);
+    for (i = 0; i < n; ++i) {
+        block = array_get(&postorder, i);
+        for (j = 0; j < 2 && block->jump[j]; ++j) {
+            next = block->jump[j];
+            array_get(&pred_list, array_get(&pred_index, next->order)) = i;
+            array_get(&pred_index, next->order) += 1;
+        }
     }
 
-    for (i = 0; i < array_len(&def->statements); ++i) {
-        st = &array_get(&def->statements, i);
-        st->out = 0;
+    for (i = n; i > 0; --i) {
+        array_get(&pred_index, i) = array_get(&pred_index, i - 1);
     }
+
+    array_get(&pred_index, 0) = 0;
+    initialize_liveness(def, &array_get(&postorder, 0), n, array_len(&symbols));
 }
 
 static int count_symbol(struct var v)
@@ -69,15 +138,15 @@ static int count_symbol(struct var v)
     struct symbol *sym;
 
     if (!v.is_symbol
-        || !is_object(v.value.symbol->type))
+        || !is_object(var_symbol(v)->type))
     {
         return 0;
     }
 
-    sym = (struct symbol *) v.value.symbol;
+    sym = (struct symbol *) var_symbol(v);
     if (!sym->index) {
         len = array_len(&symbols);
-        if (len < 64) {
+        if (len < MAX_SYMBOLS) {
             array_push_back(&symbols, sym);
             sym->index = len + 1;
             return 1;
@@ -191,22 +260,51 @@ static int traverse(
 }
 
 /*
- * Solve generic dataflow problem iteratively, going through each basic
- * block until visit function returns 0 for all nodes.
+ * Solve backward dataflow problem using a worklist, where blocks are
+ * visited in postorder, meaning successors are visited before their
+ * predecessors. Visit function returns non-zero if the result at the
+ * start of the block changed, in which case the predecessors of the
+ * block are visited again.
  */
 static void execute_iterative_dataflow(
     struct definition *def,
     int (*callback)(struct definition *def, struct block *))
 {
-    int changes;
+    int i, j, n, count, pred;
+    struct block *block;
 
-    do {
-        changes = traverse(def, callback);
-    } while (changes);
+    n = array_len(&postorder);
+    array_realloc(&pending, n);
+    array_len(&pending) = n;
+    memset(&array_get(&pending, 0), 1, n);
+    count = n;
+    while (count) {
+        for (i = 0; i < n; ++i) {
+            if (!array_get(&pending, i))
+                continue;
+
+            count--;
+            array_get(&pending, i) = 0;
+            block = array_get(&postorder, i);
+            if (!callback(def, block))
+                continue;
+
+            for (j = array_get(&pred_index, i);
+                j < array_get(&pred_index, i + 1);
+                ++j)
+            {
+                pred = array_get(&pred_list, j);
+                if (!array_get(&pending, pred)) {
+                    array_get(&pending, pred) = 1;
+                    count++;
+                }
+            }
+        }
+    }
 }
 
 #if !NDEBUG
-static void print_liveness_statement(unsigned long live)
+static void print_liveness_statement(const unsigned long *live)
 {
     int j, k;
     const struct symbol *sym;
@@ -214,7 +312,7 @@ static void print_liveness_statement(unsigned long live)
     printf("--- {");
     for (j = 0, k = 0; j < array_len(&symbols); ++j) {
         sym = array_get(&symbols, j);
-        if (live & (1ul << (sym->index - 1))) {
+        if (is_live_in(live, sym->index)) {
             if (k) {
                 printf(", ");
             }
@@ -228,13 +326,11 @@ static void print_liveness_statement(unsigned long live)
 int print_liveness(struct definition *def, struct block *block)
 {
     int i;
-    struct statement *st;
 
     printf("%s:\n", sym_name(block->label));
     print_liveness_statement(block->in);
     for (i = block->head; i < block->head + block->count; ++i) {
-        st = &array_get(&def->statements, i);
-        print_liveness_statement(st->out);
+        print_liveness_statement(live_after(def, i));
     }
 
     if (block->jump[1] || block->has_return_value) {
@@ -245,11 +341,99 @@ int print_liveness(struct definition *def, struct block *block)
 }
 #endif
 
-INTERNAL int is_live_after(const struct symbol *sym, const struct statement *st)
+/*
+ * Serialize blocks again after branches are folded, and remove blocks
+ * no longer reachable from the function.
+ */
+static void remove_unreachable_blocks(struct definition *def)
+{
+    int i, n;
+    struct block *block;
+
+    array_empty(&blocklist);
+    serialize_basic_blocks(def->body);
+    for (i = 0, n = 0; i < array_len(&def->nodes); ++i) {
+        block = array_get(&def->nodes, i);
+        if (block->color == BLACK) {
+            array_get(&def->nodes, n) = block;
+            n++;
+        } else {
+            release_block(def, block);
+        }
+    }
+
+    blocks_removed += array_len(&def->nodes) - n;
+    array_len(&def->nodes) = n;
+}
+
+/*
+ * Translate to and from static single assignment form, doing constant
+ * propagation and value numbering in between. Versions kept as
+ * separate temporaries are added to the function, so symbols are
+ * numbered again afterwards. Branches found to always go the same way
+ * are folded, in which case dataflow is initialized again for the
+ * remaining blocks. Return non-zero if the function was converted.
+ */
+static int transform_ssa(struct definition *def)
+{
+    int n, folded, converted;
+
+    n = array_len(&postorder);
+    timer_push(TIMER_SSA);
+    converted = ssa_construct(
+        def,
+        &array_get(&postorder, 0),
+        n,
+        &array_get(&pred_index, 0),
+        &array_get(&pred_list, 0),
+        &array_get(&symbols, 0),
+        array_len(&symbols));
+
+    if (converted) {
+        timer_push(TIMER_CONSTANT_PROPAGATION);
+        propagate_constants(
+            def,
+            &array_get(&postorder, 0),
+            n,
+            &array_get(&pred_index, 0),
+            &array_get(&pred_list, 0));
+        timer_pop();
+        timer_push(TIMER_VALUE_NUMBERING);
+        global_value_numbering(def, &array_get(&postorder, 0), n);
+        timer_pop();
+        ssa_destruct(def);
+        reset_symbol_indexes();
+        array_empty(&symbols);
+        folded = traverse(def, &fold_constant_branches);
+        if (folded) {
+            branches_folded += folded;
+            remove_unreachable_blocks(def);
+        }
+
+        traverse(def, &enumerate_used_symbols);
+        if (folded) {
+            initialize_dataflow(def);
+        } else {
+            initialize_liveness(
+                def,
+                &array_get(&postorder, 0),
+                n,
+                array_len(&symbols));
+        }
+    }
+
+    timer_pop();
+    return converted;
+}
+
+INTERNAL int is_live_after(
+    const struct definition *def,
+    const struct symbol *sym,
+    int index)
 {
     if (optimization_level && is_object(sym->type)) {
         assert(sym->index);
-        return (st->out & (1ul << (sym->index - 1))) != 0;
+        return is_live_in(live_after(def, index), sym->index);
     }
 
     return 1;
@@ -277,25 +461,69 @@ INTERNAL void optimize(struct definition *def)
     traverse(def, &skip_empty_blocks);
     syms = traverse(def, &enumerate_used_symbols);
 
-    if (syms < 64) {
+    if (syms < MAX_SYMBOLS) {
+        functions_optimized++;
         initialize_dataflow(def);
+        if (optimization_level < 2 || !transform_ssa(def)) {
+            timer_push(TIMER_VALUE_NUMBERING);
+            local_value_numbering(
+                def,
+                &array_get(&postorder, 0),
+                array_len(&postorder));
+            timer_pop();
+        }
+
         do {
             n = 0;
+            timer_push(TIMER_LIVENESS);
             execute_iterative_dataflow(def, &live_variable_analysis);
+            timer_pop();
 
             /*traverse(&print_liveness);*/
+            timer_push(TIMER_DEAD_STORE);
             n += traverse(def, &dead_store_elimination);
+            timer_pop();
+            timer_push(TIMER_MERGE_ASSIGNMENT);
             n += traverse(def, &merge_chained_assignment);
+            timer_pop();
             /*if (n) printf("Did %d changes!\n", n);*/
         } while (n);
+    } else {
+        functions_skipped++;
     }
 
+    /*
+     * Liveness is only used by transformations in this pass, and would
+     * otherwise be kept for functions waiting to be inlined.
+     */
+    array_clear(&def->liveness);
     reset_symbol_indexes();
     traverse(def, &color_white);
 }
 
 INTERNAL void pop_optimization(void)
 {
+    if (optimization_level) {
+        verbose("Optimized %d functions, skipped %d with too many symbols.",
+            functions_optimized, functions_skipped);
+        if (branches_folded) {
+            verbose("Folded %d constant branches, removing %d unreachable "
+                "blocks.", branches_folded, blocks_removed);
+        }
+    }
+
+    functions_optimized = 0;
+    functions_skipped = 0;
+    branches_folded = 0;
+    blocks_removed = 0;
     array_clear(&blocklist);
+    array_clear(&postorder);
+    array_clear(&pred_index);
+    array_clear(&pred_list);
+    array_clear(&pending);
     array_clear(&symbols);
+    liveness_finalize();
+    ssa_finalize();
+    constant_propagation_finalize();
+    value_numbering_finalize();
 }
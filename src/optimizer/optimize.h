@@ -5,6 +5,9 @@
 
 #include <lacc/ir.h>
 
+/* Limit given by width of symbol index. */
+#define MAX_SYMBOLS ((1 << 18) - 1)
+
 /* Set to non-zero to enable optimization. */
 INTERNAL void push_optimization(int level);
 
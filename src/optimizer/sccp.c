@@ -0,0 +1,762 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "sccp.h"
+#include "ssa.h"
+
+#include <lacc/array.h>
+#include <lacc/context.h>
+#include <lacc/symbol.h>
+#include <lacc/type.h>
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Lattice of values. Symbols start out undefined, and are lowered to
+ * constant when assigned, or varying when assigned different values.
+ */
+enum lattice {
+    UNDEFINED,
+    CONSTANT,
+    VARYING
+};
+
+struct cell {
+    enum lattice state;
+    union value value;
+};
+
+/* Value of each symbol, indexed by symbol number. */
+static array_of(struct cell) cells;
+
+/*
+ * Blocks found to be reachable, by postorder number, and edges found to
+ * be taken, by index in list of predecessors.
+ */
+static array_of(char) executable, feasible;
+
+/*
+ * Place where the value of a tracked symbol is read, which must be
+ * evaluated again when the value is lowered. Uses of each symbol are
+ * chained from first_use, indexed by symbol number.
+ */
+enum use_kind {
+    USE_PHI,
+    USE_STATEMENT,
+    USE_BRANCH
+};
+
+struct use {
+    enum use_kind kind;
+    int block;
+    int item;
+    int next;
+};
+
+static array_of(struct use) use_list;
+static array_of(int) first_use;
+
+/* Target block of each edge, by index in list of predecessors. */
+static array_of(int) edge_target;
+
+/*
+ * Edges which became feasible, and symbols which were lowered, waiting
+ * to be propagated.
+ */
+static array_of(int) flow_worklist, ssa_worklist;
+
+static struct definition *function_def;
+static struct block **cfg_blocks;
+static const int *edge_index, *edge_preds;
+
+static int constants_propagated;
+
+static struct cell *cell_of(const struct symbol *sym)
+{
+    int i;
+    struct cell cell = {VARYING};
+
+    i = sym->index;
+    assert(i);
+    while (array_len(&cells) <= i) {
+        array_push_back(&cells, cell);
+    }
+
+    return &array_get(&cells, i);
+}
+
+/*
+ * Only versions are tracked, which are assigned at most once. Symbols
+ * with the value of the original symbol on entry are never assigned,
+ * and considered varying.
+ */
+static int is_tracked(const struct symbol *sym)
+{
+    return sym->index && ssa_is_version(sym);
+}
+
+static int is_whole(struct var var)
+{
+    return !var_offset(var)
+        && !is_field(var)
+        && type_equal_unqualified(var.type, var_symbol(var)->type);
+}
+
+static struct cell operand_value(struct var var)
+{
+    const struct symbol *sym;
+    struct cell cell = {VARYING};
+
+    switch (var.kind) {
+    case IMMEDIATE:
+        if (!var.is_symbol) {
+            cell.state = CONSTANT;
+            cell.value = var.value.imm;
+        }
+        break;
+    case DIRECT:
+        sym = var_symbol(var);
+        if (!is_whole(var))
+            break;
+        if (sym->readonly) {
+            cell.state = CONSTANT;
+            cell.value = sym->value.constant;
+        } else if (is_tracked(sym)) {
+            cell = *cell_of(sym);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return cell;
+}
+
+static int is_same_value(Type type, union value a, union value b)
+{
+    switch (type_of(type)) {
+    case T_FLOAT:
+        return !memcmp(&a.f, &b.f, sizeof(float));
+    case T_LDOUBLE:
+        return a.ld == b.ld;
+    default:
+        return a.u == b.u;
+    }
+}
+
+static int is_true(Type type, union value value)
+{
+    switch (type_of(type)) {
+    case T_FLOAT:
+        return value.f != 0.0f;
+    case T_DOUBLE:
+        return value.d != 0.0;
+    case T_LDOUBLE:
+        return get_long_double(value) != 0.0L;
+    default:
+        return value.u != 0;
+    }
+}
+
+/*
+ * Convert result of integer arithmetic to the type of the expression,
+ * wrapping around on overflow.
+ */
+static union value wrap_around(Type type, union value value)
+{
+    return convert(value, basic_type__unsigned_long, type);
+}
+
+static int is_binary_integer(const struct expression *expr)
+{
+    return is_integer(expr->type)
+        && type_equal_unqualified(expr->l.type, expr->type)
+        && type_equal_unqualified(expr->r.type, expr->type);
+}
+
+static int is_comparable(const struct expression *expr)
+{
+    return (is_integer(expr->l.type) || is_pointer(expr->l.type))
+        && type_equal_unqualified(expr->l.type, expr->r.type);
+}
+
+/*
+ * Evaluate expression with constant operands. Only integer arithmetic
+ * is folded, and conversions between arithmetic types. Return zero if
+ * the result cannot be computed.
+ */
+static int fold(
+    const struct expression *expr,
+    union value l,
+    union value r,
+    union value *result)
+{
+    int bits;
+    long shift;
+    Type type;
+    union value value;
+
+    type = expr->type;
+    switch (expr->op) {
+    case IR_OP_CAST:
+        if ((is_pointer(type) || is_pointer(expr->l.type))
+            && !((is_integer(type) || is_pointer(type))
+                && (is_integer(expr->l.type) || is_pointer(expr->l.type))))
+        {
+            return 0;
+        }
+        value = convert(l, expr->l.type, type);
+        break;
+    case IR_OP_NOT:
+        if (!is_integer(type))
+            return 0;
+        value.u = ~l.u;
+        value = wrap_around(type, value);
+        break;
+    case IR_OP_NEG:
+        if (!is_integer(type))
+            return 0;
+        value.u = -l.u;
+        value = wrap_around(type, value);
+        break;
+    case IR_OP_ADD:
+    case IR_OP_SUB:
+    case IR_OP_MUL:
+    case IR_OP_AND:
+    case IR_OP_OR:
+    case IR_OP_XOR:
+        if (!is_binary_integer(expr))
+            return 0;
+        switch (expr->op) {
+        default: assert(0);
+        case IR_OP_ADD: value.u = l.u + r.u; break;
+        case IR_OP_SUB: value.u = l.u - r.u; break;
+        case IR_OP_MUL: value.u = l.u * r.u; break;
+        case IR_OP_AND: value.u = l.u & r.u; break;
+        case IR_OP_OR: value.u = l.u | r.u; break;
+        case IR_OP_XOR: value.u = l.u ^ r.u; break;
+        }
+        value = wrap_around(type, value);
+        break;
+    case IR_OP_DIV:
+    case IR_OP_MOD:
+        if (!is_binary_integer(expr) || !r.u)
+            return 0;
+        if (is_signed(type)) {
+            if (r.i == -1)
+                return 0;
+            value.i = expr->op == IR_OP_DIV ? l.i / r.i : l.i % r.i;
+        } else {
+            value.u = expr->op == IR_OP_DIV ? l.u / r.u : l.u % r.u;
+        }
+        value = wrap_around(type, value);
+        break;
+    case IR_OP_SHL:
+    case IR_OP_SHR:
+        if (!is_integer(type)
+            || !is_integer(expr->r.type)
+            || !type_equal_unqualified(expr->l.type, type))
+        {
+            return 0;
+        }
+        bits = size_of(type) * 8;
+        shift = is_signed(expr->r.type) ? r.i : (long) r.u;
+        if (shift < 0 || shift >= bits)
+            return 0;
+        if (expr->op == IR_OP_SHL) {
+            value.u = l.u << shift;
+        } else if (is_signed(type)) {
+            value.i = l.i >> shift;
+        } else {
+            value.u = l.u >> shift;
+        }
+        value = wrap_around(type, value);
+        break;
+    case IR_OP_EQ:
+    case IR_OP_NE:
+    case IR_OP_GE:
+    case IR_OP_GT:
+        if (!is_integer(type) || !is_comparable(expr))
+            return 0;
+        switch (expr->op) {
+        default: assert(0);
+        case IR_OP_EQ:
+            value.u = l.u == r.u;
+            break;
+        case IR_OP_NE:
+            value.u = l.u != r.u;
+            break;
+        case IR_OP_GE:
+            value.u = is_signed(expr->l.type) ? l.i >= r.i : l.u >= r.u;
+            break;
+        case IR_OP_GT:
+            value.u = is_signed(expr->l.type) ? l.i > r.i : l.u > r.u;
+            break;
+        }
+        value = wrap_around(type, value);
+        break;
+    default:
+        return 0;
+    }
+
+    *result = value;
+    return 1;
+}
+
+static struct cell evaluate(const struct expression *expr)
+{
+    struct cell l, r, cell = {VARYING};
+
+    if (has_side_effects(*expr) || !is_scalar(expr->type))
+        return cell;
+
+    l = operand_value(expr->l);
+    r.state = CONSTANT;
+    if (expr->op >= IR_OP_ADD) {
+        r = operand_value(expr->r);
+    }
+
+    if (l.state == VARYING || r.state == VARYING)
+        return cell;
+
+    if (l.state == UNDEFINED || r.state == UNDEFINED) {
+        cell.state = UNDEFINED;
+    } else if (fold(expr, l.value, r.value, &cell.value)) {
+        cell.state = CONSTANT;
+    }
+
+    return cell;
+}
+
+/*
+ * Lower value of symbol to meet with given value, adding it to the SSA
+ * worklist if the value changed.
+ */
+static void lower(const struct symbol *sym, struct cell value)
+{
+    struct cell *cell;
+
+    cell = cell_of(sym);
+    if (cell->state == VARYING || value.state == UNDEFINED)
+        return;
+
+    if (cell->state == UNDEFINED) {
+        *cell = value;
+    } else if (value.state == CONSTANT
+        && is_same_value(sym->type, cell->value, value.value))
+    {
+        return;
+    } else {
+        cell->state = VARYING;
+    }
+
+    array_push_back(&ssa_worklist, sym->index);
+}
+
+/*
+ * Mark edge from block b to successor as taken, adding it to the flow
+ * worklist if not seen before.
+ */
+static void mark_edge(int b, const struct block *next)
+{
+    int i, s;
+
+    s = next->order;
+    assert(cfg_blocks[s] == next);
+    for (i = edge_index[s]; i < edge_index[s + 1]; ++i) {
+        if (edge_preds[i] == b && !array_get(&feasible, i)) {
+            array_get(&feasible, i) = 1;
+            array_push_back(&flow_worklist, i);
+        }
+    }
+}
+
+/* Meet of arguments to phi function i along feasible edges. */
+static void visit_phi(int b, int i)
+{
+    int j;
+    struct cell value, arg;
+    struct block *block;
+    const struct symbol *sym;
+
+    block = cfg_blocks[b];
+    value.state = UNDEFINED;
+    for (j = edge_index[b]; j < edge_index[b + 1]; ++j) {
+        if (!array_get(&feasible, j))
+            continue;
+
+        sym = ssa_phi_argument(block, i, j - edge_index[b]);
+        arg = operand_value(var_direct(sym));
+        if (arg.state == UNDEFINED)
+            continue;
+
+        if (value.state == UNDEFINED) {
+            value = arg;
+        } else if (arg.state == VARYING
+            || !is_same_value(sym->type, value.value, arg.value))
+        {
+            value.state = VARYING;
+            break;
+        }
+    }
+
+    lower(ssa_phi_result(block, i), value);
+}
+
+static int is_tracked_assignment(const struct statement *st)
+{
+    return st->st == IR_ASSIGN
+        && st->t.kind == DIRECT
+        && is_tracked(var_symbol(st->t));
+}
+
+static void visit_statement(int i)
+{
+    struct cell value;
+    const struct statement *st;
+
+    st = &array_get(&function_def->statements, i);
+    if (is_tracked_assignment(st)) {
+        value = evaluate(&st->expr);
+        if (!type_equal_unqualified(st->t.type, st->expr.type)) {
+            value.state = VARYING;
+        }
+        lower(var_symbol(st->t), value);
+    }
+}
+
+/* Mark outgoing edges which can be taken. */
+static void visit_branch(int b)
+{
+    struct cell value;
+    struct block *block;
+
+    block = cfg_blocks[b];
+    if (block->jump[1]) {
+        value = evaluate(&block->expr);
+        if (value.state == CONSTANT) {
+            mark_edge(b, block->jump[is_true(block->expr.type, value.value)]);
+        } else if (value.state == VARYING) {
+            mark_edge(b, block->jump[0]);
+            mark_edge(b, block->jump[1]);
+        }
+    } else if (block->jump[0]) {
+        mark_edge(b, block->jump[0]);
+    }
+}
+
+/* Evaluate whole block, the first time it is found reachable. */
+static void visit_block(int b)
+{
+    int i, n;
+    struct block *block;
+
+    block = cfg_blocks[b];
+    assert(!array_get(&executable, b));
+    array_get(&executable, b) = 1;
+    n = ssa_phi_count(block);
+    for (i = 0; i < n; ++i) {
+        visit_phi(b, i);
+    }
+
+    for (i = block->head; i < block->head + block->count; ++i) {
+        visit_statement(i);
+    }
+
+    visit_branch(b);
+}
+
+/*
+ * Only phi functions need to be evaluated again when a new edge into
+ * an already reachable block is found.
+ */
+static void visit_edge(int e)
+{
+    int i, n, b;
+
+    b = array_get(&edge_target, e);
+    if (!array_get(&executable, b)) {
+        visit_block(b);
+    } else {
+        n = ssa_phi_count(cfg_blocks[b]);
+        for (i = 0; i < n; ++i) {
+            visit_phi(b, i);
+        }
+    }
+}
+
+/* Evaluate uses of symbol in reachable blocks. */
+static void visit_uses(int sym)
+{
+    int i;
+    const struct use *use;
+
+    for (i = array_get(&first_use, sym); i != -1; i = use->next) {
+        use = &array_get(&use_list, i);
+        if (!array_get(&executable, use->block))
+            continue;
+
+        switch (use->kind) {
+        case USE_PHI:
+            visit_phi(use->block, use->item);
+            break;
+        case USE_STATEMENT:
+            visit_statement(use->item);
+            break;
+        case USE_BRANCH:
+            visit_branch(use->block);
+            break;
+        }
+    }
+}
+
+static void add_use(
+    const struct symbol *sym,
+    enum use_kind kind,
+    int b,
+    int i)
+{
+    struct use use;
+
+    if (!is_tracked(sym) || sym->index >= array_len(&first_use))
+        return;
+
+    use.kind = kind;
+    use.block = b;
+    use.item = i;
+    use.next = array_get(&first_use, sym->index);
+    array_get(&first_use, sym->index) = array_len(&use_list);
+    array_push_back(&use_list, use);
+}
+
+static void add_expression_uses(
+    const struct expression *expr,
+    enum use_kind kind,
+    int b,
+    int i)
+{
+    if (expr->l.kind == DIRECT) {
+        add_use(var_symbol(expr->l), kind, b, i);
+    }
+
+    if (expr->op >= IR_OP_ADD && expr->r.kind == DIRECT) {
+        add_use(var_symbol(expr->r), kind, b, i);
+    }
+}
+
+/*
+ * Build chains of uses for all symbols with a cell, and the target of
+ * each edge.
+ */
+static void build_uses(int count)
+{
+    int b, i, j, n;
+    struct block *block;
+    const struct statement *st;
+
+    array_empty(&use_list);
+    array_empty(&first_use);
+    array_realloc(&first_use, array_len(&cells));
+    for (i = 0; i < array_len(&cells); ++i) {
+        array_push_back(&first_use, -1);
+    }
+
+    array_empty(&edge_target);
+    for (b = 0; b < count; ++b) {
+        block = cfg_blocks[b];
+        n = ssa_phi_count(block);
+        for (j = edge_index[b]; j < edge_index[b + 1]; ++j) {
+            array_push_back(&edge_target, b);
+            for (i = 0; i < n; ++i) {
+                add_use(
+                    ssa_phi_argument(block, i, j - edge_index[b]),
+                    USE_PHI, b, i);
+            }
+        }
+
+        for (i = block->head; i < block->head + block->count; ++i) {
+            st = &array_get(&function_def->statements, i);
+            if (is_tracked_assignment(st)) {
+                add_expression_uses(&st->expr, USE_STATEMENT, b, i);
+            }
+        }
+
+        if (block->jump[1]) {
+            add_expression_uses(&block->expr, USE_BRANCH, b, 0);
+        }
+    }
+}
+
+static int is_integer_constant(struct cell cell, Type type)
+{
+    return cell.state == CONSTANT && (is_integer(type) || is_pointer(type));
+}
+
+static int replace_operand(struct var *var)
+{
+    struct cell cell;
+
+    if (var->kind != DIRECT)
+        return 0;
+
+    cell = operand_value(*var);
+    if (!is_integer_constant(cell, var->type))
+        return 0;
+
+    *var = var_numeric(var->type, cell.value);
+    return 1;
+}
+
+/*
+ * Replace expression by a constant, or otherwise an operand known to
+ * be constant. Conversions are only folded as a whole, and binary
+ * operations keep at least one operand which is not immediate.
+ */
+static int replace_expression(struct expression *expr)
+{
+    struct cell cell;
+
+    if (has_side_effects(*expr) || is_immediate(*expr))
+        return 0;
+
+    cell = evaluate(expr);
+    if (is_integer_constant(cell, expr->type)) {
+        *expr = as_expr(var_numeric(expr->type, cell.value));
+        return 1;
+    }
+
+    if (is_identity(*expr))
+        return replace_operand(&expr->l);
+
+    if (expr->op < IR_OP_ADD
+        || expr->l.kind == IMMEDIATE
+        || expr->r.kind == IMMEDIATE)
+    {
+        return 0;
+    }
+
+    return replace_operand(&expr->l) || replace_operand(&expr->r);
+}
+
+static int replace_constants(struct block *block)
+{
+    int i, n;
+    struct cell cell;
+    struct statement *st;
+
+    for (i = block->head, n = 0; i < block->head + block->count; ++i) {
+        st = &array_get(&function_def->statements, i);
+        switch (st->st) {
+        case IR_ASSIGN:
+        case IR_PARAM:
+        case IR_EXPR:
+            n += replace_expression(&st->expr);
+        default:
+            break;
+        }
+    }
+
+    if (block->jump[1]) {
+        cell = evaluate(&block->expr);
+        if (cell.state == CONSTANT && !is_immediate(block->expr)) {
+            block->expr = as_expr(
+                var_int(is_true(block->expr.type, cell.value)));
+            n++;
+        }
+    } else if (block->has_return_value) {
+        n += replace_expression(&block->expr);
+    }
+
+    return n;
+}
+
+/*
+ * Propagate constants using separate worklists for edges in the control
+ * flow graph and for SSA values, as described by Wegman and Zadeck. A
+ * block is evaluated in full the first time it is reached, after which
+ * only phi functions and uses of lowered values are visited again.
+ */
+INTERNAL int propagate_constants(
+    struct definition *def,
+    struct block **blocks,
+    int count,
+    const int *index,
+    const int *preds)
+{
+    int i, j, n;
+    struct cell top = {UNDEFINED};
+    struct block *block;
+    const struct statement *st;
+
+    function_def = def;
+    cfg_blocks = blocks;
+    edge_index = index;
+    edge_preds = preds;
+    array_empty(&cells);
+    for (i = 0; i < count; ++i) {
+        block = blocks[i];
+        n = ssa_phi_count(block);
+        for (j = 0; j < n; ++j) {
+            *cell_of(ssa_phi_result(block, j)) = top;
+        }
+
+        for (j = block->head; j < block->head + block->count; ++j) {
+            st = &array_get(&def->statements, j);
+            if (is_tracked_assignment(st)) {
+                *cell_of(var_symbol(st->t)) = top;
+            }
+        }
+    }
+
+    build_uses(count);
+    array_empty(&executable);
+    array_realloc(&executable, count);
+    array_len(&executable) = count;
+    array_zero(&executable);
+    array_empty(&feasible);
+    array_realloc(&feasible, index[count]);
+    array_len(&feasible) = index[count];
+    array_zero(&feasible);
+    array_empty(&flow_worklist);
+    array_empty(&ssa_worklist);
+
+    visit_block(count - 1);
+    while (array_len(&flow_worklist) || array_len(&ssa_worklist)) {
+        while (array_len(&flow_worklist)) {
+            visit_edge(array_pop_back(&flow_worklist));
+        }
+
+        while (array_len(&ssa_worklist)) {
+            visit_uses(array_pop_back(&ssa_worklist));
+        }
+    }
+
+    for (i = 0, n = 0; i < count; ++i) {
+        if (array_get(&executable, i)) {
+            n += replace_constants(blocks[i]);
+        }
+    }
+
+    constants_propagated += n;
+    function_def = NULL;
+    return n;
+}
+
+INTERNAL void constant_propagation_finalize(void)
+{
+    if (constants_propagated) {
+        verbose("Propagated constants to %d expressions.",
+            constants_propagated);
+    }
+
+    constants_propagated = 0;
+    array_clear(&cells);
+    array_clear(&executable);
+    array_clear(&feasible);
+    array_clear(&use_list);
+    array_clear(&first_use);
+    array_clear(&edge_target);
+    array_clear(&flow_worklist);
+    array_clear(&ssa_worklist);
+}
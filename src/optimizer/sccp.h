@@ -0,0 +1,32 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include <lacc/ir.h>
+
+/*
+ * Sparse conditional constant propagation over a function in SSA form.
+ * Values are propagated through assignments and phi nodes, only along
+ * edges which can be taken given the constants found so far.
+ *
+ *   .t1 = 2
+ *   if .t1 > 1 goto L1
+ *
+ * The condition is known to always be true, and is replaced by constant
+ * 1, such that the branch can be folded after translating back from SSA
+ * form. Blocks only reachable through branches never taken are left
+ * untouched.
+ *
+ * Blocks and predecessors are given in the same way as to ssa_construct.
+ * Return number of expressions and operands replaced by constants.
+ */
+INTERNAL int propagate_constants(
+    struct definition *def,
+    struct block **blocks,
+    int count,
+    const int *index,
+    const int *preds);
+
+/* Print statistics, and free memory. */
+INTERNAL void constant_propagation_finalize(void);
+
+#endif
@@ -0,0 +1,1103 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "ssa.h"
+#include "optimize.h"
+
+#include <lacc/array.h>
+#include <lacc/context.h>
+#include <lacc/symbol.h>
+#include <assert.h>
+#include <string.h>
+
+typedef array_of(int) IntArray;
+
+/*
+ * Symbols in the function, indexed by symbol number. Versions created
+ * during renaming are numbered after the symbols originally used, and
+ * refer back to the symbol they were created from.
+ */
+struct name {
+    struct symbol *sym;
+
+    /* Number of original symbol, or 0 if not renamed. */
+    int origin;
+
+    /* Block defining this version, in postorder. */
+    int block;
+
+    /* Version currently in scope, while walking the dominator tree. */
+    int current;
+
+    /* Block of last definition seen, or -1. */
+    int mark;
+
+    /* Number of assignments in the original code. */
+    int defs;
+
+    unsigned int is_candidate : 1;
+    unsigned int is_nonlocal : 1;
+    unsigned int is_split : 1;
+};
+
+/*
+ * Phi node merging versions of the same symbol at the start of a block.
+ * There is one argument per predecessor, in the same order as the list
+ * of predecessors, starting at index args in phi_args.
+ */
+struct phi {
+    int origin;
+    int result;
+    int args;
+    struct symbol *copy;
+};
+
+static struct definition *definition;
+
+/* Control flow graph, as given by the optimizer. */
+static struct block **cfg;
+static const int *cfg_index, *cfg_preds;
+static int block_count, symbol_count;
+
+static array_of(struct name) names;
+
+/*
+ * Immediate dominator of each block, children in the dominator tree,
+ * dominance frontiers, and blocks assigning each symbol. Lists are
+ * grouped by the first element, with offsets given by the index.
+ */
+static IntArray idom, dom_index, dom_list, df_index, df_list;
+static IntArray site_index, site_list;
+
+/* Phi nodes placed in each block. */
+static IntArray phi_index, phi_args;
+static array_of(struct phi) phis;
+
+/* Temporary lists of pairs, markers, and saved versions. */
+static IntArray pairs, marks, work, undo;
+
+/*
+ * Position in undo list on entering each block on the path from the
+ * root of the dominator tree, and explicit stack of blocks and the next
+ * child to visit while walking the tree.
+ */
+static IntArray scopes, dom_stack;
+
+/* Callbacks given to ssa_visit_dominator_tree. */
+static int (*visit_enter)(struct definition *, struct block *);
+static void (*visit_leave)(struct definition *, struct block *);
+
+/* Statements saved while inserting copies. */
+static array_of(struct statement) saved;
+
+static int functions_converted, versions_created, phis_placed, splits;
+
+/*
+ * Group list of (key, value) pairs by key, such that values with key i
+ * are found in list from index[i] up to index[i + 1]. Values keep their
+ * relative order.
+ */
+static void group_pairs(int keys, IntArray *index, IntArray *list)
+{
+    int i, n, key;
+
+    n = array_len(&pairs) / 2;
+    array_empty(index);
+    array_realloc(index, (keys + 1));
+    array_len(index) = keys + 1;
+    array_zero(index);
+    for (i = 0; i < n; ++i) {
+        key = array_get(&pairs, 2 * i);
+        array_get(index, key + 1) += 1;
+    }
+
+    for (i = 0; i < keys; ++i) {
+        array_get(index, i + 1) += array_get(index, i);
+    }
+
+    array_empty(list);
+    array_realloc(list, n);
+    array_len(list) = n;
+    for (i = 0; i < n; ++i) {
+        key = array_get(&pairs, 2 * i);
+        array_get(list, array_get(index, key)) = array_get(&pairs, 2 * i + 1);
+        array_get(index, key) += 1;
+    }
+
+    for (i = keys; i > 0; --i) {
+        array_get(index, i) = array_get(index, i - 1);
+    }
+
+    array_get(index, 0) = 0;
+    array_empty(&pairs);
+}
+
+static void add_pair(int key, int value)
+{
+    array_push_back(&pairs, key);
+    array_push_back(&pairs, value);
+}
+
+static void reset_marks(int n)
+{
+    array_realloc(&marks, n);
+    array_len(&marks) = n;
+    memset(&array_get(&marks, 0), 0xFF, n * sizeof(int));
+}
+
+static int intersect(int b1, int b2)
+{
+    while (b1 != b2) {
+        while (b1 < b2) {
+            b1 = array_get(&idom, b1);
+        }
+        while (b2 < b1) {
+            b2 = array_get(&idom, b2);
+        }
+    }
+
+    return b1;
+}
+
+/*
+ * Compute immediate dominators with the iterative algorithm by Cooper,
+ * Harvey and Kennedy, visiting blocks in reverse postorder. Blocks are
+ * identified by their postorder number, such that intersecting two
+ * paths in the dominator tree is a matter of walking up from the lower
+ * numbered block.
+ */
+static void compute_dominators(void)
+{
+    int i, j, p, dom, entry, changed;
+
+    entry = block_count - 1;
+    array_realloc(&idom, block_count);
+    array_len(&idom) = block_count;
+    for (i = 0; i < entry; ++i) {
+        array_get(&idom, i) = -1;
+    }
+
+    array_get(&idom, entry) = entry;
+    do {
+        changed = 0;
+        for (i = entry - 1; i >= 0; --i) {
+            dom = -1;
+            for (j = cfg_index[i]; j < cfg_index[i + 1]; ++j) {
+                p = cfg_preds[j];
+                if (array_get(&idom, p) != -1) {
+                    dom = (dom == -1) ? p : intersect(p, dom);
+                }
+            }
+
+            assert(dom != -1);
+            if (array_get(&idom, i) != dom) {
+                array_get(&idom, i) = dom;
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    for (i = 0; i < entry; ++i) {
+        add_pair(array_get(&idom, i), i);
+    }
+
+    group_pairs(block_count, &dom_index, &dom_list);
+}
+
+/*
+ * Dominance frontier of block x is the set of blocks where dominance
+ * of x ends. Walk up from each predecessor of a join point until
+ * reaching its immediate dominator, adding the join point to the
+ * frontier of each block passed.
+ */
+static void compute_dominance_frontiers(void)
+{
+    int i, j, runner;
+
+    reset_marks(block_count);
+    for (i = 0; i < block_count; ++i) {
+        if (cfg_index[i + 1] - cfg_index[i] < 2)
+            continue;
+
+        for (j = cfg_index[i]; j < cfg_index[i + 1]; ++j) {
+            runner = cfg_preds[j];
+            while (runner != array_get(&idom, i)) {
+                if (array_get(&marks, runner) != i) {
+                    array_get(&marks, runner) = i;
+                    add_pair(runner, i);
+                }
+                runner = array_get(&idom, runner);
+            }
+        }
+    }
+
+    group_pairs(block_count, &df_index, &df_list);
+}
+
+/*
+ * Get number of symbol referenced by operand, if it is a candidate for
+ * renaming, or a version of one.
+ */
+static int name_of(struct var var)
+{
+    int i;
+
+    if (!var.is_symbol || (var.kind != DIRECT && var.kind != DEREF))
+        return 0;
+
+    i = var_symbol(var)->index;
+    if (!i
+        || i >= array_len(&names)
+        || array_get(&names, i).sym != var_symbol(var))
+    {
+        return 0;
+    }
+
+    return array_get(&names, i).origin ? i : 0;
+}
+
+/*
+ * Disqualify symbols which have their address taken, or are accessed
+ * with a different type than they are declared with. Operand is read
+ * in the given block, or -1 if only written.
+ */
+static void check_operand(struct var var, int block)
+{
+    int i;
+    struct name *name;
+
+    if (!var.is_symbol || !is_object(var_symbol(var)->type))
+        return;
+
+    i = var_symbol(var)->index;
+    if (!i || i > symbol_count)
+        return;
+
+    name = &array_get(&names, i);
+    switch (var.kind) {
+    case DIRECT:
+        if (var_offset(var)
+            || is_field(var)
+            || !type_equal(var.type, name->sym->type))
+        {
+            name->is_candidate = 0;
+        }
+        break;
+    case ADDRESS:
+        name->is_candidate = 0;
+        return;
+    default:
+        break;
+    }
+
+    if (block != -1 && name->mark != block) {
+        name->is_nonlocal = 1;
+    }
+}
+
+static void check_expression(const struct expression *expr, int block)
+{
+    switch (expr->op) {
+    default:
+        check_operand(expr->r, block);
+    case IR_OP_CAST:
+    case IR_OP_NOT:
+    case IR_OP_NEG:
+    case IR_OP_CALL:
+    case IR_OP_VA_ARG:
+        check_operand(expr->l, block);
+        break;
+    }
+}
+
+static void check_definition(struct var var, int block)
+{
+    int i;
+    struct name *name;
+
+    if (var.kind != DIRECT)
+        return;
+
+    i = var_symbol(var)->index;
+    if (!i || i > symbol_count)
+        return;
+
+    name = &array_get(&names, i);
+    name->defs++;
+    if (name->mark != block) {
+        name->mark = block;
+        add_pair(i, block);
+    }
+}
+
+/*
+ * Find symbols to rename, and blocks where they are assigned. Symbols
+ * read before being assigned in the same block are live across blocks,
+ * and need phi nodes.
+ */
+static void find_candidates(struct symbol **symbols)
+{
+    int i, j;
+    struct name *name;
+    struct block *block;
+    struct statement *st;
+
+    array_empty(&names);
+    array_realloc(&names, (symbol_count + 1));
+    array_len(&names) = symbol_count + 1;
+    array_zero(&names);
+    for (i = 1; i <= symbol_count; ++i) {
+        name = &array_get(&names, i);
+        name->sym = symbols[i - 1];
+        name->mark = -1;
+        name->is_candidate = name->sym->symtype == SYM_DEFINITION
+            && name->sym->linkage == LINK_NONE
+            && is_scalar(name->sym->type)
+            && !is_volatile(name->sym->type);
+    }
+
+    for (i = 0; i < block_count; ++i) {
+        block = cfg[i];
+        for (j = block->head; j < block->head + block->count; ++j) {
+            st = &array_get(&definition->statements, j);
+            check_expression(&st->expr, i);
+            if (st->st == IR_ASSIGN) {
+                if (st->t.kind == DEREF) {
+                    check_operand(st->t, i);
+                } else {
+                    check_operand(st->t, -1);
+                    check_definition(st->t, i);
+                }
+            }
+        }
+
+        if (block->has_return_value || block->jump[1]) {
+            check_expression(&block->expr, i);
+        }
+    }
+
+    group_pairs(symbol_count + 1, &site_index, &site_list);
+}
+
+/*
+ * Place phi nodes in the iterated dominance frontier of all blocks
+ * assigning to each symbol. Return number of phi nodes placed.
+ */
+static int place_phis(void)
+{
+    int i, j, k, x, y;
+    struct name *name;
+    struct phi phi = {0};
+
+    reset_marks(2 * block_count);
+    for (i = 1; i <= symbol_count; ++i) {
+        name = &array_get(&names, i);
+        if (!name->is_candidate || !name->is_nonlocal)
+            continue;
+
+        array_empty(&work);
+        for (j = array_get(&site_index, i);
+            j < array_get(&site_index, i + 1);
+            ++j)
+        {
+            x = array_get(&site_list, j);
+            array_get(&marks, block_count + x) = i;
+            array_push_back(&work, x);
+        }
+
+        while (array_len(&work)) {
+            x = array_pop_back(&work);
+            for (k = array_get(&df_index, x);
+                k < array_get(&df_index, x + 1);
+                ++k)
+            {
+                y = array_get(&df_list, k);
+                if (array_get(&marks, y) == i)
+                    continue;
+
+                array_get(&marks, y) = i;
+                add_pair(y, i);
+                if (array_get(&marks, block_count + y) != i) {
+                    array_get(&marks, block_count + y) = i;
+                    array_push_back(&work, y);
+                }
+            }
+        }
+    }
+
+    group_pairs(block_count, &phi_index, &work);
+    array_empty(&phis);
+    array_empty(&phi_args);
+    for (i = 0; i < block_count; ++i) {
+        k = cfg_index[i + 1] - cfg_index[i];
+        for (j = array_get(&phi_index, i);
+            j < array_get(&phi_index, i + 1);
+            ++j)
+        {
+            phi.origin = array_get(&work, j);
+            phi.args = array_len(&phi_args);
+            array_push_back(&phis, phi);
+            array_realloc(&phi_args, (phi.args + k));
+            array_len(&phi_args) += k;
+        }
+    }
+
+    return array_len(&phis);
+}
+
+static int create_version(int origin, int block)
+{
+    int i;
+    struct name name = {0};
+
+    i = array_len(&names);
+    name.sym = sym_create_temporary(array_get(&names, origin).sym->type);
+    name.sym->index = i;
+    name.origin = origin;
+    name.block = block;
+    array_push_back(&names, name);
+    versions_created++;
+    return i;
+}
+
+static void push_version(int origin, int version)
+{
+    struct name *name;
+
+    name = &array_get(&names, origin);
+    array_push_back(&undo, origin);
+    array_push_back(&undo, name->current);
+    name->current = version;
+}
+
+static void pop_versions(int mark)
+{
+    int origin, version;
+
+    while (array_len(&undo) > mark) {
+        version = array_pop_back(&undo);
+        origin = array_pop_back(&undo);
+        array_get(&names, origin).current = version;
+    }
+}
+
+static void leave_scope(int b)
+{
+    assert(array_len(&scopes));
+    pop_versions(array_pop_back(&scopes));
+}
+
+/*
+ * Visit blocks in preorder over the dominator tree, calling leave on
+ * each block after all blocks it dominates. The tree can be as deep as
+ * the number of blocks, so the path from the root is kept on an
+ * explicit stack instead of recursing. Return sum of values returned
+ * by enter.
+ */
+static int walk_dominator_tree(int (*enter)(int), void (*leave)(int))
+{
+    int b, i, n;
+
+    array_empty(&dom_stack);
+    b = block_count - 1;
+    n = enter(b);
+    array_push_back(&dom_stack, b);
+    array_push_back(&dom_stack, array_get(&dom_index, b));
+    while (array_len(&dom_stack)) {
+        i = array_get(&dom_stack, array_len(&dom_stack) - 1);
+        b = array_get(&dom_stack, array_len(&dom_stack) - 2);
+        if (i < array_get(&dom_index, b + 1)) {
+            array_get(&dom_stack, array_len(&dom_stack) - 1) = i + 1;
+            b = array_get(&dom_list, i);
+            n += enter(b);
+            array_push_back(&dom_stack, b);
+            array_push_back(&dom_stack, array_get(&dom_index, b));
+        } else {
+            leave(b);
+            array_len(&dom_stack) -= 2;
+        }
+    }
+
+    return n;
+}
+
+static void rename_operand(struct var *var)
+{
+    int i;
+
+    i = name_of(*var);
+    if (i) {
+        assert(array_get(&names, i).origin == i);
+        i = array_get(&names, i).current;
+        var->value.sym.id = array_get(&names, i).sym->id;
+    }
+}
+
+static void rename_expression(struct expression *expr)
+{
+    switch (expr->op) {
+    default:
+        rename_operand(&expr->r);
+    case IR_OP_CAST:
+    case IR_OP_NOT:
+    case IR_OP_NEG:
+    case IR_OP_CALL:
+    case IR_OP_VA_ARG:
+        rename_operand(&expr->l);
+        break;
+    }
+}
+
+/*
+ * Fill in arguments of phi nodes in successor block for the edge from
+ * block b, using the versions currently in scope.
+ */
+static void fill_phi_arguments(int b, int s)
+{
+    int i, j;
+    const struct phi *phi;
+
+    for (j = cfg_index[s]; j < cfg_index[s + 1]; ++j) {
+        if (cfg_preds[j] != b)
+            continue;
+
+        for (i = array_get(&phi_index, s);
+            i < array_get(&phi_index, s + 1);
+            ++i)
+        {
+            phi = &array_get(&phis, i);
+            array_get(&phi_args, phi->args + j - cfg_index[s]) =
+                array_get(&names, phi->origin).current;
+        }
+    }
+}
+
+/*
+ * Rename operands in block to the version in scope, and create a new
+ * version for each assignment. Visit blocks in preorder over the
+ * dominator tree, such that the version in scope is always the one
+ * last assigned on any path to the block.
+ */
+static int rename_block(int b)
+{
+    int i;
+    struct block *block;
+    struct statement *st;
+    const struct phi *phi;
+
+    block = cfg[b];
+    array_push_back(&scopes, array_len(&undo));
+    for (i = array_get(&phi_index, b); i < array_get(&phi_index, b + 1); ++i) {
+        phi = &array_get(&phis, i);
+        push_version(phi->origin, phi->result);
+    }
+
+    for (i = block->head; i < block->head + block->count; ++i) {
+        st = &array_get(&definition->statements, i);
+        rename_expression(&st->expr);
+        if (st->st == IR_ASSIGN) {
+            if (st->t.kind == DEREF) {
+                rename_operand(&st->t);
+            } else if (name_of(st->t)) {
+                push_version(
+                    var_symbol(st->t)->index,
+                    create_version(var_symbol(st->t)->index, b));
+                rename_operand(&st->t);
+            }
+        }
+    }
+
+    if (block->has_return_value || block->jump[1]) {
+        rename_expression(&block->expr);
+    }
+
+    if (block->jump[0]) {
+        fill_phi_arguments(b, block->jump[0]->order);
+        if (block->jump[1] && block->jump[1] != block->jump[0]) {
+            fill_phi_arguments(b, block->jump[1]->order);
+        }
+    }
+
+    return 0;
+}
+
+INTERNAL int ssa_construct(
+    struct definition *def,
+    struct block **list,
+    int count,
+    const int *index,
+    const int *preds,
+    struct symbol **symbols,
+    int n)
+{
+    int i, j, defs;
+    struct name *name;
+    struct phi *phi;
+
+    assert(count > 0);
+    assert(list[count - 1] == def->body);
+    if (index[count] != index[count - 1])
+        return 0;
+
+    definition = def;
+    cfg = list;
+    block_count = count;
+    cfg_index = index;
+    cfg_preds = preds;
+    symbol_count = n;
+    find_candidates(symbols);
+    for (i = 1, defs = 0; i <= n; ++i) {
+        name = &array_get(&names, i);
+        if (name->is_candidate) {
+            defs += name->defs;
+        }
+    }
+
+    if (!defs)
+        return 0;
+
+    compute_dominators();
+    compute_dominance_frontiers();
+    if (n + defs + place_phis() > MAX_SYMBOLS)
+        return 0;
+
+    for (i = 1; i <= n; ++i) {
+        name = &array_get(&names, i);
+        if (name->is_candidate) {
+            name->origin = i;
+            name->current = i;
+        }
+    }
+
+    for (i = 0; i < count; ++i) {
+        for (j = array_get(&phi_index, i);
+            j < array_get(&phi_index, i + 1);
+            ++j)
+        {
+            phi = &array_get(&phis, j);
+            phi->result = create_version(phi->origin, i);
+        }
+    }
+
+    array_empty(&undo);
+    array_empty(&scopes);
+    walk_dominator_tree(&rename_block, &leave_scope);
+    functions_converted++;
+    phis_placed += array_len(&phis);
+    return 1;
+}
+
+/*
+ * Get number of version referenced by symbol, or 0 if the symbol is
+ * not renamed.
+ */
+static int version_of(const struct symbol *sym)
+{
+    int i;
+
+    i = sym->index;
+    if (!definition
+        || !i
+        || i >= array_len(&names)
+        || array_get(&names, i).sym != sym)
+    {
+        return 0;
+    }
+
+    return array_get(&names, i).origin ? i : 0;
+}
+
+INTERNAL int ssa_is_version(const struct symbol *sym)
+{
+    return version_of(sym) != 0;
+}
+
+INTERNAL int ssa_is_unique_version(const struct symbol *sym)
+{
+    int i, origin;
+
+    i = version_of(sym);
+    if (!i || i <= symbol_count)
+        return 0;
+
+    origin = array_get(&names, i).origin;
+    return array_get(&names, origin).defs == 1;
+}
+
+INTERNAL int ssa_phi_count(const struct block *block)
+{
+    int b;
+
+    assert(definition);
+    b = block->order;
+    assert(cfg[b] == block);
+    return array_get(&phi_index, b + 1) - array_get(&phi_index, b);
+}
+
+INTERNAL const struct symbol *ssa_phi_result(const struct block *block, int i)
+{
+    const struct phi *phi;
+
+    phi = &array_get(&phis, array_get(&phi_index, block->order) + i);
+    return array_get(&names, phi->result).sym;
+}
+
+INTERNAL const struct symbol *ssa_phi_argument(
+    const struct block *block,
+    int i,
+    int j)
+{
+    const struct phi *phi;
+
+    phi = &array_get(&phis, array_get(&phi_index, block->order) + i);
+    return array_get(&names, array_get(&phi_args, phi->args + j)).sym;
+}
+
+static int enter_visitor(int b)
+{
+    return visit_enter(definition, cfg[b]);
+}
+
+static void leave_visitor(int b)
+{
+    visit_leave(definition, cfg[b]);
+}
+
+INTERNAL int ssa_visit_dominator_tree(
+    int (*enter)(struct definition *, struct block *),
+    void (*leave)(struct definition *, struct block *))
+{
+    assert(definition);
+    visit_enter = enter;
+    visit_leave = leave;
+    return walk_dominator_tree(&enter_visitor, &leave_visitor);
+}
+
+/*
+ * Check that version read is the one last assigned on every path to
+ * the block, in which case all versions can share the same storage.
+ * Symbols without phi nodes are only assigned and read within the same
+ * block, unless there is just one assignment.
+ */
+static void check_version(int version, int b)
+{
+    int origin;
+    struct name *name;
+
+    origin = array_get(&names, version).origin;
+    name = &array_get(&names, origin);
+    if (name->current != version
+        || (!name->is_nonlocal
+            && name->defs > 1
+            && array_get(&names, version).block != b))
+    {
+        name->is_split = 1;
+    }
+}
+
+static void check_operand_version(struct var var, int b)
+{
+    int i;
+
+    i = name_of(var);
+    if (i) {
+        check_version(i, b);
+    }
+}
+
+static void check_expression_versions(const struct expression *expr, int b)
+{
+    switch (expr->op) {
+    default:
+        check_operand_version(expr->r, b);
+    case IR_OP_CAST:
+    case IR_OP_NOT:
+    case IR_OP_NEG:
+    case IR_OP_CALL:
+    case IR_OP_VA_ARG:
+        check_operand_version(expr->l, b);
+        break;
+    }
+}
+
+static void check_phi_arguments(int b, int s)
+{
+    int i, j, arg;
+    const struct phi *phi;
+
+    for (j = cfg_index[s]; j < cfg_index[s + 1]; ++j) {
+        if (cfg_preds[j] != b)
+            continue;
+
+        for (i = array_get(&phi_index, s);
+            i < array_get(&phi_index, s + 1);
+            ++i)
+        {
+            phi = &array_get(&phis, i);
+            arg = array_get(&phi_args, phi->args + j - cfg_index[s]);
+            check_version(arg, b);
+        }
+    }
+}
+
+static int check_block(int b)
+{
+    int i, v;
+    struct block *block;
+    const struct statement *st;
+    const struct phi *phi;
+
+    block = cfg[b];
+    array_push_back(&scopes, array_len(&undo));
+    for (i = array_get(&phi_index, b); i < array_get(&phi_index, b + 1); ++i) {
+        phi = &array_get(&phis, i);
+        push_version(phi->origin, phi->result);
+    }
+
+    for (i = block->head; i < block->head + block->count; ++i) {
+        st = &array_get(&definition->statements, i);
+        check_expression_versions(&st->expr, b);
+        if (st->st == IR_ASSIGN) {
+            v = name_of(st->t);
+            if (st->t.kind == DEREF) {
+                if (v) {
+                    check_version(v, b);
+                }
+            } else if (v) {
+                push_version(array_get(&names, v).origin, v);
+            }
+        }
+    }
+
+    if (block->has_return_value || block->jump[1]) {
+        check_expression_versions(&block->expr, b);
+    }
+
+    if (block->jump[0]) {
+        check_phi_arguments(b, block->jump[0]->order);
+        if (block->jump[1] && block->jump[1] != block->jump[0]) {
+            check_phi_arguments(b, block->jump[1]->order);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Map version back to original symbol, unless versions of it are kept
+ * separate.
+ */
+static void restore_operand(struct var *var)
+{
+    int i;
+    const struct name *name;
+
+    i = name_of(*var);
+    if (i) {
+        name = &array_get(&names, array_get(&names, i).origin);
+        if (!name->is_split) {
+            var->value.sym.id = name->sym->id;
+        }
+    }
+}
+
+static void restore_expression(struct expression *expr)
+{
+    switch (expr->op) {
+    default:
+        restore_operand(&expr->r);
+    case IR_OP_CAST:
+    case IR_OP_NOT:
+    case IR_OP_NEG:
+    case IR_OP_CALL:
+    case IR_OP_VA_ARG:
+        restore_operand(&expr->l);
+        break;
+    }
+}
+
+static struct statement copy_statement(
+    const struct symbol *target,
+    const struct symbol *source)
+{
+    struct statement st = {0};
+
+    st.st = IR_ASSIGN;
+    st.t = var_direct(target);
+    st.expr = as_expr(var_direct(source));
+    return st;
+}
+
+/*
+ * Assign arguments of phi nodes in successor to their temporaries, at
+ * the end of block b. Each phi node has its own temporary, such that
+ * copies for different phi nodes do not interfere with each other.
+ */
+static void copy_phi_arguments(int b, int s)
+{
+    int i, j;
+    const struct phi *phi;
+    const struct name *arg;
+
+    for (j = cfg_index[s]; j < cfg_index[s + 1]; ++j) {
+        if (cfg_preds[j] == b)
+            break;
+    }
+
+    assert(j < cfg_index[s + 1]);
+    for (i = array_get(&phi_index, s); i < array_get(&phi_index, s + 1); ++i) {
+        phi = &array_get(&phis, i);
+        if (phi->copy) {
+            arg = &array_get(&names,
+                array_get(&phi_args, phi->args + j - cfg_index[s]));
+            array_push_back(
+                &definition->statements,
+                copy_statement(phi->copy, arg->sym));
+        }
+    }
+}
+
+/*
+ * Rebuild list of statements, assigning phi results from temporaries
+ * at the start of blocks, and assigning the temporaries at the end of
+ * predecessors.
+ */
+static void insert_copies(void)
+{
+    int i, j, b, head;
+    struct block *block;
+    const struct phi *phi;
+
+    array_empty(&saved);
+    array_concat(&saved, &definition->statements);
+    array_empty(&definition->statements);
+    for (i = 0; i < array_len(&definition->nodes); ++i) {
+        block = array_get(&definition->nodes, i);
+        head = block->head;
+        block->head = array_len(&definition->statements);
+        b = block->order;
+        if (b < 0 || b >= block_count || cfg[b] != block) {
+            b = -1;
+        }
+
+        if (b != -1) {
+            for (j = array_get(&phi_index, b);
+                j < array_get(&phi_index, b + 1);
+                ++j)
+            {
+                phi = &array_get(&phis, j);
+                if (phi->copy) {
+                    array_push_back(
+                        &definition->statements,
+                        copy_statement(
+                            array_get(&names, phi->result).sym,
+                            phi->copy));
+                }
+            }
+        }
+
+        for (j = head; j < head + block->count; ++j) {
+            array_push_back(&definition->statements, array_get(&saved, j));
+        }
+
+        if (b != -1 && block->jump[0]) {
+            copy_phi_arguments(b, block->jump[0]->order);
+            if (block->jump[1] && block->jump[1] != block->jump[0]) {
+                copy_phi_arguments(b, block->jump[1]->order);
+            }
+        }
+
+        block->count = array_len(&definition->statements) - block->head;
+    }
+}
+
+INTERNAL void ssa_destruct(struct definition *def)
+{
+    int i, j, copies;
+    struct name *name;
+    struct block *block;
+    struct statement *st;
+    struct phi *phi;
+
+    assert(def == definition);
+    array_empty(&undo);
+    array_empty(&scopes);
+    walk_dominator_tree(&check_block, &leave_scope);
+    for (i = 0; i < block_count; ++i) {
+        block = cfg[i];
+        for (j = block->head; j < block->head + block->count; ++j) {
+            st = &array_get(&def->statements, j);
+            restore_expression(&st->expr);
+            if (st->st == IR_ASSIGN) {
+                restore_operand(&st->t);
+            }
+        }
+
+        if (block->has_return_value || block->jump[1]) {
+            restore_expression(&block->expr);
+        }
+    }
+
+    for (i = 0, copies = 0; i < array_len(&phis); ++i) {
+        phi = &array_get(&phis, i);
+        if (array_get(&names, phi->origin).is_split) {
+            phi->copy = sym_create_temporary(
+                array_get(&names, phi->origin).sym->type);
+            array_push_back(&def->locals, phi->copy);
+            copies++;
+        }
+    }
+
+    if (copies) {
+        insert_copies();
+    }
+
+    for (i = symbol_count + 1; i < array_len(&names); ++i) {
+        name = &array_get(&names, i);
+        name->sym->index = 0;
+        if (array_get(&names, name->origin).is_split) {
+            array_push_back(&def->locals, name->sym);
+        } else {
+            sym_discard(name->sym);
+        }
+    }
+
+    for (i = 1; i <= symbol_count; ++i) {
+        splits += array_get(&names, i).is_split;
+    }
+
+    definition = NULL;
+}
+
+INTERNAL void ssa_finalize(void)
+{
+    if (functions_converted) {
+        verbose("Converted %d functions to SSA form, with %d versions and "
+            "%d phi nodes. Kept %d symbols split.",
+            functions_converted, versions_created, phis_placed, splits);
+    }
+
+    functions_converted = 0;
+    versions_created = 0;
+    phis_placed = 0;
+    splits = 0;
+    array_clear(&names);
+    array_clear(&idom);
+    array_clear(&dom_index);
+    array_clear(&dom_list);
+    array_clear(&df_index);
+    array_clear(&df_list);
+    array_clear(&site_index);
+    array_clear(&site_list);
+    array_clear(&phi_index);
+    array_clear(&phi_args);
+    array_clear(&phis);
+    array_clear(&pairs);
+    array_clear(&marks);
+    array_clear(&work);
+    array_clear(&undo);
+    array_clear(&scopes);
+    array_clear(&dom_stack);
+    array_clear(&saved);
+}
@@ -0,0 +1,81 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <lacc/ir.h>
+
+/*
+ * Convert function to static single assignment form. Scalar local
+ * variables and temporaries which never have their address taken are
+ * renamed, giving each assignment a new version, and phi nodes are
+ * placed where different versions meet.
+ *
+ * Blocks are given in postorder, with the entry block last. Indices of
+ * predecessors of block number i are found in preds, from index[i] up
+ * to index[i + 1]. These lists must stay valid until ssa_destruct.
+ * Symbols used must be numbered from 1 to n, and new versions are
+ * numbered after them.
+ *
+ * Return non-zero if the function was converted.
+ */
+INTERNAL int ssa_construct(
+    struct definition *def,
+    struct block **blocks,
+    int count,
+    const int *index,
+    const int *preds,
+    struct symbol **symbols,
+    int n);
+
+/*
+ * Return non-zero if symbol is renamed, meaning it is assigned at most
+ * once while in SSA form.
+ */
+INTERNAL int ssa_is_version(const struct symbol *sym);
+
+/*
+ * Return non-zero if symbol is a version of a symbol with only one
+ * assignment in the original code. Such versions can be read anywhere
+ * dominated by the assignment, without keeping symbols split when
+ * translating back.
+ */
+INTERNAL int ssa_is_unique_version(const struct symbol *sym);
+
+/*
+ * Phi nodes at the start of a block, each with a result, and one
+ * argument for each predecessor in the same order as the list of
+ * predecessors given on construction.
+ */
+INTERNAL int ssa_phi_count(const struct block *block);
+
+INTERNAL const struct symbol *ssa_phi_result(const struct block *block, int i);
+
+INTERNAL const struct symbol *ssa_phi_argument(
+    const struct block *block,
+    int i,
+    int j);
+
+/*
+ * Visit blocks in preorder over the dominator tree, calling enter on
+ * each block before visiting the blocks it dominates, and leave after.
+ * Return sum of values returned by enter.
+ */
+INTERNAL int ssa_visit_dominator_tree(
+    int (*enter)(struct definition *, struct block *),
+    void (*leave)(struct definition *, struct block *));
+
+/*
+ * Translate back from static single assignment form. Versions are
+ * mapped back to the symbol they were created from, unless that would
+ * change the meaning of the program. In that case versions are kept as
+ * separate temporaries, and phi nodes replaced by copies at the end of
+ * predecessor blocks.
+ *
+ * Passes operating on SSA form must keep phi nodes in place, even if
+ * their result is no longer used.
+ */
+INTERNAL void ssa_destruct(struct definition *def);
+
+/* Print statistics, and free memory. */
+INTERNAL void ssa_finalize(void);
+
+#endif
@@ -11,12 +11,14 @@
 static int var_equal(struct var a, struct var b)
 {
     return type_equal(a.type, b.type)
-        && ((!a.is_symbol && !b.is_symbol) || a.value.symbol == b.value.symbol)
+        && a.is_symbol == b.is_symbol
         && a.kind == b.kind
         && a.field_width == b.field_width
         && a.field_offset == b.field_offset
         /* no compare of immediate numeric value, or lvalue. */
-        && a.offset == b.offset;
+        && (!a.is_symbol
+            || (var_symbol(a) == var_symbol(b)
+                && var_offset(a) == var_offset(b)));
 }
 
 /*
@@ -30,21 +32,24 @@ static int var_equal(struct var a, struct var b)
  *
  *  s1: t2 = a + b
  *
+ * Statements are referenced by index of the first one, s2 following
+ * directly after.
  */
-static int can_merge(
-    const struct block *block,
-    const struct statement s1,
-    const struct statement s2)
+static int can_merge(const struct definition *def, int index)
 {
-    return s1.st == IR_ASSIGN
-        && s2.st == IR_ASSIGN
-        && is_identity(s2.expr)
-        && var_equal(s1.t, s2.expr.l)
-        && type_equal(s1.t.type, s2.t.type)
-        && s1.t.kind == DIRECT
-        && s1.t.value.symbol->linkage == LINK_NONE
-        && !is_field(s1.t)
-        && !is_live_after(s1.t.value.symbol, &s2);
+    const struct statement *s1, *s2;
+
+    s1 = &array_get(&def->statements, index);
+    s2 = &array_get(&def->statements, index + 1);
+    return s1->st == IR_ASSIGN
+        && s2->st == IR_ASSIGN
+        && is_identity(s2->expr)
+        && var_equal(s1->t, s2->expr.l)
+        && type_equal(s1->t.type, s2->t.type)
+        && s1->t.kind == DIRECT
+        && var_symbol(s1->t)->linkage == LINK_NONE
+        && !is_field(s1->t)
+        && !is_live_after(def, var_symbol(s1->t), index + 1);
 }
 
 static void statement_array_erase(
@@ -57,6 +62,8 @@ static void statement_array_erase(
     assert(index >= 0);
     assert(index < array_len(&def->statements));
     array_erase(&def->statements, index);
+    erase_liveness(def, index);
+
     for (i = 0; i < array_len(&def->nodes); ++i) {
         block = array_get(&def->nodes, i);
         if (index > block->head + block->count)
@@ -75,24 +82,21 @@ INTERNAL int merge_chained_assignment(
     struct block *block)
 {
     int i, c;
-    struct statement s1, s2;
+    struct statement *s1, *s2;
 
     if (block->count <= 1)
         return 0;
 
     c = 0;
     i = 1;
-    s1 = array_get(&def->statements, block->head);
     while (i < block->count) {
-        s2 = array_get(&def->statements, block->head + i);
-        if (can_merge(block, s1, s2)) {
+        if (can_merge(def, block->head + i - 1)) {
             c++;
-            s1.t = s2.t;
-            array_get(&def->statements, block->head + i - 1) = s1;
+            s1 = &array_get(&def->statements, block->head + i - 1);
+            s2 = &array_get(&def->statements, block->head + i);
+            s1->t = s2->t;
             statement_array_erase(def, block->head + i);
-            s1 = array_get(&def->statements, block->head + i - 1);
         } else {
-            s1 = array_get(&def->statements, block->head + i);
             i += 1;
         }
     }
@@ -100,6 +104,15 @@ INTERNAL int merge_chained_assignment(
     return c;
 }
 
+/*
+ * Calls returning aggregate types can need the target as storage for
+ * the result, even if it is not read afterwards.
+ */
+static int is_call_with_aggregate_result(const struct statement *st)
+{
+    return st->expr.op == IR_OP_CALL && is_struct_or_union(st->t.type);
+}
+
 INTERNAL int dead_store_elimination(
     struct definition *def,
     struct block *block)
@@ -111,8 +124,9 @@ INTERNAL int dead_store_elimination(
         st = &array_get(&def->statements, block->head + i);
         if (st->st == IR_ASSIGN
             && st->t.kind == DIRECT
-            && !is_live_after(st->t.value.symbol, st)
-            && st->t.value.symbol->linkage == LINK_NONE)
+            && !is_live_after(def, var_symbol(st->t), block->head + i)
+            && var_symbol(st->t)->linkage == LINK_NONE
+            && !is_call_with_aggregate_result(st))
         {
             c += 1;
             if (has_side_effects(st->expr)) {
@@ -126,3 +140,22 @@ INTERNAL int dead_store_elimination(
 
     return c;
 }
+
+INTERNAL int fold_constant_branches(
+    struct definition *def,
+    struct block *block)
+{
+    if (!block->jump[1]
+        || !is_immediate(block->expr)
+        || !(is_integer(block->expr.type) || is_pointer(block->expr.type)))
+    {
+        return 0;
+    }
+
+    if (block->expr.l.value.imm.u) {
+        block->jump[0] = block->jump[1];
+    }
+
+    block->jump[1] = NULL;
+    return 1;
+}
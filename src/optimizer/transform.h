@@ -28,4 +28,12 @@ INTERNAL int dead_store_elimination(
     struct definition *def,
     struct block *block);
 
+/*
+ * Replace conditional jump on a constant by a jump to the branch always
+ * taken, leaving the other one unreachable.
+ */
+INTERNAL int fold_constant_branches(
+    struct definition *def,
+    struct block *block);
+
 #endif
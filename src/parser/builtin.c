@@ -119,6 +119,7 @@ static struct block *parse__builtin_alloca(
     struct definition *def,
     struct block *block)
 {
+    Type type;
     struct var t1;
     struct symbol *sym;
 
@@ -129,7 +130,8 @@ static struct block *parse__builtin_alloca(
     t1 = create_var(def, basic_type__unsigned_long);
     eval_assign(def, block, t1, block->expr);
 
-    sym = sym_create_temporary(type_create_vla(basic_type__char, t1.value.symbol));
+    type = type_create_vla(basic_type__char, var_symbol(t1));
+    sym = sym_create_temporary(type);
     array_push_back(&def->locals, sym);
 
     block = declare_vla(def, block, sym);
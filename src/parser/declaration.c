@@ -253,7 +253,7 @@ static struct block *array_declarator(
         if (!type_equal(val.type, basic_type__unsigned_long)) {
             val = eval(def, block,
                 eval_cast(def, block, val, basic_type__unsigned_long));
-        } else if (val.kind == DIRECT && !is_temporary(val.value.symbol)) {
+        } else if (val.kind == DIRECT && !is_temporary(var_symbol(val))) {
             val = eval_copy(def, block, val);
         }
 
@@ -265,8 +265,8 @@ static struct block *array_declarator(
             length = val.value.imm.u;
         } else {
             assert(val.kind == DIRECT);
-            assert(val.value.symbol);
-            sym = val.value.symbol;
+            assert(var_symbol(val));
+            sym = var_symbol(val);
         }
     }
 
@@ -996,6 +996,37 @@ INTERNAL struct block *declare_vla(
     return block;
 }
 
+/*
+ * Remember value of constant scalar objects with static storage, which
+ * is known for the rest of the translation unit.
+ */
+static void mark_readonly(const struct definition *def, struct symbol *sym)
+{
+    const struct statement *st;
+
+    if (!is_scalar(sym->type)
+        || !is_const(sym->type)
+        || is_volatile(sym->type)
+        || def->body->count != 1)
+    {
+        return;
+    }
+
+    st = &array_get(&def->statements, def->body->head);
+    if (st->st == IR_ASSIGN
+        && st->t.kind == DIRECT
+        && var_symbol(st->t) == sym
+        && !var_offset(st->t)
+        && !is_field(st->t)
+        && is_immediate(st->expr)
+        && !st->expr.l.is_symbol
+        && type_equal(st->expr.type, sym->type))
+    {
+        sym->readonly = 1;
+        sym->value.constant = st->expr.l.value.imm;
+    }
+}
+
 /*
  * Parse declaration, possibly with initializer. New symbols are added
  * to the symbol table.
@@ -1110,6 +1141,7 @@ static struct block *init_declarator(
         parent = initializer(def, parent, sym);
         assert(size_of(sym->type) > 0);
         if (sym->linkage != LINK_NONE) {
+            mark_readonly(def, sym);
             cfg_define(def, sym);
         }
         break;
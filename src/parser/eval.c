@@ -36,16 +36,16 @@ static int extract_literal_char(struct var v)
     String str;
 
     assert(v.kind == DIRECT);
-    assert(v.value.symbol->symtype == SYM_LITERAL);
+    assert(var_symbol(v)->symtype == SYM_LITERAL);
 
-    str = v.value.symbol->value.string;
+    str = var_symbol(v)->value.string;
     raw = str_raw(str);
-    if (v.offset >= str_len(str)) {
+    if (var_offset(v) >= str_len(str)) {
         error("Access outside bounds of string literal.");
         exit(1);
     }
 
-    return raw[v.offset];
+    return raw[var_offset(v)];
 }
 
 INTERNAL int immediate_bool(struct expression expr)
@@ -58,12 +58,12 @@ INTERNAL int immediate_bool(struct expression expr)
     case IMMEDIATE:
         return immediate_bool_value(expr.l.value.imm, expr.type);
     case DIRECT:
-        if (expr.l.value.symbol->symtype == SYM_LITERAL)
+        if (var_symbol(expr.l)->symtype == SYM_LITERAL)
             return extract_literal_char(expr.l) != 0;
         break;
     case ADDRESS:
-        if (expr.l.value.symbol->symtype == SYM_LITERAL
-            || is_function(expr.l.value.symbol->type))
+        if (var_symbol(expr.l)->symtype == SYM_LITERAL
+            || is_function(var_symbol(expr.l)->type))
             return 1;
     default:
         break;
@@ -107,7 +107,7 @@ INTERNAL struct var var_direct(const struct symbol *sym)
 
     assert(sym);
     var.type = sym->type;
-    var.value.symbol = sym;
+    var.value.sym.id = sym->id;
     var.is_symbol = 1;
 
     switch (sym->symtype) {
@@ -144,6 +144,29 @@ INTERNAL struct var var_numeric(Type type, union value val)
     return var;
 }
 
+INTERNAL struct var var_add_offset(struct var var, long n)
+{
+    long offset;
+
+    if (!var.is_symbol) {
+        var.value.imm.u += n;
+        return var;
+    }
+
+    /*
+     * Offsets are stored in 32 bits. Negative results are undefined
+     * behavior, and only rejected if used in code generation.
+     */
+    offset = var_offset(var) + n;
+    if (offset > INT_MAX || offset < INT_MIN) {
+        error("Offset %ld exceeds limit of %d.", offset, INT_MAX);
+        exit(1);
+    }
+
+    var_offset(var) = (int) offset;
+    return var;
+}
+
 static struct var imm_signed(Type type, long n)
 {
     union value val = {0};
@@ -425,7 +448,6 @@ static struct var cast_operand(
     }
 
     if (var.kind == IMMEDIATE) {
-        assert(!var.offset);
         return var_numeric(type, convert(var.value.imm, var.type, type));
     }
 
@@ -466,7 +488,6 @@ INTERNAL struct expression eval_cast(
     }
 
     if (var.kind == IMMEDIATE) {
-        assert(!var.offset);
         var = var_numeric(type, convert(var.value.imm, var.type, type));
         return as_expr(var);
     }
@@ -670,10 +691,10 @@ INTERNAL struct expression eval_add(
             }
             expr = as_expr(l);
         } else if (l.kind == ADDRESS && r.kind == IMMEDIATE) {
-            l.offset += r.value.imm.i;
+            l = var_add_offset(l, r.value.imm.i);
             expr = as_expr(l);
         } else if (l.kind == IMMEDIATE && r.kind == ADDRESS) {
-            r.offset += l.value.imm.i;
+            r = var_add_offset(r, l.value.imm.i);
             expr = as_expr(r);
         } else {
             expr = create_binary_expression(IR_OP_ADD, type, l, r);
@@ -693,7 +714,7 @@ INTERNAL struct expression eval_add(
             error("Pointer arithmetic on incomplete type %t.", l.type);
             exit(1);
         } else if (l.kind == ADDRESS && r.kind == IMMEDIATE) {
-            l.offset += r.value.imm.i * size;
+            l = var_add_offset(l, r.value.imm.i * size);
             expr = as_expr(l);
         } else if (l.kind == IMMEDIATE && r.kind == IMMEDIATE) {
             l.value.imm.i += r.value.imm.i * size;
@@ -765,7 +786,7 @@ INTERNAL struct expression eval_sub(
             }
             expr = as_expr(l);
         } else if (l.kind == ADDRESS && r.kind == IMMEDIATE) {
-            l.offset -= r.value.imm.i;
+            l = var_add_offset(l, -r.value.imm.i);
             expr = as_expr(l);
         } else {
             expr = create_binary_expression(IR_OP_SUB, type, l, r);
@@ -784,7 +805,7 @@ INTERNAL struct expression eval_sub(
             error("Pointer arithmetic on incomplete type.");
             exit(1);
         } else if (l.kind == ADDRESS && r.kind == IMMEDIATE) {
-            l.offset -= r.value.imm.i * size;
+            l = var_add_offset(l, -r.value.imm.i * size);
             expr = as_expr(l);
         } else if (l.kind == IMMEDIATE && r.kind == IMMEDIATE) {
             l.value.imm.i -= r.value.imm.i * size;
@@ -1219,11 +1240,11 @@ INTERNAL struct var rvalue(
     } else if (is_array(var.type)) {
         if (is_vla(var.type)) {
             if (var.kind == DIRECT) {
-                assert(is_vla(var.value.symbol->type));
-                var = var_direct(var.value.symbol->value.vla_address);
+                assert(is_vla(var_symbol(var)->type));
+                var = var_direct(var_symbol(var)->value.vla_address);
             } else {
                 assert(var.kind == DEREF);
-                assert(!var.offset);
+                assert(!var.is_symbol || !var_offset(var));
                 var.kind = DIRECT;
                 var.type = type_create_pointer(type_next(var.type));
             }
@@ -1330,7 +1351,6 @@ INTERNAL struct expression eval_unary_plus(struct var val)
     }
 
     if (val.kind == IMMEDIATE) {
-        assert(!val.offset);
         val = var_numeric(type, convert(val.value.imm, val.type, type));
         return as_expr(val);
     }
@@ -1351,14 +1371,14 @@ INTERNAL struct var eval_addr(
     }
 
     if (is_vla(var.type) && var.kind == DIRECT) {
-        assert(is_vla(var.value.symbol->type));
-        var = var_direct(var.value.symbol->value.vla_address);
+        assert(is_vla(var_symbol(var)->type));
+        var = var_direct(var_symbol(var)->value.vla_address);
         return var;
     }
 
     switch (var.kind) {
     case IMMEDIATE:
-        if (!var.is_symbol || var.value.symbol->symtype != SYM_LITERAL) {
+        if (!var.is_symbol || var_symbol(var)->symtype != SYM_LITERAL) {
             error("Cannot take address of immediate of type '%t'.", var.type);
             exit(1);
         }
@@ -1389,13 +1409,11 @@ INTERNAL struct var eval_addr(
     case DEREF:
         if (!var.is_symbol) {
             /*
-             * Address of *(const + offset) is just the constant.
-             * Convert to immediate, adding the extra offset.
+             * Address of *(const + offset) is just the constant, which
+             * already includes the offset. Convert to immediate.
              */
             var.kind = IMMEDIATE;
             var.type = type_create_pointer(var.type);
-            var.value.imm.u += var.offset;
-            var.offset = 0;
             var.lvalue = 0;
         } else {
             /*
@@ -1403,13 +1421,13 @@ INTERNAL struct var eval_addr(
              * not possible to just convert to DIRECT. Offset must be
              * applied after converting to direct pointer.
              */
-            assert(is_pointer(var.value.symbol->type));
-            tmp = var_direct(var.value.symbol);
-            if (var.offset) {
+            assert(is_pointer(var_symbol(var)->type));
+            tmp = var_direct(var_symbol(var));
+            if (var_offset(var)) {
                 ptr = cast_operand(def, block, tmp,
                     type_create_pointer(basic_type__char));
                 tmp = eval(def, block,
-                    eval_add(def, block, ptr, var_int(var.offset)));
+                    eval_add(def, block, ptr, var_int(var_offset(var))));
             }
             tmp.type = type_create_pointer(var.type);
             var = tmp;
@@ -1442,7 +1460,7 @@ INTERNAL struct var eval_deref(
         break;
     case DIRECT:
         assert(var.is_symbol);
-        if (var.offset != 0 || !is_pointer(var.value.symbol->type)) {
+        if (var_offset(var) != 0 || !is_pointer(var_symbol(var)->type)) {
             /*
              * Cannot immediately dereference a pointer which is at a
              * direct offset from another symbol. Also, pointers that
@@ -1473,12 +1491,12 @@ INTERNAL struct var eval_deref(
         var.kind = DEREF;
         var.type = type_deref(var.type);
         var.lvalue = 1;
-        assert(!var.is_symbol || var.value.symbol->symtype == SYM_LITERAL);
+        assert(!var.is_symbol || var_symbol(var)->symtype == SYM_LITERAL);
         return var;
     }
 
     assert(var.kind == DIRECT);
-    assert(!var.offset);
+    assert(!var_offset(var));
     assert(is_pointer(var.type));
     var.kind = DEREF;
     var.type = type_deref(var.type);
@@ -1511,7 +1529,7 @@ static struct var eval_assign_string_literal(
 
     assert(is_identity(expr));
     assert(is_array(target.type));
-    assert(expr.l.value.symbol->symtype == SYM_LITERAL);
+    assert(var_symbol(expr.l)->symtype == SYM_LITERAL);
     if (!is_char(type_next(target.type))) {
         error("Assigning string literal to non-char array.");
         exit(1);
@@ -1519,9 +1537,9 @@ static struct var eval_assign_string_literal(
 
     if (!size_of(target.type)) {
         assert(target.kind == DIRECT);
-        assert(target.offset == 0);
-        assert(size_of(target.value.symbol->type) == 0);
-        set_array_length(target.value.symbol->type, size_of(expr.type));
+        assert(var_offset(target) == 0);
+        assert(size_of(var_symbol(target)->type) == 0);
+        set_array_length(var_symbol(target)->type, size_of(expr.type));
         target.type = expr.type;
         ir_assign(def, block, target, expr);
     } else {
@@ -1539,7 +1557,7 @@ static struct var eval_assign_string_literal(
         target.type = type;
     }
 
-    target.offset += size_of(expr.type);
+    var_offset(target) += size_of(expr.type);
     return target;
 }
 
@@ -272,4 +272,10 @@ INTERNAL struct var imm_unsigned(Type type, unsigned long val);
 /* Immediate representing void value. */
 INTERNAL struct var var_void(void);
 
+/*
+ * Add constant number of bytes to address of var. For dereferenced
+ * constants, the offset is added to the immediate value.
+ */
+INTERNAL struct var var_add_offset(struct var var, long n);
+
 #endif
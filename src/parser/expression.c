@@ -223,7 +223,7 @@ static struct block *postfix(
             value.type = mbr->type;
             value.field_width = mbr->field_width;
             value.field_offset = mbr->field_offset;
-            value.offset += mbr->offset;
+            value = var_add_offset(value, mbr->offset);
             block->expr = as_expr(value);
             root = block->expr;
             break;
@@ -242,7 +242,7 @@ static struct block *postfix(
                 value.type = mbr->type;
                 value.field_width = mbr->field_width;
                 value.field_offset = mbr->field_offset;
-                value.offset += mbr->offset;
+                value = var_add_offset(value, mbr->offset);
                 block->expr = as_expr(value);
                 root = block->expr;
             } else {
@@ -11,6 +11,7 @@
 #include <lacc/token.h>
 
 #include <assert.h>
+#include <limits.h>
 
 typedef array_of(struct statement) InitializerList;
 
@@ -75,7 +76,7 @@ static int is_loadtime_constant(struct expression expr)
         if (!is_array(expr.type) && !is_function(expr.type))
             return 0;
     case ADDRESS:
-        return expr.l.value.symbol->linkage != LINK_NONE;
+        return var_symbol(expr.l)->linkage != LINK_NONE;
     default:
         return 0;
     }
@@ -157,7 +158,7 @@ static struct var access_member(
     target.type = member->type;
     target.field_offset = member->field_offset;
     target.field_width = member->field_width;
-    target.offset = offset + member->offset;
+    var_offset(target) = offset + member->offset;
     return target;
 }
 
@@ -211,7 +212,7 @@ static struct block *initialize_union(
     String name;
 
     done = 0;
-    filled = target.offset;
+    filled = var_offset(target);
     type = target.type;
     init = get_initializer_list();
     assert(is_union(type));
@@ -262,7 +263,7 @@ static struct block *initialize_struct(
 
     prev = NULL;
     target.lvalue = 1;
-    filled = target.offset;
+    filled = var_offset(target);
     type = target.type;
     assert(is_struct(type));
     assert(nmembers(type) > 0);
@@ -354,7 +355,7 @@ static struct block *initialize_struct_or_union(
         break;
     default:
         assert(target.is_symbol);
-        block = read_initializer_element(def, block, target.value.symbol);
+        block = read_initializer_element(def, block, var_symbol(target));
         break;
     }
 
@@ -452,7 +453,7 @@ static struct block *initialize_array(
     type = target.type;
     elem = type_next(type);
     width = size_of(elem);
-    initial = target.offset;
+    initial = var_offset(target);
 
     /*
      * Need to read expression to determine if element is a string
@@ -464,7 +465,7 @@ static struct block *initialize_array(
     case '[':
         break;
     default:
-        block = read_initializer_element(def, block, target.value.symbol);
+        block = read_initializer_element(def, block, var_symbol(target));
         break;
     }
 
@@ -474,7 +475,7 @@ static struct block *initialize_array(
         && is_identity(block->expr)
         && is_array(block->expr.type)
         && block->expr.l.kind == DIRECT
-        && block->expr.l.value.symbol->symtype == SYM_LITERAL)
+        && var_symbol(block->expr.l)->symtype == SYM_LITERAL)
     {
         target = assign_initializer_element(def, block, values, target);
     } else {
@@ -484,7 +485,7 @@ static struct block *initialize_array(
                 next();
             }
 
-            target.offset = initial + (i * width);
+            var_offset(target) = initial + (i * width);
             block = initialize_member(def, block, values, target);
             i += 1;
             c = i > c ? i : c;
@@ -497,9 +498,9 @@ static struct block *initialize_array(
     }
 
     if (!size_of(type)) {
-        assert(is_array(target.value.symbol->type));
-        assert(!size_of(target.value.symbol->type));
-        set_array_length(target.value.symbol->type, c);
+        assert(is_array(var_symbol(target)->type));
+        assert(!size_of(var_symbol(target)->type));
+        set_array_length(var_symbol(target)->type, c);
     }
 
     return block;
@@ -536,10 +537,12 @@ static struct block *initialize_member(
     } else {
         if (!block->has_init_value) {
             if (try_consume('{')) {
-                block = read_initializer_element(def, block, target.value.symbol);
+                block = read_initializer_element(def, block,
+                    var_symbol(target));
                 consume('}');
             } else {
-                block = read_initializer_element(def, block, target.value.symbol);
+                block = read_initializer_element(def, block,
+                    var_symbol(target));
             }
         }
 
@@ -572,7 +575,7 @@ static struct block *initialize_object(
     } else if (is_array(target.type)) {
         block = initialize_array(def, block, values, target, MEMBER);
     } else {
-        block = read_initializer_element(def, block, target.value.symbol);
+        block = read_initializer_element(def, block, var_symbol(target));
         assign_initializer_element(def, block, values, target);
     }
 
@@ -612,7 +615,7 @@ static void zero_initialize(
         var = target;
         target.type = type_next(target.type);
         for (i = 0; i < size / size_of(target.type); ++i) {
-            target.offset = var.offset + i * size_of(target.type);
+            var_offset(target) = var_offset(var) + i * size_of(target.type);
             zero_initialize(def, values, target);
         }
         break;
@@ -672,7 +675,7 @@ static void zero_initialize_bytes(
         }
 
         zero_initialize(def, values, target);
-        target.offset += size_of(target.type);
+        var_offset(target) += size_of(target.type);
         bytes -= size;
     }
 }
@@ -696,12 +699,12 @@ static void initialize_padding(
     size_t bytes;
 
     assert(!prev.field_width);
-    assert(prev.offset <= next.offset);
-    assert(prev.offset * 8 + prev.field_offset
-        <= next.offset * 8 + next.field_offset);
+    assert(var_offset(prev) <= var_offset(next));
+    assert(var_offset(prev) * 8 + prev.field_offset
+        <= var_offset(next) * 8 + next.field_offset);
 
     while (1) {
-        if (prev.offset == next.offset) {
+        if (var_offset(prev) == var_offset(next)) {
             assert(prev.field_offset <= next.field_offset);
             prev.field_width = next.field_offset - prev.field_offset;
             if (prev.field_width) {
@@ -727,7 +730,7 @@ static void initialize_padding(
         case 16:
         case 32:
         case 64:
-            prev.offset += prev.field_offset / 8;
+            var_offset(prev) += prev.field_offset / 8;
             prev.field_offset = 0;
         case 0:
             break;
@@ -739,24 +742,25 @@ static void initialize_padding(
                 prev.type = basic_type__unsigned_long;
             }
 
-            bytes = prev.offset + size_of(prev.type);
+            bytes = var_offset(prev) + size_of(prev.type);
             prev.field_width = size_of(prev.type) * 8 - prev.field_offset;
-            if (bytes > next.offset) {
-                assert(prev.field_width * 8 > (bytes - next.offset));
-                prev.field_width -= (bytes - next.offset) * 8;
+            if (bytes > var_offset(next)) {
+                assert(prev.field_width * 8 > (bytes - var_offset(next)));
+                prev.field_width -= (bytes - var_offset(next)) * 8;
             }
 
             assert((prev.field_offset + prev.field_width) % 8 == 0);
             zero_initialize(def, block, prev);
-            prev.offset += (prev.field_offset + prev.field_width) / 8;
+            var_offset(prev) += (prev.field_offset + prev.field_width) / 8;
             prev.field_offset = 0;
             prev.field_width = 0;
             break;
         }
 
-        assert(prev.offset <= next.offset);
-        zero_initialize_bytes(def, block, prev, next.offset - prev.offset);
-        prev.offset = next.offset;
+        assert(var_offset(prev) <= var_offset(next));
+        zero_initialize_bytes(def, block, prev,
+            var_offset(next) - var_offset(prev));
+        var_offset(prev) = var_offset(next);
     }
 }
 
@@ -772,7 +776,7 @@ static int merge_assignments(struct statement *a, const struct statement *b)
 {
     long m1, m2;
 
-    if (a->t.offset != b->t.offset
+    if (var_offset(a->t) != var_offset(b->t)
         || !is_constant_assignment(a)
         || !is_constant_assignment(b))
     {
@@ -846,11 +850,11 @@ static size_t validate_contiguous_initialization(InitializerList *block)
 
         if (field.field_width) {
             assert(!field.field_offset
-                || (i && prev.offset == field.offset));
-            assert(field.offset * 8 + field.field_offset == bits);
+                || (i && var_offset(prev) == var_offset(field)));
+            assert(var_offset(field) * 8 + field.field_offset == bits);
             bits += field.field_width;
         } else {
-            assert(field.offset * 8 == bits);
+            assert(var_offset(field) * 8 == bits);
             bits += size_of(field.type) * 8;
         }
 
@@ -875,7 +879,7 @@ static void sort_and_trim(InitializerList *values)
     code = &array_get(values, 0);
     for (i = 1; i < array_len(values); ++i) {
         j = i - 1;
-        while (j >= 0 && code[j].t.offset > code[j + 1].t.offset) {
+        while (j >= 0 && var_offset(code[j].t) > var_offset(code[j + 1].t)) {
             tmp = code[j];
             code[j] = code[j + 1];
             code[j + 1] = tmp;
@@ -886,7 +890,7 @@ static void sort_and_trim(InitializerList *values)
             }
         }
 
-        if (code[j].t.offset == code[j + 1].t.offset
+        if (var_offset(code[j].t) == var_offset(code[j + 1].t)
             && code[j].t.field_offset == code[j + 1].t.field_offset)
         {
             assert(code[j].t.field_width == code[j + 1].t.field_width);
@@ -913,7 +917,12 @@ static void postprocess_object_initialization(
     struct var prev, next;
     InitializerList block;
 
-    assert(!target.offset);
+    assert(!var_offset(target));
+    if (size_of(target.type) > INT_MAX) {
+        error("Object is too large to initialize.");
+        exit(1);
+    }
+
     sort_and_trim(values);
     block = get_initializer_list();
     prev = target;
@@ -923,19 +932,19 @@ static void postprocess_object_initialization(
         next = st.t;
         assert(st.st == IR_ASSIGN);
         assert(st.expr.op != IR_OP_CALL);
-        assert(next.is_symbol && next.value.symbol == target.value.symbol);
+        assert(next.is_symbol && var_symbol(next) == var_symbol(target));
         initialize_padding(def, &block, prev, next);
         array_push_back(&block, st);
-        prev.offset = next.offset;
+        var_offset(prev) = var_offset(next);
         prev.field_offset = next.field_offset + next.field_width;
         if (!next.field_width) {
-            prev.offset += size_of(next.type);
+            var_offset(prev) += size_of(next.type);
         } else {
             has_field = 1;
         }
     }
 
-    next.offset = size_of(target.type);
+    var_offset(next) = size_of(target.type);
     next.field_offset = 0;
     initialize_padding(def, &block, prev, next);
     if (has_field) {
@@ -0,0 +1,619 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "inline.h"
+#include "parse.h"
+#include <lacc/array.h>
+#include <lacc/context.h>
+#include <lacc/timer.h>
+#include <lacc/type.h>
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Maximum number of statements in a function body for it to be copied
+ * to call sites. Functions declared inline can be larger than other
+ * static functions.
+ */
+#define MAX_STATIC_SIZE 16
+#define MAX_INLINE_SIZE 64
+
+/* Stop inlining calls when a function has grown this many statements. */
+#define MAX_GROWTH 1024
+
+/* Maximum number of parameters and local variables in function body. */
+#define MAX_LOCALS 256
+
+#define is_binary(e) ((e).op >= IR_OP_ADD)
+
+static int inline_level, calls_inlined;
+
+/*
+ * Temporaries replacing parameters and local variables of the function
+ * being inlined, indexed by symbol number minus one.
+ */
+static array_of(struct symbol *) symbol_copies;
+
+/*
+ * Copy of each block in callee, in the same order as callee nodes. The
+ * position is stored in block order while copying.
+ */
+static array_of(struct block *) block_copies;
+
+/* Statements of caller after inlining, ordered by block. */
+static array_of(struct statement) compacted;
+
+/*
+ * Parameters and local variables of a function are numbered from 1
+ * while the function is considered for inlining, and reset to zero
+ * afterwards. Other symbols keep index 0, so locals can be recognized
+ * without searching the lists of the definition.
+ */
+static void number_locals(const struct definition *def)
+{
+    int i, n;
+    struct symbol *sym;
+
+    n = array_len(&def->params);
+    for (i = 0; i < n; ++i) {
+        sym = array_get(&def->params, i);
+        assert(!sym->index);
+        sym->index = i + 1;
+    }
+
+    for (i = 0; i < array_len(&def->locals); ++i) {
+        sym = array_get(&def->locals, i);
+        assert(!sym->index);
+        sym->index = n + i + 1;
+    }
+}
+
+static void reset_locals(const struct definition *def)
+{
+    int i;
+
+    for (i = 0; i < array_len(&def->params); ++i) {
+        array_get(&def->params, i)->index = 0;
+    }
+
+    for (i = 0; i < array_len(&def->locals); ++i) {
+        array_get(&def->locals, i)->index = 0;
+    }
+}
+
+static int is_local(const struct symbol *sym)
+{
+    return sym->index != 0;
+}
+
+/*
+ * Local variables can only be replaced by temporaries if their address
+ * is never taken.
+ */
+static int is_inline_operand(struct var var)
+{
+    if (!var.is_symbol || var_symbol(var)->linkage != LINK_NONE)
+        return 1;
+
+    return var.kind != ADDRESS
+        && var_offset(var) == 0
+        && !is_field(var)
+        && is_local(var_symbol(var));
+}
+
+static int is_inline_expression(
+    const struct definition *def,
+    struct expression expr)
+{
+    if (expr.op == IR_OP_CALL
+        && expr.l.is_symbol
+        && var_symbol(expr.l) == def->symbol)
+    {
+        return 0;
+    }
+
+    return is_inline_operand(expr.l)
+        && (!is_binary(expr) || is_inline_operand(expr.r));
+}
+
+static int is_inline_symbol(const struct symbol *sym)
+{
+    return is_scalar(sym->type) && !is_volatile(sym->type);
+}
+
+/*
+ * Determine if function body can be copied to a call site. Functions
+ * using variable length arrays, va_start, or inline assembly are not
+ * considered, nor recursive functions. All parameters and local
+ * variables must be scalars which can be held in temporaries.
+ */
+static int can_inline(const struct definition *def)
+{
+    int i, limit;
+    Type type;
+    const struct block *block;
+    const struct statement *st;
+
+    assert(is_function(def->symbol->type));
+    if (def->symbol->inlined) {
+        limit = MAX_INLINE_SIZE;
+    } else if (inline_level >= 2 && def->symbol->linkage == LINK_INTERN) {
+        limit = MAX_STATIC_SIZE;
+    } else {
+        return 0;
+    }
+
+    type = def->symbol->type;
+    if (array_len(&def->statements) > limit
+        || array_len(&def->nodes) > limit
+        || array_len(&def->params) + array_len(&def->locals) > MAX_LOCALS
+        || array_len(&def->asm_statements)
+        || is_vararg(type)
+        || !(is_void(type_next(type)) || is_scalar(type_next(type))))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < array_len(&def->params); ++i) {
+        if (!is_inline_symbol(array_get(&def->params, i)))
+            return 0;
+    }
+
+    for (i = 0; i < array_len(&def->locals); ++i) {
+        if (!is_inline_symbol(array_get(&def->locals, i)))
+            return 0;
+    }
+
+    number_locals(def);
+    for (i = 0; i < array_len(&def->statements); ++i) {
+        st = &array_get(&def->statements, i);
+        switch (st->st) {
+        case IR_ASSIGN:
+            if (!is_inline_operand(st->t))
+                goto fail;
+            /* Fallthrough. */
+        case IR_EXPR:
+        case IR_PARAM:
+            if (!is_inline_expression(def, st->expr))
+                goto fail;
+            break;
+        default:
+            goto fail;
+        }
+    }
+
+    for (i = 0; i < array_len(&def->nodes); ++i) {
+        block = array_get(&def->nodes, i);
+        if ((block->has_return_value || block->jump[1])
+            && !is_inline_expression(def, block->expr))
+        {
+            goto fail;
+        }
+    }
+
+    reset_locals(def);
+    return 1;
+
+fail:
+    reset_locals(def);
+    return 0;
+}
+
+/*
+ * Find function called by expression, if it is one of the candidates.
+ * Arguments are given by the parameter statements directly preceding
+ * the call at index i in block, which must match the parameters of the
+ * function definition.
+ */
+static struct definition *find_callee(
+    struct definition *def,
+    struct block *block,
+    int i,
+    struct expression expr,
+    struct definition **callees,
+    int count)
+{
+    int j, n;
+    const struct symbol *sym;
+    const struct statement *st;
+    struct definition *callee;
+
+    if (expr.op != IR_OP_CALL
+        || expr.l.kind != ADDRESS
+        || !expr.l.is_symbol
+        || var_offset(expr.l)
+        || var_symbol(expr.l) == def->symbol)
+    {
+        return NULL;
+    }
+
+    sym = var_symbol(expr.l);
+    for (j = 0, callee = NULL; j < count; ++j) {
+        if (callees[j]->symbol == sym) {
+            callee = callees[j];
+            break;
+        }
+    }
+
+    if (!callee
+        || !can_inline(callee)
+        || !type_equal_unqualified(expr.type, type_next(sym->type)))
+    {
+        return NULL;
+    }
+
+    n = array_len(&callee->params);
+    if (i < n) {
+        return NULL;
+    }
+
+    if (i > n) {
+        st = &array_get(&def->statements, block->head + i - n - 1);
+        if (st->st == IR_PARAM)
+            return NULL;
+    }
+
+    for (j = 0; j < n; ++j) {
+        st = &array_get(&def->statements, block->head + i - n + j);
+        if (st->st != IR_PARAM
+            || !is_identity(st->expr)
+            || !type_equal_unqualified(
+                    st->expr.type,
+                    array_get(&callee->params, j)->type))
+        {
+            return NULL;
+        }
+    }
+
+    return callee;
+}
+
+static struct var copy_var(struct var var)
+{
+    const struct symbol *sym;
+
+    if (var.is_symbol && var_symbol(var)->linkage == LINK_NONE) {
+        sym = var_symbol(var);
+        if (is_local(sym)) {
+            assert(sym->index <= array_len(&symbol_copies));
+            var.value.sym.id = array_get(&symbol_copies, sym->index - 1)->id;
+            var.lvalue = 0;
+        }
+    }
+
+    return var;
+}
+
+static struct expression copy_expression(struct expression expr)
+{
+    expr.l = copy_var(expr.l);
+    if (is_binary(expr)) {
+        expr.r = copy_var(expr.r);
+    }
+
+    return expr;
+}
+
+static struct block *copy_of(
+    const struct definition *callee,
+    const struct block *block)
+{
+    assert(block->order >= 0 && block->order < array_len(&block_copies));
+    assert(array_get(&callee->nodes, block->order) == block);
+    return array_get(&block_copies, block->order);
+}
+
+static struct symbol *create_copy(struct definition *def, Type type)
+{
+    struct symbol *sym;
+
+    sym = sym_create_temporary(type);
+    array_push_back(&def->locals, sym);
+    return sym;
+}
+
+/*
+ * Create temporaries for parameters and local variables of callee, and
+ * number the callee symbols to find their copies. Indexes are reset
+ * again once the body is copied.
+ */
+static void copy_symbols(struct definition *def, struct definition *callee)
+{
+    int i;
+    struct symbol *sym;
+
+    array_empty(&symbol_copies);
+    number_locals(callee);
+    for (i = 0; i < array_len(&callee->params); ++i) {
+        sym = array_get(&callee->params, i);
+        array_push_back(&symbol_copies, create_copy(def, sym->type));
+    }
+
+    for (i = 0; i < array_len(&callee->locals); ++i) {
+        sym = array_get(&callee->locals, i);
+        array_push_back(&symbol_copies, create_copy(def, sym->type));
+    }
+}
+
+static void push_statement(
+    struct definition *def,
+    struct block *block,
+    enum sttype st,
+    struct var t,
+    struct expression expr)
+{
+    struct statement stmt = {0};
+
+    assert(block->head + block->count == array_len(&def->statements));
+    stmt.st = st;
+    stmt.t = t;
+    stmt.expr = expr;
+    array_push_back(&def->statements, stmt);
+    block->count++;
+}
+
+/*
+ * Replace return from inlined function by assignment to call target.
+ * Values not directly assignable to target are first evaluated to a
+ * new temporary.
+ */
+static void assign_result(
+    struct definition *def,
+    struct block *block,
+    const struct var *target)
+{
+    struct var tmp = {0};
+
+    if (!target) {
+        if (has_side_effects(block->expr)) {
+            push_statement(def, block, IR_EXPR, tmp, block->expr);
+        }
+    } else if (is_identity(block->expr)
+        || (target->kind == DIRECT && !is_field(*target)))
+    {
+        push_statement(def, block, IR_ASSIGN, *target, block->expr);
+    } else {
+        tmp = var_direct(create_copy(def, block->expr.type));
+        push_statement(def, block, IR_ASSIGN, tmp, block->expr);
+        push_statement(def, block, IR_ASSIGN, *target, as_expr(tmp));
+    }
+}
+
+/*
+ * Copy all blocks of callee to def, continuing to next block on
+ * return. Return the copy of callee entry point.
+ */
+static struct block *copy_body(
+    struct definition *def,
+    struct definition *callee,
+    struct block *next,
+    const struct var *target)
+{
+    int i, j;
+    struct statement st;
+    struct block *block, *copy;
+
+    array_empty(&block_copies);
+    for (i = 0; i < array_len(&callee->nodes); ++i) {
+        copy = cfg_block_init(def);
+        array_push_back(&block_copies, copy);
+        array_get(&callee->nodes, i)->order = i;
+    }
+
+    for (i = 0; i < array_len(&callee->nodes); ++i) {
+        block = array_get(&callee->nodes, i);
+        copy = array_get(&block_copies, i);
+        copy->head = array_len(&def->statements);
+        for (j = 0; j < block->count; ++j) {
+            st = array_get(&callee->statements, block->head + j);
+            st.t = copy_var(st.t);
+            st.expr = copy_expression(st.expr);
+            array_push_back(&def->statements, st);
+            copy->count++;
+        }
+
+        if (block->has_return_value || block->jump[1]) {
+            copy->expr = copy_expression(block->expr);
+        }
+
+        if (block->jump[0]) {
+            copy->jump[0] = copy_of(callee, block->jump[0]);
+            if (block->jump[1]) {
+                copy->jump[1] = copy_of(callee, block->jump[1]);
+            }
+        } else {
+            if (block->has_return_value) {
+                assign_result(def, copy, target);
+            }
+            copy->jump[0] = next;
+        }
+    }
+
+    return copy_of(callee, callee->body);
+}
+
+/*
+ * Split block at call statement i, or at the block expression if i is
+ * equal to number of statements. Arguments are assigned to copies of
+ * the callee parameters, and the remaining part of block is moved to a
+ * new block which the inlined body continues to.
+ */
+static struct block *inline_call(
+    struct definition *def,
+    struct block *block,
+    int i,
+    struct definition *callee)
+{
+    int j, n;
+    struct var target;
+    struct statement *st;
+    struct block *next;
+    const struct var *result;
+
+    copy_symbols(def, callee);
+    n = array_len(&callee->params);
+    for (j = 0; j < n; ++j) {
+        st = &array_get(&def->statements, block->head + i - n + j);
+        assert(st->st == IR_PARAM);
+        st->st = IR_ASSIGN;
+        st->t = var_direct(array_get(&symbol_copies, j));
+    }
+
+    next = cfg_block_init(def);
+    next->jump[0] = block->jump[0];
+    next->jump[1] = block->jump[1];
+    next->has_return_value = block->has_return_value;
+    if (i < block->count) {
+        st = &array_get(&def->statements, block->head + i);
+        target = st->t;
+        result = (st->st == IR_ASSIGN) ? &target : NULL;
+        next->head = block->head + i + 1;
+        next->count = block->count - i - 1;
+        next->expr = block->expr;
+    } else {
+        target = var_direct(create_copy(def, block->expr.type));
+        result = &target;
+        next->expr = as_expr(target);
+    }
+
+    block->count = i;
+    block->jump[0] = copy_body(def, callee, next, result);
+    block->jump[1] = NULL;
+    reset_locals(callee);
+    block->has_return_value = 0;
+    return next;
+}
+
+/*
+ * Inline the first call in block to one of the candidate functions,
+ * returning the block continuing after the call. Return NULL if there
+ * are no calls to inline.
+ */
+static struct block *inline_next_call(
+    struct definition *def,
+    struct block *block,
+    struct definition **callees,
+    int count)
+{
+    int i;
+    struct statement *st;
+    struct definition *callee;
+
+    for (i = 0; i < block->count; ++i) {
+        st = &array_get(&def->statements, block->head + i);
+        if (st->st != IR_ASSIGN && st->st != IR_EXPR)
+            continue;
+
+        if (st->st == IR_ASSIGN
+            && !type_equal_unqualified(st->t.type, st->expr.type))
+            continue;
+
+        callee = find_callee(def, block, i, st->expr, callees, count);
+        if (callee) {
+            return inline_call(def, block, i, callee);
+        }
+    }
+
+    if ((block->has_return_value || block->jump[1])
+        && !is_void(block->expr.type))
+    {
+        callee = find_callee(def, block, i, block->expr, callees, count);
+        if (callee) {
+            return inline_call(def, block, i, callee);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Statements of blocks split by inlining are no longer contiguous, and
+ * calls replaced are left without any block. Rebuild the list so that
+ * each block again refers to its own range of statements.
+ */
+static void compact_statements(struct definition *def)
+{
+    int i, j;
+    struct block *block;
+
+    array_empty(&compacted);
+    for (i = 0; i < array_len(&def->nodes); ++i) {
+        block = array_get(&def->nodes, i);
+        for (j = 0; j < block->count; ++j) {
+            array_push_back(&compacted,
+                array_get(&def->statements, block->head + j));
+        }
+
+        block->head = array_len(&compacted) - block->count;
+    }
+
+    array_empty(&def->statements);
+    array_concat(&def->statements, &compacted);
+}
+
+INTERNAL void push_inlining(int level)
+{
+    inline_level = level;
+}
+
+INTERNAL int is_inline_candidate(const struct definition *def)
+{
+    return inline_level >= 2
+        && is_function(def->symbol->type)
+        && def->symbol->linkage == LINK_INTERN
+        && can_inline(def);
+}
+
+INTERNAL int inline_calls(
+    struct definition *def,
+    struct definition **callees,
+    int count)
+{
+    int i, n, size, nodes;
+    struct block *block;
+
+    if (!inline_level
+        || !count
+        || !is_function(def->symbol->type)
+        || array_len(&def->asm_statements))
+    {
+        return 0;
+    }
+
+    timer_push(TIMER_INLINE);
+    assert(!array_len(&def->liveness));
+    size = array_len(&def->statements);
+    nodes = array_len(&def->nodes);
+    for (i = 0, n = 0; i < nodes; ++i) {
+        block = array_get(&def->nodes, i);
+        while (array_len(&def->statements) - size < MAX_GROWTH) {
+            block = inline_next_call(def, block, callees, count);
+            if (!block)
+                break;
+            n++;
+        }
+    }
+
+    if (n) {
+        compact_statements(def);
+        calls_inlined += n;
+    }
+
+    timer_pop();
+    return n;
+}
+
+INTERNAL void pop_inlining(void)
+{
+    if (inline_level) {
+        verbose("Inlined %d function calls.", calls_inlined);
+    }
+
+    inline_level = 0;
+    calls_inlined = 0;
+    array_clear(&symbol_copies);
+    array_clear(&block_copies);
+    array_clear(&compacted);
+}
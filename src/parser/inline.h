@@ -0,0 +1,42 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include <lacc/ir.h>
+
+/*
+ * Enable inlining of function calls for the given optimization level.
+ * Functions declared inline are candidates from level 1, and other
+ * small static functions from level 2.
+ */
+INTERNAL void push_inlining(int level);
+
+/*
+ * Determine if a static function is small enough to be inlined, in
+ * which case compilation is postponed until it is known whether any
+ * call remains after inlining.
+ */
+INTERNAL int is_inline_candidate(const struct definition *def);
+
+/*
+ * Replace calls in def to any of the given functions by a copy of the
+ * callee body. Parameters and local variables of the callee become new
+ * temporaries in def, and each return becomes an assignment to the
+ * call target followed by a jump to the rest of the calling block.
+ *
+ *     .t1 = call square    ->    .t2 = a
+ *                                 .t3 = .t2 * .t2
+ *                                 .t1 = .t3
+ *
+ * Only calls written directly in def are considered, meaning calls
+ * copied from a callee are not inlined any further. Return number of
+ * calls replaced.
+ */
+INTERNAL int inline_calls(
+    struct definition *def,
+    struct definition **callees,
+    int count);
+
+/* Print statistics, and free memory. */
+INTERNAL void pop_inlining(void);
+
+#endif
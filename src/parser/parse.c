@@ -5,8 +5,10 @@
 #include "declaration.h"
 #include "expression.h"
 #include "initializer.h"
+#include "inline.h"
 #include "parse.h"
 #include "symtab.h"
+#include <lacc/context.h>
 #include <lacc/deque.h>
 
 #include <assert.h>
@@ -49,6 +51,10 @@ static array_of(struct definition *) prototypes;
  * they are never called. Therefore keep all inline definitions in a
  * separate list, and postpone compilation of these until the end of the
  * translation unit.
+ *
+ * When optimizing, small static functions are kept here as well. Calls
+ * to functions in this list are replaced by a copy of their body, and
+ * only those still referenced after inlining are compiled.
  */
 static array_of(struct definition *) inline_definitions;
 
@@ -76,6 +82,13 @@ static array_of(struct block *) blocks;
  */
 static array_of(int) restore_list_count;
 
+/*
+ * Number of IR statements generated, and largest number in a single
+ * definition, printed with -v. Statement lists are reused between
+ * definitions, so the largest determines memory usage.
+ */
+static int statement_count, statement_max;
+
 static void recycle_block(struct block *block)
 {
     memset(block, 0, sizeof(*block));
@@ -111,11 +124,17 @@ static void cfg_empty(struct definition *def)
         array_clear(&st->targets);
     }
 
+    statement_count += array_len(&def->statements);
+    if (array_len(&def->statements) > statement_max) {
+        statement_max = array_len(&def->statements);
+    }
+
     array_empty(&def->params);
     array_empty(&def->locals);
     array_empty(&def->labels);
     array_empty(&def->nodes);
     array_empty(&def->statements);
+    array_empty(&def->liveness);
     array_empty(&def->asm_statements);
 }
 
@@ -146,6 +165,24 @@ INTERNAL struct symbol *create_label(struct definition *def)
     return label;
 }
 
+INTERNAL void release_block(struct definition *def, struct block *block)
+{
+    int i;
+    struct symbol *label;
+
+    for (i = array_len(&def->labels) - 1; i >= 0; --i) {
+        label = array_get(&def->labels, i);
+        if (label == block->label) {
+            label = array_pop_back(&def->labels);
+            array_get(&def->labels, i) = label;
+            sym_discard((struct symbol *) block->label);
+            break;
+        }
+    }
+
+    recycle_block(block);
+}
+
 INTERNAL struct definition *cfg_init(void)
 {
     struct definition *def;
@@ -215,7 +252,7 @@ static struct definition *pop_inline_function(void)
     for (i = 0; i < array_len(&inline_definitions); ++i) {
         def = array_get(&inline_definitions, i);
         assert(is_function(def->symbol->type));
-        assert(def->symbol->inlined);
+        assert(def->symbol->inlined || def->symbol->linkage == LINK_INTERN);
         if (def->symbol->referenced) {
             array_erase(&inline_definitions, i);
             return def;
@@ -261,9 +298,12 @@ INTERNAL struct definition *parse(void)
             break; /* no more input */
         } else {
             def = deque_pop_front(&definitions);
-            if (def->symbol->inlined) {
+            if (def->symbol->inlined || is_inline_candidate(def)) {
                 array_push_back(&inline_definitions, def);
             } else {
+                inline_calls(def,
+                    &array_get(&inline_definitions, 0),
+                    array_len(&inline_definitions));
                 return def;
             }
         }
@@ -272,7 +312,11 @@ INTERNAL struct definition *parse(void)
     assert(peek() == END);
     assert(!deque_len(&definitions));
     def = pop_inline_function();
-    if (!def) {
+    if (def) {
+        inline_calls(def,
+            &array_get(&inline_definitions, 0),
+            array_len(&inline_definitions));
+    } else {
         for (i = 0; i < array_len(&expressions); ++i) {
             block = array_get(&expressions, i);
             recycle_block(block);
@@ -303,6 +347,7 @@ INTERNAL void parse_finalize(void)
         array_clear(&def->labels);
         array_clear(&def->nodes);
         array_clear(&def->statements);
+        array_clear(&def->liveness);
         array_clear(&def->asm_statements);
         free(def);
     }
@@ -319,6 +364,14 @@ INTERNAL void parse_finalize(void)
     array_clear(&blocks);
     array_clear(&restore_list_count);
 
+    verbose("Generated %d IR statements of %lu bytes, at most %d in one "
+        "definition.",
+        statement_count,
+        (unsigned long) sizeof(struct statement),
+        statement_max);
+    statement_count = 0;
+    statement_max = 0;
+
     initializer_finalize();
     expression_parse_finalize();
     symtab_finalize();
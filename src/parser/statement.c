@@ -415,7 +415,9 @@ static struct asm_operand asm_operand(
 
     force_register = strchr(str, 'r') && !strchr(str, 'm');
 
-    if (force_register && (var.kind != DIRECT || !is_temporary(var.value.symbol))) {
+    if (force_register
+        && (var.kind != DIRECT || !is_temporary(var_symbol(var))))
+    {
         tmp = create_var(def, var.type);
         op.variable = tmp;
         if (!is_output || str[0] == '+') {
@@ -426,7 +428,7 @@ static struct asm_operand asm_operand(
             wb.value = tmp;
             array_push_back(&write_back, wb);
         }
-    } else if (var.kind == DEREF && !is_temporary(var.value.symbol)) {
+    } else if (var.kind == DEREF && !is_temporary(var_symbol(var))) {
         var = eval_addr(def, *block, var);
         tmp = create_var(def, var.type);
         eval_assign(def, *block, tmp, as_expr(var));
@@ -24,6 +24,14 @@ static String
     prefix_string = SHORT_STRING_INIT(".LC"),
     prefix_label = SHORT_STRING_INIT(".L");
 
+/*
+ * Symbol currently visible by some name, shadowing any symbols bound to
+ * the same name in outer scope.
+ */
+struct binding {
+    struct symbol *sym;
+};
+
 /*
  * Maintain list of symbols allocated for temporaries and labels, which
  * can be reused between function definitions.
@@ -32,47 +40,53 @@ static String
  */
 static SymbolArray temporaries;
 
+/*
+ * Table of all allocated symbols, indexed by id. Slot 0 is not used.
+ * Ids of deallocated symbols are kept in a free list for reuse.
+ */
+static SymbolArray symbol_table;
+static array_of(int) free_symbol_ids;
+
 static struct symbol *alloc_sym(void)
 {
+    int id;
     struct symbol *sym;
 
     if (array_len(&temporaries)) {
         sym = array_pop_back(&temporaries);
+        id = sym->id;
         memset(sym, 0, sizeof(*sym));
     } else {
         sym = calloc(1, sizeof(*sym));
+        if (array_len(&free_symbol_ids)) {
+            id = array_pop_back(&free_symbol_ids);
+            array_get(&symbol_table, id) = sym;
+        } else {
+            if (!array_len(&symbol_table)) {
+                array_push_back(&symbol_table, NULL);
+            }
+            id = array_len(&symbol_table);
+            array_push_back(&symbol_table, sym);
+        }
     }
 
+    sym->id = id;
     return sym;
 }
 
-/*
- * Cache string types, to avoid creating new type for every string
- * literal.
- */
-struct string_type_handle {
-    size_t length;
-    Type type;
-};
-
-static array_of(struct string_type_handle) string_types;
-
-static Type get_string_type(size_t len)
+static void free_sym(struct symbol *sym)
 {
-    int i;
-    struct string_type_handle handle;
-
-    for (i = 0; i < array_len(&string_types); ++i) {
-        handle = array_get(&string_types, i);
-        if (handle.length == len) {
-            return handle.type;
-        }
-    }
+    assert(array_get(&symbol_table, sym->id) == sym);
+    array_get(&symbol_table, sym->id) = NULL;
+    array_push_back(&free_symbol_ids, sym->id);
+    free(sym);
+}
 
-    handle.type = type_create_array(basic_type__char, len);
-    handle.length = len;
-    array_push_back(&string_types, handle);
-    return handle.type;
+INTERNAL struct symbol *sym_get(int id)
+{
+    assert(id > 0 && id < array_len(&symbol_table));
+    assert(array_get(&symbol_table, id));
+    return array_get(&symbol_table, id);
 }
 
 /*
@@ -105,19 +119,20 @@ static void clear_namespace(struct namespace *ns)
     ns->cursor = 0;
 
     assert(array_len(&ns->scope.counts) == 0);
-    assert(array_len(&ns->scope.names) == 0);
-    assert(array_len(&ns->scope.symbols) == 0);
+    assert(array_len(&ns->scope.bindings) == 0);
+    assert(array_len(&ns->scope.shadowed) == 0);
     array_clear(&ns->scope.counts);
-    array_clear(&ns->scope.names);
-    array_clear(&ns->scope.symbols);
+    array_clear(&ns->scope.bindings);
+    array_clear(&ns->scope.shadowed);
 
     for (i = 0; i < array_len(&ns->symbols); ++i) {
         sym = array_get(&ns->symbols, i);
-        free(sym);
+        free_sym(sym);
     }
 
     array_clear(&ns->symbols);
-    hash_destroy(&ns->globals);
+    hash_clear(&ns->bindings, free);
+    hash_destroy(&ns->bindings);
 }
 
 INTERNAL void symtab_clear(void)
@@ -136,7 +151,6 @@ INTERNAL void symtab_clear(void)
     clear_namespace(&ns_ident);
     clear_namespace(&ns_label);
 
-    array_empty(&string_types);
     hash_clear(&functions, NULL);
 }
 
@@ -147,11 +161,12 @@ INTERNAL void symtab_finalize(void)
 
     for (i = 0; i < array_len(&temporaries); ++i) {
         sym = array_get(&temporaries, i);
-        free(sym);
+        free_sym(sym);
     }
 
     array_clear(&temporaries);
-    array_clear(&string_types);
+    array_clear(&symbol_table);
+    array_clear(&free_symbol_ids);
     hash_destroy(&functions);
 }
 
@@ -163,12 +178,15 @@ INTERNAL void push_scope(struct namespace *ns)
 INTERNAL void pop_scope(struct namespace *ns)
 {
     int count;
+    struct binding *b;
 
     assert(array_len(&ns->scope.counts) > 0);
 
     count = array_pop_back(&ns->scope.counts);
-    array_len(&ns->scope.symbols) -= count;
-    array_len(&ns->scope.names) -= count;
+    while (count--) {
+        b = array_pop_back(&ns->scope.bindings);
+        b->sym = array_pop_back(&ns->scope.shadowed);
+    }
 }
 
 INTERNAL int current_scope_depth(struct namespace *ns)
@@ -187,17 +205,10 @@ INTERNAL int current_scope_depth(struct namespace *ns)
 
 INTERNAL struct symbol *sym_lookup(struct namespace *ns, String name)
 {
-    int i;
-    String n;
+    struct binding *b;
 
-    for (i = array_len(&ns->scope.symbols) - 1; i >= 0; --i) {
-        n = array_get(&ns->scope.names, i);
-        if (str_eq(name, n)) {
-            return array_get(&ns->scope.symbols, i);
-        }
-    }
-
-    return hash_lookup(&ns->globals, name);
+    b = hash_lookup(&ns->bindings, name);
+    return b ? b->sym : NULL;
 }
 
 INTERNAL const char *sym_name(const struct symbol *sym)
@@ -361,14 +372,30 @@ static struct symbol *sym_redeclare(
     return sym;
 }
 
+static void *binding_add(void *ref, String *key)
+{
+    *key = *(String *) ref;
+    return calloc(1, sizeof(struct binding));
+}
+
+/*
+ * Global symbols keep the first binding made, while symbols in inner
+ * scope shadow what was visible before.
+ */
 INTERNAL void sym_make_visible(struct namespace *ns, struct symbol *sym)
 {
+    struct binding *b;
+
+    b = hash_insert(&ns->bindings, sym->name, &sym->name, binding_add);
     if (array_len(&ns->scope.counts) == 0) {
-        hash_insert(&ns->globals, sym->name, sym, NULL);
+        if (!b->sym) {
+            b->sym = sym;
+        }
     } else {
-        array_push_back(&ns->scope.names, sym->name);
-        array_push_back(&ns->scope.symbols, sym);
+        array_push_back(&ns->scope.bindings, b);
+        array_push_back(&ns->scope.shadowed, b->sym);
         array_back(&ns->scope.counts) += 1;
+        b->sym = sym;
     }
 }
 
@@ -527,7 +554,7 @@ INTERNAL struct symbol *sym_create_string(String str)
 
     len = str_len(str);
     sym = alloc_sym();
-    sym->type = get_string_type(len + 1);
+    sym->type = type_create_array(basic_type__char, len + 1);
     sym->value.string = str;
     sym->symtype = SYM_LITERAL;
     sym->linkage = LINK_INTERN;
@@ -18,15 +18,13 @@ struct namespace {
      */
     SymbolArray symbols;
 
-    /* Global symbols are stored in a hash table for fast lookup. */
-    struct hash_table globals;
-
     /*
-     * Scoped symbols are keps in a simple array, using just linear
-     * search for lookup and relying on there being relatively few names
-     * to check in the typical case. In practice this is much faster
-     * than having a hash table per scope.
+     * Each name maps to a binding holding the symbol currently visible,
+     * including global symbols, giving constant time lookup regardless
+     * of the number of symbols in scope.
      */
+    struct hash_table bindings;
+
     struct {
         /*
          * List containing number of symbols in each scope, last element
@@ -35,12 +33,12 @@ struct namespace {
         array_of(int) counts;
 
         /*
-         * All symbols contained in some scope, expanding on entering a
-         * new block, and shrinking when leaving. Resolving symbols will
-         * traverse this list backwards.
+         * All bindings made in some scope, expanding on entering a new
+         * block, and shrinking when leaving. Each binding is paired with
+         * the symbol it shadowed, which is restored on leaving scope.
          */
-        array_of(String) names;
-        SymbolArray symbols;
+        array_of(struct binding *) bindings;
+        SymbolArray shadowed;
     } scope;
 
     /* Iterator for successive calls to yield. */
@@ -90,13 +88,6 @@ INTERNAL struct symbol *sym_add(
 /* Add symbol to current scope of given namespace. */
 INTERNAL void sym_make_visible(struct namespace *ns, struct symbol *sym);
 
-/*
- * Create a symbol with the provided type and add it to current scope in
- * identifier namespace. Used to hold temporary values in expression
- * evaluation.
- */
-INTERNAL struct symbol *sym_create_temporary(Type type);
-
 /* Create an unnamed variable, produced by a compound literal. */
 INTERNAL struct symbol *sym_create_unnamed(Type type);
 
@@ -116,12 +107,6 @@ INTERNAL struct symbol *sym_create_builtin(
     String name,
     struct block *(*handler)(struct definition *, struct block *));
 
-/*
- * Release memory used for a temporary symbol, allowing it to be reused
- * in a different function.
- */
-INTERNAL void sym_discard(struct symbol *sym);
-
 /*
  * Retrieve next tentative definition or declaration from given scope.
  */
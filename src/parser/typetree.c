@@ -5,6 +5,7 @@
 #include "typetree.h"
 #include <lacc/array.h>
 #include <lacc/context.h>
+#include <lacc/hash.h>
 #include <lacc/symbol.h>
 
 #include <assert.h>
@@ -44,6 +45,16 @@ struct typetree {
     unsigned int is_vla : 1;
     unsigned int is_incomplete : 1;
 
+    /*
+     * Pointer and array types are interned, and shared by all instances
+     * with the same structure. Such types must not be modified after
+     * creation. Canonical types are interned, and also refer only to
+     * basic types or other canonical types, meaning they are equal
+     * only if they have the same handle.
+     */
+    unsigned int is_interned : 1;
+    unsigned int is_canonical : 1;
+
     /*
      * Total storage size in bytes for struct, union and basic types,
      * equal to what is returned for sizeof. Number of elements in case
@@ -86,6 +97,12 @@ struct typetree {
  */
 static array_of(struct typetree) types;
 
+/* Index of interned types, by reference. */
+static struct hash_index interned;
+
+/* Number of types found already interned. */
+static int interned_reused;
+
 static struct typetree *get_typetree_handle(int ref)
 {
     assert(ref > 0);
@@ -146,6 +163,65 @@ INTERNAL Type type_create(enum type tt)
     return type;
 }
 
+/* Hash of the fields that identify an interned type. */
+static unsigned long typetree_hash(const struct typetree *t)
+{
+    unsigned long h;
+    union {
+        Type type;
+        unsigned int bits;
+    } next;
+
+    next.bits = 0;
+    next.type = t->next;
+    h = t->type;
+    h = h * 31 + next.bits;
+    h = h * 31 + t->size;
+    h = h * 31 + (t->is_const | (t->is_volatile << 1));
+    return (h * 0x9E3779B97F4A7C15ul) >> 32;
+}
+
+static int typetree_same(const struct typetree *a, const struct typetree *b)
+{
+    return a->type == b->type
+        && a->size == b->size
+        && a->is_const == b->is_const
+        && a->is_volatile == b->is_volatile
+        && !memcmp(&a->next, &b->next, sizeof(Type));
+}
+
+/*
+ * Return handle of existing type with the same structure as the one
+ * just created, discarding the new one, or intern the new type.
+ */
+static Type type_intern(Type type)
+{
+    int ref;
+    unsigned long h;
+    struct typetree *t;
+
+    t = get_typetree_handle(type.ref);
+    h = typetree_hash(t);
+    for (ref = hash_index_first(&interned, h);
+        ref != -1;
+        ref = hash_index_next(&interned, ref))
+    {
+        if (typetree_same(t, get_typetree_handle(ref))) {
+            assert(type.ref == array_len(&types));
+            (void) array_pop_back(&types);
+            interned_reused++;
+            type.ref = ref;
+            return type;
+        }
+    }
+
+    t->is_interned = 1;
+    t->is_canonical = !t->next.ref
+        || get_typetree_handle(t->next.ref)->is_canonical;
+    hash_index_add(&interned, type.ref, h);
+    return type;
+}
+
 INTERNAL void clear_types(FILE *stream)
 {
     int i;
@@ -166,6 +242,10 @@ INTERNAL void clear_types(FILE *stream)
     }
 
     array_clear(&types);
+    verbose("Interned %d pointer and array types, reused %d times.",
+        interned.count, interned_reused);
+    hash_index_destroy(&interned);
+    interned_reused = 0;
 }
 
 INTERNAL int is_type_placeholder(Type type)
@@ -385,6 +465,7 @@ INTERNAL Type type_create_pointer(Type next)
         next = type_unqualified(next);
         next.is_pointer = 0;
         t->next = next;
+        type = type_intern(type);
     } else {
         type = next;
         type.is_pointer = 1;
@@ -405,7 +486,7 @@ INTERNAL Type type_create_function(Type next)
     return type;
 }
 
-INTERNAL Type type_create_array(Type next, size_t count)
+static Type create_array(Type next, size_t count)
 {
     Type type;
     struct typetree *t;
@@ -422,6 +503,11 @@ INTERNAL Type type_create_array(Type next, size_t count)
     return type;
 }
 
+INTERNAL Type type_create_array(Type next, size_t count)
+{
+    return type_intern(create_array(next, count));
+}
+
 INTERNAL Type type_create_incomplete(Type next)
 {
     Type type;
@@ -440,7 +526,7 @@ INTERNAL Type type_create_vla(Type next, const struct symbol *count)
     struct typetree *t;
 
     assert(count);
-    type = type_create_array(next, 0);
+    type = create_array(next, 0);
     t = get_typetree_handle(type.ref);
     t->vlen = count;
     t->is_vla = 1;
@@ -512,8 +598,16 @@ INTERNAL Type type_patch_declarator(Type head, Type target)
         } else {
             assert(is_function(head) || is_array(head));
             t = get_typetree_handle(head.ref);
-            t->next = type_patch_declarator(t->next, target);
-            next = head;
+            if (t->is_interned) {
+                assert(is_array(head));
+                next = type_patch_declarator(t->next, target);
+                next = type_create_array(next, t->size);
+                head.ref = next.ref;
+                next = head;
+            } else {
+                t->next = type_patch_declarator(t->next, target);
+                next = head;
+            }
         }
     }
 
@@ -995,6 +1089,10 @@ INTERNAL int type_equal(Type a, Type b)
 
     ta = get_typetree_handle(a.ref);
     tb = get_typetree_handle(b.ref);
+    if (ta->is_canonical && tb->is_canonical) {
+        return 0;
+    }
+
     return typetree_equal(ta, tb);
 }
 
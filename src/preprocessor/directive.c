@@ -28,6 +28,7 @@ INTERNAL struct token
     ident__line = IDENT("line"),
     ident__pragma = IDENT("pragma"),
     ident__Pragma = IDENT("_" "Pragma"),
+    ident__once = IDENT("once"),
     ident__VA_ARGS__ = IDENT("__VA_ARGS__");
 
 enum state {
@@ -15,7 +15,8 @@ EXTERNAL struct token
     ident__endif,
     ident__error,
     ident__pragma,
-    ident__Pragma;
+    ident__Pragma,
+    ident__once;
 
 /*
  * Preprocess a line starting with a '#' directive. Borrows ownership of
@@ -7,9 +7,14 @@
 #include "strtab.h"
 #include <lacc/array.h>
 #include <lacc/context.h>
+#include <lacc/hash.h>
 
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -17,20 +22,50 @@
 
 #define FILE_BUFFER_SIZE 4096
 
-struct source {
-    FILE *file;
+#define FILE_CACHE_LIMIT (256 * 1024 * 1024)
+
+/*
+ * Ownership of memory holding contents of a source file, determining
+ * how it is released.
+ */
+enum source_memory {
+    SOURCE_CACHED,
+    SOURCE_MAPPED,
+    SOURCE_ALLOCATED
+};
+
+/*
+ * A file is guarded if it has only blank lines outside of an opening
+ * #ifndef X directive and its matching #endif.
+ */
+enum guard_state {
+    GUARD_START,
+    GUARD_OPEN,
+    GUARD_CLOSED,
+    GUARD_INVALID
+};
 
+struct source {
     /*
-     * Total capacity of the line buffer is represented by size. The
-     * number of characters already handled, a prefix, is 'processed'.
-     * Read is the number of valid characters in the buffer. The
-     * processed count grows on successive calls towards the read
-     * number. When all read characters are processed, or the remaining
-     * interval between (processed, read) does not contain a full line,
-     * rewind the buffer, or increase if necessary.
+     * Whole file contents, ending with a newline followed by a null
+     * terminator. Size is the number of characters, not including the
+     * terminator. The number of characters already handled, a prefix,
+     * is 'processed', growing on successive calls towards size.
      */
     char *buffer;
-    size_t size, processed, read;
+    size_t size, processed;
+    enum source_memory memory;
+
+    /* Newline was added to the end of file contents. */
+    int is_newline_added;
+
+    /*
+     * Detect include guard while reading the file, tracking nesting of
+     * conditional directives and the macro tested by the first one.
+     */
+    enum guard_state guard_state;
+    int guard_depth;
+    String guard;
 
     /* Full path, or relative to invocation directory. */
     String path;
@@ -43,11 +78,90 @@ struct source {
 
     /* Current line. */
     int line;
+
+    /* Found in a system include directory. */
+    int is_system;
 };
 
+/*
+ * Set of file paths, each identified by position in the list. Tables
+ * keyed by path keep values in a separate list with the same index.
+ */
+struct path_table {
+    array_of(char *) paths;
+    struct hash_index index;
+};
+
+/*
+ * Contents of included files kept in memory by the compile server, and
+ * inherited by worker processes forked from it. Entries are validated
+ * against size and modification time of the file, once per translation
+ * unit.
+ */
+struct cached_file {
+    char *data;
+    size_t size;
+    time_t mtime;
+    int checked;
+    int is_valid;
+};
+
+/*
+ * Files read in the current translation unit. Files marked with
+ * #pragma once, or guarded by a macro which is still defined, do not
+ * need to be read again.
+ */
+struct included_file {
+    String macro;
+    int is_once;
+    int is_dependency;
+    int is_system;
+};
+
+static struct path_table included_paths;
+static array_of(struct included_file) included_files;
+
+/* Index of each file read, in the order first opened. */
+static array_of(int) dependencies;
+
+/*
+ * Result of searching include paths for a system header, kept for all
+ * translation units in the same invocation. Directories before the one
+ * found are known not to contain the file, and are not tried again.
+ * Values are the index of the search path directory.
+ *
+ * Results are not shared with the compile server, which would keep
+ * them across requests without noticing headers added to an earlier
+ * directory.
+ */
+static struct path_table include_names;
+static array_of(int) include_cache;
+
+/* Statistics for include path resolution, printed with -v. */
+static int include_lookups, include_cache_hits, include_failed_opens;
+
+/* Number of lines skipped without processing in inactive blocks. */
+static int inactive_lines_skipped;
+
+static struct path_table cached_paths;
+static array_of(struct cached_file) file_cache;
+static size_t file_cache_size;
+
+/* Incremented for each translation unit, to validate cached files. */
+static int input_generation;
+
+/* Report path of files read from disk to this descriptor, if set. */
+static int file_report_fd = -1;
+
+/* Working directory, used to construct absolute paths. */
+static char *working_directory;
+
 /* Temporary buffer used to construct search paths. */
 static char *path_buffer;
 
+/* Temporary buffer used to construct absolute paths. */
+static char *absolute_path_buffer;
+
 /* Buffer for reading lines. */
 static char *rline;
 static size_t rlen;
@@ -55,6 +169,13 @@ static size_t rlen;
 /* List of directories to search on resolving include directives. */
 static array_of(const char *) search_path_list;
 
+/*
+ * Index of first system include directory in search path list, added
+ * after any directories given with -I. Files found here, or included
+ * relative to such files, are system headers.
+ */
+static int first_system_path = -1;
+
 /*
  * List of files to include before first source file, specified with
  * -include option.
@@ -73,14 +194,198 @@ INTERNAL int current_file_line;
 
 static void push_file(struct source source)
 {
-    assert(source.file);
+    assert(source.buffer);
+    assert(!source.buffer[source.size]);
     assert(!str_is_empty(source.path));
 
     current_file_line = 0;
     current_file_path = source.path;
-    source.buffer = malloc(FILE_BUFFER_SIZE);
-    source.size = FILE_BUFFER_SIZE;
+    if (rlen <= source.size) {
+        rlen = source.size + 1;
+        rline = realloc(rline, rlen);
+    }
+
     array_push_back(&source_stack, source);
+    if (source.is_newline_added) {
+        error("Missing newline at end of file.");
+    }
+}
+
+static unsigned long hash_path(const char *path)
+{
+    unsigned long hash = 5381;
+
+    while (*path) {
+        hash = hash * 33 + (unsigned char) *path++;
+    }
+
+    return hash;
+}
+
+static int path_find(const struct path_table *tab, const char *path)
+{
+    int i;
+
+    for (i = hash_index_first(&tab->index, hash_path(path));
+        i != -1;
+        i = hash_index_next(&tab->index, i))
+    {
+        if (!strcmp(array_get(&tab->paths, i), path))
+            break;
+    }
+
+    return i;
+}
+
+/* Add path not already in table, returning its index. */
+static int path_add(struct path_table *tab, const char *path)
+{
+    int i;
+    char *copy;
+
+    assert(path_find(tab, path) == -1);
+    i = array_len(&tab->paths);
+    copy = malloc(strlen(path) + 1);
+    strcpy(copy, path);
+    array_push_back(&tab->paths, copy);
+    hash_index_add(&tab->index, i, hash_path(path));
+    return i;
+}
+
+static void path_clear(struct path_table *tab)
+{
+    int i;
+
+    for (i = 0; i < array_len(&tab->paths); ++i) {
+        free(array_get(&tab->paths, i));
+    }
+
+    array_empty(&tab->paths);
+    hash_index_clear(&tab->index);
+}
+
+static void path_destroy(struct path_table *tab)
+{
+    path_clear(tab);
+    array_clear(&tab->paths);
+    hash_index_destroy(&tab->index);
+}
+
+static struct included_file *find_included_file(const char *path, int add)
+{
+    int i;
+    struct included_file entry = {0};
+
+    i = path_find(&included_paths, path);
+    if (i == -1) {
+        if (!add) {
+            return NULL;
+        }
+
+        i = path_add(&included_paths, path);
+        array_push_back(&included_files, entry);
+    }
+
+    return &array_get(&included_files, i);
+}
+
+static void clear_included_files(void)
+{
+    path_clear(&included_paths);
+    array_empty(&included_files);
+    array_empty(&dependencies);
+}
+
+INTERNAL void input_add_dependency(const char *path, int is_system)
+{
+    struct included_file *entry;
+
+    entry = find_included_file(path, 1);
+    if (!entry->is_dependency) {
+        entry->is_dependency = 1;
+        entry->is_system = is_system;
+        array_push_back(&dependencies, entry - &array_get(&included_files, 0));
+    }
+}
+
+INTERNAL int input_dependency_count(void)
+{
+    return array_len(&dependencies);
+}
+
+INTERNAL const char *input_dependency(int i, int *is_system)
+{
+    assert(i >= 0 && i < array_len(&dependencies));
+    i = array_get(&dependencies, i);
+    *is_system = array_get(&included_files, i).is_system;
+    return array_get(&included_paths.paths, i);
+}
+
+INTERNAL void input_guards(
+    void (*callback)(void *, const char *, String, int),
+    void *context)
+{
+    int i;
+    struct included_file *entry;
+
+    for (i = 0; i < array_len(&included_files); ++i) {
+        entry = &array_get(&included_files, i);
+        if (entry->is_once || !str_is_empty(entry->macro)) {
+            callback(context,
+                array_get(&included_paths.paths, i),
+                entry->macro,
+                entry->is_once);
+        }
+    }
+}
+
+INTERNAL void input_add_guard(const char *path, String macro, int is_once)
+{
+    struct included_file *entry;
+
+    entry = find_included_file(path, 1);
+    entry->macro = macro;
+    entry->is_once = is_once;
+}
+
+static void clear_include_cache(void)
+{
+    path_destroy(&include_names);
+    array_clear(&include_cache);
+}
+
+static void set_include_cache(const char *name, int i)
+{
+    int j;
+
+    j = path_find(&include_names, name);
+    if (j != -1) {
+        array_get(&include_cache, j) = i;
+    } else {
+        path_add(&include_names, name);
+        array_push_back(&include_cache, i);
+    }
+}
+
+/*
+ * Including the file again has no effect if it is marked with #pragma
+ * once, or if the guard macro is defined.
+ */
+static int is_include_skipped(const char *path)
+{
+    struct included_file *entry;
+
+    entry = find_included_file(path, 0);
+    if (entry
+        && (entry->is_once
+            || (!str_is_empty(entry->macro)
+                && macro_definition(entry->macro))))
+    {
+        verbose("Skipping include of %s.", path);
+        return 1;
+    }
+
+    return 0;
 }
 
 static int pop_file(void)
@@ -91,10 +396,19 @@ static int pop_file(void)
     len = array_len(&source_stack);
     if (len) {
         source = array_pop_back(&source_stack);
-        if (source.file != stdin) {
-            fclose(source.file);
+        if (source.guard_state == GUARD_CLOSED) {
+            find_included_file(str_raw(source.path), 1)->macro = source.guard;
+        }
+        switch (source.memory) {
+        case SOURCE_CACHED:
+            break;
+        case SOURCE_MAPPED:
+            munmap(source.buffer, source.size);
+            break;
+        case SOURCE_ALLOCATED:
+            free(source.buffer);
+            break;
         }
-        free(source.buffer);
         if (len - 1) {
             return 1;
         }
@@ -111,8 +425,23 @@ INTERNAL void input_finalize(void)
     assert(!array_len(&source_stack));
     array_clear(&source_stack);
     array_clear(&search_path_list);
+    first_system_path = -1;
     array_clear(&include_files);
+    clear_included_files();
+    path_destroy(&included_paths);
+    array_clear(&included_files);
+    array_clear(&dependencies);
+    clear_include_cache();
+    verbose("Resolved %d system includes, %d from cache, %d failed opens.",
+        include_lookups, include_cache_hits, include_failed_opens);
+    verbose("Skipped %d lines in inactive blocks.", inactive_lines_skipped);
+    include_lookups = 0;
+    include_cache_hits = 0;
+    include_failed_opens = 0;
+    inactive_lines_skipped = 0;
     free(path_buffer);
+    free(absolute_path_buffer);
+    free(working_directory);
     free(rline);
 }
 
@@ -140,6 +469,270 @@ static char *create_path(const char *path, size_t dirlen, const char *name)
     return path_buffer;
 }
 
+/*
+ * Get absolute path of file, or the path itself if already absolute.
+ * Result is stored in a temporary buffer, valid until the next call.
+ */
+static const char *absolute_path(const char *path)
+{
+    size_t len;
+
+    if (*path == '/') {
+        return path;
+    }
+
+    if (!working_directory) {
+        len = 256;
+        do {
+            len *= 2;
+            working_directory = realloc(working_directory, len);
+        } while (!getcwd(working_directory, len));
+    }
+
+    len = strlen(working_directory);
+    absolute_path_buffer = realloc(
+        absolute_path_buffer,
+        len + strlen(path) + 2);
+    strcpy(absolute_path_buffer, working_directory);
+    absolute_path_buffer[len] = '/';
+    strcpy(absolute_path_buffer + len + 1, path);
+    return absolute_path_buffer;
+}
+
+/*
+ * Find cached contents of file, checking that the file is unchanged on
+ * first use in each translation unit.
+ */
+static struct cached_file *find_cached_file(const char *path)
+{
+    int i;
+    struct stat st;
+    struct cached_file *entry;
+
+    if (!array_len(&file_cache)) {
+        return NULL;
+    }
+
+    path = absolute_path(path);
+    i = path_find(&cached_paths, path);
+    if (i == -1) {
+        return NULL;
+    }
+
+    entry = &array_get(&file_cache, i);
+    if (entry->checked != input_generation) {
+        entry->checked = input_generation;
+        entry->is_valid = !stat(path, &st)
+            && st.st_size == (off_t) entry->size
+            && st.st_mtime == entry->mtime;
+    }
+
+    return entry->is_valid ? entry : NULL;
+}
+
+INTERNAL void input_cache_file(const char *path)
+{
+    int i;
+    FILE *file;
+    char *data;
+    struct stat st;
+    struct cached_file *entry, empty = {0};
+
+    assert(*path == '/');
+    if (stat(path, &st) || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return;
+    }
+
+    i = path_find(&cached_paths, path);
+    entry = (i != -1) ? &array_get(&file_cache, i) : NULL;
+    if (entry
+        && entry->size == (size_t) st.st_size
+        && entry->mtime == st.st_mtime)
+    {
+        return;
+    }
+
+    if (file_cache_size + st.st_size > FILE_CACHE_LIMIT) {
+        return;
+    }
+
+    file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+
+    data = malloc(st.st_size + 1);
+    if (fread(data, sizeof(char), st.st_size, file) != (size_t) st.st_size
+        || data[st.st_size - 1] != '\n')
+    {
+        free(data);
+        fclose(file);
+        return;
+    }
+
+    fclose(file);
+    data[st.st_size] = '\0';
+    if (entry) {
+        file_cache_size -= entry->size;
+        free(entry->data);
+    } else {
+        i = path_add(&cached_paths, path);
+        array_push_back(&file_cache, empty);
+        entry = &array_get(&file_cache, i);
+    }
+
+    entry->data = data;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    entry->checked = 0;
+    file_cache_size += entry->size;
+}
+
+INTERNAL void input_report_files(int fd)
+{
+    file_report_fd = fd;
+    strtab_report_strings(fd);
+}
+
+/*
+ * Write line to the compile server. Each line is written in a single
+ * call no larger than the atomic pipe write size, so that lines from
+ * concurrent workers are not interleaved.
+ */
+static void report_line(const char *head, const char *tail)
+{
+    static char *buf;
+    static size_t cap;
+    static long limit;
+    size_t hlen, len;
+
+    if (!limit) {
+        limit = fpathconf(file_report_fd, _PC_PIPE_BUF);
+    }
+
+    hlen = strlen(head);
+    len = hlen + strlen(tail);
+    if (limit > 0 && len + 1 > (size_t) limit) {
+        verbose("Not reporting %s to compile server, line is too long.",
+            tail);
+        return;
+    }
+
+    if (cap < len + 1) {
+        cap = len + 1;
+        buf = realloc(buf, cap);
+    }
+
+    memcpy(buf, head, hlen);
+    memcpy(buf + hlen, tail, len - hlen);
+    buf[len] = '\n';
+    if (write(file_report_fd, buf, len + 1) != len + 1) {
+        file_report_fd = -1;
+    }
+}
+
+/* Report absolute path of file read from disk. */
+static void report_file(const char *path)
+{
+    report_line("", absolute_path(path));
+}
+
+/*
+ * Read all remaining input from file descriptor into an allocated
+ * buffer. Add newline at the end if missing.
+ */
+static void load_source(struct source *source, int fd)
+{
+    ssize_t n;
+    size_t cap, len;
+    char *data;
+
+    len = 0;
+    cap = FILE_BUFFER_SIZE;
+    data = malloc(cap);
+    while ((n = read(fd, data + len, cap - len - 1)) > 0) {
+        len += n;
+        if (cap - len < FILE_BUFFER_SIZE) {
+            cap *= 2;
+            data = realloc(data, cap);
+        }
+    }
+
+    if (len && data[len - 1] != '\n') {
+        data[len++] = '\n';
+        source->is_newline_added = 1;
+    }
+
+    data[len] = '\0';
+    source->buffer = data;
+    source->size = len;
+    source->memory = SOURCE_ALLOCATED;
+}
+
+/*
+ * Read whole file into memory, mapping it directly when possible. The
+ * mapping can only be used as is if the file ends with a newline, and
+ * does not fill the last page completely. The rest of the page is then
+ * zero filled, terminating the buffer.
+ */
+static int read_source(struct source *source, const char *path)
+{
+    int fd;
+    char *data;
+    struct stat st;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+
+    if (!fstat(fd, &st)
+        && S_ISREG(st.st_mode)
+        && st.st_size > 0
+        && st.st_size % sysconf(_SC_PAGESIZE) != 0)
+    {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            if (data[st.st_size - 1] == '\n') {
+                close(fd);
+                source->buffer = data;
+                source->size = st.st_size;
+                source->memory = SOURCE_MAPPED;
+                return 1;
+            }
+            munmap(data, st.st_size);
+        }
+    }
+
+    load_source(source, fd);
+    close(fd);
+    return 1;
+}
+
+/*
+ * Open included file for reading, using contents cached in memory if
+ * still valid.
+ */
+static int open_source(struct source *source, const char *path, int sys)
+{
+    struct cached_file *entry;
+
+    entry = find_cached_file(path);
+    if (entry) {
+        source->buffer = entry->data;
+        source->size = entry->size;
+        source->memory = SOURCE_CACHED;
+    } else if (!read_source(source, path)) {
+        return 0;
+    } else if (file_report_fd != -1) {
+        report_file(path);
+    }
+
+    source->is_system = sys;
+    input_add_dependency(path, sys);
+    return 1;
+}
+
 INTERNAL void include_file(const char *name)
 {
     const char *path;
@@ -159,8 +752,11 @@ INTERNAL void include_file(const char *name)
         path = name;
     }
 
-    source.file = fopen(path, "r");
-    if (source.file) {
+    if (is_include_skipped(path)) {
+        return;
+    }
+
+    if (open_source(&source, path, file->is_system)) {
         source.path = str_c(path);
         source.dirlen = path_dirlen(path);
         push_file(source);
@@ -169,35 +765,92 @@ INTERNAL void include_file(const char *name)
     }
 }
 
-INTERNAL void include_system_file(const char *name)
+static int is_system_search_path(int i)
+{
+    return first_system_path != -1 && i >= first_system_path;
+}
+
+static const char *search_path(int i, const char *name)
 {
-    struct source source = {0};
     const char *path;
     size_t dirlen;
-    int i;
 
-    for (i = 0; i < array_len(&search_path_list); ++i) {
-        path = array_get(&search_path_list, i);
-        dirlen = strlen(path);
-        while (path[dirlen - 1] == '/') {
-            dirlen--;
-            assert(dirlen);
-        }
-        path = create_path(path, dirlen, name);
-        source.file = fopen(path, "r");
-        if (source.file) {
-            source.path = str_c(path);
-            source.dirlen = path_dirlen(path);
-            break;
+    path = array_get(&search_path_list, i);
+    dirlen = strlen(path);
+    while (path[dirlen - 1] == '/') {
+        dirlen--;
+        assert(dirlen);
+    }
+
+    return create_path(path, dirlen, name);
+}
+
+/*
+ * Try to include file from the given search path directory. Return 0
+ * if not found, otherwise 1, also when the include is skipped because
+ * of an include guard.
+ */
+static int include_search_path(int i, const char *name)
+{
+    const char *path;
+    struct source source = {0};
+
+    path = search_path(i, name);
+    if (is_include_skipped(path)) {
+        return 1;
+    }
+
+    if (!open_source(&source, path, is_system_search_path(i))) {
+        include_failed_opens++;
+        return 0;
+    }
+
+    source.path = str_c(path);
+    source.dirlen = path_dirlen(path);
+    push_file(source);
+    return 1;
+}
+
+INTERNAL void include_system_file(const char *name)
+{
+    int i, j;
+
+    include_lookups++;
+    j = path_find(&include_names, name);
+    i = 0;
+    if (j != -1) {
+        i = array_get(&include_cache, j);
+        if (i < array_len(&search_path_list)) {
+            include_cache_hits++;
+            if (include_search_path(i, name)) {
+                return;
+            }
+            i = i + 1;
         }
     }
 
-    if (source.file) {
-        push_file(source);
-    } else {
-        error("Unable to resolve include file '%s'.", name);
-        exit(1);
+    for (; i < array_len(&search_path_list); ++i) {
+        if (include_search_path(i, name)) {
+            if (j != -1) {
+                array_get(&include_cache, j) = i;
+            } else {
+                set_include_cache(name, i);
+            }
+            return;
+        }
     }
+
+    error("Unable to resolve include file '%s'.", name);
+    exit(1);
+}
+
+INTERNAL void pragma_once(void)
+{
+    struct source *source;
+
+    assert(array_len(&source_stack));
+    source = &array_back(&source_stack);
+    find_included_file(str_raw(source->path), 1)->is_once = 1;
 }
 
 INTERNAL int add_include_search_path(const char *path)
@@ -206,6 +859,15 @@ INTERNAL int add_include_search_path(const char *path)
     return 0;
 }
 
+INTERNAL void add_system_search_path(const char *path)
+{
+    if (first_system_path == -1) {
+        first_system_path = array_len(&search_path_list);
+    }
+
+    array_push_back(&search_path_list, path);
+}
+
 INTERNAL int add_include_file(const char *path)
 {
     array_push_back(&include_files, path);
@@ -220,13 +882,13 @@ INTERNAL int add_include_file(const char *path)
 static void inject_include_files(void)
 {
     int i;
-    struct source source = {0};
+    struct source source;
     const char *path;
 
     for (i = array_len(&include_files) - 1; i >= 0; --i) {
         path = array_get(&include_files, i);
-        source.file = fopen(path, "r");
-        if (source.file) {
+        memset(&source, 0, sizeof(source));
+        if (open_source(&source, path, 0)) {
             source.path = str_c(path);
             source.dirlen = path_dirlen(path);
             push_file(source);
@@ -236,6 +898,24 @@ static void inject_include_files(void)
     }
 }
 
+INTERNAL const char *prefix_header(void)
+{
+    return array_len(&include_files) ? array_get(&include_files, 0) : NULL;
+}
+
+INTERNAL void skip_prefix_header(void)
+{
+    struct source *source;
+
+    assert(array_len(&source_stack) > 1);
+    source = &array_back(&source_stack);
+    assert(!source->processed);
+    pop_file();
+    source = &array_back(&source_stack);
+    current_file_path = source->path;
+    current_file_line = source->line;
+}
+
 INTERNAL void set_input_file(const char *path)
 {
     static String sstdin = SHORT_STRING_INIT("<stdin>");
@@ -246,6 +926,8 @@ INTERNAL void set_input_file(const char *path)
     while (pop_file() != EOF)
         ;
 
+    clear_included_files();
+    input_generation++;
     if (!rline) {
         rlen = FILE_BUFFER_SIZE;
         rline = calloc(rlen, sizeof(*rline));
@@ -257,16 +939,16 @@ INTERNAL void set_input_file(const char *path)
     if (path) {
         sep = strrchr(path, '/');
         source.path = str_c(path);
-        source.file = fopen(path, "r");
         if (sep) {
             source.dirlen = sep - path;
         }
-        if (!source.file) {
+        if (!read_source(&source, path)) {
             error("Unable to open file %s.", path);
             exit(1);
         }
+        input_add_dependency(path, 0);
     } else {
-        source.file = stdin;
+        load_source(&source, STDIN_FILENO);
         source.path = sstdin;
     }
 
@@ -274,6 +956,38 @@ INTERNAL void set_input_file(const char *path)
     inject_include_files();
 }
 
+/*
+ * Word with all bytes set to one, and with only the high bit of each
+ * byte set.
+ */
+#define WORD_ONES (~0ul / 0xFF)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+
+/* Non-zero if any byte in word is zero. */
+#define WORD_HAS_ZERO(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+
+/* Non-zero if any byte in word is equal to c. */
+#define WORD_HAS_BYTE(w, c) WORD_HAS_ZERO((w) ^ (WORD_ONES * (c)))
+
+/*
+ * Return number of characters in whole words at the start of str, not
+ * exceeding len, that do not contain a, b, or the null character.
+ */
+static size_t skip_words_without(const char *str, size_t len, int a, int b)
+{
+    size_t i;
+    unsigned long w;
+
+    for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, str + i, sizeof(w));
+        if (WORD_HAS_ZERO(w) || WORD_HAS_BYTE(w, a) || WORD_HAS_BYTE(w, b)) {
+            break;
+        }
+    }
+
+    return i;
+}
+
 /*
  * Consume input until encountering end of comment. Return number of
  * characters read, or 0 if end of input reached.
@@ -281,13 +995,14 @@ INTERNAL void set_input_file(const char *path)
  * This must also handle line continuations, which logically happens
  * before replacing comments with whitespace.
  */
-static size_t read_comment(const char *line, int *linecount)
+static size_t read_comment(const char *line, size_t len, int *linecount)
 {
     char c;
     const char *ptr;
 
     ptr = line;
     do {
+        ptr += skip_words_without(ptr, len - (ptr - line), '*', '\n');
         c = *ptr++;
         if (c == '*') {
             while (*ptr == '\\' && ptr[1] == '\n') {
@@ -308,13 +1023,17 @@ static size_t read_comment(const char *line, int *linecount)
  * Read single line comment ending at the first newline. Return number
  * of characters read, or 0 if end of input reached.
  */
-static size_t read_line_comment(const char *line, int *linecount)
+static size_t read_line_comment(
+    const char *line,
+    size_t len,
+    int *linecount)
 {
     char c;
     const char *ptr;
 
     ptr = line;
     do {
+        ptr += skip_words_without(ptr, len - (ptr - line), '\\', '\n');
         c = *ptr++;
         if (c == '\\' && *ptr == '\n') {
             *linecount += 1;
@@ -417,6 +1136,34 @@ static size_t read_literal(const char *line, char **buf, int *lines)
     return 0;
 }
 
+/*
+ * Return number of characters at the start of line, not exceeding len,
+ * which do not need any special handling in read_line. Check a whole
+ * word at a time, stopping at the first word containing any of the
+ * special characters. The exact position is left to the caller.
+ */
+static size_t skip_plain_characters(const char *line, size_t len)
+{
+    size_t i;
+    unsigned long w;
+
+    for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, line + i, sizeof(w));
+        if (WORD_HAS_BYTE(w, '\n')
+            || WORD_HAS_BYTE(w, '"')
+            || WORD_HAS_BYTE(w, '\'')
+            || WORD_HAS_BYTE(w, '*')
+            || WORD_HAS_BYTE(w, '/')
+            || WORD_HAS_BYTE(w, '?')
+            || WORD_HAS_BYTE(w, '\\'))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
 /*
  * Read initial part of line, until forming a complete source line ready
  * for tokenization. Store the result with the following mutations done:
@@ -442,11 +1189,11 @@ INTERNAL size_t read_line(
     const char *start;
 
     assert(write[-1] == '\0');
-    count = 0;
     lines = 0;
     start = line;
+    count = skip_plain_characters(line, len);
 
-    for (i = 0; i < len; ++i) {
+    for (i = count; i < len; ++i) {
         switch (line[i]) {
         case '\n':
             if (count) {
@@ -499,7 +1246,7 @@ INTERNAL size_t read_line(
                 i += n - 1;
                 start = &line[i + 1];
             } else if (c == '*' && write[-1] == '/') {
-                n = read_comment(&line[i + 1], &lines);
+                n = read_comment(&line[i + 1], len - i - 1, &lines);
                 if (!n) {
                     return 0;
                 }
@@ -518,7 +1265,7 @@ INTERNAL size_t read_line(
                     *write++ = c;
                 }
             } else if (c == '/' && write[-1] == '/') {
-                n = read_line_comment(&line[i + 1], &lines);
+                n = read_line_comment(&line[i + 1], len - i - 1, &lines);
                 if (!n) {
                     return 0;
                 }
@@ -530,7 +1277,9 @@ INTERNAL size_t read_line(
             }
             break;
         default:
-            count++;
+            n = skip_plain_characters(line + i + 1, len - i - 1);
+            count += n + 1;
+            i += n;
             break;
         }
     }
@@ -544,74 +1293,102 @@ INTERNAL size_t read_line(
 static char *initial_preprocess_line(struct source *fn)
 {
     size_t added;
+
     assert(fn->buffer);
-    assert(fn->processed <= fn->read);
-    assert(fn->read < fn->size);
+    assert(fn->processed <= fn->size);
+    if (fn->processed == fn->size) {
+        return NULL;
+    }
 
-    do {
-        if (fn->processed == fn->read || !fn->processed) {
-            if (feof(fn->file)) {
-                if (fn->read > fn->processed) {
-                    error("Unable to process the whole input.");
-                    exit(1);
-                }
-                return NULL;
-            }
-            if (!fn->processed) {
-                fn->read += fread(
-                    fn->buffer + fn->read,
-                    sizeof(char),
-                    fn->size - fn->read - 1,
-                    fn->file);
-            } else {
-                fn->read = fread(
-                    fn->buffer,
-                    sizeof(char),
-                    fn->size - 1,
-                    fn->file);
-            }
-            fn->processed = 0;
-            fn->buffer[fn->read] = '\0';
-            if (feof(fn->file)) {
-                if (!fn->read) {
-                    return NULL;
-                }
-                if (fn->buffer[fn->read - 1] != '\n') {
-                    error("Missing newline at end of file.");
-                    fn->buffer[fn->read] = '\n';
-                }
-            }
+    added = read_line(
+        fn->buffer + fn->processed,
+        fn->size - fn->processed,
+        rline + 1,
+        &fn->line);
+
+    if (!added) {
+        error("Unable to process the whole input.");
+        exit(1);
+    }
+
+    fn->processed += added;
+    return rline + 1;
+}
+
+static const char *skip_blank(const char *line)
+{
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+
+    return line;
+}
+
+static int is_word(const char *word, size_t len, const char *str)
+{
+    return strlen(str) == len && !strncmp(word, str, len);
+}
+
+/*
+ * Update include guard state of the file for a line which has been
+ * read. This only looks at the text of conditional directives, which
+ * are processed the same way whether in an active block or not.
+ */
+static void detect_include_guard(struct source *source, const char *line)
+{
+    size_t len;
+    const char *word;
+
+    line = skip_blank(line);
+    if (*line != '#') {
+        if (*line != '\0' && !source->guard_depth) {
+            source->guard_state = GUARD_INVALID;
         }
+        return;
+    }
 
-        assert(fn->processed < fn->read);
-        added = read_line(
-            fn->buffer + fn->processed,
-            fn->read - fn->processed,
-            rline + 1,
-            &fn->line);
-
-        if (!added) {
-            if (!fn->processed) {
-                fn->size += FILE_BUFFER_SIZE;
-                fn->buffer = realloc(fn->buffer, fn->size);
-                if (rlen <= fn->size) {
-                    rlen = fn->size + 1;
-                    rline = realloc(rline, rlen);
+    word = skip_blank(line + 1);
+    for (line = word; isalnum(*line) || *line == '_'; ++line)
+        ;
+
+    len = line - word;
+    if (is_word(word, len, "if")
+        || is_word(word, len, "ifdef")
+        || is_word(word, len, "ifndef"))
+    {
+        if (!source->guard_depth) {
+            if (source->guard_state == GUARD_START
+                && is_word(word, len, "ifndef"))
+            {
+                word = skip_blank(line);
+                for (line = word; isalnum(*line) || *line == '_'; ++line)
+                    ;
+                if (line > word && *skip_blank(line) == '\0') {
+                    source->guard = str_intern(word, line - word);
+                    source->guard_state = GUARD_OPEN;
+                } else {
+                    source->guard_state = GUARD_INVALID;
                 }
             } else {
-                memmove(
-                    fn->buffer,
-                    fn->buffer + fn->processed,
-                    fn->read - fn->processed);
-                assert(fn->read > fn->processed);
-                fn->read -= fn->processed;
-                fn->processed = 0;
+                source->guard_state = GUARD_INVALID;
             }
         }
-    } while (!added);
-
-    fn->processed += added;
-    return rline + 1;
+        source->guard_depth++;
+    } else if (is_word(word, len, "endif")) {
+        if (!source->guard_depth) {
+            source->guard_state = GUARD_INVALID;
+        } else if (!--source->guard_depth
+            && source->guard_state == GUARD_OPEN)
+        {
+            source->guard_state = GUARD_CLOSED;
+        }
+    } else if (is_word(word, len, "else") || is_word(word, len, "elif")) {
+        if (source->guard_depth == 1) {
+            source->guard_state = GUARD_INVALID;
+        }
+    } else if (len && !source->guard_depth) {
+        source->guard_state = GUARD_INVALID;
+    }
 }
 
 static int is_directive(const char *line)
@@ -623,6 +1400,158 @@ static int is_directive(const char *line)
     return *line == '#';
 }
 
+/*
+ * Return number of characters at the start of line, not exceeding len,
+ * which can be skipped in an inactive block after the first token on a
+ * line. Only the end of line and start of comments and literals matter.
+ */
+static size_t skip_inactive_characters(const char *line, size_t len)
+{
+    size_t i;
+    unsigned long w;
+
+    for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, line + i, sizeof(w));
+        if (WORD_HAS_BYTE(w, '\n')
+            || WORD_HAS_BYTE(w, '"')
+            || WORD_HAS_BYTE(w, '\'')
+            || WORD_HAS_BYTE(w, '/')
+            || WORD_HAS_BYTE(w, '\\'))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*
+ * Skip lines of an inactive block, up to the next line starting with a
+ * directive. Lines are not copied or transformed, only comments, string
+ * literals and line continuations are tracked to find where each line
+ * starts. Stop at the beginning of the directive line, which is read as
+ * normal.
+ *
+ * Unterminated literals end at the newline, as they are allowed to
+ * appear in skipped text. Stop at an unterminated comment, leaving
+ * read_line to report the error.
+ */
+static void skip_inactive_lines(struct source *source)
+{
+    int lines, is_start, is_comment;
+    const char *ptr, *end, *begin;
+    char c, q;
+
+    ptr = source->buffer + source->processed;
+    end = source->buffer + source->size;
+    begin = ptr;
+    lines = 0;
+    is_start = 1;
+    is_comment = 0;
+
+    while (ptr < end) {
+        c = *ptr;
+        if (is_comment) {
+            ptr += skip_words_without(ptr, end - ptr, '*', '\n');
+            c = *ptr++;
+            if (c == '\n') {
+                lines++;
+            } else if (c == '*') {
+                while (*ptr == '\\' && ptr[1] == '\n') {
+                    lines++;
+                    ptr += 2;
+                }
+                if (*ptr == '/') {
+                    is_comment = 0;
+                    ptr++;
+                }
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '\n':
+            ptr++;
+            lines++;
+            inactive_lines_skipped += lines;
+            source->line += lines;
+            lines = 0;
+            begin = ptr;
+            is_start = 1;
+            continue;
+        case ' ':
+        case '\t':
+        case '\f':
+        case '\v':
+        case '\r':
+            ptr++;
+            continue;
+        case '\\':
+            if (ptr[1] == '\n') {
+                lines++;
+                ptr += 2;
+                continue;
+            }
+            break;
+        case '/':
+            if (ptr[1] == '*') {
+                is_comment = 1;
+                ptr += 2;
+                continue;
+            } else if (ptr[1] == '/') {
+                for (ptr += 2; ptr < end && *ptr != '\n'; ++ptr) {
+                    if (*ptr == '\\' && ptr[1] == '\n') {
+                        lines++;
+                        ptr++;
+                    }
+                }
+                continue;
+            }
+            break;
+        case '#':
+            if (is_start) {
+                goto done;
+            }
+            break;
+        case '?':
+            if (is_start && ptr[1] == '?' && ptr[2] == '=') {
+                goto done;
+            }
+            break;
+        case '"':
+        case '\'':
+            q = c;
+            for (ptr += 1; ptr < end && *ptr != '\n' && *ptr != q; ++ptr) {
+                if (*ptr == '\\') {
+                    if (ptr[1] == '\n') {
+                        lines++;
+                    }
+                    ptr++;
+                }
+            }
+            if (*ptr == q) {
+                ptr++;
+            }
+            is_start = 0;
+            continue;
+        default:
+            break;
+        }
+
+        is_start = 0;
+        ptr += 1 + skip_inactive_characters(ptr + 1, end - ptr - 1);
+    }
+
+    if (is_comment) {
+        goto done;
+    }
+
+    begin = end;
+
+done:
+    source->processed = begin - source->buffer;
+}
+
 INTERNAL char *getprepline(void)
 {
     static int stale;
@@ -642,6 +1571,9 @@ INTERNAL char *getprepline(void)
             current_file_line = source->line;
             stale = 0;
         }
+        if (!in_active_block()) {
+            skip_inactive_lines(source);
+        }
         line = initial_preprocess_line(source);
         current_file_line += source->line - loc;
         if (!line) {
@@ -649,6 +1581,8 @@ INTERNAL char *getprepline(void)
             if (pop_file() == EOF) {
                 return NULL;
             }
+        } else if (source->guard_state != GUARD_INVALID) {
+            detect_include_guard(source, line);
         }
         if (!in_active_block() && !is_directive(line)) {
             line = NULL;
@@ -659,5 +1593,9 @@ INTERNAL char *getprepline(void)
         verbose("(%s, %d): `%s`", str_raw(source->path), source->line, line);
     }
 
+    if (file_report_fd != -1) {
+        strtab_collect(source->is_system);
+    }
+
     return line;
 }
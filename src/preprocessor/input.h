@@ -18,13 +18,74 @@ INTERNAL void input_finalize(void);
  */
 INTERNAL int add_include_search_path(const char *);
 
+/*
+ * Append system include directory to list of directories to search,
+ * after any directories added with add_include_search_path. Files
+ * found here are not reported as user dependencies.
+ */
+INTERNAL void add_system_search_path(const char *);
+
 /* Push new include file. */
 INTERNAL void include_file(const char *);
 INTERNAL void include_system_file(const char *);
 
+/*
+ * Mark the current file to be skipped if included again, from #pragma
+ * once directive.
+ */
+INTERNAL void pragma_once(void);
+
+/*
+ * Keep contents of file in memory, to be reused by worker processes
+ * forked from the compile server. Path must be absolute.
+ */
+INTERNAL void input_cache_file(const char *path);
+
+/*
+ * Report absolute path of files read from disk to the given file
+ * descriptor, one per line. Strings interned while reading system
+ * headers are also reported, see strtab_report_strings.
+ */
+INTERNAL void input_report_files(int fd);
+
 /* Add file to be included before the main source file. */
 INTERNAL int add_include_file(const char *path);
 
+/* Path of the first file added with add_include_file, or NULL. */
+INTERNAL const char *prefix_header(void);
+
+/*
+ * Do not read the first -include file, after loading a precompiled
+ * header in its place. Must be called before any input is read.
+ */
+INTERNAL void skip_prefix_header(void);
+
+/*
+ * Record file as read in the current translation unit, and whether it
+ * is a system header. This is done automatically for all files opened.
+ */
+INTERNAL void input_add_dependency(const char *path, int is_system);
+
+/* Number of files read in the current translation unit. */
+INTERNAL int input_dependency_count(void);
+
+/*
+ * Path of file read, in the order first opened. Set is_system if the
+ * file is a system header.
+ */
+INTERNAL const char *input_dependency(int i, int *is_system);
+
+/*
+ * Call function for each file in the current translation unit which is
+ * guarded by a macro, or marked with #pragma once.
+ */
+INTERNAL void input_guards(
+    void (*callback)(void *context, const char *path, String macro, int once),
+    void *context);
+
+/* Restore include guard state, as reported by input_guards. */
+INTERNAL void input_add_guard(const char *path, String macro, int is_once);
+
 /*
  * Yield next line ready for further preprocessing. Joins continuations,
  * and replaces comments with a single space. Line implicitly ends with
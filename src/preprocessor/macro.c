@@ -4,6 +4,7 @@
 #endif
 #include "input.h"
 #include "macro.h"
+#include "pch.h"
 #include "strtab.h"
 #include "tokenize.h"
 #include <lacc/context.h>
@@ -11,29 +12,142 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <time.h>
 
+#define SHORT_NAME_FILTER_SIZE (1 << 14)
+
 static struct hash_table macro_hash_table;
 static int new_macro_added;
 
-typedef array_of(String) ExpandStack;
+/*
+ * Most identifiers are not macros, and should be rejected without a
+ * hash table lookup. Definitions with long names are bound directly to
+ * the interned string. Short names are stored inline, and instead count
+ * the number of definitions hashing to each slot of a filter.
+ */
+static unsigned short short_name_filter[SHORT_NAME_FILTER_SIZE];
+
+/* Number of macro lookups, and how many needed the hash table. */
+static int macro_lookups, macro_hash_probes;
+
+/*
+ * Short names are hashed as two 64 bit words, multiplied by 2^64
+ * divided by the golden ratio. The upper half of the product is used
+ * to index the filter.
+ */
+#if (ULONG_MAX >> 31 >> 31 >> 1) != 1
+# error "Short name filter requires 64 bit unsigned long."
+#endif
+#define GOLDEN_RATIO_64 0x9E3779B97F4A7C15ul
+
+/* Filter slot counting definitions of the given short name. */
+static unsigned short *short_name_count(String name)
+{
+    unsigned long w[2], h;
+
+    assert(IS_SHORT_STRING(name));
+    assert(sizeof(w) == sizeof(name));
+    memcpy(w, &name, sizeof(w));
+    h = (w[0] ^ (w[1] * 31)) * GOLDEN_RATIO_64;
+    return &short_name_filter[(h >> 32) & (SHORT_NAME_FILTER_SIZE - 1)];
+}
+
+static void bind_macro(struct macro *macro)
+{
+    if (IS_SHORT_STRING(macro->name)) {
+        *short_name_count(macro->name) += 1;
+    } else {
+        str_set_data(macro->name, macro);
+    }
+}
+
+static void unbind_macro(struct macro *macro)
+{
+    if (IS_SHORT_STRING(macro->name)) {
+        assert(*short_name_count(macro->name) > 0);
+        *short_name_count(macro->name) -= 1;
+    } else {
+        str_set_data(macro->name, NULL);
+    }
+}
+
+static struct macro *find_macro(String name)
+{
+    macro_lookups++;
+    if (!IS_SHORT_STRING(name)) {
+        return str_data(name);
+    }
+
+    if (!*short_name_count(name)) {
+        return NULL;
+    }
+
+    macro_hash_probes++;
+    return hash_lookup(&macro_hash_table, name);
+}
+
+/*
+ * Macro being expanded, and the scope it was previously marked with.
+ * Scopes are strictly nested, forming a stack shared by all of them.
+ */
+struct expansion {
+    struct macro *macro;
+    int scope;
+};
+
+static array_of(struct expansion) expansions;
+
+/*
+ * Pending input being rescanned, either the line being expanded, or the
+ * replacement of a macro. The top of the stack is read first. Contexts
+ * of macros are pushed together with their expansion, and the line at
+ * the bottom is owned by the caller.
+ */
+struct pending {
+    TokenArray list;
+    int pos;
+};
+
+static array_of(struct pending) rescan;
+
+/* Number of scopes created, used to give each a unique identifier. */
+static int scope_count;
 
 /* Keep track of arrays being recycled. */
 static array_of(TokenArray) arrays;
-static array_of(ExpandStack) stacks;
 
-static int is_expanded(const ExpandStack *scope, String name)
+/*
+ * Macros are not expanded again in the same scope while being expanded,
+ * which is checked in constant time by marking the definition itself.
+ */
+static int is_expanded(int scope, String name)
 {
-    int i;
-    for (i = 0; i < array_len(scope); ++i) {
-        if (str_eq(array_get(scope, i), name)) {
-            return 1;
-        }
-    }
-    return 0;
+    const struct macro *def;
+
+    def = find_macro(name);
+    return def && def->scope == scope;
+}
+
+static void push_expansion(int scope, struct macro *def)
+{
+    struct expansion e;
+
+    e.macro = def;
+    e.scope = def->scope;
+    def->scope = scope;
+    array_push_back(&expansions, e);
+}
+
+static void pop_expansion(void)
+{
+    struct expansion e;
+
+    e = array_pop_back(&expansions);
+    e.macro->scope = e.scope;
 }
 
 INTERNAL TokenArray get_token_array(void)
@@ -53,23 +167,6 @@ INTERNAL void release_token_array(TokenArray list)
     array_push_back(&arrays, list);
 }
 
-static ExpandStack get_expand_stack(void)
-{
-    ExpandStack stack = {0};
-    if (array_len(&stacks)) {
-        stack = array_pop_back(&stacks);
-        array_zero(&stack);
-        array_empty(&stack);
-    }
-
-    return stack;
-}
-
-static void release_expand_stack(ExpandStack stack)
-{
-    array_push_back(&stacks, stack);
-}
-
 static int macrocmp(const struct macro *a, const struct macro *b)
 {
     int i;
@@ -96,6 +193,7 @@ static int macrocmp(const struct macro *a, const struct macro *b)
 static void macro_hash_del(void *ref)
 {
     struct macro *macro = (struct macro *) ref;
+    unbind_macro(macro);
     release_token_array(macro->replacement);
     free(macro);
 }
@@ -107,7 +205,9 @@ static void *macro_hash_add(void *ref, String *key)
     arg = (struct macro *) ref;
     macro = calloc(1, sizeof(*macro));
     *macro = *arg;
+    macro->scope = 0;
     *key = macro->name;
+    bind_macro(macro);
     /*
      * Signal that the hash table has ownership now, and it will not be
      * freed in define().
@@ -118,28 +218,30 @@ static void *macro_hash_add(void *ref, String *key)
 
 INTERNAL void macro_reset(void)
 {
+    assert(!array_len(&expansions));
+    assert(!array_len(&rescan));
     hash_clear(&macro_hash_table, macro_hash_del);
+    scope_count = 0;
 }
 
 INTERNAL void macro_finalize(void)
 {
     int i;
     TokenArray list;
-    ExpandStack stack;
 
+    verbose("Looked up %d macro names, %d in hash table.",
+        macro_lookups, macro_hash_probes);
     hash_destroy(&macro_hash_table);
+    macro_lookups = 0;
+    macro_hash_probes = 0;
     for (i = 0; i < array_len(&arrays); ++i) {
         list = array_get(&arrays, i);
         array_clear(&list);
     }
 
-    for (i = 0; i < array_len(&stacks); ++i) {
-        stack = array_get(&stacks, i);
-        array_clear(&stack);
-    }
-
     array_clear(&arrays);
-    array_clear(&stacks);
+    array_clear(&expansions);
+    array_clear(&rescan);
 }
 
 static struct token get__line__token(void)
@@ -164,11 +266,11 @@ static struct token get__file__token(void)
  * Replace __FILE__ with file name, and __LINE__ with line number, by
  * mutating the replacement list on the fly.
  */
-INTERNAL const struct macro *macro_definition(String name)
+static struct macro *lookup_macro(String name)
 {
     struct macro *ref;
 
-    ref = hash_lookup(&macro_hash_table, name);
+    ref = find_macro(name);
     if (ref) {
         if (ref->is__file__) {
             array_get(&ref->replacement, 0) = get__file__token();
@@ -180,6 +282,11 @@ INTERNAL const struct macro *macro_definition(String name)
     return ref;
 }
 
+INTERNAL const struct macro *macro_definition(String name)
+{
+    return lookup_macro(name);
+}
+
 INTERNAL void define(struct macro macro)
 {
     struct macro *ref;
@@ -196,6 +303,7 @@ INTERNAL void define(struct macro macro)
     } else {
         ref->is__file__ = str_eq(builtin__file__, ref->name);
         ref->is__line__ = str_eq(builtin__line__, ref->name);
+        pch_record_define(ref);
         if (!new_macro_added) {
             release_token_array(macro.replacement);
         }
@@ -204,6 +312,7 @@ INTERNAL void define(struct macro macro)
 
 INTERNAL void undef(String name)
 {
+    pch_record_undef(name);
     hash_remove(&macro_hash_table, name, macro_hash_del);
 }
 
@@ -280,46 +389,6 @@ static enum token_type peek_token(const TokenArray *list, int i)
     return END;
 }
 
-/*
- * Replace content of list in segment [start, start + gaplength] with
- * contents of slice. The gap is from reading arguments from list, and
- * the slice is result of expanding it. Slice might be smaller or larger
- * than the gap.
- */ 
-static void array_replace_slice(
-    TokenArray *list,
-    int start,
-    int gaplength,
-    TokenArray *slice)
-{
-    int length;
-    assert(start + gaplength <= array_len(list));
-
-    length = array_len(list) - gaplength + array_len(slice);
-    array_realloc(list, length);
-
-    /*
-     * Move trailing data out of the way, or move closer to prefix, to
-     * align exactly where slice is inserted.
-     */
-    if (array_len(slice) != gaplength) {
-        memmove(
-            list->data + start + array_len(slice),
-            list->data + start + gaplength,
-            (array_len(list) - (start + gaplength)) * sizeof(*list->data));
-    }
-
-    /* Copy slice directly into now vacant space in list. */
-    if (array_len(slice)) {
-        memcpy(
-            list->data + start,
-            slice->data,
-            array_len(slice) * sizeof(*list->data));
-    }
-
-    list->length = length;
-}
-
 /*
  * Replacing # <param> and <a> ## <b> is done in an initial scan of
  * the replacement list. This pass requires the parameters to not be
@@ -422,16 +491,11 @@ static TokenArray expand_stringify_and_paste(
     return list;
 }
 
-static int expand_line(ExpandStack *scope, TokenArray *list);
-
-static TokenArray expand_macro(
-    ExpandStack *scope,
-    const struct macro *def,
-    TokenArray *args)
+static TokenArray expand_macro(const struct macro *def, TokenArray *args)
 {
-    int i, j;
+    int i;
     struct token t;
-    TokenArray list;
+    TokenArray list, subst;
 
     list = expand_stringify_and_paste(def, args);
     if (def->params > 0) {
@@ -445,185 +509,256 @@ static TokenArray expand_macro(
             }
         }
 
+        subst = get_token_array();
         for (i = 0; i < array_len(&list); ++i) {
             t = array_get(&list, i);
             if (t.token == PARAM) {
-                j = t.d.val.i;
-                if (!array_len(&args[j])) {
-                    array_erase(&list, i);
-                    i--;
-                } else {
-                    array_replace_slice(&list, i, 1, &args[j]);
-                }
+                array_concat(&subst, &args[t.d.val.i]);
+            } else {
+                array_push_back(&subst, t);
             }
         }
 
+        release_token_array(list);
+        list = subst;
         for (i = 0; i < def->params; ++i)
             release_token_array(args[i]);
         free(args);
     }
 
-    expand_line(scope, &list);
     return list;
 }
 
+static void push_context(int scope, struct macro *def, TokenArray list)
+{
+    struct pending ctx;
+
+    ctx.list = list;
+    ctx.pos = 0;
+    push_expansion(scope, def);
+    array_push_back(&rescan, ctx);
+}
+
+static void pop_context(void)
+{
+    struct pending ctx;
+
+    ctx = array_pop_back(&rescan);
+    pop_expansion();
+    release_token_array(ctx.list);
+}
+
 /*
- * Read tokens forming next macro argument. Missing arguments are
- * represented by an empty list.
+ * Read next pending token, popping macro contexts above base which are
+ * completely read. Return 0 at end of the line being expanded.
+ */
+static int next_token(int base, struct token *t)
+{
+    struct pending *ctx;
+
+    while (1) {
+        ctx = &array_back(&rescan);
+        if (ctx->pos < array_len(&ctx->list)) {
+            *t = array_get(&ctx->list, ctx->pos++);
+            return 1;
+        }
+
+        if (array_len(&rescan) == base + 1) {
+            return 0;
+        }
+
+        pop_context();
+    }
+}
+
+/*
+ * Determine if pending tokens start with a parenthesized argument list,
+ * ending before the end of line. The list can continue past the end of
+ * the context it starts in.
+ */
+static int is_complete_invocation(int base)
+{
+    int i, j, nesting;
+    struct token t;
+    const struct pending *ctx;
+
+    nesting = 0;
+    for (i = array_len(&rescan) - 1; i >= base; --i) {
+        ctx = &array_get(&rescan, i);
+        for (j = ctx->pos; j < array_len(&ctx->list); ++j) {
+            t = array_get(&ctx->list, j);
+            if (t.token == NEWLINE || (!nesting && t.token != '(')) {
+                return 0;
+            } else if (t.token == '(') {
+                nesting++;
+            } else if (t.token == ')' && !--nesting) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read tokens forming next macro argument, and the token ending it.
+ * Missing arguments are represented by an empty list.
  *
  * Stop reading on first ',' encountered with no parenthesis nesting
  * depth. Exception is argument for (...), which consumes input until
  * first ')'.
  */
 static TokenArray read_arg(
-    ExpandStack *scope,
+    int base,
+    int scope,
     int is_va_arg,
-    const struct token *list,
-    const struct token **endptr)
+    struct token *end)
 {
     int nesting = 0;
     struct token t;
     TokenArray arg = get_token_array();
 
-    while (nesting
-        || ((list->token != ',' || is_va_arg) && list->token != ')'))
-    {
-        if (list->token == NEWLINE) {
+    while (1) {
+        if (!next_token(base, &t) || t.token == NEWLINE) {
             error("Unexpected end of input in expansion.");
             exit(1);
         }
-        if (list->token == '(') {
+        if (!nesting && (t.token == ')' || (t.token == ',' && !is_va_arg))) {
+            break;
+        }
+        if (t.token == '(') {
             nesting++;
-        } else if (list->token == ')') {
+        } else if (t.token == ')') {
             nesting--;
-            if (nesting < 0) {
-                error("Negative nesting depth in expansion.");
-                exit(1);
-            }
         }
-        t = *list++;
         if (t.is_expandable && is_expanded(scope, t.d.string)) {
             t.disable_expand = 1;
         }
         array_push_back(&arg, t);
     }
 
-    *endptr = list;
+    *end = t;
     return arg;
 }
 
-static TokenArray *read_args(
-    ExpandStack *scope,
-    const struct macro *def,
-    const struct token *list,
-    const struct token **endptr)
+static TokenArray *read_args(int base, int scope, const struct macro *def)
 {
     int i;
+    struct token t;
     TokenArray *args = NULL;
 
-    if (def->type == FUNCTION_LIKE) {
-        if (list->token != '(') {
-            error("Expected '(' to begin macro argument list.");
-            exit(1);
-        }
-
-        list += 1;
-        if (def->params) {
-            args = calloc(def->params, sizeof(*args));
-            for (i = 0; i < def->params - def->is_vararg; ++i) {
-                args[i] = read_arg(scope, 0, list, &list);
-                if (list->token != ',') {
-                    if (i == def->params - 1)
-                        break;
-                    if (def->is_vararg && i == def->params - 2) {
-                        i = -1;
-                        break;
-                    } else {
-                        error("Expected ',' between macro parameters.");
-                        exit(1);
-                    }
-                } else list += 1;
-            }
-
-            /* Last parameter can be optional for vararg macros. */
-            if (def->is_vararg && i != -1) {
-                assert(i == def->params - 1);
-                args[i] = read_arg(scope, 1, list, &list);
+    assert(def->type == FUNCTION_LIKE);
+    next_token(base, &t);
+    assert(t.token == '(');
+    if (def->params) {
+        args = calloc(def->params, sizeof(*args));
+        for (i = 0; i < def->params - def->is_vararg; ++i) {
+            args[i] = read_arg(base, scope, 0, &t);
+            if (t.token != ',') {
+                if (i == def->params - 1)
+                    break;
+                if (def->is_vararg && i == def->params - 2) {
+                    i = -1;
+                    break;
+                } else {
+                    error("Expected ',' between macro parameters.");
+                    exit(1);
+                }
             }
         }
 
-        if (list->token != ')') {
-            error("Expected ')' to close macro argument list.");
-            exit(1);
+        /* Last parameter can be optional for vararg macros. */
+        if (def->is_vararg && i != -1) {
+            assert(i == def->params - 1);
+            args[i] = read_arg(base, scope, 1, &t);
         }
+    } else {
+        next_token(base, &t);
+    }
 
-        list += 1;
+    if (t.token != ')') {
+        error("Expected ')' to close macro argument list.");
+        exit(1);
     }
 
-    *endptr = list;
     return args;
 }
 
-static int expand_line(ExpandStack *scope, TokenArray *list)
+/*
+ * Expand macros in list, writing the result to a new list which then
+ * replaces the input. Rescanning is iterative: the replacement of each
+ * macro is pushed as a new context on top of the pending input, and the
+ * macro stays disabled until all of its replacement is read. Tokens
+ * found naming a disabled macro are never expanded again.
+ *
+ * Arguments of a function-like macro are read across the end of the
+ * context they start in, which first ends those expansions. This way,
+ * an expansion ending with the name of a function-like macro continues
+ * with arguments from the rest of the line. Incomplete invocations are
+ * left for the caller to read more input.
+ */
+static int expand_line(int scope, TokenArray *list)
 {
-    int size, i, n;
+    int base, n;
     struct token t;
-    const struct macro *def;
-    const struct token *endptr;
-    TokenArray *args, expn;
-
-    for (n = 0, i = 0; i < array_len(list); ++i) {
-        t = array_get(list, i);
+    struct macro *def;
+    struct pending ctx;
+    TokenArray *args, expn, result;
+
+    base = array_len(&rescan);
+    ctx.list = *list;
+    ctx.pos = 0;
+    array_push_back(&rescan, ctx);
+    result = get_token_array();
+    n = 0;
+
+    while (next_token(base, &t)) {
         if (!t.is_expandable || t.disable_expand) {
+            array_push_back(&result, t);
             continue;
         }
 
-        def = macro_definition(t.d.string);
-        if (!def)
-            continue;
-
-        if (is_expanded(scope, t.d.string)) {
-            array_get(list, i).disable_expand = 1;
+        def = lookup_macro(t.d.string);
+        if (!def) {
+            array_push_back(&result, t);
             continue;
         }
 
-        /* Only expand if next token is '(' */
-        if (def->type == FUNCTION_LIKE
-            && (i == array_len(list) - 1
-                || array_get(list, i + 1).token != '('))
-        {
+        if (def->scope == scope) {
+            t.disable_expand = 1;
+            array_push_back(&result, t);
             continue;
         }
 
-        args = read_args(scope, def, list->data + i + 1, &endptr);
-        array_push_back(scope, def->name);
-        expn = expand_macro(scope, def, args);
-        size = (endptr - list->data) - i;
-        (void) array_pop_back(scope);
+        args = NULL;
+        if (def->type == FUNCTION_LIKE) {
+            if (!is_complete_invocation(base)) {
+                array_push_back(&result, t);
+                continue;
+            }
 
-        /* Fix leading whitespace after expansion. */
+            args = read_args(base, scope, def);
+        }
+
+        expn = expand_macro(def, args);
         if (array_len(&expn)) {
             expn.data[0].leading_whitespace = t.leading_whitespace;
         }
 
-        /* Squeeze in expansion in list. */
-        array_replace_slice(list, i, size, &expn);
-        i += array_len(&expn) - 1;
-        release_token_array(expn);
+        push_context(scope, def, expn);
         n += 1;
     }
 
+    assert(array_len(&rescan) == base + 1);
+    ctx = array_pop_back(&rescan);
+    release_token_array(ctx.list);
+    *list = result;
     return n;
 }
 
 INTERNAL int expand(TokenArray *list)
 {
-    int n;
-    ExpandStack stack = get_expand_stack();
-
-    n = expand_line(&stack, list);
-    release_expand_stack(stack);
-    return n;
+    return expand_line(++scope_count, list);
 }
 
 INTERNAL int tok_cmp(struct token a, struct token b)
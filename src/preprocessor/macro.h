@@ -28,6 +28,12 @@ struct macro {
     unsigned int is__file__ : 1;
     unsigned int is_vararg : 1;
 
+    /*
+     * Identifier of innermost scope in which the macro is currently
+     * being expanded, or 0. Used to suppress recursive expansion.
+     */
+    int scope;
+
     /*
      * A substitution is either a token or a parameter, and parameters
      * are represented by PARAM tokens with an integer index between
@@ -0,0 +1,507 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "input.h"
+#include "pch.h"
+#include "preprocess.h"
+#include "strtab.h"
+#include <lacc/context.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Changing the format, or the representation of tokens, requires
+ * bumping the version.
+ */
+#define PCH_MAGIC "lacc-pch-1"
+
+enum journal_entry {
+    JOURNAL_DEFINE = 'D',
+    JOURNAL_UNDEF = 'U'
+};
+
+struct buffer {
+    char *data;
+    size_t length, capacity;
+};
+
+struct reader {
+    const unsigned char *data;
+    size_t length, offset;
+    int is_error;
+};
+
+static int is_recording;
+
+/*
+ * Macro definitions and tokens are serialized as they are recorded,
+ * together with the number of entries.
+ */
+static struct buffer journal, recorded;
+static unsigned long journal_entries, recorded_tokens;
+
+static void put_bytes(struct buffer *buf, const void *ptr, size_t len)
+{
+    if (buf->length + len > buf->capacity) {
+        buf->capacity = buf->capacity ? buf->capacity * 2 : 4096;
+        if (buf->capacity < buf->length + len) {
+            buf->capacity = buf->length + len;
+        }
+        buf->data = realloc(buf->data, buf->capacity);
+    }
+
+    memcpy(buf->data + buf->length, ptr, len);
+    buf->length += len;
+}
+
+static void put_u8(struct buffer *buf, unsigned int value)
+{
+    unsigned char c;
+
+    c = value & 0xFF;
+    put_bytes(buf, &c, 1);
+}
+
+static void put_u32(struct buffer *buf, unsigned long value)
+{
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        put_u8(buf, value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static void put_u64(struct buffer *buf, unsigned long value)
+{
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        put_u8(buf, value & 0xFF);
+        value >>= 8;
+    }
+}
+
+/* Write string with null terminator, to be read back in place. */
+static void put_cstr(struct buffer *buf, const char *str)
+{
+    size_t len;
+
+    len = strlen(str);
+    put_u32(buf, len);
+    put_bytes(buf, str, len + 1);
+}
+
+static void put_string(struct buffer *buf, String str)
+{
+    size_t len;
+
+    len = str_len(str);
+    put_u32(buf, len);
+    put_bytes(buf, str_raw(str), len);
+}
+
+/*
+ * Numbers are only produced by the preprocessor for __LINE__, which
+ * always has a basic integer type.
+ */
+static void write_token(struct buffer *buf, struct token t)
+{
+    put_u8(buf, t.token);
+    put_u8(buf, t.is_expandable | (t.disable_expand << 1));
+    put_u32(buf, t.leading_whitespace);
+    if (t.token == NUMBER) {
+        assert(is_integer(t.type));
+        put_u8(buf, t.type.type);
+        put_u8(buf, t.type.is_unsigned);
+        put_u64(buf, t.d.val.u);
+    } else if (t.token == PARAM) {
+        put_u64(buf, t.d.val.u);
+    } else {
+        put_string(buf, t.d.string);
+    }
+}
+
+static const unsigned char *get_bytes(struct reader *rd, size_t len)
+{
+    const unsigned char *ptr;
+
+    if (rd->is_error || rd->length - rd->offset < len) {
+        rd->is_error = 1;
+        return NULL;
+    }
+
+    ptr = rd->data + rd->offset;
+    rd->offset += len;
+    return ptr;
+}
+
+static unsigned int get_u8(struct reader *rd)
+{
+    const unsigned char *ptr;
+
+    ptr = get_bytes(rd, 1);
+    return ptr ? *ptr : 0;
+}
+
+static unsigned long get_u32(struct reader *rd)
+{
+    int i;
+    unsigned long value;
+    const unsigned char *ptr;
+
+    ptr = get_bytes(rd, 4);
+    if (!ptr) {
+        return 0;
+    }
+
+    for (i = 3, value = 0; i >= 0; --i) {
+        value = (value << 8) | ptr[i];
+    }
+
+    return value;
+}
+
+static unsigned long get_u64(struct reader *rd)
+{
+    int i;
+    unsigned long value;
+    const unsigned char *ptr;
+
+    ptr = get_bytes(rd, 8);
+    if (!ptr) {
+        return 0;
+    }
+
+    for (i = 7, value = 0; i >= 0; --i) {
+        value = (value << 8) | ptr[i];
+    }
+
+    return value;
+}
+
+static const char *get_cstr(struct reader *rd)
+{
+    size_t len;
+    const unsigned char *ptr;
+
+    len = get_u32(rd);
+    ptr = get_bytes(rd, len + 1);
+    if (!ptr || ptr[len] != '\0') {
+        rd->is_error = 1;
+        return "";
+    }
+
+    return (const char *) ptr;
+}
+
+static String get_string(struct reader *rd)
+{
+    size_t len;
+    const unsigned char *ptr;
+
+    len = get_u32(rd);
+    ptr = get_bytes(rd, len);
+    if (!ptr || !len) {
+        return str_empty();
+    }
+
+    return str_intern((const char *) ptr, len);
+}
+
+static struct token read_token(struct reader *rd)
+{
+    unsigned int flags;
+    struct token t = {0};
+
+    t.token = (signed char) get_u8(rd);
+    flags = get_u8(rd);
+    t.is_expandable = flags & 1;
+    t.disable_expand = (flags >> 1) & 1;
+    t.leading_whitespace = get_u32(rd);
+    if (t.token == NUMBER) {
+        t.type.type = (signed char) get_u8(rd);
+        t.type.is_unsigned = get_u8(rd);
+        t.d.val.u = get_u64(rd);
+    } else if (t.token == PARAM) {
+        t.d.val.u = get_u64(rd);
+    } else {
+        t.d.string = get_string(rd);
+    }
+
+    return t;
+}
+
+INTERNAL void pch_begin(void)
+{
+    is_recording = 1;
+    journal.length = 0;
+    recorded.length = 0;
+    journal_entries = 0;
+    recorded_tokens = 0;
+}
+
+INTERNAL void pch_record_define(const struct macro *macro)
+{
+    int i;
+
+    if (is_recording) {
+        journal_entries++;
+        put_u8(&journal, JOURNAL_DEFINE);
+        put_string(&journal, macro->name);
+        put_u8(&journal, macro->type);
+        put_u32(&journal, macro->params);
+        put_u8(&journal, macro->is_vararg);
+        put_u32(&journal, array_len(&macro->replacement));
+        for (i = 0; i < array_len(&macro->replacement); ++i) {
+            write_token(&journal, array_get(&macro->replacement, i));
+        }
+    }
+}
+
+INTERNAL void pch_record_undef(String name)
+{
+    if (is_recording) {
+        journal_entries++;
+        put_u8(&journal, JOURNAL_UNDEF);
+        put_string(&journal, name);
+    }
+}
+
+INTERNAL void pch_record_token(struct token t)
+{
+    if (is_recording && t.token != END) {
+        recorded_tokens++;
+        write_token(&recorded, t);
+    }
+}
+
+static void put_guard(void *ptr, const char *path, String macro, int once)
+{
+    struct buffer *buf;
+
+    buf = (struct buffer *) ptr;
+    put_cstr(buf, path);
+    put_string(buf, macro);
+    put_u8(buf, once);
+}
+
+static void count_guard(void *ptr, const char *path, String macro, int once)
+{
+    unsigned long *count;
+
+    count = (unsigned long *) ptr;
+    *count += 1;
+}
+
+INTERNAL int pch_write(FILE *stream, const char *signature)
+{
+    int i, n, ret, is_system;
+    const char *path;
+    unsigned long guards;
+    struct stat st;
+    struct buffer buf = {0};
+
+    assert(is_recording);
+    is_recording = 0;
+    put_cstr(&buf, PCH_MAGIC);
+    put_cstr(&buf, signature);
+
+    n = input_dependency_count();
+    put_u32(&buf, n);
+    for (i = 0; i < n; ++i) {
+        path = input_dependency(i, &is_system);
+        if (stat(path, &st)) {
+            error("Unable to read status of %s.", path);
+            free(buf.data);
+            return 1;
+        }
+        put_cstr(&buf, path);
+        put_u8(&buf, is_system);
+        put_u64(&buf, st.st_size);
+        put_u64(&buf, st.st_mtime);
+    }
+
+    guards = 0;
+    input_guards(&count_guard, &guards);
+    put_u32(&buf, guards);
+    input_guards(&put_guard, &buf);
+
+    put_u32(&buf, journal_entries);
+    put_bytes(&buf, journal.data, journal.length);
+    put_u32(&buf, recorded_tokens);
+    put_bytes(&buf, recorded.data, recorded.length);
+
+    ret = fwrite(buf.data, 1, buf.length, stream) != buf.length;
+    free(buf.data);
+    return ret;
+}
+
+static char *read_file(const char *path, size_t *length)
+{
+    FILE *f;
+    char *data;
+    struct stat st;
+
+    if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+
+    f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    data = malloc(st.st_size + 1);
+    *length = fread(data, 1, st.st_size, f);
+    fclose(f);
+    if (*length != (size_t) st.st_size) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+/*
+ * Check that header is compatible, and that no files read when it was
+ * created have changed since.
+ */
+static int is_valid(struct reader *rd, const char *signature)
+{
+    unsigned long i, n, size, mtime;
+    const char *path;
+    struct stat st;
+
+    if (strcmp(get_cstr(rd), PCH_MAGIC)
+        || strcmp(get_cstr(rd), signature))
+    {
+        return 0;
+    }
+
+    n = get_u32(rd);
+    for (i = 0; i < n && !rd->is_error; ++i) {
+        path = get_cstr(rd);
+        get_u8(rd);
+        size = get_u64(rd);
+        mtime = get_u64(rd);
+        if (stat(path, &st)
+            || (unsigned long) st.st_size != size
+            || (unsigned long) st.st_mtime != mtime)
+        {
+            verbose("Precompiled header is out of date with %s.", path);
+            return 0;
+        }
+    }
+
+    return !rd->is_error;
+}
+
+static void replay_journal(struct reader *rd)
+{
+    unsigned long i, j, n, len;
+    struct macro macro;
+
+    n = get_u32(rd);
+    for (i = 0; i < n && !rd->is_error; ++i) {
+        switch (get_u8(rd)) {
+        case JOURNAL_DEFINE:
+            memset(&macro, 0, sizeof(macro));
+            macro.name = get_string(rd);
+            macro.type = get_u8(rd) == FUNCTION_LIKE
+                ? FUNCTION_LIKE
+                : OBJECT_LIKE;
+            macro.params = get_u32(rd);
+            macro.is_vararg = get_u8(rd);
+            macro.replacement = get_token_array();
+            len = get_u32(rd);
+            for (j = 0; j < len && !rd->is_error; ++j) {
+                array_push_back(&macro.replacement, read_token(rd));
+            }
+            define(macro);
+            break;
+        case JOURNAL_UNDEF:
+            undef(get_string(rd));
+            break;
+        default:
+            rd->is_error = 1;
+            break;
+        }
+    }
+}
+
+INTERNAL int pch_load(const char *path, const char *signature)
+{
+    char *data;
+    unsigned long i, n;
+    size_t length;
+    const char *file;
+    String macro;
+    int once, is_system;
+    TokenArray tokens;
+    struct reader rd = {0};
+
+    data = read_file(path, &length);
+    if (!data) {
+        return 1;
+    }
+
+    rd.data = (const unsigned char *) data;
+    rd.length = length;
+    if (!is_valid(&rd, signature)) {
+        free(data);
+        return 1;
+    }
+
+    rd.offset = 0;
+    get_cstr(&rd);
+    get_cstr(&rd);
+    n = get_u32(&rd);
+    for (i = 0; i < n; ++i) {
+        file = get_cstr(&rd);
+        is_system = get_u8(&rd);
+        input_add_dependency(file, is_system);
+        get_u64(&rd);
+        get_u64(&rd);
+    }
+
+    n = get_u32(&rd);
+    for (i = 0; i < n && !rd.is_error; ++i) {
+        file = get_cstr(&rd);
+        macro = get_string(&rd);
+        once = get_u8(&rd);
+        input_add_guard(file, macro, once);
+    }
+
+    replay_journal(&rd);
+    tokens = get_token_array();
+    n = get_u32(&rd);
+    for (i = 0; i < n && !rd.is_error; ++i) {
+        array_push_back(&tokens, read_token(&rd));
+    }
+
+    if (rd.is_error) {
+        error("Invalid precompiled header %s.", path);
+        exit(1);
+    }
+
+    inject_tokens(&tokens);
+    release_token_array(tokens);
+    free(data);
+    return 0;
+}
+
+INTERNAL void pch_finalize(void)
+{
+    is_recording = 0;
+    free(journal.data);
+    free(recorded.data);
+    memset(&journal, 0, sizeof(journal));
+    memset(&recorded, 0, sizeof(recorded));
+}
@@ -0,0 +1,51 @@
+#ifndef PCH_H
+#define PCH_H
+
+#include "macro.h"
+#include <lacc/token.h>
+
+#include <stdio.h>
+
+/*
+ * Precompiled headers are a cache of the token stream produced by the
+ * preprocessor, and the macro definitions and include guards in effect
+ * at the end of the header. Parser state is not saved, so declarations
+ * and types are still built from the tokens in every translation unit.
+ */
+
+/*
+ * Start recording macro definitions and tokens produced by the
+ * preprocessor, to be written as a precompiled header.
+ */
+INTERNAL void pch_begin(void);
+
+/* Record macro definition, if recording. */
+INTERNAL void pch_record_define(const struct macro *macro);
+
+/* Record removal of macro definition, if recording. */
+INTERNAL void pch_record_undef(String name);
+
+/* Record token added to lookahead, if recording. */
+INTERNAL void pch_record_token(struct token t);
+
+/*
+ * Write precompiled header, containing files read with size and
+ * modification time, include guards, the journal of macro definitions,
+ * and all tokens produced. The signature is a description of options
+ * that must be the same for the header to be valid. Stop recording.
+ */
+INTERNAL int pch_write(FILE *stream, const char *signature);
+
+/*
+ * Load precompiled header, if it is valid for the given signature, and
+ * none of the files read when it was created have changed. Replay the
+ * macro journal, and inject tokens to be read before any other input.
+ *
+ * Return 0 on success, or non-zero if the header could not be used.
+ */
+INTERNAL int pch_load(const char *path, const char *signature);
+
+/* Free memory used for recording. */
+INTERNAL void pch_finalize(void);
+
+#endif
@@ -5,17 +5,22 @@
 #include "directive.h"
 #include "input.h"
 #include "macro.h"
+#include "pch.h"
 #include "preprocess.h"
 #include "strtab.h"
 #include "tokenize.h"
 #include <lacc/context.h>
 #include <lacc/deque.h>
+#include <lacc/timer.h>
 
 #include <assert.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Size of chunks of text passed on when producing -E output. */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
 /*
  * Buffer of preprocessed tokens, ready to be consumed by the parser.
  * Filled lazily on calls to peek(0), peekn(1) and next(0).
@@ -30,6 +35,7 @@ static char *line_buffer;
 
 INTERNAL void preprocess_reset(void)
 {
+    output_preprocessed = 0;
     line_buffer = NULL;
     macro_reset();
     strtab_reset();
@@ -391,6 +397,7 @@ static void add_to_lookahead(struct token t)
 {
     struct token prev;
 
+    pch_record_token(t);
     if (!output_preprocessed) {
         switch (t.token) {
         case PREP_CHAR:
@@ -456,7 +463,9 @@ static void preprocess_pragma(TokenArray *line)
 
     assert(array_len(line) > 0);
     assert(!tok_cmp(ident__pragma, array_get(line, 0)));
-    if (output_preprocessed) {
+    if (array_len(line) > 1 && !tok_cmp(ident__once, array_get(line, 1))) {
+        pragma_once();
+    } else if (output_preprocessed) {
         add_to_lookahead(basic_token[NEWLINE]);
         add_to_lookahead(basic_token['#']);
         for (i = 0; i < array_len(line); ++i) {
@@ -557,6 +566,7 @@ static void preprocess_line(int n)
     int i;
     struct token t;
 
+    timer_push(TIMER_PREPROCESS);
     do {
         t = get_token();
         if (t.token == END) {
@@ -606,6 +616,18 @@ static void preprocess_line(int n)
     while (deque_len(&lookahead) < n) {
         add_to_lookahead(basic_token[END]);
     }
+
+    timer_pop();
+}
+
+INTERNAL void inject_tokens(const TokenArray *tokens)
+{
+    int i;
+
+    assert(!output_preprocessed);
+    for (i = 0; i < array_len(tokens); ++i) {
+        add_to_lookahead(array_get(tokens, i));
+    }
 }
 
 INTERNAL void inject_line(char *line)
@@ -691,36 +713,106 @@ INTERNAL const struct token *access_token(int n)
     return &deque_get(&lookahead, n - 1);
 }
 
-INTERNAL void preprocess(FILE *output)
+/*
+ * Write preprocessed text for a token with given leading whitespace and
+ * quotation, without going through the output buffer. Only used for
+ * tokens too large to fit.
+ */
+static void write_token_text(
+    void (*write)(void *, const char *, size_t),
+    void *context,
+    size_t ws,
+    const char *quote,
+    String str)
+{
+    static const char spaces[] = "                ";
+
+    size_t n;
+
+    for (; ws > 0; ws -= n) {
+        n = ws < sizeof(spaces) - 1 ? ws : sizeof(spaces) - 1;
+        write(context, spaces, n);
+    }
+
+    n = strlen(quote);
+    write(context, quote, n);
+    write(context, str_raw(str), str_len(str));
+    write(context, quote, n);
+}
+
+/*
+ * Produce preprocessed text, copying whitespace and token spelling into
+ * a buffer which is passed to the write callback each time it is full.
+ */
+INTERNAL void preprocess_text(
+    void (*write)(void *, const char *, size_t),
+    void *context)
 {
+    static char buf[OUTPUT_BUFFER_SIZE];
+
+    size_t pos, ws, len;
+    const char *quote;
     const struct token *t;
 
+    pos = 0;
     output_preprocessed = 1;
     while (peek() != END) {
         next();
         t = access_token(0);
-        if (t->leading_whitespace) {
-            fprintf(output, "%*s", t->leading_whitespace, " ");
-        }
-
         switch (t->token) {
         case NUMBER:
             assert(0);
             break;
         case PREP_STRING:
         case STRING:
-            putc('\"', output);
-            fprintf(output, "%s", str_raw(t->d.string));
-            putc('\"', output);
+            quote = "\"";
             break;
         case PREP_CHAR:
-            putc('\'', output);
-            fprintf(output, "%s", str_raw(t->d.string));
-            putc('\'', output);
+            quote = "'";
             break;
         default:
-            fprintf(output, "%s", str_raw(t->d.string));
+            quote = "";
             break;
         }
+
+        ws = t->leading_whitespace;
+        len = str_len(t->d.string);
+        if (pos + ws + len + 2 > sizeof(buf)) {
+            write(context, buf, pos);
+            pos = 0;
+            if (ws + len + 2 > sizeof(buf)) {
+                write_token_text(write, context, ws, quote, t->d.string);
+                continue;
+            }
+        }
+
+        if (ws) {
+            memset(buf + pos, ' ', ws);
+            pos += ws;
+        }
+
+        if (*quote) {
+            buf[pos++] = *quote;
+            memcpy(buf + pos, str_raw(t->d.string), len);
+            pos += len;
+            buf[pos++] = *quote;
+        } else {
+            memcpy(buf + pos, str_raw(t->d.string), len);
+            pos += len;
+        }
+    }
+
+    if (pos) {
+        write(context, buf, pos);
     }
 }
+
+static void write_file(void *output, const char *str, size_t len)
+{
+    fwrite(str, sizeof(char), len, (FILE *) output);
+}
+
+INTERNAL void preprocess(FILE *output)
+{
+    preprocess_text(&write_file, output);
+}
@@ -1,6 +1,8 @@
 #ifndef PREPROCESS_H
 #define PREPROCESS_H
 
+#include "macro.h"
+
 #include <stdio.h>
 
 /*
@@ -9,6 +11,14 @@
  */
 INTERNAL void preprocess(FILE *output);
 
+/*
+ * Produce the same preprocessed text as written by preprocess, passing
+ * each piece to the write callback together with context.
+ */
+INTERNAL void preprocess_text(
+    void (*write)(void *context, const char *str, size_t len),
+    void *context);
+
 /*
  * Preprocess a single line, adding any resulting tokens to the
  * lookahead buffer. This should happen before any input file is read.
@@ -18,6 +28,12 @@ INTERNAL void preprocess(FILE *output);
  */
 INTERNAL void inject_line(char *line);
 
+/*
+ * Add tokens read from a precompiled header to the lookahead buffer.
+ * This should happen before any input file is read.
+ */
+INTERNAL void inject_tokens(const TokenArray *tokens);
+
 /* Initialize data structures used for preprocessing. */
 INTERNAL void preprocess_reset(void);
 
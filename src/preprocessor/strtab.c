@@ -12,9 +12,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
 
 #define STRTAB_CAPACITY_INITIAL 2048
 #define STRTAB_CAPACITY_MAX INT_MAX
+#define STRTAB_CHUNK_SIZE (64 * 1024)
+
+/*
+ * Collected strings are written in batches no larger than the minimum
+ * atomic pipe write size required by POSIX, so that lines written by
+ * concurrent processes are not interleaved.
+ */
+#define STRTAB_REPORT_SIZE 512
 
 /*
  * Global structure containing a singleton instance of all unique string
@@ -37,6 +46,49 @@ static struct {
     } *entries;
 } strtab;
 
+/*
+ * Stored in front of the value of each entry, holding data associated
+ * with the string.
+ */
+struct strtab_header {
+    void *data;
+};
+
+/*
+ * Values are allocated from large chunks of memory, which are only
+ * freed when the string table is reset.
+ */
+struct strtab_chunk {
+    struct strtab_chunk *next;
+    size_t size, used;
+};
+
+static struct strtab_chunk *chunks;
+
+/*
+ * Copy of the table made by strtab_persist, restored on reset. Values
+ * are in chunks which are never freed.
+ */
+static struct {
+    int capacity;
+    int count;
+    struct strtab_entry *entries;
+    struct strtab_chunk *chunks;
+} persisted;
+
+/* Strings collected for reporting, and where to write them. */
+static array_of(String) collected;
+static int is_collecting, report_fd = -1;
+
+/* Statistics reported when the table is reset. */
+static struct {
+    size_t bytes;
+    int chunks;
+    int lookups;
+    int probes;
+    int max_probe;
+} stats;
+
 /* Buffer used to concatenate strings before registering them. */
 static char *catbuf;
 static size_t catlen;
@@ -44,20 +96,150 @@ static size_t catlen;
 /* List of all long double values encountered. */
 static array_of(long double) long_double_values;
 
-INTERNAL void strtab_reset(void)
+/*
+ * Write collected strings to report descriptor, packing as many lines
+ * as possible in each write.
+ */
+static void report_collected(void)
+{
+    int i;
+    size_t len, used;
+    const char *str;
+    char buf[STRTAB_REPORT_SIZE];
+
+    for (i = 0, used = 0; i < array_len(&collected); ++i) {
+        str = str_raw(array_get(&collected, i));
+        len = str_len(array_get(&collected, i));
+        if (len + 2 > sizeof(buf)
+            || memchr(str, '\n', len)
+            || memchr(str, '\0', len))
+        {
+            continue;
+        }
+
+        if (used + len + 2 > sizeof(buf)) {
+            if (write(report_fd, buf, used) != used) {
+                report_fd = -1;
+                break;
+            }
+            used = 0;
+        }
+
+        buf[used] = 'S';
+        memcpy(buf + used + 1, str, len);
+        buf[used + len + 1] = '\n';
+        used += len + 2;
+    }
+
+    if (report_fd != -1 && used && write(report_fd, buf, used) != used) {
+        report_fd = -1;
+    }
+
+    array_empty(&collected);
+}
+
+/*
+ * Restore table to the persisted copy, clearing data associated with
+ * the strings in it.
+ */
+static void restore_persisted(void)
 {
     int i;
+    struct strtab_header *header;
+
+    if (strtab.capacity != persisted.capacity) {
+        free(strtab.entries);
+        strtab.entries = malloc(persisted.capacity * sizeof(*strtab.entries));
+    }
+
+    strtab.capacity = persisted.capacity;
+    strtab.count = persisted.count;
+    memcpy(strtab.entries,
+        persisted.entries,
+        persisted.capacity * sizeof(*strtab.entries));
 
     for (i = 0; i < strtab.capacity; ++i) {
-        free(strtab.entries[i].value);
+        if (strtab.entries[i].value) {
+            header = (struct strtab_header *) strtab.entries[i].value - 1;
+            header->data = NULL;
+        }
+    }
+}
+
+INTERNAL void strtab_reset(void)
+{
+    struct strtab_chunk *chunk;
+
+    if (strtab.count) {
+        verbose("Interned %d strings of %lu bytes in %d chunks.",
+            strtab.count, (unsigned long) stats.bytes, stats.chunks);
+        verbose("Looked up %d strings with %d probes, longest %d, load %d/%d.",
+            stats.lookups, stats.probes, stats.max_probe,
+            strtab.count, strtab.capacity);
     }
 
-    free(strtab.entries);
-    memset(&strtab, 0, sizeof(strtab));
+    if (report_fd != -1 && array_len(&collected)) {
+        report_collected();
+    }
+
+    while (chunks) {
+        chunk = chunks;
+        chunks = chunk->next;
+        free(chunk);
+    }
+
+    if (persisted.entries) {
+        restore_persisted();
+    } else {
+        free(strtab.entries);
+        memset(&strtab, 0, sizeof(strtab));
+    }
+
+    memset(&stats, 0, sizeof(stats));
     free(catbuf);
     catbuf = NULL;
     catlen = 0;
     array_clear(&long_double_values);
+    array_clear(&collected);
+    is_collecting = 0;
+}
+
+/*
+ * Chunks holding the current strings are moved to the persisted list,
+ * and new strings are allocated from new chunks.
+ */
+INTERNAL void strtab_persist(void)
+{
+    struct strtab_chunk *chunk;
+
+    if (!strtab.count || strtab.count == persisted.count) {
+        return;
+    }
+
+    while (chunks) {
+        chunk = chunks;
+        chunks = chunk->next;
+        chunk->next = persisted.chunks;
+        persisted.chunks = chunk;
+    }
+
+    free(persisted.entries);
+    persisted.capacity = strtab.capacity;
+    persisted.count = strtab.count;
+    persisted.entries = malloc(strtab.capacity * sizeof(*strtab.entries));
+    memcpy(persisted.entries,
+        strtab.entries,
+        strtab.capacity * sizeof(*strtab.entries));
+}
+
+INTERNAL void strtab_report_strings(int fd)
+{
+    report_fd = fd;
+}
+
+INTERNAL void strtab_collect(int enable)
+{
+    is_collecting = enable;
 }
 
 /*
@@ -90,30 +272,22 @@ static int strtab_match_entry(
 static struct strtab_entry *strtab_find_entry(
     const char *value,
     int length,
-    int hash)
+    int hash,
+    int *probes)
 {
-    int i, j;
+    int i, n;
     struct strtab_entry *entry;
 
     assert(strtab.capacity > 0);
     i = hash & (strtab.capacity - 1);
-    entry = &strtab.entries[i];
-    if (strtab_match_entry(entry, value, length, hash)) {
-        return entry;
-    }
-
-    for (j = i + 1; j < strtab.capacity; ++j) {
-        entry = &strtab.entries[j];
+    for (n = 1; n <= strtab.capacity; ++n) {
+        entry = &strtab.entries[i];
         if (strtab_match_entry(entry, value, length, hash)) {
+            *probes = n;
             return entry;
         }
-    }
 
-    for (j = 0; j < i; ++j) {
-        entry = &strtab.entries[j];
-        if (strtab_match_entry(entry, value, length, hash)) {
-            return entry;
-        }
+        i = (i + 1) & (strtab.capacity - 1);
     }
 
     assert(0);
@@ -127,7 +301,7 @@ static int strtab_is_full(void)
 
 static void strtab_expand(void)
 {
-    int i, cap;
+    int i, cap, n;
     struct strtab_entry *tab, *entry;
 
     tab = strtab.entries;
@@ -144,7 +318,8 @@ static void strtab_expand(void)
     strtab.entries = calloc(strtab.capacity, sizeof(struct strtab_entry));
     for (i = 0; i < cap; ++i) {
         if (tab[i].value) {
-            entry = strtab_find_entry(tab[i].value, tab[i].length, tab[i].hash);
+            entry = strtab_find_entry(
+                tab[i].value, tab[i].length, tab[i].hash, &n);
             *entry = tab[i];
         }
     }
@@ -152,10 +327,47 @@ static void strtab_expand(void)
     free(tab);
 }
 
+/*
+ * Allocate space for header and value of a new entry, keeping headers
+ * aligned. Values too large to share a chunk get one of their own.
+ */
+static struct strtab_header *strtab_alloc(size_t len)
+{
+    size_t size, cap;
+    struct strtab_chunk *chunk;
+
+    size = sizeof(struct strtab_header) + len + 1;
+    size = (size + sizeof(struct strtab_header) - 1)
+        & ~(sizeof(struct strtab_header) - 1);
+
+    chunk = chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        cap = size > STRTAB_CHUNK_SIZE ? size : STRTAB_CHUNK_SIZE;
+        chunk = malloc(sizeof(*chunk) + cap);
+        chunk->size = cap;
+        chunk->used = 0;
+        if (chunks && cap > STRTAB_CHUNK_SIZE) {
+            chunk->next = chunks->next;
+            chunks->next = chunk;
+        } else {
+            chunk->next = chunks;
+            chunks = chunk;
+        }
+
+        stats.chunks++;
+    }
+
+    chunk->used += size;
+    stats.bytes += size;
+    return (struct strtab_header *)
+        ((char *) (chunk + 1) + chunk->used - size);
+}
+
 INTERNAL String str_intern(const char *buf, size_t len)
 {
-    int hash, i;
+    int hash, i, n, added;
     struct strtab_entry *entry;
+    struct strtab_header *header;
     String str = {0};
 
     if (len <= SHORT_STRING_LEN) {
@@ -182,13 +394,21 @@ INTERNAL String str_intern(const char *buf, size_t len)
     assert(strtab.capacity > 0);
     assert(strtab.count < strtab.capacity - 1);
     hash = djb2_hash(buf, len);
-    entry = strtab_find_entry(buf, len, hash);
+    entry = strtab_find_entry(buf, len, hash, &n);
+    stats.lookups++;
+    stats.probes += n;
+    if (n > stats.max_probe) {
+        stats.max_probe = n;
+    }
 
-    if (!entry->value) {
+    added = !entry->value;
+    if (added) {
         strtab.count++;
         entry->hash = hash;
         entry->length = len;
-        entry->value = malloc(len + 1);
+        header = strtab_alloc(len);
+        header->data = NULL;
+        entry->value = (char *) (header + 1);
         memcpy(entry->value, buf, len);
         entry->value[len] = '\0';
     }
@@ -204,9 +424,25 @@ INTERNAL String str_intern(const char *buf, size_t len)
     str.small.cap = -1;
     assert(!IS_SHORT_STRING(str));
     assert(str_len(str) == len);
+    if (added && is_collecting) {
+        array_push_back(&collected, str);
+    }
+
     return str;
 }
 
+INTERNAL void *str_data(String str)
+{
+    assert(!IS_SHORT_STRING(str));
+    return ((struct strtab_header *) str.large.ptr - 1)->data;
+}
+
+INTERNAL void str_set_data(String str, void *data)
+{
+    assert(!IS_SHORT_STRING(str));
+    ((struct strtab_header *) str.large.ptr - 1)->data = data;
+}
+
 INTERNAL String str_c(const char *s)
 {
     return str_intern(s, strlen(s));
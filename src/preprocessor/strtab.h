@@ -8,8 +8,8 @@
 #include <stddef.h>
 
 /*
- * Register a string and store it internally as a singleton, allocating
- * a copy for each unique string.
+ * Register a string and store it internally as a singleton, copying
+ * each unique string to memory freed when the table is reset.
  *
  * This is the only valid way of creating string objects, and it
  * guarantees that equality checks can be reduced to checking pointers
@@ -17,10 +17,36 @@
  */
 INTERNAL String str_intern(const char *str, size_t len);
 
+/*
+ * Get or set pointer associated with an interned string which is too
+ * long to be stored inline. Initially NULL, and valid until the string
+ * table is reset.
+ */
+INTERNAL void *str_data(String str);
+INTERNAL void str_set_data(String str, void *data);
+
 /* Concatenate two strings together, returning a new interned string. */
 INTERNAL String str_cat(String a, String b);
 
-/* Free memory used for string table. */
+/*
+ * Free memory used for string table. Strings kept by strtab_persist
+ * remain, with associated data cleared.
+ */
 INTERNAL void strtab_reset(void);
 
+/*
+ * Keep all strings currently in the table on later resets. Used by the
+ * compile server to share strings with worker processes.
+ */
+INTERNAL void strtab_persist(void);
+
+/*
+ * Collect strings added while enabled, and write them to the file
+ * descriptor when the table is reset. Each string is written on a
+ * separate line prefixed by 'S', skipping strings containing newline
+ * or null characters.
+ */
+INTERNAL void strtab_report_strings(int fd);
+INTERNAL void strtab_collect(int enable);
+
 #endif
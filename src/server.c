@@ -0,0 +1,470 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include "server.h"
+#include "preprocessor/input.h"
+#include "preprocessor/strtab.h"
+#include <lacc/array.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <assert.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Messages exchanged between client and server are framed by a single
+ * byte type tag and a four byte payload length.
+ *
+ * The client sends working directory and each command line argument,
+ * followed by a run message. The server responds with a stream of
+ * output chunks, ending with the exit status.
+ */
+enum message {
+    MSG_CWD = 'C',
+    MSG_ARG = 'A',
+    MSG_RUN = 'R',
+    MSG_STDOUT = 'O',
+    MSG_STDERR = 'E',
+    MSG_EXIT = 'X'
+};
+
+#define SERVER_BACKLOG 64
+#define SERVER_POLL_TIMEOUT 1000
+
+/* Largest message accepted, protecting against garbage length. */
+#define MESSAGE_SIZE_MAX (16 * 1024 * 1024)
+
+/* Maximum number of strings shared with worker processes. */
+#define SERVER_STRINGS_MAX (256 * 1024)
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        n = write(fd, data, len);
+        if (n <= 0) {
+            return -1;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int read_all(int fd, char *data, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, data, len);
+        if (n <= 0) {
+            return -1;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int send_message(int fd, enum message type, const char *data, size_t len)
+{
+    unsigned char header[5];
+
+    header[0] = type;
+    header[1] = len & 0xFF;
+    header[2] = (len >> 8) & 0xFF;
+    header[3] = (len >> 16) & 0xFF;
+    header[4] = (len >> 24) & 0xFF;
+    if (write_all(fd, (const char *) header, sizeof(header))) {
+        return -1;
+    }
+
+    return write_all(fd, data, len);
+}
+
+/*
+ * Read next message into buffer, which is reallocated to fit payload
+ * and a terminating null character. Fail if the payload is larger than
+ * MESSAGE_SIZE_MAX, or memory cannot be allocated.
+ */
+static int read_message(int fd, enum message *type, char **buf, size_t *len)
+{
+    unsigned char header[5];
+    char *data;
+
+    if (read_all(fd, (char *) header, sizeof(header))) {
+        return -1;
+    }
+
+    *type = header[0];
+    *len = (size_t) header[1]
+        | ((size_t) header[2] << 8)
+        | ((size_t) header[3] << 16)
+        | ((size_t) header[4] << 24);
+
+    if (*len > MESSAGE_SIZE_MAX) {
+        return -1;
+    }
+
+    data = realloc(*buf, *len + 1);
+    if (!data) {
+        return -1;
+    }
+
+    *buf = data;
+    (*buf)[*len] = '\0';
+    return read_all(fd, *buf, *len);
+}
+
+static char *get_working_directory(void)
+{
+    char *buf;
+    size_t len;
+
+    buf = NULL;
+    len = 256;
+    do {
+        len *= 2;
+        buf = realloc(buf, len);
+    } while (!getcwd(buf, len));
+
+    return buf;
+}
+
+static int set_address(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long.\n", path);
+        return 1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/*
+ * Forward output from worker process to client until both streams are
+ * closed. Keep draining the pipes if the client goes away, so that the
+ * worker is not blocked.
+ */
+static void relay_output(int conn, int out, int err)
+{
+    char buf[4096];
+    ssize_t n;
+    int i, open;
+    struct pollfd fds[2];
+
+    fds[0].fd = out;
+    fds[1].fd = err;
+    fds[0].events = POLLIN;
+    fds[1].events = POLLIN;
+    open = 2;
+
+    while (open) {
+        if (poll(fds, 2, -1) < 0) {
+            break;
+        }
+
+        for (i = 0; i < 2; ++i) {
+            if (fds[i].fd < 0 || !fds[i].revents) {
+                continue;
+            }
+
+            n = read(fds[i].fd, buf, sizeof(buf));
+            if (n <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open--;
+            } else if (conn != -1) {
+                if (send_message(conn, i ? MSG_STDERR : MSG_STDOUT, buf, n)) {
+                    conn = -1;
+                }
+            }
+        }
+    }
+}
+
+static void send_status(int conn, int status)
+{
+    char data[4];
+
+    data[0] = status & 0xFF;
+    data[1] = (status >> 8) & 0xFF;
+    data[2] = (status >> 16) & 0xFF;
+    data[3] = (status >> 24) & 0xFF;
+    send_message(conn, MSG_EXIT, data, sizeof(data));
+}
+
+/*
+ * Read request from client, and run compilation in a separate process
+ * with output redirected through pipes. The worker reports files read
+ * from disk to the server, which can then cache them for subsequent
+ * requests.
+ */
+static int handle_request(int conn, int report, int (*compile)(int, char *[]))
+{
+    static const char chdir_failed[] = "Unable to change directory.\n";
+
+    enum message type;
+    int ret, status, out[2], err[2];
+    size_t len;
+    char *buf, *arg, *cwd;
+    pid_t pid;
+    array_of(char *) args = {0};
+
+    buf = NULL;
+    cwd = NULL;
+    type = MSG_ARG;
+    while (!(ret = read_message(conn, &type, &buf, &len))
+        && type != MSG_RUN)
+    {
+        arg = malloc(len + 1);
+        memcpy(arg, buf, len + 1);
+        if (type == MSG_CWD) {
+            free(cwd);
+            cwd = arg;
+        } else {
+            array_push_back(&args, arg);
+        }
+    }
+
+    free(buf);
+    if (ret || type != MSG_RUN || !array_len(&args)) {
+        return 1;
+    }
+
+    if (!cwd || chdir(cwd)) {
+        send_message(conn, MSG_STDERR, chdir_failed, strlen(chdir_failed));
+        send_status(conn, 1);
+        return 1;
+    }
+
+    if (pipe(out) || pipe(err)) {
+        return 1;
+    }
+
+    array_push_back(&args, NULL);
+    switch ((pid = fork())) {
+    case 0:
+        close(conn);
+        close(out[0]);
+        close(err[0]);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        close(out[1]);
+        close(err[1]);
+        input_report_files(report);
+        ret = compile(array_len(&args) - 1, &array_get(&args, 0));
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ret > 255 ? 255 : ret);
+    case -1:
+        send_status(conn, 1);
+        return 1;
+    default:
+        close(out[1]);
+        close(err[1]);
+        relay_output(conn, out[0], err[0]);
+        waitpid(pid, &status, 0);
+        send_status(conn, WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+        return 0;
+    }
+}
+
+/*
+ * Read lines reported by worker processes, adding files to the cache,
+ * and interned strings to share with later workers.
+ */
+static void read_reported_files(int fd, int *strings)
+{
+    static char *buf;
+    static size_t cap, len;
+
+    ssize_t n;
+    char *line, *end;
+
+    if (cap - len < 4096) {
+        cap = cap ? cap * 2 : 8192;
+        buf = realloc(buf, cap);
+    }
+
+    n = read(fd, buf + len, cap - len);
+    if (n <= 0) {
+        return;
+    }
+
+    len += n;
+    line = buf;
+    while ((end = memchr(line, '\n', len - (line - buf))) != NULL) {
+        *end = '\0';
+        switch (*line) {
+        case '/':
+            input_cache_file(line);
+            break;
+        case 'S':
+            if (*strings < SERVER_STRINGS_MAX && end - line > 1) {
+                str_intern(line + 1, end - line - 1);
+                *strings += 1;
+            }
+            break;
+        }
+        line = end + 1;
+    }
+
+    len -= line - buf;
+    memmove(buf, line, len);
+}
+
+INTERNAL int serve(const char *path, int (*compile)(int, char *[]))
+{
+    int sock, conn, report[2], strings;
+    pid_t pid;
+    struct sockaddr_un addr;
+    struct pollfd fds[2];
+
+    if (set_address(&addr, path)) {
+        return 1;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        fprintf(stderr, "%s\n", "Unable to create socket.");
+        return 1;
+    }
+
+    unlink(path);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr))
+        || listen(sock, SERVER_BACKLOG))
+    {
+        fprintf(stderr, "Unable to listen on '%s'.\n", path);
+        close(sock);
+        return 1;
+    }
+
+    if (pipe(report)) {
+        close(sock);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    strings = 0;
+    fds[0].fd = sock;
+    fds[1].fd = report[0];
+    fds[0].events = POLLIN;
+    fds[1].events = POLLIN;
+
+    while (1) {
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+            ;
+
+        if (poll(fds, 2, SERVER_POLL_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        if (fds[1].revents) {
+            read_reported_files(report[0], &strings);
+        }
+
+        if (fds[0].revents) {
+            conn = accept(sock, NULL, NULL);
+            if (conn == -1) {
+                continue;
+            }
+
+            fflush(stdout);
+            fflush(stderr);
+            strtab_persist();
+            if ((pid = fork()) == 0) {
+                close(sock);
+                close(report[0]);
+                _exit(handle_request(conn, report[1], compile));
+            }
+
+            close(conn);
+        }
+    }
+
+    return 0;
+}
+
+INTERNAL int connect_server(const char *path, int argc, char *argv[])
+{
+    int i, sock, status;
+    enum message type;
+    size_t len;
+    char *buf, *cwd;
+    struct sockaddr_un addr;
+
+    if (set_address(&addr, path)) {
+        return -1;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return -1;
+    }
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr))) {
+        close(sock);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    cwd = get_working_directory();
+    status = send_message(sock, MSG_CWD, cwd, strlen(cwd));
+    for (i = 0; i < argc && !status; ++i) {
+        status = send_message(sock, MSG_ARG, argv[i], strlen(argv[i]));
+    }
+
+    if (!status) {
+        status = send_message(sock, MSG_RUN, NULL, 0);
+    }
+
+    free(cwd);
+    if (status) {
+        close(sock);
+        return -1;
+    }
+
+    buf = NULL;
+    status = -1;
+    while (!read_message(sock, &type, &buf, &len)) {
+        if (type == MSG_STDOUT) {
+            fwrite(buf, sizeof(char), len, stdout);
+            fflush(stdout);
+        } else if (type == MSG_STDERR) {
+            fwrite(buf, sizeof(char), len, stderr);
+            fflush(stderr);
+        } else if (type == MSG_EXIT && len == 4) {
+            status = (unsigned char) buf[0]
+                | ((unsigned char) buf[1] << 8)
+                | ((unsigned char) buf[2] << 16)
+                | ((unsigned char) buf[3] << 24);
+            break;
+        }
+    }
+
+    if (status == -1) {
+        fprintf(stderr, "%s\n", "Lost connection to compile server.");
+        status = 1;
+    }
+
+    free(buf);
+    close(sock);
+    return status;
+}
@@ -0,0 +1,25 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/*
+ * Run as compile server, listening for requests on a Unix domain socket
+ * at the given path. Each request is handled by a worker process forked
+ * from the server, calling compile with arguments forwarded from the
+ * client. Files read by workers are cached in the server, and reused by
+ * later requests.
+ *
+ * Does not return unless setting up the socket fails.
+ */
+INTERNAL int serve(const char *path, int (*compile)(int, char *[]));
+
+/*
+ * Forward command line arguments and working directory to a compile
+ * server listening on the given path. Output from the compilation is
+ * written to stdout and stderr.
+ *
+ * Return exit status of the remote compilation, or -1 if not able to
+ * connect to the server.
+ */
+INTERNAL int connect_server(const char *path, int argc, char *argv[]);
+
+#endif
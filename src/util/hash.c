@@ -11,11 +11,21 @@
 #include <limits.h>
 
 #define HASH_CAPACITY_INITIAL 16
-#define HASH_CAPACITY_MAX INT_MAX
+#define HASH_CAPACITY_MAX (INT_MAX / 2 + 1)
+
+/*
+ * Each slot has a metadata byte, stored separately from the entries so
+ * that probing scans contiguous memory. Occupied slots keep the upper
+ * bits of the hash, used to filter out most entries without comparing
+ * keys.
+ */
+#define SLOT_EMPTY 0x00
+#define SLOT_DELETED 0x01
+#define SLOT_FULL 0x80
+
+#define slot_tag(h) (SLOT_FULL | (((unsigned) (h) >> 24) & 0x7F))
 
 struct hash_entry {
-    int hash;
-    int deleted;
     String key;
 
     /*
@@ -28,19 +38,20 @@ struct hash_entry {
 INTERNAL void hash_clear(struct hash_table *tab, void (*del)(void *))
 {
     int i;
-    struct hash_entry *entry;
 
     if (del) {
         for (i = 0; i < tab->capacity; ++i) {
-            entry = &tab->entries[i];
-            if (entry->value) {
-                del(entry->value);
+            if (tab->meta[i] & SLOT_FULL) {
+                del(tab->entries[i].value);
             }
         }
     }
 
     tab->count = 0;
-    memset(tab->entries, 0, tab->capacity * sizeof(*tab->entries));
+    tab->deleted = 0;
+    if (tab->capacity) {
+        memset(tab->meta, SLOT_EMPTY, tab->capacity);
+    }
 }
 
 INTERNAL void hash_destroy(struct hash_table *tab)
@@ -49,85 +60,84 @@ INTERNAL void hash_destroy(struct hash_table *tab)
     memset(tab, 0, sizeof(*tab));
 }
 
-static int hash_match_entry(
-    const struct hash_entry *entry,
+/*
+ * Find slot holding key, or -1 if not present. Also return the first
+ * slot where the key can be inserted, reusing deleted entries.
+ */
+static int hash_find_slot(
+    const struct hash_table *tab,
     String key,
-    int hash)
+    int hash,
+    int *slot)
 {
-    if (entry->deleted)
-        return 0;
-
-    return !entry->value || (entry->hash == hash && str_eq(entry->key, key));
-}
-
-static struct hash_entry *hash_find_entry(
-    struct hash_table *tab,
-    String key,
-    int hash)
-{
-    int i, j;
-    struct hash_entry *entry;
+    int i, mask, insert;
+    unsigned char tag;
 
     assert(tab->capacity > 0);
-    i = hash & (tab->capacity - 1);
-    entry = &tab->entries[i];
-    if (hash_match_entry(entry, key, hash)) {
-        return entry;
-    }
-
-    for (j = i + 1; j < tab->capacity; ++j) {
-        entry = &tab->entries[j];
-        if (hash_match_entry(entry, key, hash)) {
-            return entry;
+    mask = tab->capacity - 1;
+    tag = slot_tag(hash);
+    insert = -1;
+    for (i = hash & mask; tab->meta[i] != SLOT_EMPTY; i = (i + 1) & mask) {
+        if (tab->meta[i] == tag && str_eq(tab->entries[i].key, key)) {
+            return i;
         }
-    }
 
-    for (j = 0; j < i; ++j) {
-        entry = &tab->entries[j];
-        if (hash_match_entry(entry, key, hash)) {
-            return entry;
+        if (tab->meta[i] == SLOT_DELETED && insert == -1) {
+            insert = i;
         }
     }
 
-    assert(0);
-    return NULL;
+    *slot = (insert == -1) ? i : insert;
+    return -1;
 }
 
-static void hash_expand(struct hash_table *tab)
+/*
+ * Allocate new storage large enough for the current elements, leaving
+ * deleted entries behind. Grows only when live entries fill at least
+ * half of the table, otherwise just cleans up the deleted ones.
+ */
+static void hash_rehash(struct hash_table *tab)
 {
-    int i;
-    struct hash_entry *a, *b;
+    int i, j, hash;
     struct hash_table copy = {0};
 
-    if (!tab->capacity) {
-        copy.capacity = HASH_CAPACITY_INITIAL;
-    } else if (tab->capacity < HASH_CAPACITY_MAX) {
-        copy.capacity = tab->capacity * 2;
-    } else {
-        error("Reached hash table size limit after %d elements.", tab->count);
-        exit(1);
+    copy.capacity = tab->capacity ? tab->capacity : HASH_CAPACITY_INITIAL;
+    while (copy.capacity / 2 <= tab->count) {
+        if (copy.capacity >= HASH_CAPACITY_MAX) {
+            error("Reached hash table size limit after %d elements.",
+                tab->count);
+            exit(1);
+        }
+        copy.capacity *= 2;
     }
 
     copy.count = tab->count;
-    copy.entries = calloc(copy.capacity, sizeof(struct hash_entry));
+    copy.entries = malloc(copy.capacity * (sizeof(struct hash_entry) + 1));
+    copy.meta = (unsigned char *) (copy.entries + copy.capacity);
+    memset(copy.meta, SLOT_EMPTY, copy.capacity);
     for (i = 0; i < tab->capacity; ++i) {
-        a = &tab->entries[i];
-        if (!a->value || a->deleted)
-            continue;
-
-        b = hash_find_entry(&copy, a->key, a->hash);
-        b->hash = a->hash;
-        b->key = a->key;
-        b->value = a->value;
+        if (tab->meta[i] & SLOT_FULL) {
+            hash = str_hash(tab->entries[i].key);
+            for (j = hash & (copy.capacity - 1);
+                copy.meta[j] != SLOT_EMPTY;
+                j = (j + 1) & (copy.capacity - 1))
+                ;
+            copy.meta[j] = slot_tag(hash);
+            copy.entries[j] = tab->entries[i];
+        }
     }
 
     free(tab->entries);
     *tab = copy;
 }
 
+/*
+ * Keep at least one in four slots empty, counting deleted entries as
+ * occupied, so that probe sequences stay short.
+ */
 static int hash_is_full(struct hash_table *tab)
 {
-    return tab->count >= tab->capacity / 2;
+    return (tab->count + tab->deleted + 1) * 4 > tab->capacity * 3;
 }
 
 INTERNAL void *hash_insert(
@@ -136,68 +146,232 @@ INTERNAL void *hash_insert(
     void *value,
     void *(*add)(void *, String *))
 {
-    int hash;
+    int hash, i, slot;
     struct hash_entry *entry;
 
     if (hash_is_full(tab)) {
-        hash_expand(tab);
+        hash_rehash(tab);
         assert(!hash_is_full(tab));
     }
 
-    assert(tab->capacity > 0);
-    assert(tab->count < tab->capacity - 1);
     hash = str_hash(key);
-    entry = hash_find_entry(tab, key, hash);
-
-    assert(!entry->deleted);
-    if (!entry->value) {
-        tab->count++;
-        entry->hash = hash;
-        if (add) {
-            entry->value = add(value, &entry->key);
-        } else {
-            entry->key = key;
-            entry->value = value;
-        }
+    i = hash_find_slot(tab, key, hash, &slot);
+    if (i != -1) {
+        return tab->entries[i].value;
     }
 
-    assert(entry->hash == hash && str_eq(entry->key, key));
+    if (tab->meta[slot] == SLOT_DELETED) {
+        tab->deleted--;
+    }
+
+    tab->count++;
+    tab->meta[slot] = slot_tag(hash);
+    entry = &tab->entries[slot];
+    if (add) {
+        entry->value = add(value, &entry->key);
+    } else {
+        entry->key = key;
+        entry->value = value;
+    }
+
+    assert(str_eq(entry->key, key));
     return entry->value;
 }
 
 INTERNAL void *hash_lookup(struct hash_table *tab, String key)
 {
-    int hash;
-    struct hash_entry *entry;
+    int i, slot;
 
-    if (!tab->capacity)
+    if (!tab->count)
         return NULL;
 
-    hash = str_hash(key);
-    entry = hash_find_entry(tab, key, hash);
-    return entry->value;
+    i = hash_find_slot(tab, key, str_hash(key), &slot);
+    return (i != -1) ? tab->entries[i].value : NULL;
 }
 
+/*
+ * Removed entries are marked deleted to not break probe sequences
+ * going through them, unless followed by an empty slot. In that case
+ * the entry, and any deleted entries in front of it, become empty.
+ */
 INTERNAL void hash_remove(
     struct hash_table *tab,
     String key,
     void (*del)(void *))
 {
-    int hash;
-    struct hash_entry *entry;
+    int i, mask, slot;
+    void *value;
 
-    if (!tab->capacity)
+    if (!tab->count)
         return;
 
-    hash = str_hash(key);
-    entry = hash_find_entry(tab, key, hash);
-    if (entry->value) {
-        entry->deleted = 1;
-        entry->hash = 0;
-        if (del) {
-            del(entry->value);
+    i = hash_find_slot(tab, key, str_hash(key), &slot);
+    if (i == -1)
+        return;
+
+    mask = tab->capacity - 1;
+    value = tab->entries[i].value;
+    tab->count--;
+    if (tab->meta[(i + 1) & mask] == SLOT_EMPTY) {
+        tab->meta[i] = SLOT_EMPTY;
+        for (i = (i - 1) & mask; tab->meta[i] == SLOT_DELETED;
+            i = (i - 1) & mask)
+        {
+            tab->meta[i] = SLOT_EMPTY;
+            tab->deleted--;
+        }
+    } else {
+        tab->meta[i] = SLOT_DELETED;
+        tab->deleted++;
+    }
+
+    if (del) {
+        del(value);
+    }
+}
+
+/*
+ * Elements in the same bucket are chained through links indexed by
+ * element number, also holding the full hash value. Elements not in
+ * the index have a link marked absent.
+ */
+#define LINK_END (-1)
+#define LINK_ABSENT (-2)
+
+struct hash_link {
+    unsigned long hash;
+    int next;
+};
+
+static void hash_index_insert(struct hash_index *idx, int i)
+{
+    int b;
+
+    b = idx->links[i].hash & (idx->capacity - 1);
+    idx->links[i].next = idx->buckets[b];
+    idx->buckets[b] = i;
+}
+
+/*
+ * Double the number of buckets, keeping at most one element per bucket
+ * on average. Elements are inserted again in increasing order, so that
+ * chains still start with the highest numbers.
+ */
+static void hash_index_grow(struct hash_index *idx)
+{
+    int i;
+
+    idx->capacity = idx->capacity ? idx->capacity * 2 : HASH_CAPACITY_INITIAL;
+    if (idx->capacity > HASH_CAPACITY_MAX) {
+        error("Reached hash index size limit after %d elements.", idx->count);
+        exit(1);
+    }
+
+    idx->buckets = realloc(idx->buckets, idx->capacity * sizeof(int));
+    for (i = 0; i < idx->capacity; ++i) {
+        idx->buckets[i] = LINK_END;
+    }
+
+    for (i = 0; i < idx->size; ++i) {
+        if (idx->links[i].next != LINK_ABSENT) {
+            hash_index_insert(idx, i);
         }
+    }
+}
 
-        entry->value = NULL;
+INTERNAL void hash_index_add(struct hash_index *idx, int i, unsigned long h)
+{
+    int size;
+
+    assert(i >= 0);
+    if (i >= idx->size) {
+        size = idx->size ? idx->size : HASH_CAPACITY_INITIAL;
+        while (size <= i) {
+            size *= 2;
+        }
+
+        idx->links = realloc(idx->links, size * sizeof(*idx->links));
+        while (idx->size < size) {
+            idx->links[idx->size++].next = LINK_ABSENT;
+        }
+    }
+
+    assert(idx->links[i].next == LINK_ABSENT);
+    idx->links[i].hash = h;
+    idx->links[i].next = LINK_END;
+    if (idx->count == idx->capacity) {
+        hash_index_grow(idx);
+    } else {
+        hash_index_insert(idx, i);
     }
+
+    idx->count++;
+}
+
+INTERNAL int hash_index_first(const struct hash_index *idx, unsigned long h)
+{
+    int i;
+
+    if (!idx->count)
+        return -1;
+
+    i = idx->buckets[h & (idx->capacity - 1)];
+    while (i != LINK_END && idx->links[i].hash != h) {
+        i = idx->links[i].next;
+    }
+
+    return i;
+}
+
+INTERNAL int hash_index_next(const struct hash_index *idx, int i)
+{
+    unsigned long h;
+
+    assert(i >= 0 && i < idx->size);
+    assert(idx->links[i].next != LINK_ABSENT);
+    h = idx->links[i].hash;
+    do {
+        i = idx->links[i].next;
+    } while (i != LINK_END && idx->links[i].hash != h);
+
+    return i;
+}
+
+INTERNAL void hash_index_remove(struct hash_index *idx, int i)
+{
+    int *p;
+
+    assert(i >= 0 && i < idx->size);
+    assert(idx->links[i].next != LINK_ABSENT);
+    p = &idx->buckets[idx->links[i].hash & (idx->capacity - 1)];
+    while (*p != i) {
+        assert(*p != LINK_END);
+        p = &idx->links[*p].next;
+    }
+
+    *p = idx->links[i].next;
+    idx->links[i].next = LINK_ABSENT;
+    idx->count--;
+}
+
+INTERNAL void hash_index_clear(struct hash_index *idx)
+{
+    int i;
+
+    for (i = 0; i < idx->capacity; ++i) {
+        idx->buckets[i] = LINK_END;
+    }
+
+    for (i = 0; i < idx->size; ++i) {
+        idx->links[i].next = LINK_ABSENT;
+    }
+
+    idx->count = 0;
+}
+
+INTERNAL void hash_index_destroy(struct hash_index *idx)
+{
+    free(idx->buckets);
+    free(idx->links);
+    memset(idx, 0, sizeof(*idx));
 }
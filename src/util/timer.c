@@ -0,0 +1,249 @@
+#if !AMALGAMATION
+# define INTERNAL
+# define EXTERNAL extern
+#endif
+#include <lacc/timer.h>
+
+#include <sys/time.h>
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+#define TIMER_STACK_MAX 16
+
+static const char *phase_names[] = {
+    "preprocess",
+    "parse",
+    "inlining",
+    "optimize",
+    "ssa translation",
+    "constant propagation",
+    "value numbering",
+    "liveness analysis",
+    "dead store elimination",
+    "merge assignments",
+    "instruction selection",
+    "encoding",
+    "flush",
+};
+
+static struct {
+    double wall;
+    double cpu;
+} totals[TIMER_PHASES];
+
+static enum timer_phase stack[TIMER_STACK_MAX];
+static int depth;
+
+static int is_report_enabled;
+static double last_wall, last_cpu;
+
+static FILE *trace;
+static long trace_events, trace_epoch;
+
+/* Thread id of trace events, and whether this is a worker process. */
+static int trace_id = 1, is_trace_worker;
+
+static double wall_seconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double cpu_seconds(void)
+{
+    return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static long microseconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000l + tv.tv_usec;
+}
+
+/* Attribute time since last mark to the innermost active phase. */
+static void mark(void)
+{
+    double wall, cpu;
+    enum timer_phase phase;
+
+    wall = wall_seconds();
+    cpu = cpu_seconds();
+    if (depth) {
+        phase = stack[depth - 1];
+        totals[phase].wall += wall - last_wall;
+        totals[phase].cpu += cpu - last_cpu;
+    }
+
+    last_wall = wall;
+    last_cpu = cpu;
+}
+
+INTERNAL void timer_enable_report(void)
+{
+    is_report_enabled = 1;
+}
+
+INTERNAL int timer_enable_trace(const char *path)
+{
+    if (trace) {
+        fclose(trace);
+    }
+
+    trace = fopen(path, "w");
+    if (!trace) {
+        fprintf(stderr, "Could not open trace file '%s'.\n", path);
+        return 1;
+    }
+
+    trace_events = 0;
+    trace_epoch = microseconds();
+    fprintf(trace, "{\"traceEvents\":[");
+    return 0;
+}
+
+INTERNAL int timer_is_tracing(void)
+{
+    return trace != NULL;
+}
+
+/*
+ * The stream of the parent process is left untouched, and must not be
+ * flushed by the worker. Events are written with a leading separator,
+ * to be appended after the ones already written by the parent.
+ */
+INTERNAL void timer_trace_worker(FILE *stream, int id)
+{
+    assert(trace);
+    assert(stream);
+    trace = stream;
+    trace_id = id;
+    trace_events = 1;
+    is_trace_worker = 1;
+}
+
+INTERNAL void timer_merge_trace(FILE *stream)
+{
+    int c;
+
+    assert(trace);
+    rewind(stream);
+    c = getc(stream);
+    if (c == ',' && !trace_events) {
+        c = getc(stream);
+    }
+
+    while (c != EOF) {
+        trace_events = 1;
+        putc(c, trace);
+        c = getc(stream);
+    }
+}
+
+INTERNAL void timer_push(enum timer_phase phase)
+{
+    if (is_report_enabled) {
+        assert(depth < TIMER_STACK_MAX);
+        mark();
+        stack[depth++] = phase;
+    }
+}
+
+INTERNAL void timer_pop(void)
+{
+    if (is_report_enabled) {
+        assert(depth > 0);
+        mark();
+        depth--;
+    }
+}
+
+INTERNAL long timer_clock(void)
+{
+    return trace ? microseconds() - trace_epoch : 0;
+}
+
+static void write_json_string(const char *str)
+{
+    char c;
+
+    putc('"', trace);
+    while ((c = *str++) != '\0') {
+        if (c == '"' || c == '\\') {
+            putc('\\', trace);
+            putc(c, trace);
+        } else if ((unsigned char) c < 0x20) {
+            fprintf(trace, "\\u%04x", c);
+        } else {
+            putc(c, trace);
+        }
+    }
+
+    putc('"', trace);
+}
+
+INTERNAL void timer_trace(const char *name, const char *detail, long start)
+{
+    long end;
+
+    if (!trace) {
+        return;
+    }
+
+    end = timer_clock();
+    fprintf(trace, "%s\n{\"name\":", trace_events++ ? "," : "");
+    write_json_string(name);
+    fprintf(trace, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d", trace_id);
+    fprintf(trace, ",\"ts\":%ld,\"dur\":%ld", start, end - start);
+    if (detail) {
+        fprintf(trace, ",\"args\":{\"detail\":");
+        write_json_string(detail);
+        putc('}', trace);
+    }
+
+    putc('}', trace);
+}
+
+INTERNAL void timer_report(FILE *stream, const char *file)
+{
+    int i;
+    double wall, cpu;
+
+    if (!is_report_enabled) {
+        return;
+    }
+
+    assert(!depth);
+    for (i = 0, wall = 0, cpu = 0; i < TIMER_PHASES; ++i) {
+        wall += totals[i].wall;
+        cpu += totals[i].cpu;
+    }
+
+    fprintf(stream, "Time report for %s:\n", file ? file : "<stdin>");
+    fprintf(stream, "  %-26s %10s %10s\n", "phase", "wall (s)", "cpu (s)");
+    for (i = 0; i < TIMER_PHASES; ++i) {
+        fprintf(stream, "  %-26s %10.4f %10.4f %5.1f%%\n",
+            phase_names[i], totals[i].wall, totals[i].cpu,
+            wall > 0 ? 100 * totals[i].wall / wall : 0.0);
+        totals[i].wall = 0;
+        totals[i].cpu = 0;
+    }
+
+    fprintf(stream, "  %-26s %10.4f %10.4f\n", "total", wall, cpu);
+}
+
+INTERNAL void timer_finalize(void)
+{
+    if (trace) {
+        if (!is_trace_worker) {
+            fprintf(trace, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        }
+
+        fclose(trace);
+        trace = NULL;
+    }
+}
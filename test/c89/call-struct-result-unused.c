@@ -0,0 +1,21 @@
+struct point {
+	long x, y, z;
+};
+
+static int calls;
+
+static struct point make(long x) {
+	struct point p = {0};
+	calls++;
+	p.x = x;
+	p.y = x * 2;
+	return p;
+}
+
+int main(void) {
+	struct point p;
+	p = make(1);
+	p = make(2);
+	make(3);
+	return p.y + calls;
+}
@@ -0,0 +1,66 @@
+int printf(const char *, ...);
+
+static const int verbose = 0;
+static const unsigned long mask = 0xF0;
+const short limit = -3;
+
+static int loop(int n) {
+	int i, k = 4, s = 0;
+	for (i = 0; i < n; ++i) {
+		if (k > 2)
+			s += k << 1;
+		else
+			s -= 100;
+		k = 4;
+	}
+	return s;
+}
+
+static int dead(int x) {
+	static const int debug = 0;
+	int y = 7;
+	if (debug) {
+		printf("never\n");
+		y = x;
+	}
+	if (verbose || y != 7)
+		return -1;
+	return y * 6 + x;
+}
+
+static long shifts(void) {
+	int a = -16, b = 3;
+	unsigned char c = 250;
+	long r;
+	r = (a >> 2) + (a / b) + (a % b);
+	c = c + 10;
+	r += c;
+	r += (long) (mask >> 4) + limit;
+	return r;
+}
+
+static int divide(int x) {
+	int zero = 0, one = -1;
+	if (x)
+		return x / zero;
+	return -2147483647 / (x + one) + x;
+}
+
+static int phi(int c) {
+	int v;
+	if (c)
+		v = 5;
+	else
+		v = 5;
+	while (c-- > 0) {
+		if (v != 5)
+			v = c;
+	}
+	return v;
+}
+
+int main(void) {
+	printf("%d %d %d\n", loop(3), loop(0), dead(2));
+	printf("%ld %d %d\n", shifts(), divide(0), phi(3));
+	return 0;
+}
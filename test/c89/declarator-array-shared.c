@@ -0,0 +1,26 @@
+void *v[3];
+int (*q[3])[4];
+int *(*r[2])[3];
+char (*c[3])[5];
+
+int *p[3];
+int x[4], y[4];
+char z[5];
+
+int main(void) {
+	int i, s = 0;
+	q[0] = &x;
+	q[1] = &y;
+	r[1] = &p;
+	c[0] = &z;
+	v[0] = c[0];
+	p[2] = &y[1];
+	for (i = 0; i < 4; ++i) {
+		(*q[0])[i] = i;
+		(*q[1])[i] = i * 2;
+	}
+
+	s += sizeof(p) + sizeof(q) + sizeof(*q[0]) + sizeof(r) + sizeof(*r[1])
+		+ sizeof(*c[0]) + sizeof(v) + sizeof(v[0]);
+	return s + (*q[0])[3] + (*q[1])[2] + *(*r[1])[2];
+}
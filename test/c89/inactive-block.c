@@ -0,0 +1,34 @@
+#if 0
+This text isn't tokenized, and "quotes can be unterminated
+/* A comment hiding a directive
+#error Not reached
+*/ int a = "\
+#error Not reached";
+// Line comment \
+#error Not reached
+  #  if 1
+#error Not reached
+# else
+#error Not reached
+# endif
+int b = '#'; #error Not reached
+#elif 1 /*
+#error Not reached
+*/
+int first = __LINE__;
+#else
+#error Not reached
+#endif
+
+#ifdef NOT_DEFINED
+/* Continued
+ * comment */ #error Not reached
+??=error Not reached
+#error Not reached \
+ continued
+#endif
+int second = __LINE__;
+
+int main(void) {
+	return first + second;
+}
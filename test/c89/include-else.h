@@ -0,0 +1,6 @@
+#ifndef INCLUDE_ELSE_H
+#define INCLUDE_ELSE_H
+n += 1000;
+#else
+n += 10000;
+#endif
@@ -0,0 +1,19 @@
+int printf(const char *, ...);
+
+int main(void) {
+	int n = 0;
+
+#include "include-guard.h"
+#include "include-guard.h"
+#undef INCLUDE_GUARD_H
+#include "include-guard.h"
+#include "include-guard.h"
+
+#include "include-once.h"
+#include "include-once.h"
+
+#include "include-else.h"
+#include "include-else.h"
+
+	return printf("%d\n", n);
+}
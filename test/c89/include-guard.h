@@ -0,0 +1,7 @@
+#ifndef INCLUDE_GUARD_H
+#define INCLUDE_GUARD_H
+
+/* Counted once for each time the guard is not defined. */
+n += 1;
+
+#endif
@@ -0,0 +1,64 @@
+int printf(const char *, ...);
+
+static int calls;
+
+static int square(int x) {
+	return x * x;
+}
+
+static long clamp(long v, long lo, long hi) {
+	if (v < lo)
+		return lo;
+	if (v > hi)
+		return hi;
+	return v;
+}
+
+static void count(void) {
+	calls++;
+}
+
+static int sum(const int *p, int n) {
+	int s = 0;
+	while (n-- > 0)
+		s += *p++;
+	return s;
+}
+
+static void store(int *p, int v) {
+	*p = square(v) + 1;
+}
+
+static int fact(int n) {
+	return n < 2 ? 1 : n * fact(n - 1);
+}
+
+static int twice(int x) {
+	count();
+	return x + x;
+}
+
+static double scale(float f, char c) {
+	return f * c;
+}
+
+static int (*pointer)(int) = twice;
+
+int main(void) {
+	int a[] = {1, 2, 3, 4}, r = 0, i;
+	long l = 0;
+
+	for (i = 0; i < 4; ++i) {
+		r += square(a[i]);
+		l += clamp(a[i] * 10L, 15, 35);
+	}
+
+	count();
+	store(&a[1], square(3));
+	printf("%d %ld %d %d\n", r, l, a[1], sum(a, 4));
+	printf("%d %d\n", twice(square(2)), pointer(5));
+	printf("%d %f %d\n", fact(5), scale(1.5f, 'a'), calls);
+	if (square(r) > 100)
+		return twice(0);
+	return square(0);
+}
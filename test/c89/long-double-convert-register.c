@@ -0,0 +1,8 @@
+int printf(const char *, ...);
+int main(void) {
+	int a = 3, b = 4;
+	long double x = a + b;
+	double y = a * b;
+	long double z = y + 1;
+	return printf("%Lf %Lf\n", x, z);
+}
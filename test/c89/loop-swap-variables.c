@@ -0,0 +1,39 @@
+int printf(const char *, ...);
+
+static int fib(int n) {
+	int a = 0, b = 1, t;
+	while (n--) {
+		t = a;
+		a = b;
+		b = t + b;
+	}
+	return a;
+}
+
+static int last(int n) {
+	int i, x = -1, y = 0;
+	for (i = 0; i < n; ++i) {
+		y = x;
+		x = i;
+		if (i & 1)
+			continue;
+		x = x * 2;
+	}
+	return x + y;
+}
+
+static long select(int c, long p, long q) {
+	long r;
+	if (c > 2)
+		r = p;
+	else if (c)
+		r = q;
+	else
+		r = p + q;
+	return c ? r : -r;
+}
+
+int main(void) {
+	return printf("%d %d %d %ld %ld\n",
+		fib(10), last(7), last(0), select(3, 4, 5), select(0, 4, 5));
+}
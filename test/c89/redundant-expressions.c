@@ -0,0 +1,72 @@
+int printf(const char *, ...);
+
+static int g = 3;
+
+static int bump(void) {
+	return g++;
+}
+
+static int loads(int *p, int *q) {
+	int a, b, c, d;
+	a = *p + 1;
+	b = *p + 1;
+	*q = 7;
+	c = *p + 1;
+	bump();
+	d = g * 2 + g * 2;
+	return a + b * 10 + c * 100 + d * 1000;
+}
+
+static int reassigned(int x, int y) {
+	int a, b, c;
+	a = x * y;
+	x = x + 1;
+	b = x * y;
+	c = y * x;
+	return a + b + c;
+}
+
+static long branches(long i, long n, const long *v) {
+	long s = i * 8 + n;
+	if (n > 2) {
+		s += i * 8 + n;
+		if (v[i] > 0)
+			s += v[i] * (i * 8 + n);
+	} else {
+		s -= n + i * 8;
+	}
+	while (i < n) {
+		s += i * 8;
+		i++;
+	}
+	return s + i * 8;
+}
+
+static int fields(void) {
+	struct { int x, y; } s;
+	int a, b;
+	s.x = 4;
+	s.y = 5;
+	a = s.x * s.y;
+	s.x = 6;
+	b = s.x * s.y;
+	return a + b;
+}
+
+static double mixed(int n, double f) {
+	double a = n * f, b = f * n;
+	float c = (float) n, d = (float) n;
+	return a + b + c + d;
+}
+
+int main(void) {
+	int i = 2, j = 5;
+	long v[] = {1, 2, 3, 4};
+	printf("%d\n", loads(&i, &j));
+	printf("%d\n", loads(&i, &i));
+	printf("%d %d\n", reassigned(3, 4), fields());
+	printf("%ld %ld %ld\n",
+		branches(1, 4, v), branches(3, 1, v), branches(0, 3, v));
+	printf("%f %d\n", mixed(3, 1.5), g);
+	return 0;
+}
@@ -99,7 +99,8 @@ prp=$(check -E); result="$?"; retval=$((retval + result))
 asm=$(check -S); result="$?"; retval=$((retval + result))
 elf=$(check -c); result="$?"; retval=$((retval + result))
 opt=$(check "-c -O1"); result="$?"; retval=$((retval + result))
-echo "[-E: ${prp}] [-S: ${asm}] [-c: ${elf}] [-c -O1: ${opt}] :: ${file}"
+ssa=$(check "-c -O2"); result="$?"; retval=$((retval + result))
+echo "[-E: ${prp}] [-S: ${asm}] [-c: ${elf}] [-c -O1: ${opt}] [-c -O2: ${ssa}] :: ${file}"
 
 if [ $retval -eq 0 ] && [ -f "${i}/${f}.sh" ]
 then
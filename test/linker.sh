@@ -75,6 +75,93 @@ $lacc -shared -fPIC linker/foo.c -o $bin/libfoo.so
 $lacc linker/bar.c -lfoo -L$bin -o $bin/a.out
 c=$(check "a.out"); result="$?"; retval=$((retval + result))
 
-echo "[-fno-PIC: ${a}] [-fPIC: ${b}] [-shared: ${c}]"
+# Parallel compilation
+$lacc -j 2 linker/foo.c linker/bar.c -o $bin/a.out
+d=$(check "a.out"); result="$?"; retval=$((retval + result))
+
+# Compile twice with result cache, second time reading cached objects
+rm -rf $bin/cache
+for i in 1 2
+do
+	$lacc --cache-dir=$bin/cache -c linker/foo.c -o $bin/foo.o \
+		&& $lacc --cache-dir=$bin/cache -c linker/bar.c -o $bin/bar.o \
+		&& $lacc $bin/foo.o $bin/bar.o -o $bin/a.out
+done
+e=$(check "a.out"); result="$?"; retval=$((retval + result))
+if ! $lacc --cache-dir=$bin/cache --cache-stats | grep -q "hits: 2"
+then
+	e="${red}Missing cache hits!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Hits counted by parallel workers are added to the same statistics
+$lacc -j 2 --cache-dir=$bin/cache linker/foo.c linker/bar.c -o $bin/a.out
+if ! $lacc --cache-dir=$bin/cache --cache-stats | grep -q "hits: 4"
+then
+	e="${red}Missing cache hits with -j!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Select linker, and leave no object files behind
+rm -f foo.o bar.o
+$lacc -fuse-ld=/usr/bin/ld linker/foo.c linker/bar.c -o $bin/a.out
+f=$(check "a.out"); result="$?"; retval=$((retval + result))
+if [ -e foo.o ] || [ -e bar.o ]
+then
+	f="${red}Object files not removed!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Remove temporary object files also when compilation stops on error
+rm -rf $bin/tmp && mkdir -p $bin/tmp
+echo '#include "missing.h"' > $bin/missing.c
+TMPDIR=$bin/tmp $lacc -fuse-ld=/usr/bin/ld linker/foo.c $bin/missing.c \
+	-o $bin/a.out 2>/dev/null
+if [ -n "$(ls $bin/tmp)" ]
+then
+	f="${red}Temporary files not removed!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Precompiled header used in place of -include file
+cp linker/prefix.h $bin/prefix.h
+rm -f $bin/prefix.h.pch
+$lacc $bin/prefix.h \
+	&& $lacc -v -include $bin/prefix.h linker/foo.c linker/bar.c \
+		-o $bin/a.out > $bin/prefix.log 2>&1
+g=$(check "a.out"); result="$?"; retval=$((retval + result))
+if [ $(grep -c "Using precompiled header" $bin/prefix.log) -ne 2 ]
+then
+	g="${red}Precompiled header not used!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Dependency file as by-product of compilation
+rm -f $bin/foo.d
+$lacc -MMD -MP -c linker/foo.c -o $bin/foo.o && $lacc $bin/foo.o -MD \
+	-MF $bin/bar.d -MT bar linker/bar.c -o $bin/a.out
+h=$(check "a.out"); result="$?"; retval=$((retval + result))
+if ! grep -q "^$bin/foo.o: linker/foo.c$" $bin/foo.d \
+	|| grep -q "stdio.h" $bin/foo.d \
+	|| ! grep -q "^bar: linker/bar.c" $bin/bar.d \
+	|| ! grep -q "stdlib.h" $bin/bar.d
+then
+	h="${red}Wrong dependencies!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Built-in static linker, with objects kept in memory or written to
+# temporary files when compiling in parallel
+$lacc -fuse-ld=lacc linker/foo.c linker/bar.c -lm -o $bin/a.out
+i=$(check "a.out"); result="$?"; retval=$((retval + result))
+if [ $result -eq 0 ]
+then
+	$lacc -j 2 -fuse-ld=lacc linker/foo.c linker/bar.c -o $bin/a.out
+	i=$(check "a.out"); result="$?"; retval=$((retval + result))
+fi
+
+echo "[-fno-PIC: ${a}] [-fPIC: ${b}] [-shared: ${c}] [-j: ${d}]" \
+	"[--cache-dir: ${e}] [-fuse-ld: ${f}] [-include .pch: ${g}]" \
+	"[-MD: ${h}] [-fuse-ld=lacc: ${i}]"
 rm -f foo.o bar.o
 exit $retval
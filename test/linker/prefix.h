@@ -0,0 +1,9 @@
+#ifndef PREFIX_H
+#define PREFIX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define printf(...) printf(__VA_ARGS__)
+
+#endif
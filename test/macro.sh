@@ -0,0 +1,119 @@
+#!/bin/sh
+
+# Time preprocessing of generated macro workloads with increasing size,
+# where time should grow linearly with the size of the input.
+
+lacc="$1"
+if [ -z "$lacc" ]
+then
+	lacc=../bin/lacc
+	command -v $lacc >/dev/null 2>&1 || {
+		echo "$lacc required, run 'make'."
+		exit 1
+	}
+fi
+
+bin=../bin/test/macro
+mkdir -p $bin
+
+# Table of X-macro entries, expanded from a single definition.
+wide()
+{
+	echo "#define X(n) + n"
+	echo "#define TABLE \\"
+	i=0
+	while [ $i -lt $1 ]
+	do
+		echo "	X($i) \\"
+		i=$((i + 1))
+	done
+	echo
+	echo "int a = 0 TABLE;"
+}
+
+# Function-like macros nested in a chain of definitions.
+deep()
+{
+	echo "#define F0(x) x"
+	i=1
+	while [ $i -lt $1 ]
+	do
+		echo "#define F$i(x) F$((i - 1))(x)"
+		i=$((i + 1))
+	done
+	echo "int a = F$((i - 1))(1);"
+}
+
+# Many invocations on the same line.
+long()
+{
+	echo "#define ADD(x) + x"
+	printf "int a = 0"
+	i=0
+	while [ $i -lt $1 ]
+	do
+		printf " ADD(%d)" $i
+		i=$((i + 1))
+	done
+	echo ";"
+}
+
+# Each expansion ends with the name of a macro invoked by the rest of
+# the line.
+chain()
+{
+	echo "#define A(x) + x B"
+	echo "#define B(x) + x A"
+	printf "int a = 0 A(0)"
+	i=1
+	while [ $i -lt $1 ]
+	do
+		printf "(%d)" $i
+		i=$((i + 1))
+	done
+	echo ";"
+}
+
+# Definitions which are added and removed again, mixed with lookups of
+# a growing set of names.
+churn()
+{
+	echo "#define X(n) + n"
+	echo "#define T"
+	i=0
+	while [ $i -lt $1 ]
+	do
+		echo "#define K$i X($i)"
+		echo "#define U$i K$i"
+		echo "#undef T"
+		echo "#define T U$i"
+		echo "int a$i = 0 T K$((i / 2));"
+		echo "#undef U$i"
+		i=$((i + 1))
+	done
+}
+
+# Fall back to whole seconds where date does not support %N.
+now()
+{
+	t=$(date +%s%N)
+	case $t in
+	*[!0-9]*) echo "$(date +%s)000000000" ;;
+	*) echo $t ;;
+	esac
+}
+
+for workload in wide deep long chain churn
+do
+	printf "%-6s" "$workload"
+	for n in 1000 2000 4000 8000
+	do
+		file=$bin/$workload-$n.c
+		$workload $n > $file
+		start=$(now)
+		$lacc -E $file -o /dev/null || exit 1
+		end=$(now)
+		printf " [%d: %d ms]" $n $(((end - start) / 1000000))
+	done
+	echo
+done
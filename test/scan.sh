@@ -0,0 +1,286 @@
+#!/bin/sh
+
+# Measure throughput of read_line on the sqlite sources, against the
+# previous implementation checking one byte at a time. The old version
+# is kept in the harness below, and compiled together with the in-tree
+# amalgamation. Both must produce the same lines.
+
+lacc="$1"
+if [ -z "$lacc" ]
+then
+	lacc=../bin/lacc
+	command -v $lacc >/dev/null 2>&1 || {
+		echo "$lacc required, run 'make'."
+		exit 1
+	}
+fi
+
+if [ ! -f sqlite/shell.c ] || [ ! -f sqlite/sqlite3.c ]
+then
+	echo "Missing sqlite source, download and place in 'test/sqlite' folder."
+	exit 1
+fi
+
+bin=../bin/test/scan
+mkdir -p $bin
+
+cat > $bin/scan.c <<'EOF'
+#define main lacc_main
+#include "lacc.c"
+#undef main
+
+#include <time.h>
+
+#define ROUNDS 20
+
+static char *data, *line;
+static size_t size;
+
+static size_t read_comment_bytes(const char *line, int *linecount)
+{
+    char c;
+    const char *ptr;
+
+    ptr = line;
+    do {
+        c = *ptr++;
+        if (c == '*') {
+            while (*ptr == '\\' && ptr[1] == '\n') {
+                *linecount += 1;
+                ptr += 2;
+            }
+            if (*ptr == '/') {
+                return ptr + 1 - line;
+            }
+        } else if (c == '\n') {
+            *linecount += 1;
+        }
+    } while (c != '\0');
+    return 0;
+}
+
+static size_t read_line_comment_bytes(const char *line, int *linecount)
+{
+    char c;
+    const char *ptr;
+
+    ptr = line;
+    do {
+        c = *ptr++;
+        if (c == '\\' && *ptr == '\n') {
+            *linecount += 1;
+            ptr++;
+        } else if (c == '\n') {
+            return ptr - line;
+        }
+    } while (c != '\0');
+    return 0;
+}
+
+/* Previous read_line, inspecting every byte in a switch. */
+static size_t read_line_bytes(
+    const char *line,
+    size_t len,
+    char *write,
+    int *linecount)
+{
+    char c;
+    int lines;
+    size_t count, i, n;
+    const char *start;
+
+    count = 0;
+    lines = 0;
+    start = line;
+
+    for (i = 0; i < len; ++i) {
+        switch (line[i]) {
+        case '\n':
+            if (count) {
+                memcpy(write, start, count);
+            }
+            write[count] = '\0';
+            *linecount += lines + 1;
+            return i + 1;
+        case '"':
+        case '\'':
+        case '/':
+        case '?':
+        case '\\':
+            break;
+        default:
+            count++;
+            continue;
+        }
+
+        break;
+    }
+
+    for (; i < len; ++i) {
+        switch (line[i]) {
+        case '\n':
+            if (count) {
+                memcpy(write, start, count);
+            }
+            write[count] = '\0';
+            *linecount += lines + 1;
+            return i + 1;
+        case '"':
+        case '\'':
+        case '*':
+        case '/':
+        case '?':
+        case '\\':
+            if (count) {
+                memcpy(write, start, count);
+                write += count;
+                start += count;
+                count = 0;
+            }
+            c = line[i];
+            if (c == '"' || c == '\'') {
+                n = read_literal(&line[i], &write, &lines);
+                if (!n) {
+                    return 0;
+                }
+                i += n - 1;
+                start = &line[i + 1];
+            } else if (c == '*' && write[-1] == '/') {
+                n = read_comment_bytes(&line[i + 1], &lines);
+                if (!n) {
+                    return 0;
+                }
+                write[-1] = ' ';
+                i += n;
+                start = &line[i + 1];
+            } else if (c == '\\' && line[i + 1] == '\n') {
+                i += 1;
+                start = &line[i + 1];
+                lines += 1;
+            } else if (c == '?' && line[i + 1] == '?') {
+                c = read_trigraph(line[i + 2]);
+                if (c) {
+                    i += 2;
+                    start = &line[i + 1];
+                    *write++ = c;
+                }
+            } else if (c == '/' && write[-1] == '/') {
+                n = read_line_comment_bytes(&line[i + 1], &lines);
+                if (!n) {
+                    return 0;
+                }
+                write[-1] = '\0';
+                *linecount += lines + 1;
+                return i + n + 1;
+            } else {
+                count++;
+            }
+            break;
+        default:
+            count++;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Read all lines of input, returning a checksum of the lines produced
+ * and the number of source lines consumed.
+ */
+static unsigned long scan(
+    size_t (*read)(const char *, size_t, char *, int *),
+    int *lines)
+{
+    size_t i, n;
+    unsigned long sum;
+    const char *ptr;
+
+    *lines = 0;
+    for (i = 0, sum = 0; i < size; i += n) {
+        n = read(data + i, size - i, line + 1, lines);
+        if (!n) {
+            printf(" [unable to read line %d]\n", *lines + 1);
+            exit(1);
+        }
+        for (ptr = line + 1; *ptr; ++ptr) {
+            sum = sum * 31 + (unsigned char) *ptr;
+        }
+    }
+
+    return sum;
+}
+
+static void measure(
+    const char *name,
+    size_t (*read)(const char *, size_t, char *, int *),
+    unsigned long *checksum)
+{
+    int i, lines;
+    clock_t start;
+    double seconds;
+    unsigned long sum;
+
+    start = clock();
+    for (i = 0; i < ROUNDS; ++i) {
+        sum = scan(read, &lines);
+    }
+
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    if (*checksum && sum != *checksum) {
+        printf(" [%s: wrong result]\n", name);
+        exit(1);
+    }
+
+    *checksum = sum;
+    printf(" [%s: %.0f MB/s, %d lines]",
+        name, size * (double) ROUNDS / seconds / 1e6, lines);
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+    FILE *f;
+    size_t n;
+    char buf[4096];
+    unsigned long checksum;
+
+    for (i = 1; i < argc; ++i) {
+        f = fopen(argv[i], "r");
+        if (!f) {
+            return 1;
+        }
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            data = realloc(data, size + n + 1);
+            memcpy(data + size, buf, n);
+            size += n;
+        }
+        fclose(f);
+    }
+
+    if (!size || data[size - 1] != '\n') {
+        return 1;
+    }
+
+    data[size] = '\0';
+    line = calloc(size + 2, sizeof(*line));
+    checksum = 0;
+    measure("bytes", read_line_bytes, &checksum);
+    measure("words", read_line, &checksum);
+    printf("\n");
+    free(line);
+    free(data);
+    return 0;
+}
+EOF
+
+# Link with the system compiler, as when bootstrapping.
+for cc in "cc -O2" "$lacc -O2"
+do
+	echo "$cc"
+	$cc -DAMALGAMATION -I../include -I../src -include ../config.h \
+		-c $bin/scan.c -o $bin/scan.o || exit 1
+	cc $bin/scan.o -o $bin/scan || exit 1
+	$bin/scan sqlite/sqlite3.c sqlite/shell.c || exit 1
+done
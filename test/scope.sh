@@ -0,0 +1,76 @@
+#!/bin/sh
+
+# Time compilation of generated functions with a large number of local
+# variables, where time should grow linearly with the number of names
+# in scope.
+
+lacc="$1"
+if [ -z "$lacc" ]
+then
+	lacc=../bin/lacc
+	command -v $lacc >/dev/null 2>&1 || {
+		echo "$lacc required, run 'make'."
+		exit 1
+	}
+fi
+
+bin=../bin/test/scope
+mkdir -p $bin
+
+# Chain of locals in a single block, each referring to the previous.
+locals()
+{
+	echo "int f(int a) {"
+	echo "	int v0 = a;"
+	i=1
+	while [ $i -lt $1 ]
+	do
+		echo "	int v$i = v$((i - 1)) + $i;"
+		i=$((i + 1))
+	done
+	echo "	return v$((i - 1));"
+	echo "}"
+}
+
+# Locals declared in nested blocks, shadowing names from outer scope.
+nested()
+{
+	echo "int f(int a) {"
+	echo "	int v = a;"
+	i=0
+	while [ $i -lt $1 ]
+	do
+		echo "	{ int v$i = v + $i; int v = v$i;"
+		i=$((i + 1))
+	done
+	printf "	a = v;"
+	i=0
+	while [ $i -lt $1 ]
+	do
+		printf " }"
+		i=$((i + 1))
+	done
+	echo
+	echo "	return a;"
+	echo "}"
+}
+
+now()
+{
+	date +%s%N
+}
+
+for workload in locals nested
+do
+	printf "%-6s" "$workload"
+	for n in 1000 2000 4000 8000
+	do
+		file=$bin/$workload-$n.c
+		$workload $n > $file
+		start=$(now)
+		$lacc -S $file -o /dev/null || exit 1
+		end=$(now)
+		printf " [%d: %d ms]" $n $(((end - start) / 1000000))
+	done
+	echo
+done
@@ -0,0 +1,102 @@
+#!/bin/sh
+
+if test -t 1
+then
+    colors=$(tput colors)
+    if test -n "$colors" && test $colors -ge 8
+    then
+        reset="$(tput sgr0)"
+        red="$(tput setaf 1)"
+        green="$(tput setaf 2)"
+    fi
+fi
+
+lacc="$1"
+if [ -z "$lacc" ]
+then
+	lacc=../bin/lacc
+	command -v $lacc >/dev/null 2>&1 || {
+		echo "$lacc required, run 'make'."
+		exit 1
+	}
+fi
+
+bin=../bin/test/server
+mkdir -p $bin
+
+sock=$bin/lacc.sock
+$lacc --server $sock &
+pid=$!
+
+# Wait for server to start listening
+i=0
+while [ ! -S $sock ] && [ $i -lt 50 ]
+do
+	sleep 0.1
+	i=$((i + 1))
+done
+
+cc linker/foo.c linker/bar.c -o $bin/expected
+expected=$($bin/expected 1 2 3)
+
+check()
+{
+	if [ $? -ne 0 ]
+	then
+		echo "${red}Compilation failed!${reset}";
+		return 1
+	fi
+
+	actual=$($bin/a.out 1 2 3)
+	if [ "$expected" != "$actual" ]
+	then
+		echo "${red}Wrong output!${reset}";
+		return 1
+	fi
+
+	echo "${green}Ok!${reset}"
+	return 0
+}
+
+# Second request reuses headers cached from the first
+$lacc --client $sock -c linker/foo.c -o $bin/foo.o \
+	&& $lacc --client $sock -c linker/bar.c -o $bin/bar.o \
+	&& $lacc --client $sock $bin/foo.o $bin/bar.o -o $bin/a.out
+a=$(check); result="$?"; retval=$((retval + result))
+
+# Diagnostics and exit status are forwarded to the client
+echo "int main(void) { return x; }" > $bin/error.c
+$lacc --client $sock -c $bin/error.c -o $bin/error.o 2> $bin/error.txt
+if [ $? -ne 0 ] && grep -q "Undefined symbol" $bin/error.txt
+then
+	b="${green}Ok!${reset}"
+else
+	b="${red}Missing error!${reset}"
+	retval=$((retval + 1))
+fi
+
+# Header added to an earlier search directory is found by the next request
+rm -rf $bin/first $bin/second && mkdir -p $bin/first $bin/second
+echo "#define VALUE 1" > $bin/second/value.h
+printf '#include <value.h>\nint value = VALUE;\n' > $bin/value.c
+$lacc --client $sock -I$bin/first -I$bin/second -E $bin/value.c > /dev/null
+echo "#define VALUE 2" > $bin/first/value.h
+if $lacc --client $sock -I$bin/first -I$bin/second -E $bin/value.c \
+	| grep -q "value = 2"
+then
+	c="${green}Ok!${reset}"
+else
+	c="${red}Stale include!${reset}"
+	retval=$((retval + 1))
+fi
+
+kill $pid
+rm -f $sock
+
+# Fall back to local compilation when server is not running
+$lacc --client $sock linker/foo.c linker/bar.c -o $bin/a.out
+d=$(check); result="$?"; retval=$((retval + result))
+
+echo "[--client: ${a}] [errors: ${b}] [include: ${c}] [fallback: ${d}]"
+rm -f foo.o bar.o
+exit $retval
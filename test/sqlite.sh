@@ -47,8 +47,6 @@ then
 	exit 1
 fi
 
-rm shell.o sqlite3.o
-
 # Build with reference compiler
 cc sqlite/shell.c sqlite/sqlite3.c -o $bin/reference -lm -lpthread -ldl
 
@@ -70,5 +68,12 @@ then
 	exit 1
 fi
 
-echo "${green}Ok!${reset}"
+# Throughput of preprocessed output, writing the amalgamation to -E.
+start=$(date +%s%N)
+$lacc -E sqlite/sqlite3.c -o $bin/sqlite3.i
+end=$(date +%s%N)
+size=$(wc -c < $bin/sqlite3.i)
+msec=$(((end - start) / 1000000 + 1))
+
+echo "${green}Ok!${reset} [-E: $((size / 1000 / msec)) MB/s]"
 exit 0